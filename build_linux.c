@@ -0,0 +1,29 @@
+
+///
+// Headless linux build config
+// Build with build_linux.sh. There is no window, gfx or audio on linux (yet) so this is
+// for running tests, benchmarks & simulation code.
+
+#define OOGABOOGA_HEADLESS 1
+
+#define RUN_TESTS 1
+
+#define INITIAL_PROGRAM_MEMORY_SIZE MB(5)
+
+// #define ENABLE_PROFILING 1
+
+#define TEMPORARY_STORAGE_SIZE MB(32)
+
+// #define VERY_DEBUG 1
+
+#define ENTRY_PROC entry
+
+// Ooga booga needs to be included AFTER configuration and BEFORE the program code
+#include "oogabooga/oogabooga.c"
+
+// Only include headless compatible programs here (no drawing, no audio)
+#if PHYSICS_BENCHMARK
+	#include "physics_benchmark.c" // the game's physics step, ./build_linux.sh -DPHYSICS_BENCHMARK=1
+#else
+	#include "oogabooga/examples/headless.c"
+#endif
@@ -0,0 +1,18 @@
+#!/bin/sh
+
+# Headless linux build (see build_linux.c)
+# Pass any extra flags as arguments, for example: ./build_linux.sh -O2
+
+CC=${CC:-clang}
+CFLAGS="-g -O0 -std=gnu11 -rdynamic
+        -Wextra -Wno-sign-compare -Wno-unused-parameter
+        -Wno-incompatible-library-redeclaration -Wno-builtin-requires-header
+        -I../src -I../"
+LIBS="-ldl -lpthread -lm"
+SRC=../build_linux.c
+EXENAME=game
+
+mkdir -p build
+cd build
+$CC $SRC -o $EXENAME $CFLAGS "$@" $LIBS
+cd ..
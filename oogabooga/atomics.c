@@ -0,0 +1,146 @@
+
+///
+// Atomics with memory ordering.
+// Same idea as C11 atomics but for plain volatile integers, so you don't need _Atomic types.
+//
+//     MEMORY_ORDER_RELAXED: only the operation itself is atomic
+//     MEMORY_ORDER_ACQUIRE: loads/stores after it can't move before it (use when loading a flag or index)
+//     MEMORY_ORDER_RELEASE: loads/stores before it can't move after it (use when publishing data)
+//     MEMORY_ORDER_ACQ_REL: both, for read-modify-write
+//     MEMORY_ORDER_SEQ_CST: acq_rel + one global order of all seq_cst operations
+//
+// Pass the order as a constant so it compiles down to the right instruction. On x86 that means
+// everything except seq_cst stores and fences is just a plain mov, ordering only stops the
+// compiler from moving things around.
+//
+//     atomic_load_32/64/ptr(a, order)
+//     atomic_store_32/64/ptr(a, value, order)
+//     atomic_exchange_32/64/ptr(a, value, order)            returns the old value
+//     atomic_fetch_add_32/64(a, n, order)                   returns the old value
+//     atomic_fetch_and/or_32/64(a, bits, order)             returns the old value
+//     atomic_compare_exchange_32/64/ptr(a, &expected, desired, order)
+//         Returns true if *a was expected and is now desired, otherwise expected is set to what *a was.
+//     atomic_thread_fence(order)
+//
+// compare_and_swap_xx in cpu.c are the same as atomic_compare_exchange with MEMORY_ORDER_SEQ_CST.
+
+// Same values as gcc's __ATOMIC_XXX
+typedef enum Memory_Order {
+	MEMORY_ORDER_RELAXED = 0,
+	MEMORY_ORDER_ACQUIRE = 2,
+	MEMORY_ORDER_RELEASE = 3,
+	MEMORY_ORDER_ACQ_REL = 4,
+	MEMORY_ORDER_SEQ_CST = 5,
+} Memory_Order;
+
+#if COMPILER_GCC || COMPILER_CLANG
+
+	// The failure order of compare_exchange can't be release
+	#define _atomic_failure_order(order) \
+		((order) == MEMORY_ORDER_RELEASE ? MEMORY_ORDER_RELAXED : (order) == MEMORY_ORDER_ACQ_REL ? MEMORY_ORDER_ACQUIRE : (order))
+
+	#define _atomic_define(suffix, type) \
+		inline type \
+		atomic_load_##suffix(type volatile *a, Memory_Order order) { \
+			return __atomic_load_n(a, order); \
+		} \
+		inline void \
+		atomic_store_##suffix(type volatile *a, type value, Memory_Order order) { \
+			__atomic_store_n(a, value, order); \
+		} \
+		inline type \
+		atomic_exchange_##suffix(type volatile *a, type value, Memory_Order order) { \
+			return __atomic_exchange_n(a, value, order); \
+		} \
+		inline bool \
+		atomic_compare_exchange_##suffix(type volatile *a, type *expected, type desired, Memory_Order order) { \
+			return __atomic_compare_exchange_n(a, expected, desired, false, order, _atomic_failure_order(order)); \
+		}
+
+	#define _atomic_define_arithmetic(suffix, type, signed_type) \
+		inline type \
+		atomic_fetch_add_##suffix(type volatile *a, signed_type n, Memory_Order order) { \
+			return __atomic_fetch_add(a, (type)n, order); \
+		} \
+		inline type \
+		atomic_fetch_and_##suffix(type volatile *a, type bits, Memory_Order order) { \
+			return __atomic_fetch_and(a, bits, order); \
+		} \
+		inline type \
+		atomic_fetch_or_##suffix(type volatile *a, type bits, Memory_Order order) { \
+			return __atomic_fetch_or(a, bits, order); \
+		}
+
+	_atomic_define(32, uint32_t)
+	_atomic_define(64, uint64_t)
+	_atomic_define(ptr, void*)
+	_atomic_define_arithmetic(32, uint32_t, int32_t)
+	_atomic_define_arithmetic(64, uint64_t, int64_t)
+
+	inline void
+	atomic_thread_fence(Memory_Order order) {
+		__atomic_thread_fence(order);
+	}
+
+#elif COMPILER_MSVC
+
+	// x86 only. Loads are already acquire and stores release, the barrier is for the compiler.
+	// Every interlocked instruction is a full barrier.
+
+	#define _atomic_define(suffix, type, interlocked_type, interlocked_suffix) \
+		inline type \
+		atomic_load_##suffix(type volatile *a, Memory_Order order) { \
+			type value = *a; \
+			_ReadWriteBarrier(); \
+			return value; \
+		} \
+		inline void \
+		atomic_store_##suffix(type volatile *a, type value, Memory_Order order) { \
+			if (order == MEMORY_ORDER_SEQ_CST) { \
+				_InterlockedExchange##interlocked_suffix((interlocked_type volatile*)a, (interlocked_type)value); \
+			} else { \
+				_ReadWriteBarrier(); \
+				*a = value; \
+			} \
+		} \
+		inline type \
+		atomic_exchange_##suffix(type volatile *a, type value, Memory_Order order) { \
+			return (type)_InterlockedExchange##interlocked_suffix((interlocked_type volatile*)a, (interlocked_type)value); \
+		} \
+		inline bool \
+		atomic_compare_exchange_##suffix(type volatile *a, type *expected, type desired, Memory_Order order) { \
+			type old = (type)_InterlockedCompareExchange##interlocked_suffix((interlocked_type volatile*)a, (interlocked_type)desired, (interlocked_type)*expected); \
+			if (old == *expected) return true; \
+			*expected = old; \
+			return false; \
+		}
+
+	#define _atomic_define_arithmetic(suffix, type, signed_type, interlocked_type, interlocked_suffix) \
+		inline type \
+		atomic_fetch_add_##suffix(type volatile *a, signed_type n, Memory_Order order) { \
+			return (type)_InterlockedExchangeAdd##interlocked_suffix((interlocked_type volatile*)a, (interlocked_type)n); \
+		} \
+		inline type \
+		atomic_fetch_and_##suffix(type volatile *a, type bits, Memory_Order order) { \
+			return (type)_InterlockedAnd##interlocked_suffix((interlocked_type volatile*)a, (interlocked_type)bits); \
+		} \
+		inline type \
+		atomic_fetch_or_##suffix(type volatile *a, type bits, Memory_Order order) { \
+			return (type)_InterlockedOr##interlocked_suffix((interlocked_type volatile*)a, (interlocked_type)bits); \
+		}
+
+	_atomic_define(32, uint32_t, long, )
+	_atomic_define(64, uint64_t, long long, 64)
+	_atomic_define(ptr, void*, long long, 64)
+	_atomic_define_arithmetic(32, uint32_t, int32_t, long, )
+	_atomic_define_arithmetic(64, uint64_t, int64_t, long long, 64)
+
+	inline void
+	atomic_thread_fence(Memory_Order order) {
+		if (order == MEMORY_ORDER_SEQ_CST) _mm_mfence();
+		else _ReadWriteBarrier();
+	}
+
+#else
+	#warning "No atomics for this compiler"
+#endif
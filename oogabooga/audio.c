@@ -537,11 +537,11 @@ wav_load_file(string path, void **frames, Audio_Format format, u64 *number_of_fr
 void
 audio_prepare_intermediate_buffers() {
 	if (!audio_intermediate_mega_buffer) {
-		audio_intermediate_mega_buffer = alloc(get_heap_allocator(), MB(2));
+		audio_intermediate_mega_buffer = alloc(get_tagged_heap_allocator(MEMORY_TAG_AUDIO), MB(2));
 		memset(audio_intermediate_mega_buffer, 0, MB(2));
 		audio_intermediate_mega_buffer_size = MB(2);
 		
-		growing_array_init((void**)&audio_intermediate_heap_buffers, sizeof(void*), get_heap_allocator());
+		growing_array_init((void**)&audio_intermediate_heap_buffers, sizeof(void*), get_tagged_heap_allocator(MEMORY_TAG_AUDIO));
 	}
 	
 	u64 heap_buffer_count = growing_array_get_valid_count(audio_intermediate_heap_buffers);
@@ -549,7 +549,7 @@ audio_prepare_intermediate_buffers() {
 	
 		for (u64 i = 0; i < heap_buffer_count; i += 1) {
 			void *buffer = audio_intermediate_heap_buffers[i];
-			dealloc(get_heap_allocator(), buffer);
+			dealloc(get_tagged_heap_allocator(MEMORY_TAG_AUDIO), buffer);
 		}
 	
 		growing_array_clear((void**)&audio_intermediate_heap_buffers);
@@ -560,9 +560,9 @@ audio_prepare_intermediate_buffers() {
 	if (new_size != audio_intermediate_mega_buffer_size) {
 		new_size = get_next_power_of_two(new_size);
 		
-		dealloc(get_heap_allocator(), audio_intermediate_mega_buffer);
+		dealloc(get_tagged_heap_allocator(MEMORY_TAG_AUDIO), audio_intermediate_mega_buffer);
 		
-		audio_intermediate_mega_buffer = alloc(get_heap_allocator(), new_size);
+		audio_intermediate_mega_buffer = alloc(get_tagged_heap_allocator(MEMORY_TAG_AUDIO), new_size);
 		memset(audio_intermediate_mega_buffer, 0, new_size);
 		audio_intermediate_mega_buffer_size = new_size;
 		heap_allocated_intermediate_bytes = 0;
@@ -585,7 +585,7 @@ audio_get_intermediate_buffer(u64 size) {
 		audio_intermediate_mega_buffer_next = (u8*)audio_intermediate_mega_buffer_next + size;
 		return p;
 	} else {
-		void *p = alloc(get_heap_allocator(), get_next_power_of_two(size));
+		void *p = alloc(get_tagged_heap_allocator(MEMORY_TAG_AUDIO), get_next_power_of_two(size));
 		heap_allocated_intermediate_bytes += get_next_power_of_two(size);
 		log_verbose("Audio had to heap allocate an intermediate buffer of %dkb", get_next_power_of_two(size)/1000);
 		growing_array_add((void**)&audio_intermediate_heap_buffers, &p);
@@ -1236,58 +1236,46 @@ typedef struct Audio_Player {
 	Audio_Playback_Config config;
 	
 } Audio_Player;
-#define AUDIO_PLAYERS_PER_BLOCK 128
-typedef struct Audio_Player_Block {
-	Audio_Player players[AUDIO_PLAYERS_PER_BLOCK]; // Players need to be persistent in memory
-	
-	struct Audio_Player_Block *next;
-} Audio_Player_Block;
+#define AUDIO_PLAYERS_PER_CHUNK 128
 
 // #Global
-ogb_instance Audio_Player_Block audio_player_block;
+// Players need to be persistent in memory, the pool never moves them.
+// They're made on whatever thread plays a clip and freed on the audio thread, hence the lock.
+ogb_instance Pool audio_player_pool;
+ogb_instance Spinlock audio_player_pool_lock;
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
-Audio_Player_Block audio_player_block = {0};
+Pool audio_player_pool = {0};
+Spinlock audio_player_pool_lock = {0};
 #endif
 
 Audio_Player *
 audio_player_get_one() {
 
-	Audio_Player_Block *block = &audio_player_block;
-	Audio_Player_Block *last = 0;
-	
-	while (block) {
-		
-		for (u64 i = 0; i < AUDIO_PLAYERS_PER_BLOCK; i++) {
-			if (!block->players[i].allocated) {
-			
-				memset(&block->players[i], 0, sizeof(block->players[i]));
-				block->players[i].allocated = true;
-				block->players[i].config.volume = 1.0;
-				block->players[i].config.playback_speed = 1.0;
-				
-				return &block->players[i];
-			}
-		}
-		
-		last = block;
-		block = block->next;
+	spinlock_acquire_or_wait(&audio_player_pool_lock);
+	if (!audio_player_pool.stride) {
+		audio_player_pool = make_typed_pool(Audio_Player, AUDIO_PLAYERS_PER_CHUNK, get_tagged_heap_allocator(MEMORY_TAG_AUDIO));
 	}
+	Audio_Player *p = (Audio_Player*)pool_alloc(&audio_player_pool);
 	
-	// No free player found, make another block
-	// #Volatile can't assign to last->next before this is zero initialized
-	Audio_Player_Block *new_block = alloc(get_heap_allocator(), sizeof(Audio_Player_Block));
+	// Still under the lock, the mixer sees the player as live as soon as we release it
+	// and would act on whatever release flags were left in the memory.
+	memset(p, 0, sizeof(*p));
+	p->allocated = true;
+	p->config.volume = 1.0;
+	p->config.playback_speed = 1.0;
+	spinlock_release(&audio_player_pool_lock);
 	
-#if !DO_ZERO_INITIALIATION
-	memset(new_block, 0, sizeof(*new_block));
-#endif
-
-	last->next = new_block;
+	return p;
+}
 
-	new_block->players[0].allocated = true;
-	new_block->players[0].config.volume = 1.0;
-	block->players[0].config.playback_speed = 1.0;
-	return &new_block->players[0];
+// Only on the audio thread, see audio_player_release
+void
+audio_player_free(Audio_Player *p) {
+	p->allocated = false;
+	spinlock_acquire_or_wait(&audio_player_pool_lock);
+	pool_free(&audio_player_pool, p);
+	spinlock_release(&audio_player_pool_lock);
 }
 
 void 
@@ -1497,7 +1485,7 @@ void
 DEPRECATED(play_one_audio_clip_at_position(string path, Vector3 pos), "Use play_one_audio_clip_with_config() instead") {
 	if (!just_audio_clips_initted) {
 		just_audio_clips_initted = true;
-		just_audio_clips = make_hash_table(string, Audio_Source, get_heap_allocator());
+		just_audio_clips = make_hash_table(string, Audio_Source, get_tagged_heap_allocator(MEMORY_TAG_AUDIO));
 	}
 	
 	Audio_Source *src_ptr = hash_table_find(&just_audio_clips, path);
@@ -1505,7 +1493,7 @@ DEPRECATED(play_one_audio_clip_at_position(string path, Vector3 pos), "Use play_
 		play_one_audio_clip_source_at_position(*src_ptr, pos);
 	} else {
 		Audio_Source new_src;
-		bool ok = audio_open_source_stream(&new_src, path, get_heap_allocator());
+		bool ok = audio_open_source_stream(&new_src, path, get_tagged_heap_allocator(MEMORY_TAG_AUDIO));
 		if (!ok) {
 			log_error("Could not load audio to play from %s", path);
 			return;
@@ -1519,7 +1507,7 @@ void
 play_one_audio_clip_with_config(string path, Audio_Playback_Config config) {
 	if (!just_audio_clips_initted) {
 		just_audio_clips_initted = true;
-		just_audio_clips = make_hash_table(string, Audio_Source, get_heap_allocator());
+		just_audio_clips = make_hash_table(string, Audio_Source, get_tagged_heap_allocator(MEMORY_TAG_AUDIO));
 	}
 	
 	Audio_Source *src_ptr = hash_table_find(&just_audio_clips, path);
@@ -1527,7 +1515,7 @@ play_one_audio_clip_with_config(string path, Audio_Playback_Config config) {
 		play_one_audio_clip_source_with_config(*src_ptr, config);
 	} else {
 		Audio_Source new_src;
-		bool ok = audio_open_source_stream(&new_src, path, get_heap_allocator());
+		bool ok = audio_open_source_stream(&new_src, path, get_tagged_heap_allocator(MEMORY_TAG_AUDIO));
 		if (!ok) {
 			log_error("Could not load audio to play from %s", path);
 			return;
@@ -1771,287 +1759,287 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
     
 	memset(output, 0, output_size);
 	
-	Audio_Player_Block *block = &audio_player_block;
-	
 	if (!audio_source_start_time_records) {
-		growing_array_init_reserve((void**)&audio_source_start_time_records, sizeof(float64), next_audio_source_uid, get_heap_allocator());
+		growing_array_init_reserve((void**)&audio_source_start_time_records, sizeof(float64), next_audio_source_uid, get_tagged_heap_allocator(MEMORY_TAG_AUDIO));
 	}
 	
 	if (growing_array_get_valid_count(audio_source_start_time_records) < next_audio_source_uid) {
 		growing_array_resize((void**)&audio_source_start_time_records, next_audio_source_uid);
 	}
 	
-	while (block) {
+	// Players don't move and are only freed right here, so we can grab the live ones under the
+	// lock and mix without holding it. Anything made while we mix gets picked up next time.
+	spinlock_acquire_or_wait(&audio_player_pool_lock);
+	u64 player_count = audio_player_pool.count;
+	Audio_Player **players = (Audio_Player**)talloc(player_count*sizeof(Audio_Player*));
+	for (u64 i = 0; i < player_count; i++) {
+		players[i] = (Audio_Player*)pool_get_live(&audio_player_pool, i);
+	}
+	spinlock_release(&audio_player_pool_lock);
+	
+	for (u64 i = 0; i < player_count; i++) {
+		Audio_Player *p = players[i];
+		if (p->release_when_done && (p->frame_index >= p->source.number_of_frames
+									  || !p->has_source)) {
+			audio_player_free(p);
+			continue;
+		}
 		
-		for (u64 i = 0; i < AUDIO_PLAYERS_PER_BLOCK; i++) {
-			Audio_Player *p = &block->players[i];
-			if (p->release_when_done && (p->frame_index >= p->source.number_of_frames
-										  || !p->has_source)) {
-				p->allocated = false;
-			}
-			if (!p->allocated) {
-				continue;
-			}
-			
-			if (p->marked_for_release) {
-				p->marked_for_release = false;
-				p->allocated = false;
-				continue;
-			}
-			
-			if (p->state != AUDIO_PLAYER_STATE_PLAYING) {
-				if (p->fade_frames_remaining == 0) continue;
+		if (p->marked_for_release) {
+			audio_player_free(p);
+			continue;
+		}
+		
+		if (p->state != AUDIO_PLAYER_STATE_PLAYING) {
+			if (p->fade_frames_remaining == 0) continue;
+		}
+		
+		// #Incomplete Reverse playback ?
+		if (p->config.playback_speed <= 0.0) continue;
+		
+		if (p->frame_index >= p->source.number_of_frames && !p->looping) continue;
+		
+		spinlock_acquire_or_wait(&p->sample_lock);
+		
+		audio_prepare_intermediate_buffers();
+		
+		Audio_Source src = p->source;
+		
+		mutex_acquire_or_wait(&src.mutex_for_destroy);
+
+		Audio_Format sample_format = src.format;
+		sample_format.sample_rate = sample_format.sample_rate*p->config.playback_speed;
+		
+		bool need_convert = !bytes_match(
+			&out_format, 
+			&sample_format, 
+			sizeof(Audio_Format)
+		);
+		
+		u64 in_comp_size 
+			= get_audio_bit_width_byte_size(sample_format.bit_width);
+		
+		u64 in_frame_size = in_comp_size * sample_format.channels;
+		u64 input_size = number_of_output_frames * in_frame_size;
+		
+		void *mix_buffer = audio_get_intermediate_buffer(output_size);
+		memset(mix_buffer, 0, output_size);
+		
+		void *target_buffer = mix_buffer;
+		u64 number_of_sample_frames = number_of_output_frames;
+		
+		void *convert_buffer = 0;
+		u64 convert_buffer_size = 0;
+		
+		if (need_convert) {
+			if (sample_format.sample_rate != out_format.sample_rate) {
+				f64 src_ratio 
+					= (f64)sample_format.sample_rate 
+					  / (f64)out_format.sample_rate;
+					
+				number_of_sample_frames = round(number_of_output_frames * src_ratio);
+				input_size = number_of_sample_frames * in_frame_size;
 			}
 			
-			// #Incomplete Reverse playback ?
-			if (p->config.playback_speed <= 0.0) continue;
-			
-			if (p->frame_index >= p->source.number_of_frames && !p->looping) continue;
-			
-			spinlock_acquire_or_wait(&p->sample_lock);
+			convert_buffer_size = max(input_size, output_size);
+			convert_buffer = audio_get_intermediate_buffer(convert_buffer_size);
 			
-			audio_prepare_intermediate_buffers();
-			
-			Audio_Source src = p->source;
+			target_buffer = convert_buffer;
 			
-			mutex_acquire_or_wait(&src.mutex_for_destroy);
+		}
 
-			Audio_Format sample_format = src.format;
-			sample_format.sample_rate = sample_format.sample_rate*p->config.playback_speed;
-			
-			bool need_convert = !bytes_match(
-				&out_format, 
-				&sample_format, 
-				sizeof(Audio_Format)
-			);
-			
-			u64 in_comp_size 
-				= get_audio_bit_width_byte_size(sample_format.bit_width);
-			
-			u64 in_frame_size = in_comp_size * sample_format.channels;
-			u64 input_size = number_of_output_frames * in_frame_size;
+		// :PhaseCancellation
+		if (p->frame_index == 0) { 
+		
+			float64 start_time = audio_source_start_time_records[src.uid];
+			float64 now = os_get_elapsed_seconds();
+
+			float64 time_since_last_source_started = now - start_time;
 			
-			void *mix_buffer = audio_get_intermediate_buffer(output_size);
-			memset(mix_buffer, 0, output_size);
+			// 60 ms cooldown
+			if (time_since_last_source_started < 60.0/1000.0) {
+				spinlock_release(&p->sample_lock);
+				// #Bug ? Loopy loopers will just loop around. Not sure how we would deal with loopy loopers here
+				p->frame_index = src.number_of_frames;
+				continue;
+			}
 			
-			void *target_buffer = mix_buffer;
-			u64 number_of_sample_frames = number_of_output_frames;
+			audio_source_start_time_records[src.uid] = now;
+		}
+
+		u64 last_frame_index = p->frame_index;
+		p->frame_index = audio_source_sample_next_frames(
+			&src,
+			p->frame_index, 
+			number_of_sample_frames,
+			target_buffer,
+			p->looping
+		);
+		if (p->frame_index > last_frame_index && (p->looping || p->frame_index != src.number_of_frames)) {
+			assert(p->frame_index - last_frame_index == number_of_sample_frames);
+		}
+		
+		if (p->fade_frames_remaining > 0) {
+			u64 frames_to_fade = min(p->fade_frames_remaining, number_of_sample_frames);
 			
-			void *convert_buffer = 0;
-			u64 convert_buffer_size = 0;
+			u64 frames_faded_so_far = (p->fade_frames_total-p->fade_frames_remaining);
 			
-			if (need_convert) {
-				if (sample_format.sample_rate != out_format.sample_rate) {
-					f64 src_ratio 
-						= (f64)sample_format.sample_rate 
-						  / (f64)out_format.sample_rate;
-						
-					number_of_sample_frames = round(number_of_output_frames * src_ratio);
-					input_size = number_of_sample_frames * in_frame_size;
-				}
-				
-				convert_buffer_size = max(input_size, output_size);
-				convert_buffer = audio_get_intermediate_buffer(convert_buffer_size);
-				
-				target_buffer = convert_buffer;
+			float64 fade_prog = (f64)frames_faded_so_far / (f64)p->fade_frames_total;
+			if (p->fade_in) {
 				
-			}
-	
-			// :PhaseCancellation
-			if (p->frame_index == 0) { 
-			
-				float64 start_time = audio_source_start_time_records[src.uid];
-				float64 now = os_get_elapsed_seconds();
-
-				float64 time_since_last_source_started = now - start_time;
+				float64 fade_from = p->fade_start + fade_prog*(1.0-p->fade_start);
+					
+				float64 fade_to = fade_from + frames_to_fade / (f64)p->fade_frames_total;
 				
-				// 60 ms cooldown
-				if (time_since_last_source_started < 60.0/1000.0) {
-					spinlock_release(&p->sample_lock);
-					// #Bug ? Loopy loopers will just loop around. Not sure how we would deal with loopy loopers here
-					p->frame_index = src.number_of_frames;
-					continue;
-				}
+				audio_apply_fade_in(
+					target_buffer, 
+					frames_to_fade, 
+					p->source.format, 
+					fade_from,
+					fade_to
+				);
+				p->current_fade = fade_to;
 				
-				audio_source_start_time_records[src.uid] = now;
-			}
-	
-			u64 last_frame_index = p->frame_index;
-			p->frame_index = audio_source_sample_next_frames(
-				&src,
-				p->frame_index, 
-				number_of_sample_frames,
-				target_buffer,
-				p->looping
-			);
-			if (p->frame_index > last_frame_index && (p->looping || p->frame_index != src.number_of_frames)) {
-				assert(p->frame_index - last_frame_index == number_of_sample_frames);
-			}
-			
-			if (p->fade_frames_remaining > 0) {
-				u64 frames_to_fade = min(p->fade_frames_remaining, number_of_sample_frames);
+				if (p->is_transitioning) {
 				
-				u64 frames_faded_so_far = (p->fade_frames_total-p->fade_frames_remaining);
+					Audio_Format transition_format = p->transition_from_source.format;
 				
-				float64 fade_prog = (f64)frames_faded_so_far / (f64)p->fade_frames_total;
-				if (p->fade_in) {
+					u64 number_of_transition_frames = number_of_sample_frames;
 					
-					float64 fade_from = p->fade_start + fade_prog*(1.0-p->fade_start);
-						
-					float64 fade_to = fade_from + frames_to_fade / (f64)p->fade_frames_total;
+					u64 tran_comp_size
+						= get_audio_bit_width_byte_size(transition_format.bit_width);
+					u64 tran_frame_size = tran_comp_size * transition_format.channels;
+					u64 transition_size = number_of_transition_frames * tran_frame_size;
 					
-					audio_apply_fade_in(
-						target_buffer, 
-						frames_to_fade, 
-						p->source.format, 
-						fade_from,
-						fade_to
-					);
-					p->current_fade = fade_to;
-					
-					if (p->is_transitioning) {
-					
-						Audio_Format transition_format = p->transition_from_source.format;
+					void *tran_target_buffer = 0;
 					
-						u64 number_of_transition_frames = number_of_sample_frames;
-						
-						u64 tran_comp_size
-							= get_audio_bit_width_byte_size(transition_format.bit_width);
-						u64 tran_frame_size = tran_comp_size * transition_format.channels;
-						u64 transition_size = number_of_transition_frames * tran_frame_size;
-						
-						void *tran_target_buffer = 0;
-						
-						void *transition_convert_buffer = 0;
-						if (p->source.format.sample_rate != transition_format.sample_rate) {
-							f64 src_ratio 
-								= (f64)transition_format.sample_rate 
-								  / (f64)p->source.format.sample_rate;
-								
-							number_of_transition_frames = round(number_of_transition_frames * src_ratio);
-							transition_size = number_of_transition_frames * tran_frame_size;
+					void *transition_convert_buffer = 0;
+					if (p->source.format.sample_rate != transition_format.sample_rate) {
+						f64 src_ratio 
+							= (f64)transition_format.sample_rate 
+							  / (f64)p->source.format.sample_rate;
 							
-							void *transition_convert_buffer 
-								= audio_get_intermediate_buffer(max(transition_size, input_size));
-								
-							tran_target_buffer = transition_convert_buffer;
-						}
-						
-						void *transition_buffer = audio_get_intermediate_buffer(transition_size);
-						if (!tran_target_buffer) tran_target_buffer = transition_buffer;
+						number_of_transition_frames = round(number_of_transition_frames * src_ratio);
+						transition_size = number_of_transition_frames * tran_frame_size;
 						
-						p->transition_from_frame = audio_source_sample_next_frames(
-							&p->transition_from_source,
-							p->transition_from_frame, 
-							frames_to_fade,
-							tran_target_buffer,
-							p->looping
-						);
-						
-						if (memcmp(&transition_format, &sample_format, sizeof(Audio_Format)) != 0) {
-							int converted = convert_frames(
-								transition_buffer, 
-								sample_format, 
-								transition_convert_buffer, 
-								transition_format,
-								number_of_sample_frames
-							);
-							assert(converted == number_of_sample_frames);
-						}
-						
-						
-						
-						audio_apply_fade_out(
-							transition_buffer, 
-							frames_to_fade, 
-							transition_format, 
-							p->transition_fade_start - (fade_from)*p->transition_fade_start,
-							p->transition_fade_start - (fade_from)*p->transition_fade_start + (fade_to-fade_from)
-						);
-						
-						mix_frames(target_buffer, transition_buffer, number_of_sample_frames, sample_format);
-						
-						if (frames_faded_so_far+frames_to_fade == p->fade_frames_total) {
-							p->is_transitioning = false;
-						}
+						void *transition_convert_buffer 
+							= audio_get_intermediate_buffer(max(transition_size, input_size));
+							
+						tran_target_buffer = transition_convert_buffer;
 					}
 					
-				} else {
+					void *transition_buffer = audio_get_intermediate_buffer(transition_size);
+					if (!tran_target_buffer) tran_target_buffer = transition_buffer;
+					
+					p->transition_from_frame = audio_source_sample_next_frames(
+						&p->transition_from_source,
+						p->transition_from_frame, 
+						frames_to_fade,
+						tran_target_buffer,
+						p->looping
+					);
 					
-					p->is_transitioning = false;
+					if (memcmp(&transition_format, &sample_format, sizeof(Audio_Format)) != 0) {
+						int converted = convert_frames(
+							transition_buffer, 
+							sample_format, 
+							transition_convert_buffer, 
+							transition_format,
+							number_of_sample_frames
+						);
+						assert(converted == number_of_sample_frames);
+					}
 					
-					float64 fade_from = p->fade_start - fade_prog*(p->fade_start);
 					
-					float64 fade_to = fade_from - (frames_to_fade / (f64)p->fade_frames_total)*fade_from;
 					
 					audio_apply_fade_out(
-						target_buffer, 
+						transition_buffer, 
 						frames_to_fade, 
-						p->source.format, 
-						fade_from,
-						fade_to
+						transition_format, 
+						p->transition_fade_start - (fade_from)*p->transition_fade_start,
+						p->transition_fade_start - (fade_from)*p->transition_fade_start + (fade_to-fade_from)
 					);
-					p->current_fade = fade_to;
 					
-					if (frames_to_fade < number_of_sample_frames) {
-						memset(
-							(u8*)target_buffer+(frames_to_fade*out_frame_size), 
-							0, 
-							(number_of_sample_frames-frames_to_fade)*out_frame_size
-						);
+					mix_frames(target_buffer, transition_buffer, number_of_sample_frames, sample_format);
+					
+					if (frames_faded_so_far+frames_to_fade == p->fade_frames_total) {
+						p->is_transitioning = false;
 					}
 				}
 				
-				p->fade_frames_remaining -= frames_to_fade;
 			} else {
+				
 				p->is_transitioning = false;
-			}
-			
-			spinlock_release(&p->sample_lock);
-						
-			if (need_convert) {
-				int converted = convert_frames(
-					mix_buffer, 
-					out_format, 
-					convert_buffer, 
-					sample_format,
-					number_of_output_frames
-				);
-				assert(converted == number_of_output_frames);
-			}
-
-			if (p->config.enable_spacialization) {
-				Matrix4 view = m4_inverse(p->config.spacial_listener_xform);
 				
-				Matrix4 world_to_clip = m4_mul(view, p->config.spacial_projection);
+				float64 fade_from = p->fade_start - fade_prog*(p->fade_start);
 				
-				Vector3 ndc = m4_transform(world_to_clip, v4(v3_expand(p->config.position), 0.0)).xyz;
+				float64 fade_to = fade_from - (frames_to_fade / (f64)p->fade_frames_total)*fade_from;
 				
-				if (p->config.spacial_distance_max > p->config.spacial_distance_min) {
-		
-					Vector3 pos_in_view = m4_transform(view, v4(v3_expand(p->config.position), 1.0)).xyz;
-					
-					float32 distance = fabsf(v3_length(pos_in_view));
-					float32 distance_min = p->config.spacial_distance_min;
-					float32 distance_max = p->config.spacial_distance_max;
-					
-					float32 distance_scale_factor 
-							= clamp((distance-distance_min)/(distance_max-distance_min), 0, 1);
-					ndc = v3_mulf(v3_normalize(ndc), distance_scale_factor);
-				}
+				audio_apply_fade_out(
+					target_buffer, 
+					frames_to_fade, 
+					p->source.format, 
+					fade_from,
+					fade_to
+				);
+				p->current_fade = fade_to;
 				
-				apply_audio_spacialization(mix_buffer, out_format, number_of_output_frames, ndc);
-			}
-			if (p->config.volume != 0.0) {
-				apply_audio_volume(mix_buffer, out_format, number_of_output_frames, p->config.volume);
+				if (frames_to_fade < number_of_sample_frames) {
+					memset(
+						(u8*)target_buffer+(frames_to_fade*out_frame_size), 
+						0, 
+						(number_of_sample_frames-frames_to_fade)*out_frame_size
+					);
+				}
 			}
 			
-			mix_frames(output, mix_buffer, number_of_output_frames, out_format);
+			p->fade_frames_remaining -= frames_to_fade;
+		} else {
+			p->is_transitioning = false;
+		}
+		
+		spinlock_release(&p->sample_lock);
+					
+		if (need_convert) {
+			int converted = convert_frames(
+				mix_buffer, 
+				out_format, 
+				convert_buffer, 
+				sample_format,
+				number_of_output_frames
+			);
+			assert(converted == number_of_output_frames);
+		}
+
+		if (p->config.enable_spacialization) {
+			Matrix4 view = m4_inverse(p->config.spacial_listener_xform);
+			
+			Matrix4 world_to_clip = m4_mul(view, p->config.spacial_projection);
 			
+			Vector3 ndc = m4_transform(world_to_clip, v4(v3_expand(p->config.position), 0.0)).xyz;
 			
-			mutex_release(&src.mutex_for_destroy);
+			if (p->config.spacial_distance_max > p->config.spacial_distance_min) {
+	
+				Vector3 pos_in_view = m4_transform(view, v4(v3_expand(p->config.position), 1.0)).xyz;
+				
+				float32 distance = fabsf(v3_length(pos_in_view));
+				float32 distance_min = p->config.spacial_distance_min;
+				float32 distance_max = p->config.spacial_distance_max;
+				
+				float32 distance_scale_factor 
+						= clamp((distance-distance_min)/(distance_max-distance_min), 0, 1);
+				ndc = v3_mulf(v3_normalize(ndc), distance_scale_factor);
+			}
+			
+			apply_audio_spacialization(mix_buffer, out_format, number_of_output_frames, ndc);
+		}
+		if (p->config.volume != 0.0) {
+			apply_audio_volume(mix_buffer, out_format, number_of_output_frames, p->config.volume);
 		}
 		
-		block = block->next;
+		mix_frames(output, mix_buffer, number_of_output_frames, out_format);
+		
+		
+		mutex_release(&src.mutex_for_destroy);
 	}
 }
@@ -114,6 +114,12 @@ alloc_uninitialized(Allocator allocator, u64 size);
 ogb_instance void 
 dealloc(Allocator allocator, void *p);
 
+// Resizes p, keeping the first min(old_size, new_size) bytes. Allocators that can do it in place
+// (heap, arena) will, anything else falls back to alloc + copy + dealloc.
+// p can be 0, then it's just alloc.
+ogb_instance void* 
+reallocate(Allocator allocator, void *p, u64 old_size, u64 new_size);
+
 ogb_instance void 
 push_context(Context c);
 
@@ -151,6 +157,24 @@ dealloc(Allocator allocator, void *p) {
 	allocator.proc(0, p, ALLOCATOR_DEALLOCATE, allocator.data);
 }
 
+void* 
+reallocate(Allocator allocator, void *p, u64 old_size, u64 new_size) {
+	assert(new_size > 0, "You requested a reallocation to zero bytes. Use dealloc for that.");
+	if (!p) return alloc(allocator, new_size);
+	
+	// Allocators return 0 here if they can't reallocate
+	void *new = allocator.proc(new_size, p, ALLOCATOR_REALLOCATE, allocator.data);
+	if (!new) {
+		new = alloc_uninitialized(allocator, new_size);
+		memcpy(new, p, min(old_size, new_size));
+		dealloc(allocator, p);
+	}
+#if DO_ZERO_INITIALIZATION
+	if (new_size > old_size) memset((u8*)new + old_size, 0, new_size - old_size);
+#endif
+	return new;
+}
+
 void 
 push_context(Context c) {
 	assert(num_contexts < CONTEXT_STACK_MAX, "Context stack overflow");
@@ -0,0 +1,162 @@
+/*
+
+	Bucket array: like growing_array, but the items live in fixed size buckets instead of one
+	block that gets reallocated. So:
+		- Pointers to items stay valid until you clear/pop them, adding never moves anything.
+		- Adding is O(1) and never copies, the worst case is allocating one new bucket.
+		- Items are NOT contiguous. Index with bucket_array_get or walk it bucket by bucket.
+
+	Buckets are kept on clear, so reusing a bucket array each frame doesn't allocate once it has
+	grown to its size.
+
+	Full API:
+
+		void bucket_array_init_reserve(Bucket_Array *a, u64 block_size_in_bytes, u64 items_per_bucket, u64 count_to_reserve, Allocator allocator);
+		void bucket_array_init(Bucket_Array *a, u64 block_size_in_bytes, u64 items_per_bucket, Allocator allocator);
+		void bucket_array_deinit(Bucket_Array *a);
+
+		void *bucket_array_add_empty(Bucket_Array *a);
+		void *bucket_array_add(Bucket_Array *a, void *item);
+
+		void bucket_array_reserve(Bucket_Array *a, u64 count_to_reserve);
+		void bucket_array_pop(Bucket_Array *a);
+		void bucket_array_clear(Bucket_Array *a);
+
+		void *bucket_array_get(Bucket_Array *a, u64 index);
+
+		// Number of buckets with valid items in them, and the items in one of those buckets
+		u64   bucket_array_get_bucket_count(Bucket_Array *a);
+		void *bucket_array_get_bucket(Bucket_Array *a, u64 bucket_index, u64 *count);
+
+	Usage:
+
+		Bucket_Array things;
+		bucket_array_init(&things, sizeof(Thing), 1024, get_heap_allocator());
+
+		Thing new_thing;
+		Thing *added = bucket_array_add(&things, &new_thing); // 'new_thing' is copied, 'added' stays valid
+
+		Thing *nth_thing = bucket_array_get(&things, n);
+
+		for (u64 i = 0; i < things.count; i++) {
+			Thing *thing = bucket_array_get(&things, i);
+		}
+
+		// Faster, contiguous inside each bucket
+		for (u64 b = 0; b < bucket_array_get_bucket_count(&things); b++) {
+			u64 count;
+			Thing *bucket = bucket_array_get_bucket(&things, b, &count);
+			for (u64 i = 0; i < count; i++) {
+				Thing *thing = &bucket[i];
+			}
+		}
+
+		bucket_array_deinit(&things);
+
+*/
+
+typedef struct Bucket_Array {
+	u64 count;
+	u64 block_size_in_bytes;
+	u64 bucket_shift; // 1 << bucket_shift items per bucket
+
+	u8 **buckets; // Only this table moves when growing, never the buckets
+	u64 bucket_count; // Allocated buckets, there may be more than we have items for after a clear
+	u64 bucket_capacity;
+
+	Allocator allocator;
+} Bucket_Array;
+
+inline void *
+bucket_array_get(Bucket_Array *a, u64 index) {
+	assert(index < a->count, "Bucket array index out of range");
+	u64 mask = (1ull << a->bucket_shift) - 1;
+	return a->buckets[index >> a->bucket_shift] + (index & mask)*a->block_size_in_bytes;
+}
+
+inline u64
+bucket_array_get_bucket_count(Bucket_Array *a) {
+	return (a->count + (1ull << a->bucket_shift) - 1) >> a->bucket_shift;
+}
+
+void *
+bucket_array_get_bucket(Bucket_Array *a, u64 bucket_index, u64 *count) {
+	assert(bucket_index < bucket_array_get_bucket_count(a), "Bucket array bucket index out of range");
+	u64 first = bucket_index << a->bucket_shift;
+	*count = min(a->count - first, 1ull << a->bucket_shift);
+	return a->buckets[bucket_index];
+}
+
+void
+bucket_array_add_bucket(Bucket_Array *a) {
+	if (a->bucket_count == a->bucket_capacity) {
+		u64 new_capacity = max(a->bucket_capacity*2, 8);
+		a->buckets = (u8**)reallocate(a->allocator, a->buckets, a->bucket_capacity*sizeof(u8*), new_capacity*sizeof(u8*));
+		a->bucket_capacity = new_capacity;
+	}
+	a->buckets[a->bucket_count] = (u8*)alloc(a->allocator, a->block_size_in_bytes << a->bucket_shift);
+	a->bucket_count += 1;
+}
+
+void
+bucket_array_reserve(Bucket_Array *a, u64 count_to_reserve) {
+	while ((a->bucket_count << a->bucket_shift) < count_to_reserve) {
+		bucket_array_add_bucket(a);
+	}
+}
+
+void
+bucket_array_init_reserve(Bucket_Array *a, u64 block_size_in_bytes, u64 items_per_bucket, u64 count_to_reserve, Allocator allocator) {
+	assert(block_size_in_bytes, "Bucket array block size can't be 0");
+	assert(items_per_bucket, "Bucket array needs at least 1 item per bucket");
+
+	memset(a, 0, sizeof(*a));
+	a->allocator = allocator;
+	a->block_size_in_bytes = block_size_in_bytes;
+	a->bucket_shift = bit_scan_reverse_64(get_next_power_of_two(items_per_bucket));
+
+	bucket_array_reserve(a, count_to_reserve);
+}
+void
+bucket_array_init(Bucket_Array *a, u64 block_size_in_bytes, u64 items_per_bucket, Allocator allocator) {
+	bucket_array_init_reserve(a, block_size_in_bytes, items_per_bucket, 0, allocator);
+}
+void
+bucket_array_deinit(Bucket_Array *a) {
+	for (u64 i = 0; i < a->bucket_count; i++) {
+		dealloc(a->allocator, a->buckets[i]);
+	}
+	if (a->buckets) dealloc(a->allocator, a->buckets);
+	memset(a, 0, sizeof(*a));
+}
+
+void *
+bucket_array_add_empty(Bucket_Array *a) {
+	assert(a->block_size_in_bytes, "Bucket array is not initialized");
+
+	u64 index = a->count;
+	u64 bucket_index = index >> a->bucket_shift;
+	if (bucket_index == a->bucket_count) bucket_array_add_bucket(a);
+
+	a->count += 1;
+
+	u64 mask = (1ull << a->bucket_shift) - 1;
+	return a->buckets[bucket_index] + (index & mask)*a->block_size_in_bytes;
+}
+void *
+bucket_array_add(Bucket_Array *a, void *item) {
+	void *new = bucket_array_add_empty(a);
+	memcpy(new, item, a->block_size_in_bytes);
+	return new;
+}
+
+void
+bucket_array_pop(Bucket_Array *a) {
+	assert(a->count > 0, "No items to pop in bucket array");
+	a->count -= 1;
+}
+
+void
+bucket_array_clear(Bucket_Array *a) {
+	a->count = 0;
+}
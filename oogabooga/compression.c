@@ -0,0 +1,189 @@
+
+///
+// LZ77 block compression, same idea as the lz4 block format (not compatible with it though).
+// Fast to compress, very fast to decompress, good on data with lots of zeroes & repeated structs.
+//
+// A block is a list of sequences:
+//     [token] [extra literal length] [literals] [u16 match offset] [extra match length]
+// The high 4 bits of the token is the literal count, the low 4 bits the match length - LZ_MIN_MATCH.
+// 15 means "keep adding the next bytes until one isn't 255". The last sequence is only literals.
+//
+// Usage:
+//     u64 bound = lz_compress_bound(data.count);
+//     u8 *compressed = alloc(get_heap_allocator(), bound);
+//     u64 compressed_size = lz_compress(data.data, data.count, compressed, bound);
+//     ...
+//     bool ok = lz_decompress(compressed, compressed_size, out, data.count);
+//
+// lz_decompress checks everything it reads, so it's fine to feed it whatever came off the disk.
+//
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_LAST_LITERALS 8 // the last bytes are always literals, so we can read 8 bytes at a time when matching
+#define LZ_HASH_BITS 14
+
+ogb_instance u64 lz_compress_bound(u64 size);
+
+// Returns the compressed size, or 0 if it didn't fit in dst_capacity
+ogb_instance u64 lz_compress(const u8 *src, u64 src_size, u8 *dst, u64 dst_capacity);
+
+// dst_size must be the exact decompressed size. Returns false if the block is malformed.
+ogb_instance bool lz_decompress(const u8 *src, u64 src_size, u8 *dst, u64 dst_size);
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+u64 lz_compress_bound(u64 size) {
+	return size + size / 255 + 16;
+}
+
+u8 *lz_write_length(u8 *at, u8 *end, u64 length) {
+	while (length >= 255) {
+		if (at >= end) return 0;
+		*at++ = 255;
+		length -= 255;
+	}
+	if (at >= end) return 0;
+	*at++ = (u8)length;
+	return at;
+}
+
+u8 *lz_write_sequence(u8 *at, u8 *end, const u8 *literals, u64 literal_count, u64 offset, u64 match_length) {
+	if (at >= end) return 0;
+	u8 *token = at++;
+	u64 match_extra = match_length ? match_length - LZ_MIN_MATCH : 0;
+
+	*token = (u8)((min(literal_count, 15) << 4) | min(match_extra, 15));
+	if (literal_count >= 15) {
+		at = lz_write_length(at, end, literal_count - 15);
+		if (!at) return 0;
+	}
+
+	if ((u64)(end - at) < literal_count) return 0;
+	memcpy(at, literals, literal_count);
+	at += literal_count;
+
+	if (match_length) {
+		if (end - at < 2) return 0;
+		*at++ = (u8)(offset & 0xff);
+		*at++ = (u8)(offset >> 8);
+		if (match_extra >= 15) {
+			at = lz_write_length(at, end, match_extra - 15);
+			if (!at) return 0;
+		}
+	}
+	return at;
+}
+
+inline u32 lz_read_u32(const u8 *p) { u32 x; memcpy(&x, p, sizeof(u32)); return x; }
+inline u64 lz_read_u64(const u8 *p) { u64 x; memcpy(&x, p, sizeof(u64)); return x; }
+
+u64 lz_compress(const u8 *src, u64 src_size, u8 *dst, u64 dst_capacity) {
+	assert(src_size < 0xFFFFFFFFull, "lz_compress works on blocks under 4gb");
+
+	// position + 1 of the last time we saw each 4 byte sequence, 0 means never
+	u32 table[1 << LZ_HASH_BITS];
+	memset(table, 0, sizeof(table));
+
+	u8 *at = dst;
+	u8 *end = dst + dst_capacity;
+	u64 anchor = 0;
+	u64 pos = 0;
+
+	if (src_size > LZ_LAST_LITERALS + LZ_MIN_MATCH) {
+		u64 match_limit = src_size - LZ_LAST_LITERALS;
+		while (pos + LZ_MIN_MATCH <= match_limit) {
+			u32 sequence = lz_read_u32(src + pos);
+			u32 hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+			u64 candidate = table[hash];
+			table[hash] = (u32)(pos + 1);
+
+			if (!candidate || pos - (candidate - 1) > LZ_MAX_OFFSET || lz_read_u32(src + candidate - 1) != sequence) {
+				pos += 1;
+				continue;
+			}
+
+			u64 match = candidate - 1;
+			u64 length = LZ_MIN_MATCH;
+			// compare 8 at a time, LZ_LAST_LITERALS keeps us in bounds
+			while (pos + length + 8 <= match_limit) {
+				u64 diff = lz_read_u64(src + pos + length) ^ lz_read_u64(src + match + length);
+				if (diff) {
+					length += bit_scan_forward_64(diff) / 8;
+					goto found_length;
+				}
+				length += 8;
+			}
+			while (pos + length < match_limit && src[pos + length] == src[match + length]) {
+				length += 1;
+			}
+			found_length:
+
+			at = lz_write_sequence(at, end, src + anchor, pos - anchor, pos - match, length);
+			if (!at) return 0;
+
+			pos += length;
+			anchor = pos;
+		}
+	}
+
+	at = lz_write_sequence(at, end, src + anchor, src_size - anchor, 0, 0);
+	if (!at) return 0;
+
+	return at - dst;
+}
+
+bool lz_read_length(const u8 **at, const u8 *end, u64 *length) {
+	u8 b;
+	do {
+		if (*at >= end) return false;
+		b = **at;
+		*at += 1;
+		*length += b;
+	} while (b == 255);
+	return true;
+}
+
+bool lz_decompress(const u8 *src, u64 src_size, u8 *dst, u64 dst_size) {
+	const u8 *in = src;
+	const u8 *in_end = src + src_size;
+	u8 *out = dst;
+	u8 *out_end = dst + dst_size;
+
+	while (in < in_end) {
+		u8 token = *in++;
+
+		u64 literal_count = token >> 4;
+		if (literal_count == 15 && !lz_read_length(&in, in_end, &literal_count)) return false;
+		if (literal_count > (u64)(in_end - in) || literal_count > (u64)(out_end - out)) return false;
+		memcpy(out, in, literal_count);
+		in += literal_count;
+		out += literal_count;
+
+		// last sequence has no match
+		if (in == in_end) break;
+
+		if (in_end - in < 2) return false;
+		u64 offset = (u64)in[0] | ((u64)in[1] << 8);
+		in += 2;
+		if (offset == 0 || offset > (u64)(out - dst)) return false;
+
+		u64 length = token & 15;
+		if (length == 15 && !lz_read_length(&in, in_end, &length)) return false;
+		length += LZ_MIN_MATCH;
+		if (length > (u64)(out_end - out)) return false;
+
+		const u8 *match = out - offset;
+		if (offset >= length) {
+			memcpy(out, match, length);
+		} else {
+			// overlapping, this is how runs get encoded
+			for (u64 i = 0; i < length; i++) out[i] = match[i];
+		}
+		out += length;
+	}
+
+	return out == out_end;
+}
+
+#endif // !OOGABOOGA_LINK_EXTERNAL_INSTANCE
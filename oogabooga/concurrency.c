@@ -1,6 +1,6 @@
-
 typedef struct Spinlock Spinlock;
 typedef struct Mutex Mutex;
+typedef struct RW_Lock RW_Lock;
 typedef struct Binary_Semaphore Binary_Semaphore;
 
 // These are probably your best friend for sync-free multi-processing.
@@ -9,13 +9,46 @@ inline bool compare_and_swap_16(volatile uint16_t *a, uint16_t b, uint16_t old);
 inline bool compare_and_swap_32(volatile uint32_t *a, uint32_t b, uint32_t old);
 inline bool compare_and_swap_64(volatile uint64_t *a, uint64_t b, uint64_t old);
 inline bool compare_and_swap_bool(volatile bool *a, bool b, bool old);
+// And the rest in atomics.c
+
+///
+// Lock stats
+// Compile with ENABLE_LOCK_STATS 1 and every Spinlock, Mutex & RW_Lock gets a 'stats' member.
+// profiler_report_lock_stats() in profiling.c puts them in the profile as a counter track.
+typedef struct Lock_Stats {
+	u64 acquisitions;
+	u64 contended; // Acquisitions that didn't get the lock on the first try
+	u64 spins; // Backoff rounds while waiting
+	u64 sleeps; // Times we yielded or waited in the kernel
+} Lock_Stats;
+
+#if ENABLE_LOCK_STATS
+	#define lock_stats_add(lock, member, n) ((lock)->stats.member += (n))
+	#define lock_stats_add_atomic(lock, member, n) atomic_fetch_add_64(&(lock)->stats.member, (n), MEMORY_ORDER_RELAXED)
+#else
+	#define lock_stats_add(...)
+	#define lock_stats_add_atomic(...)
+#endif
+
+// Exponential backoff for spin loops: pauses 1, 2, 4 ... SPIN_BACKOFF_MAX_PAUSES times
+#define SPIN_BACKOFF_MAX_PAUSES 64
+inline void
+spin_backoff(u32 *pauses) {
+	for (u32 i = 0; i < *pauses; i++) _mm_pause();
+	if (*pauses < SPIN_BACKOFF_MAX_PAUSES) *pauses *= 2;
+}
 
 ///
 // Spinlock "primitive"
 // Like a mutex but it eats up the entire core while waiting.
 // Beneficial if contention is low or sync speed is important
+// Backs off exponentially while it's locked, and yields once the backoff is maxed out so
+// it doesn't starve the thread holding it when there are more threads than cores.
 typedef struct Spinlock {
 	volatile bool locked;
+#if ENABLE_LOCK_STATS
+	Lock_Stats stats;
+#endif
 } Spinlock;
 
 void ogb_instance
@@ -28,21 +61,30 @@ spinlock_acquire_or_wait(Spinlock* l);
 bool ogb_instance
 spinlock_acquire_or_wait_timeout(Spinlock* l, f64 timeout_seconds);
 
+// Returns false right away if it's locked
+bool ogb_instance
+spinlock_try_acquire(Spinlock* l);
+
 void ogb_instance
 spinlock_release(Spinlock* l);
 
 
 ///
-// High-level mutex primitive (short spinlock then OS mutex lock)
-// Just spins for a few (configurable) microseconds with a spinlock,
-// and if acquiring fails it falls back to a OS mutex.
-#define MUTEX_DEFAULT_SPIN_TIME_MICROSECONDS 100
+// High-level mutex primitive
+// Taking it when nobody else has it is one compare_and_swap, no syscall. Otherwise it spins
+// for spin_count backoff rounds and then sleeps in the kernel (os_wait_on_address) until
+// it's released. Zero initialized is fine too.
+#define MUTEX_DEFAULT_SPIN_COUNT 16
+#define MUTEX_UNLOCKED 0
+#define MUTEX_LOCKED 1
+#define MUTEX_LOCKED_WAITERS 2 // Someone might be sleeping, release needs to wake them
 typedef struct Mutex {
-	Spinlock spinlock;
-	f64 spin_time_microseconds;
-	Mutex_Handle os_handle;
-	volatile bool spinlock_acquired;
+	volatile u32 state;
+	u32 spin_count; // 0 means MUTEX_DEFAULT_SPIN_COUNT
 	volatile u64 acquiring_thread;
+#if ENABLE_LOCK_STATS
+	Lock_Stats stats;
+#endif
 } Mutex;
 
 void ogb_instance
@@ -54,81 +96,264 @@ mutex_destroy(Mutex *m);
 void ogb_instance
 mutex_acquire_or_wait(Mutex *m);
 
+bool ogb_instance
+mutex_try_acquire(Mutex *m);
+
 void ogb_instance
 mutex_release(Mutex *m);
 
 
+///
+// Reader-writer lock
+// Any number of readers or one writer. A waiting writer stops new readers from getting in, so
+// writers don't starve. Waits like Mutex: spin a bit, then sleep.
+#define RW_LOCK_WRITER 0x80000000u
+#define RW_LOCK_WRITER_WAITING 0x40000000u
+#define RW_LOCK_READER_MASK 0x3FFFFFFFu
+typedef struct RW_Lock {
+	volatile u32 state; // Reader count | RW_LOCK_WRITER | RW_LOCK_WRITER_WAITING
+	volatile u32 sleepers;
+	u32 spin_count; // 0 means MUTEX_DEFAULT_SPIN_COUNT
+#if ENABLE_LOCK_STATS
+	Lock_Stats stats;
+#endif
+} RW_Lock;
+
+void ogb_instance
+rw_lock_init(RW_Lock *l);
+
+void ogb_instance
+rw_lock_acquire_read(RW_Lock *l);
+
+void ogb_instance
+rw_lock_release_read(RW_Lock *l);
+
+void ogb_instance
+rw_lock_acquire_write(RW_Lock *l);
+
+void ogb_instance
+rw_lock_release_write(RW_Lock *l);
+
+
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
 void spinlock_init(Spinlock *l) {
 	memset(l, 0, sizeof(*l));
 }
 void spinlock_acquire_or_wait(Spinlock* l) {
+	if (compare_and_swap_bool(&l->locked, true, false)) {
+		lock_stats_add(l, acquisitions, 1);
+		return;
+	}
+
+	u32 pauses = 1;
+	u64 spins = 0;
+	u64 sleeps = 0;
 	while (true) {
-        bool expected = false;
-        if (compare_and_swap_bool(&l->locked, true, expected)) {
-            return;
-        }
-        while (l->locked) {
-            // spinny boi
-        }
-    }
+		while (l->locked) {
+			// spinny boi
+			if (pauses < SPIN_BACKOFF_MAX_PAUSES) {
+				spin_backoff(&pauses);
+				spins += 1;
+			} else {
+				os_yield_thread();
+				sleeps += 1;
+			}
+		}
+		if (compare_and_swap_bool(&l->locked, true, false)) break;
+	}
+
+	lock_stats_add(l, acquisitions, 1);
+	lock_stats_add(l, contended, 1);
+	lock_stats_add(l, spins, spins);
+	lock_stats_add(l, sleeps, sleeps);
 }
 // Returns true on aquired, false if timeout seconds reached
 bool spinlock_acquire_or_wait_timeout(Spinlock* l, f64 timeout_seconds) {
-    f64 start = os_get_elapsed_seconds();
+	if (compare_and_swap_bool(&l->locked, true, false)) {
+		lock_stats_add(l, acquisitions, 1);
+		return true;
+	}
+
+	f64 start = os_get_elapsed_seconds();
+	u32 pauses = 1;
+	u64 spins = 0;
 	while (true) {
-        bool expected = false;
-        if (compare_and_swap_bool(&l->locked, true, expected)) {
-            return true;
-        }
-        while (l->locked) {
-            // spinny boi
-            if ((os_get_elapsed_seconds()-start) >= timeout_seconds) return false;
-        }
-    }
-    return true;
+		while (l->locked) {
+			// spinny boi
+			if ((os_get_elapsed_seconds()-start) >= timeout_seconds) return false;
+			spin_backoff(&pauses);
+			spins += 1;
+		}
+		if (compare_and_swap_bool(&l->locked, true, false)) break;
+	}
+
+	lock_stats_add(l, acquisitions, 1);
+	lock_stats_add(l, contended, 1);
+	lock_stats_add(l, spins, spins);
+	return true;
+}
+bool spinlock_try_acquire(Spinlock* l) {
+	if (l->locked || !compare_and_swap_bool(&l->locked, true, false)) return false;
+	lock_stats_add(l, acquisitions, 1);
+	return true;
 }
 void spinlock_release(Spinlock* l) {
-	bool expected = true;
-    bool success = compare_and_swap_bool(&l->locked, false, expected);
-    assert(success, "This thread should have acquired the spinlock but compare_and_swap failed");
+	assert(l->locked, "Tried to release a spinlock that isn't acquired");
+	// A plain store is enough on x86, as long as the compiler doesn't move anything past it
+	COMPILER_BARRIER;
+	l->locked = false;
 }
 
 
 ///
-// High-level mutex primitive (short spinlock then OS mutex lock)
+// High-level mutex primitive
 
 void mutex_init(Mutex *m) {
-	spinlock_init(&m->spinlock);
-	m->spin_time_microseconds = MUTEX_DEFAULT_SPIN_TIME_MICROSECONDS;
-	m->os_handle = os_make_mutex();
-	m->spinlock_acquired = false;
-	m->acquiring_thread = 0;
+	memset(m, 0, sizeof(*m));
+	m->spin_count = MUTEX_DEFAULT_SPIN_COUNT;
 }
 void mutex_destroy(Mutex *m) {
-	os_destroy_mutex(m->os_handle);
+	assert(m->state == MUTEX_UNLOCKED, "Destroying a mutex that is still acquired");
 }
 void mutex_acquire_or_wait(Mutex *m) {
-	if (spinlock_acquire_or_wait_timeout(&m->spinlock, m->spin_time_microseconds / 1000000.0)) {
-        assert(!m->spinlock_acquired, "Internal sync error in Mutex");
-    	m->spinlock_acquired = true;
-    }
-    os_lock_mutex(m->os_handle);
-    
-    assert(!m->acquiring_thread, "Internal sync error in Mutex: Multiple threads acquired");
-    m->acquiring_thread = context.thread_id;
+	if (!compare_and_swap_32(&m->state, MUTEX_LOCKED, MUTEX_UNLOCKED)) {
+		u32 spin_count = m->spin_count ? m->spin_count : MUTEX_DEFAULT_SPIN_COUNT;
+		u32 pauses = 1;
+		u64 spins = 0;
+		u64 sleeps = 0;
+
+		bool acquired = false;
+		for (u32 i = 0; i < spin_count; i++) {
+			if (m->state == MUTEX_UNLOCKED && compare_and_swap_32(&m->state, MUTEX_LOCKED, MUTEX_UNLOCKED)) {
+				acquired = true;
+				break;
+			}
+			spin_backoff(&pauses);
+			spins += 1;
+		}
+
+		if (!acquired) {
+			// We don't know if others are sleeping too, so whoever gets it this way leaves it
+			// marked as having waiters. Worst case a release wakes someone for nothing.
+			while (atomic_exchange_32(&m->state, MUTEX_LOCKED_WAITERS, MEMORY_ORDER_ACQUIRE) != MUTEX_UNLOCKED) {
+				os_wait_on_address(&m->state, MUTEX_LOCKED_WAITERS);
+				sleeps += 1;
+			}
+		}
+
+		lock_stats_add(m, contended, 1);
+		lock_stats_add(m, spins, spins);
+		lock_stats_add(m, sleeps, sleeps);
+	}
+	lock_stats_add(m, acquisitions, 1);
+
+	assert(!m->acquiring_thread, "Internal sync error in Mutex: Multiple threads acquired");
+	m->acquiring_thread = context.thread_id;
+}
+bool mutex_try_acquire(Mutex *m) {
+	if (m->state != MUTEX_UNLOCKED || !compare_and_swap_32(&m->state, MUTEX_LOCKED, MUTEX_UNLOCKED)) return false;
+	lock_stats_add(m, acquisitions, 1);
+	m->acquiring_thread = context.thread_id;
+	return true;
 }
 void mutex_release(Mutex *m) {
 	assert(m->acquiring_thread != 0, "Tried to release a mutex which is not acquired");
 	assert(m->acquiring_thread == context.thread_id, "Non-owning thread tried to release mutex");
 	m->acquiring_thread = 0;
-	bool was_spinlock_acquired = m->spinlock_acquired;
-	m->spinlock_acquired = false;
-	os_unlock_mutex(m->os_handle);
-	if (was_spinlock_acquired) {
-		spinlock_release(&m->spinlock);
+	if (atomic_exchange_32(&m->state, MUTEX_UNLOCKED, MEMORY_ORDER_RELEASE) == MUTEX_LOCKED_WAITERS) {
+		os_wake_one_on_address(&m->state);
 	}
 }
 
-#endif
\ No newline at end of file
+
+///
+// Reader-writer lock
+// Sleepers wait for state to change. Whoever changes state in a way that could let them in
+// checks the sleepers count after, both sides are seq_cst so one of them sees the other:
+// either the release sees the sleeper, or the sleeper sees the new state and
+// os_wait_on_address returns right away.
+
+void rw_lock_init(RW_Lock *l) {
+	memset(l, 0, sizeof(*l));
+	l->spin_count = MUTEX_DEFAULT_SPIN_COUNT;
+}
+void rw_lock_sleep(RW_Lock *l, u32 seen_state) {
+	atomic_fetch_add_32(&l->sleepers, 1, MEMORY_ORDER_SEQ_CST);
+	os_wait_on_address(&l->state, seen_state);
+	atomic_fetch_add_32(&l->sleepers, -1, MEMORY_ORDER_RELAXED);
+}
+void rw_lock_acquire_read(RW_Lock *l) {
+	u32 spin_count = l->spin_count ? l->spin_count : MUTEX_DEFAULT_SPIN_COUNT;
+	u32 pauses = 1;
+	u32 rounds = 0;
+	u64 sleeps = 0;
+	while (true) {
+		u32 state = l->state;
+		if (!(state & (RW_LOCK_WRITER | RW_LOCK_WRITER_WAITING))) {
+			if (compare_and_swap_32(&l->state, state + 1, state)) break;
+			continue; // Another reader got in between, that's not contention
+		}
+		if (rounds < spin_count) {
+			spin_backoff(&pauses);
+			rounds += 1;
+		} else {
+			rw_lock_sleep(l, state);
+			sleeps += 1;
+		}
+	}
+
+	lock_stats_add_atomic(l, acquisitions, 1);
+	if (rounds || sleeps) {
+		lock_stats_add_atomic(l, contended, 1);
+		lock_stats_add_atomic(l, spins, rounds);
+		lock_stats_add_atomic(l, sleeps, sleeps);
+	}
+}
+void rw_lock_release_read(RW_Lock *l) {
+	u32 before = atomic_fetch_add_32(&l->state, -1, MEMORY_ORDER_SEQ_CST);
+	assert(before & RW_LOCK_READER_MASK, "Tried to release a read lock which is not acquired");
+	// Last reader out lets a waiting writer in
+	if ((before & RW_LOCK_READER_MASK) == 1 && l->sleepers) {
+		os_wake_all_on_address(&l->state);
+	}
+}
+void rw_lock_acquire_write(RW_Lock *l) {
+	u32 spin_count = l->spin_count ? l->spin_count : MUTEX_DEFAULT_SPIN_COUNT;
+	u32 pauses = 1;
+	u32 rounds = 0;
+	u64 sleeps = 0;
+	while (true) {
+		u32 state = l->state;
+		if ((state & ~RW_LOCK_WRITER_WAITING) == 0) {
+			// This clears RW_LOCK_WRITER_WAITING, other waiting writers set it again when they wake up
+			if (compare_and_swap_32(&l->state, RW_LOCK_WRITER, state)) break;
+			continue;
+		}
+		if (!(state & RW_LOCK_WRITER_WAITING)) {
+			if (!compare_and_swap_32(&l->state, state | RW_LOCK_WRITER_WAITING, state)) continue;
+			state |= RW_LOCK_WRITER_WAITING;
+		}
+		if (rounds < spin_count) {
+			spin_backoff(&pauses);
+			rounds += 1;
+		} else {
+			rw_lock_sleep(l, state);
+			sleeps += 1;
+		}
+	}
+
+	lock_stats_add(l, acquisitions, 1);
+	if (rounds || sleeps) {
+		lock_stats_add(l, contended, 1);
+		lock_stats_add(l, spins, rounds);
+		lock_stats_add(l, sleeps, sleeps);
+	}
+}
+void rw_lock_release_write(RW_Lock *l) {
+	u32 before = atomic_exchange_32(&l->state, 0, MEMORY_ORDER_SEQ_CST);
+	assert(before & RW_LOCK_WRITER, "Tried to release a write lock which is not acquired");
+	if (l->sleepers) os_wake_all_on_address(&l->state);
+}
+
+#endif
@@ -0,0 +1,254 @@
+
+/*
+
+	Bounded lock-free queues. Ring buffers of fixed size items that are copied in and out,
+	like growing_array. Nothing here ever blocks: push fails when it's full and pop when it's
+	empty, so wait/retry however fits (spin, sleep, drop the item...).
+
+	Spsc_Queue: ONE thread pushes and ONE thread pops. Push and pop don't touch the same cache
+	lines unless the queue is almost empty or full, so this is the fast one.
+
+	Mpmc_Queue: any number of threads push and pop (Dmitry Vyukov's bounded MPMC queue). Every
+	slot has a sequence number that says whose turn it is, so a push/pop is one compare_and_swap
+	on the position plus the copy.
+
+	Batch push/pop take as many slots as they can with one atomic operation. They return how many
+	items they actually pushed/popped, which can be less than asked for.
+
+	Capacity is rounded up to a power of two.
+
+	Full API:
+
+		void spsc_queue_init(Spsc_Queue *q, u64 block_size_in_bytes, u64 capacity, Allocator allocator);
+		void spsc_queue_deinit(Spsc_Queue *q);
+		bool spsc_queue_push(Spsc_Queue *q, void *item);
+		bool spsc_queue_pop(Spsc_Queue *q, void *item);
+		u64  spsc_queue_push_batch(Spsc_Queue *q, void *items, u64 count);
+		u64  spsc_queue_pop_batch(Spsc_Queue *q, void *items, u64 max_count);
+		u64  spsc_queue_get_count(Spsc_Queue *q); // Might already be outdated when it returns
+
+		(Same for mpmc_queue_xxx)
+
+	Usage:
+
+		Spsc_Queue events;
+		spsc_queue_init(&events, sizeof(Event), 1024, get_heap_allocator());
+
+		// Producer thread
+		Event e = ...;
+		while (!spsc_queue_push(&events, &e)) os_yield_thread();
+
+		// Consumer thread
+		Event batch[64];
+		u64 count = spsc_queue_pop_batch(&events, batch, 64);
+		for (u64 i = 0; i < count; i++) handle_event(&batch[i]);
+
+*/
+
+typedef struct Spsc_Queue {
+	// Producer side
+	alignat(64) volatile u64 tail; // Next slot to write
+	u64 cached_head; // So we don't have to look at the consumer's cache line every push
+
+	// Consumer side
+	alignat(64) volatile u64 head; // Next slot to read
+	u64 cached_tail;
+
+	alignat(64) u8 *data;
+	u64 capacity;
+	u64 block_size_in_bytes;
+	Allocator allocator;
+} Spsc_Queue;
+
+typedef struct Mpmc_Queue {
+	alignat(64) volatile u64 enqueue_position;
+	alignat(64) volatile u64 dequeue_position;
+
+	// Slot i is free to write for position p when sequences[i] == p, and has an item to read
+	// for position p when sequences[i] == p+1.
+	alignat(64) volatile u64 *sequences;
+	u8 *data;
+	u64 capacity;
+	u64 block_size_in_bytes;
+	Allocator allocator;
+} Mpmc_Queue;
+
+// Copies count items in/out of a ring starting at position, in two pieces if it wraps around
+void
+ring_copy_in(u8 *ring, u64 capacity, u64 block_size, u64 position, void *items, u64 count) {
+	u64 first = position & (capacity-1);
+	u64 before_wrap = min(count, capacity - first);
+	memcpy(ring + first*block_size, items, before_wrap*block_size);
+	if (count > before_wrap) memcpy(ring, (u8*)items + before_wrap*block_size, (count - before_wrap)*block_size);
+}
+void
+ring_copy_out(u8 *ring, u64 capacity, u64 block_size, u64 position, void *items, u64 count) {
+	u64 first = position & (capacity-1);
+	u64 before_wrap = min(count, capacity - first);
+	memcpy(items, ring + first*block_size, before_wrap*block_size);
+	if (count > before_wrap) memcpy((u8*)items + before_wrap*block_size, ring, (count - before_wrap)*block_size);
+}
+
+///
+// Spsc_Queue
+
+void
+spsc_queue_init(Spsc_Queue *q, u64 block_size_in_bytes, u64 capacity, Allocator allocator) {
+	assert(block_size_in_bytes, "Queue block size can't be 0");
+	assert(capacity, "Queue capacity can't be 0");
+
+	memset(q, 0, sizeof(*q));
+	q->capacity = get_next_power_of_two(capacity);
+	q->block_size_in_bytes = block_size_in_bytes;
+	q->allocator = allocator;
+	q->data = (u8*)alloc(allocator, q->capacity*block_size_in_bytes);
+}
+void
+spsc_queue_deinit(Spsc_Queue *q) {
+	dealloc(q->allocator, q->data);
+	memset(q, 0, sizeof(*q));
+}
+
+u64
+spsc_queue_push_batch(Spsc_Queue *q, void *items, u64 count) {
+	u64 tail = atomic_load_64(&q->tail, MEMORY_ORDER_RELAXED);
+	u64 free = q->capacity - (tail - q->cached_head);
+	if (free < count) {
+		q->cached_head = atomic_load_64(&q->head, MEMORY_ORDER_ACQUIRE);
+		free = q->capacity - (tail - q->cached_head);
+	}
+
+	count = min(count, free);
+	if (count == 0) return 0;
+
+	ring_copy_in(q->data, q->capacity, q->block_size_in_bytes, tail, items, count);
+	atomic_store_64(&q->tail, tail + count, MEMORY_ORDER_RELEASE); // Items are written before the consumer can see them
+	return count;
+}
+u64
+spsc_queue_pop_batch(Spsc_Queue *q, void *items, u64 max_count) {
+	u64 head = atomic_load_64(&q->head, MEMORY_ORDER_RELAXED);
+	u64 available = q->cached_tail - head;
+	if (available < max_count) {
+		q->cached_tail = atomic_load_64(&q->tail, MEMORY_ORDER_ACQUIRE);
+		available = q->cached_tail - head;
+	}
+
+	u64 count = min(max_count, available);
+	if (count == 0) return 0;
+
+	ring_copy_out(q->data, q->capacity, q->block_size_in_bytes, head, items, count);
+	atomic_store_64(&q->head, head + count, MEMORY_ORDER_RELEASE); // Done reading before the producer writes over it
+	return count;
+}
+bool
+spsc_queue_push(Spsc_Queue *q, void *item) {
+	return spsc_queue_push_batch(q, item, 1) == 1;
+}
+bool
+spsc_queue_pop(Spsc_Queue *q, void *item) {
+	return spsc_queue_pop_batch(q, item, 1) == 1;
+}
+u64
+spsc_queue_get_count(Spsc_Queue *q) {
+	u64 head = atomic_load_64(&q->head, MEMORY_ORDER_ACQUIRE);
+	u64 tail = atomic_load_64(&q->tail, MEMORY_ORDER_ACQUIRE);
+	return tail - head;
+}
+
+///
+// Mpmc_Queue
+
+void
+mpmc_queue_init(Mpmc_Queue *q, u64 block_size_in_bytes, u64 capacity, Allocator allocator) {
+	assert(block_size_in_bytes, "Queue block size can't be 0");
+	assert(capacity, "Queue capacity can't be 0");
+
+	memset(q, 0, sizeof(*q));
+	q->capacity = get_next_power_of_two(capacity);
+	q->block_size_in_bytes = block_size_in_bytes;
+	q->allocator = allocator;
+	q->data = (u8*)alloc(allocator, q->capacity*block_size_in_bytes);
+	q->sequences = (volatile u64*)alloc(allocator, q->capacity*sizeof(u64));
+	for (u64 i = 0; i < q->capacity; i++) q->sequences[i] = i;
+}
+void
+mpmc_queue_deinit(Mpmc_Queue *q) {
+	dealloc(q->allocator, q->data);
+	dealloc(q->allocator, (void*)q->sequences);
+	memset(q, 0, sizeof(*q));
+}
+
+// Claims up to count slots in a row from *position where sequences[slot] == *position+i+offset.
+// offset is 0 for push (free slots) and 1 for pop (full slots). Returns how many, 0 if there
+// were none (full/empty).
+u64
+mpmc_queue_claim(Mpmc_Queue *q, volatile u64 *position, u64 offset, u64 count, u64 *claimed_position) {
+	u64 mask = q->capacity - 1;
+	u64 pos = atomic_load_64(position, MEMORY_ORDER_RELAXED);
+	while (true) {
+		u64 n = 0;
+		while (n < count) {
+			u64 seq = atomic_load_64(&q->sequences[(pos + n) & mask], MEMORY_ORDER_ACQUIRE);
+			if (seq != pos + n + offset) break;
+			n += 1;
+		}
+
+		if (n == 0) {
+			u64 seq = atomic_load_64(&q->sequences[pos & mask], MEMORY_ORDER_ACQUIRE);
+			// Behind: the slot still has the previous lap's item (push) or no item yet (pop)
+			if ((s64)(seq - (pos + offset)) < 0) return 0;
+			// Ahead: someone else got this position, try again from where they left it
+			pos = atomic_load_64(position, MEMORY_ORDER_RELAXED);
+			continue;
+		}
+
+		// Nobody else can take the slots we just looked at unless they move position first,
+		// which would make this fail.
+		if (atomic_compare_exchange_64(position, &pos, pos + n, MEMORY_ORDER_RELAXED)) {
+			*claimed_position = pos;
+			return n;
+		}
+	}
+}
+
+u64
+mpmc_queue_push_batch(Mpmc_Queue *q, void *items, u64 count) {
+	u64 pos;
+	count = mpmc_queue_claim(q, &q->enqueue_position, 0, count, &pos);
+	if (count == 0) return 0;
+
+	ring_copy_in(q->data, q->capacity, q->block_size_in_bytes, pos, items, count);
+	for (u64 i = 0; i < count; i++) {
+		atomic_store_64(&q->sequences[(pos + i) & (q->capacity-1)], pos + i + 1, MEMORY_ORDER_RELEASE);
+	}
+	return count;
+}
+u64
+mpmc_queue_pop_batch(Mpmc_Queue *q, void *items, u64 max_count) {
+	u64 pos;
+	u64 count = mpmc_queue_claim(q, &q->dequeue_position, 1, max_count, &pos);
+	if (count == 0) return 0;
+
+	ring_copy_out(q->data, q->capacity, q->block_size_in_bytes, pos, items, count);
+	for (u64 i = 0; i < count; i++) {
+		// Free for the push one lap later
+		atomic_store_64(&q->sequences[(pos + i) & (q->capacity-1)], pos + i + q->capacity, MEMORY_ORDER_RELEASE);
+	}
+	return count;
+}
+bool
+mpmc_queue_push(Mpmc_Queue *q, void *item) {
+	return mpmc_queue_push_batch(q, item, 1) == 1;
+}
+bool
+mpmc_queue_pop(Mpmc_Queue *q, void *item) {
+	return mpmc_queue_pop_batch(q, item, 1) == 1;
+}
+u64
+mpmc_queue_get_count(Mpmc_Queue *q) {
+	u64 dequeue = atomic_load_64(&q->dequeue_position, MEMORY_ORDER_ACQUIRE);
+	u64 enqueue = atomic_load_64(&q->enqueue_position, MEMORY_ORDER_ACQUIRE);
+	// Pushes that claimed slots but haven't written yet are counted too
+	return (s64)(enqueue - dequeue) > 0 ? enqueue - dequeue : 0;
+}
@@ -105,7 +105,24 @@ typedef struct Cpu_Capabilities {
 	    return compare_and_swap_8((uint8_t*)a, (uint8_t)b, (uint8_t)old);
 	}
 	
+	// Index of lowest/highest set bit. x must not be 0.
+	#pragma intrinsic(_BitScanForward64)
+	#pragma intrinsic(_BitScanReverse64)
+	inline u64
+	bit_scan_forward_64(u64 x) {
+		unsigned long index;
+		_BitScanForward64(&index, x);
+		return (u64)index;
+	}
+	inline u64
+	bit_scan_reverse_64(u64 x) {
+		unsigned long index;
+		_BitScanReverse64(&index, x);
+		return (u64)index;
+	}
+	
 	#define MEMORY_BARRIER _ReadWriteBarrier()
+	#define COMPILER_BARRIER _ReadWriteBarrier()
 	
 	#define thread_local __declspec(thread)
 	
@@ -225,7 +242,18 @@ typedef struct Cpu_Capabilities {
 	    return compare_and_swap_8((uint8_t*)a, (uint8_t)b, (uint8_t)old);
 	}
 	
+	// Index of lowest/highest set bit. x must not be 0.
+	inline u64
+	bit_scan_forward_64(u64 x) {
+		return (u64)__builtin_ctzll(x);
+	}
+	inline u64
+	bit_scan_reverse_64(u64 x) {
+		return 63-(u64)__builtin_clzll(x);
+	}
+	
 	#define MEMORY_BARRIER {__asm__ __volatile__("" ::: "memory");__sync_synchronize();}
+	#define COMPILER_BARRIER __asm__ __volatile__("" ::: "memory")
 	
 	#define thread_local __thread
 	
@@ -251,7 +279,21 @@ typedef struct Cpu_Capabilities {
     
     #define DEPRECATED(proc, msg) 
     
+    inline u64
+	bit_scan_forward_64(u64 x) {
+		u64 i = 0;
+		while (!(x & 1ull)) { x >>= 1; i += 1; }
+		return i;
+	}
+	inline u64
+	bit_scan_reverse_64(u64 x) {
+		u64 i = 0;
+		while (x >>= 1) i += 1;
+		return i;
+	}
+    
     #define MEMORY_BARRIER
+    #define COMPILER_BARRIER
     
     #warning "Compiler is not explicitly supported, some things will probably not work as expected"
 #endif
@@ -63,10 +63,14 @@
 			- You mostly shouldn't need to use this as it's quite verbose.
 			- See struct Draw_Quad. 
 			- If you need to customize a quad more, such as setting the UV or image filtering, then most other 
-				draw_xxx functions will return a Draw_Quad* which you can modify Retroactively. Keep in mind 
-				that the returned pointer is only guaranteed to be valid BEFORE you call other draw functions.
+				draw_xxx functions will return a Draw_Quad* which you can modify Retroactively. The returned
+				pointer stays valid until the draw frame is reset (gfx_update), drawing more doesn't move it.
 				See "- Retroactively modifying quads" for more info about Draw_Quad
 				
+		- Profiler overlay (frame times, frame time histogram, top tm_scope's, see Stats in profiling.c):
+		
+			void draw_profiler_overlay(Gfx_Font *font, u32 raster_height, Vector2 top_left, u64 max_scopes);
+			
 		- Layer sorting, scissor boxing/cropping:
 		
 			void push_z_layer(s32 z);
@@ -160,32 +164,11 @@
 				
 */
 
-// We use radix sort so the exact bit count is of importance
-#define MAX_Z_BITS 21
-#define MAX_Z ((1 << MAX_Z_BITS)/2)
+// Draw_Quad, MAX_Z & the quad -> vertex stage are in quad_batch.c
 #define Z_STACK_MAX 4096
 #define SCISSOR_STACK_MAX 4096
 #define MAX_BOUND_IMAGES 16
 
-typedef struct Draw_Quad {
-	// BEWARE !! These are in ndc
-	Vector2 bottom_left, top_left, top_right, bottom_right;
-	// r, g, b, a
-	Vector4 color;
-	Gfx_Image *image;
-	Gfx_Filter_Mode image_min_filter;
-	Gfx_Filter_Mode image_mag_filter;
-	s32 z;
-	u8 type;
-	bool has_scissor;
-	// x1, y1, x2, y2
-	Vector4 uv;
-	Vector4 scissor;
-	
-	Vector4 userdata[VERTEX_USER_DATA_COUNT]; // #Volatile do NOT change this to a pointer
-	
-} Draw_Quad;
-
 typedef struct Draw_Frame {
 	Matrix4 projection;
 	// #Cleanup
@@ -199,7 +182,7 @@ typedef struct Draw_Frame {
 	u64 scissor_count;
 	Vector4 scissor_stack[SCISSOR_STACK_MAX];
 	
-	Draw_Quad *quad_buffer;
+	Bucket_Array quad_buffer; // Draw_Quad's
 	
 	u64 z_count;
 	s32 z_stack[Z_STACK_MAX];
@@ -215,12 +198,12 @@ typedef struct Draw_Frame {
 void draw_frame_init(Draw_Frame *frame) {
 	*frame = ZERO(Draw_Frame);
 	
-	growing_array_init((void**)&frame->quad_buffer, sizeof(Draw_Quad), get_heap_allocator());
+	bucket_array_init(&frame->quad_buffer, sizeof(Draw_Quad), DRAW_FRAME_QUADS_PER_BUCKET, get_tagged_heap_allocator(MEMORY_TAG_RENDERER));
 }
 void draw_frame_init_reserve(Draw_Frame *frame, u64 number_of_quads_to_reserve) {
 	*frame = ZERO(Draw_Frame);
 	
-	growing_array_init_reserve((void**)&frame->quad_buffer, sizeof(Draw_Quad), number_of_quads_to_reserve, get_heap_allocator());
+	bucket_array_init_reserve(&frame->quad_buffer, sizeof(Draw_Quad), DRAW_FRAME_QUADS_PER_BUCKET, number_of_quads_to_reserve, get_tagged_heap_allocator(MEMORY_TAG_RENDERER));
 }
 
 void draw_frame_reset(Draw_Frame *frame) {
@@ -229,10 +212,10 @@ void draw_frame_reset(Draw_Frame *frame) {
 	// I would like to try to have the quad buffer to be allocated in a growing arena
 	// which is reset every frames, like temp allocator but large enough to fit the
 	// highest number of quads the program submits in a frame.
-	// For now, we just reset the count in the heap allocated buffer
+	// For now, we just reset the count and keep the heap allocated buckets
 
-	Draw_Quad *quad_buffer = frame->quad_buffer;
-	if (quad_buffer) growing_array_clear((void**)&quad_buffer);
+	Bucket_Array quad_buffer = frame->quad_buffer;
+	bucket_array_clear(&quad_buffer);
 
 	*frame = (Draw_Frame){0};
 	
@@ -294,11 +277,7 @@ Draw_Quad *draw_quad_projected_in_frame(Draw_Quad quad, Matrix4 world_to_clip, D
 	
 	memset(quad.userdata, 0, sizeof(quad.userdata));
 	
-	Draw_Quad **target_buffer = &frame->quad_buffer;
-	
-	growing_array_add((void**)target_buffer, &quad);
-	
-	Draw_Quad *q = &(*target_buffer)[growing_array_get_valid_count(*target_buffer)-1];
+	Draw_Quad *q = (Draw_Quad*)bucket_array_add(&frame->quad_buffer, &quad);
 	
 	// This is meant to fix the annoying artifacts that shows up when sampling from a large atlas
     // presumably for floating point precision issues or something.
@@ -579,3 +558,58 @@ void pop_window_scissor() { pop_window_scissor_in_frame(&draw_frame); }
 #define COLOR_WHITE ((Vector4){1.0, 1.0, 1.0, 1.0})
 #define COLOR_BLACK ((Vector4){0.0, 0.0, 0.0, 1.0})
 
+// Needs ENABLE_PROFILING for tm_scope's and os_update() (or profiler_mark_frame()) for frames
+void draw_profiler_overlay(Gfx_Font *font, u32 raster_height, Vector2 top_left, u64 max_scopes) {
+	Profiler_Frame_Stats frames = profiler_get_frame_stats();
+	Profiler_Scope_Stats *scopes = (Profiler_Scope_Stats*)talloc(max(max_scopes, 1)*sizeof(Profiler_Scope_Stats));
+	u64 scope_count = profiler_get_top_scopes(scopes, max_scopes);
+
+	float32 line_height = raster_height*1.25f;
+	float32 padding = raster_height*0.5f;
+	float32 width = raster_height*36.0f;
+	float32 histogram_height = raster_height*3.0f;
+	float32 height = padding*3 + line_height*(2 + scope_count) + histogram_height;
+
+	draw_rect(v2(top_left.x, top_left.y - height), v2(width, height), v4(0, 0, 0, 0.75));
+
+	Vector2 p = v2(top_left.x + padding, top_left.y - padding - line_height);
+	draw_text(font, tprint("frame %.2fms   avg %.2f   p50 %.2f   p95 %.2f   p99 %.2f   max %.2f   (%llu frames)",
+		frames.last_seconds*1000.0, frames.average_seconds*1000.0, frames.p50_seconds*1000.0,
+		frames.p95_seconds*1000.0, frames.p99_seconds*1000.0, frames.max_seconds*1000.0, frames.frame_count),
+		raster_height, p, v2(1, 1), COLOR_WHITE);
+
+	// One bar per ms, green up to 60fps, yellow up to 30fps
+	p.y -= padding + histogram_height;
+	u64 most = 1;
+	for (u64 i = 0; i < PROFILER_FRAME_HISTOGRAM_BUCKETS; i++) most = max(most, frames.histogram[i]);
+	float32 bar_width = (width - padding*2)/PROFILER_FRAME_HISTOGRAM_BUCKETS;
+	for (u64 i = 0; i < PROFILER_FRAME_HISTOGRAM_BUCKETS; i++) {
+		if (!frames.histogram[i]) continue;
+		Vector4 color = i < 17 ? v4(0.3, 0.9, 0.3, 1) : i < 34 ? v4(0.9, 0.9, 0.3, 1) : v4(0.9, 0.3, 0.3, 1);
+		float32 bar_height = max(histogram_height*frames.histogram[i]/most, 1.0f);
+		draw_rect(v2(p.x + i*bar_width, p.y), v2(max(bar_width - 1.0f, 1.0f), bar_height), color);
+	}
+
+	// Scopes, times in ms
+	float32 columns[] = {0, 14, 19, 24, 28, 32};
+	string headers[] = {STR("scope"), STR("ms/frame"), STR("calls"), STR("p50"), STR("p95"), STR("p99")};
+	p.y -= padding + line_height;
+	for (u64 i = 0; i < sizeof(columns)/sizeof(columns[0]); i++) {
+		draw_text(font, headers[i], raster_height, v2(p.x + columns[i]*raster_height, p.y), v2(1, 1), v4(0.7, 0.7, 0.7, 1));
+	}
+	for (u64 i = 0; i < scope_count; i++) {
+		Profiler_Scope_Stats *s = &scopes[i];
+		p.y -= line_height;
+		string values[] = {
+			s->name,
+			tprint("%.3f", s->seconds_per_frame*1000.0),
+			tprint("%.1f", (f64)s->count/(f64)max(s->frame_count, 1)),
+			tprint("%.3f", s->p50_seconds*1000.0),
+			tprint("%.3f", s->p95_seconds*1000.0),
+			tprint("%.3f", s->p99_seconds*1000.0),
+		};
+		for (u64 j = 0; j < sizeof(columns)/sizeof(columns[0]); j++) {
+			draw_text(font, values[j], raster_height, v2(p.x + columns[j]*raster_height, p.y), v2(1, 1), COLOR_WHITE);
+		}
+	}
+}
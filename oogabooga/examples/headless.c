@@ -0,0 +1,10 @@
+
+// Minimal program without a window, for example a game server or a test runner.
+// Build with OOGABOOGA_HEADLESS (see build_linux.c)
+
+int entry(int argc, char **argv) {
+	
+	print("Hello from headless ooga booga! We have %llu logical processors.\n", os_get_number_of_logical_processors());
+	
+	return 0;
+}
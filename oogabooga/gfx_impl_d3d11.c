@@ -7,24 +7,8 @@ const Gfx_Handle GFX_INVALID_HANDLE = 0;
 
 string temp_win32_null_terminated_wide_to_fixed_utf8(const u16 *utf16);
 
-// We wanna pack this at some point
-// #Cleanup #Memory why am I doing alignat(16)?
-typedef struct alignat(16) D3D11_Vertex {
-	
-	Vector4 color;
-	Vector4 position;
-	Vector2 uv;
-	Vector2 self_uv;
-	s8 texture_index;
-	u8 type;
-	u8 sampler;
-	u8 has_scissor;
-	
-	Vector4 userdata[VERTEX_USER_DATA_COUNT];
-	
-	Vector4 scissor;
-	
-} D3D11_Vertex;
+// The vertex layout is shared with the cpu side in quad_batch.c
+typedef Quad_Vertex D3D11_Vertex;
 
 // #Global
 
@@ -58,8 +42,7 @@ ID3D11Buffer *d3d11_quad_ibo = 0;
 u32 d3d11_quad_vbo_size = 0;
 void *d3d11_staging_quad_buffer = 0;
 
-Draw_Quad *d3d11_sort_quad_buffer = 0;
-u64 d3d11_sort_quad_buffer_size = 0;
+Quad_Batcher d3d11_quad_batcher = ZERO(Quad_Batcher);
 
 u64 d3d11_thread_id = 0;
 
@@ -654,9 +637,9 @@ void gfx_render_draw_frame(Draw_Frame *frame, Gfx_Image *render_target) {
 	HRESULT hr;
 	
 	
-	if (!frame->quad_buffer) return;
+	if (!frame->quad_buffer.block_size_in_bytes) return; // Never initialized
 
-	u64 number_of_quads = growing_array_get_valid_count(frame->quad_buffer);
+	u64 number_of_quads = frame->quad_buffer.count;
 	
 	///
 	// Maybe grow quad vbo
@@ -666,15 +649,15 @@ void gfx_render_draw_frame(Draw_Frame *frame, Gfx_Image *render_target) {
 	if (required_size > d3d11_quad_vbo_size) {
 		if (d3d11_quad_vbo) {
 			D3D11Release(d3d11_quad_vbo);
-			dealloc(get_heap_allocator(), d3d11_staging_quad_buffer);
+			dealloc(get_tagged_heap_allocator(MEMORY_TAG_RENDERER), d3d11_staging_quad_buffer);
 		}
 		u64 new_size = get_next_power_of_two(required_size);
 		u64 new_indices = ((new_size/sizeof(D3D11_Vertex))/4)*6;
 		
 		d3d11_quad_vbo_size = new_size;
 		
-		d3d11_staging_quad_buffer = alloc(get_heap_allocator(), d3d11_quad_vbo_size);
-		u32 *indices = (u32*)alloc(get_heap_allocator(), new_indices*sizeof(u32));
+		d3d11_staging_quad_buffer = alloc(get_tagged_heap_allocator(MEMORY_TAG_RENDERER), d3d11_quad_vbo_size);
+		u32 *indices = (u32*)alloc(get_tagged_heap_allocator(MEMORY_TAG_RENDERER), new_indices*sizeof(u32));
 		
 		for (u64 i = 0; i < new_indices; i += 6) {
 			indices[i + 0] = (i/6)*4 + 0;
@@ -713,188 +696,64 @@ void gfx_render_draw_frame(Draw_Frame *frame, Gfx_Image *render_target) {
 		// Render geometry from into vbo quad list
 	    
 		
-		ID3D11ShaderResourceView *textures[32];
+		ID3D11ShaderResourceView *textures[QUAD_BATCH_MAX_TEXTURES];
 		ID3D11ShaderResourceView *bind_textures[MAX_BOUND_IMAGES];
-		ID3D11ShaderResourceView *last_texture = 0;
-		u64 num_textures = 0;
-		s8 last_texture_index = 0;
 		for (int i = 0; i < frame->highest_bound_slot_index+1; i += 1) {
 			bind_textures[i] = frame->bound_images[i]->gfx_handle;
 		}
 		
-		D3D11_Vertex* head = (D3D11_Vertex*)d3d11_staging_quad_buffer;
-		D3D11_Vertex* pointer = head;
-		u64 number_of_rendered_quads = 0;
-		
-		
 		///
 		// This is where we convert Draw_Quad's to vertices. It should be very fast as all it's doing is mostly
 		// copying and some minor computing.
 		// Most computation is done in draw_quad_projected in drawing.c.
 		// This way, we could easily build different draw frames on different threads and then render them
 		// here on the main thread.
+		// The sorting, batching & vertex writing is in quad_batch.c, here we just upload & draw.
 		//
-		{
-			if (frame->enable_z_sorting) {
-				if (!d3d11_sort_quad_buffer || (d3d11_sort_quad_buffer_size < number_of_quads*sizeof(Draw_Quad))) {
-					// #Memory #Heapalloc
-					if (d3d11_sort_quad_buffer) dealloc(get_heap_allocator(), d3d11_sort_quad_buffer);
-					d3d11_sort_quad_buffer = alloc(get_heap_allocator(), number_of_quads*sizeof(Draw_Quad));
-					d3d11_sort_quad_buffer_size = number_of_quads*sizeof(Draw_Quad);
-				}
-				radix_sort(frame->quad_buffer, d3d11_sort_quad_buffer, number_of_quads, sizeof(Draw_Quad), offsetof(Draw_Quad, z), MAX_Z_BITS);
-			}
+		Quad_Batcher *batcher = &d3d11_quad_batcher;
+		quad_batcher_prepare(batcher, &frame->quad_buffer, frame->enable_z_sorting, QUAD_BATCH_MAX_TEXTURES);
 		
-			for (u64 i = 0; i < number_of_quads; i++)  {
-				
-				Draw_Quad *q = &frame->quad_buffer[i];
-				
-				assert(q->z <= MAX_Z, "Z is too high. Z is %d, Max is %d.", q->z, MAX_Z);
-				assert(q->z >= (-MAX_Z+1), "Z is too low. Z is %d, Min is %d.", q->z, -MAX_Z+1);
-				
-				s8 texture_index = -1;
-				
-				if (q->image) {
-					
-					if (last_texture == q->image->gfx_handle) {
-						texture_index = last_texture_index;
-					} else {
-						// First look if texture is already bound
-						for (u64 j = 0; j < num_textures; j++) {
-							if (textures[j] == q->image->gfx_handle) {
-								texture_index = (s8)j;
-								break;
-							}
-						}
-						// Otherwise use a new slot
-						if (texture_index <= -1) {
-							if (num_textures >= 32) {
-								
-								// If max textures reached, make a draw call and start over
-								D3D11_MAPPED_SUBRESOURCE buffer_mapping;
-								ID3D11DeviceContext_Map(d3d11_context, (ID3D11Resource*)d3d11_quad_vbo, 0, D3D11_MAP_WRITE_DISCARD, 0, &buffer_mapping);
-								memcpy(buffer_mapping.pData, d3d11_staging_quad_buffer, number_of_rendered_quads*sizeof(D3D11_Vertex)*4);
-								ID3D11DeviceContext_Unmap(d3d11_context, (ID3D11Resource*)d3d11_quad_vbo, 0);
-								d3d11_draw_call(number_of_rendered_quads, textures, num_textures, bind_textures, frame->highest_bound_slot_index+1, frame, render_target);
-								head = (D3D11_Vertex*)d3d11_staging_quad_buffer;
-								num_textures = 1;
-								texture_index = 0;
-								number_of_rendered_quads = 0;
-								pointer = head;
-							} else {
-								texture_index = (s8)num_textures;
-								num_textures += 1;
-							}
-						}
-					}
-					textures[texture_index] = q->image->gfx_handle;
-					last_texture = q->image->gfx_handle;
-					last_texture_index = texture_index;
-				}
-				
-				
-				
-				// We will write to 4 vertices for the one quad
-				 {
-				
-					D3D11_Vertex* BL  = pointer + 0;
-					D3D11_Vertex* TL  = pointer + 1;
-					D3D11_Vertex* TR  = pointer + 2;
-					D3D11_Vertex* BR  = pointer + 3;
-					pointer += 4;
-					
-					BL->position = v4(q->bottom_left.x,  q->bottom_left.y,  0, 1);
-					TL->position = v4(q->top_left.x,     q->top_left.y,     0, 1);
-					TR->position = v4(q->top_right.x,    q->top_right.y,    0, 1);
-					BR->position = v4(q->bottom_right.x, q->bottom_right.y, 0, 1);
-					
-					
-					if (q->image) {
-
-						BL->uv = v2(q->uv.x1, q->uv.y1);
-						TL->uv = v2(q->uv.x1, q->uv.y2);
-						TR->uv = v2(q->uv.x2, q->uv.y2);
-						BR->uv = v2(q->uv.x2, q->uv.y1);
-						// #Hack #Bug #Cleanup
-						// When a window dimension is uneven it slightly under/oversamples on an axis by a
-						// seemingly arbitrary amount. The 0.25 is a magic value I got from trial and error.
-						// (It undersamples by a fourth of the atlas texture?)
-						// Anything > 0.25 < will slightly over/undersample on my machine.
-						// I have no idea about #Portability here.
-						// - Charlie M 26th July 2024
-						if (window.width % 2 != 0) {
-							BL->uv.x += (2.0/(float)q->image->width)*0.25;
-							TL->uv.x += (2.0/(float)q->image->width)*0.25;
-							TR->uv.x += (2.0/(float)q->image->width)*0.25;
-							BR->uv.x += (2.0/(float)q->image->width)*0.25;
-						}
-						if (window.height % 2 != 0) {
-							BL->uv.y -= (2.0/(float)q->image->height)*0.25;
-							TL->uv.y -= (2.0/(float)q->image->height)*0.25;
-							TR->uv.y -= (2.0/(float)q->image->height)*0.25;
-							BR->uv.y -= (2.0/(float)q->image->height)*0.25;
-						}
-
-						u8 sampler = -1;
-						if (q->image_min_filter == GFX_FILTER_MODE_NEAREST
-									&& q->image_mag_filter == GFX_FILTER_MODE_NEAREST)
-								sampler = 0;
-						if (q->image_min_filter == GFX_FILTER_MODE_LINEAR
-									&& q->image_mag_filter == GFX_FILTER_MODE_LINEAR)
-								sampler = 1;
-						if (q->image_min_filter == GFX_FILTER_MODE_LINEAR
-									&& q->image_mag_filter == GFX_FILTER_MODE_NEAREST)
-								sampler = 2;
-						if (q->image_min_filter == GFX_FILTER_MODE_NEAREST
-									&& q->image_mag_filter == GFX_FILTER_MODE_LINEAR)
-								sampler = 3;
-						BL->sampler=TL->sampler=TR->sampler=BR->sampler = (u8)sampler;
-								
-					}
-					BL->texture_index=TL->texture_index=TR->texture_index=BR->texture_index = texture_index;
-					
-					BL->self_uv = v2(0, 0);
-					TL->self_uv = v2(0, 1);
-					TR->self_uv = v2(1, 1);
-					BR->self_uv = v2(1, 0);
-					
-					// #Speed #Cleanup
-					// Many programs may not user userdata, which means a lot of redundant time spent on this.
-					memcpy(BL->userdata, q->userdata, sizeof(q->userdata));
-					memcpy(TL->userdata, q->userdata, sizeof(q->userdata));
-					memcpy(TR->userdata, q->userdata, sizeof(q->userdata));
-					memcpy(BR->userdata, q->userdata, sizeof(q->userdata));
-					
-					BL->color = TL->color = TR->color = BR->color = q->color;
-					
-					BL->type=TL->type=TR->type=BR->type = (u8)q->type;
-					
-					float t = q->scissor.y1;
-					q->scissor.y1 = q->scissor.y2;
-					q->scissor.y2 = t;
-					
-					q->scissor.y1 = window.pixel_height - q->scissor.y1;
-					q->scissor.y2 = window.pixel_height - q->scissor.y2;
-					
-					BL->has_scissor=TL->has_scissor=TR->has_scissor=BR->has_scissor = q->has_scissor;
-					BL->scissor=TL->scissor=TR->scissor=BR->scissor = q->scissor;
-					
-					number_of_rendered_quads += 1;
+		u64 batch_count = growing_array_get_valid_count(batcher->batches);
+		
+		// #Hack #Bug #Cleanup
+		// When a window dimension is uneven it slightly under/oversamples on an axis by a
+		// seemingly arbitrary amount. The 0.25 is a magic value I got from trial and error.
+		// (It undersamples by a fourth of the atlas texture?)
+		// Anything > 0.25 < will slightly over/undersample on my machine.
+		// I have no idea about #Portability here.
+		// - Charlie M 26th July 2024
+		if (window.width % 2 != 0 || window.height % 2 != 0) {
+			for (u64 i = 0; i < batch_count; i++) {
+				Quad_Batch *batch = &batcher->batches[i];
+				for (u64 j = 0; j < batch->image_count; j++) {
+					Gfx_Image *image = batch->images[j];
+					if (window.width  % 2 != 0) batch->uv_nudge[j].x =  (2.0/(float)image->width)*0.25;
+					if (window.height % 2 != 0) batch->uv_nudge[j].y = -(2.0/(float)image->height)*0.25;
 				}
 			}
 		}
 		
-		{
+		quad_batcher_expand(batcher, (D3D11_Vertex*)d3d11_staging_quad_buffer, window.pixel_height);
+		
+		///
+		// Upload & draw call per batch
+		for (u64 i = 0; i < batch_count; i++) {
+			Quad_Batch *batch = &batcher->batches[i];
+			if (batch->quad_count == 0) continue;
+			
+			for (u64 j = 0; j < batch->image_count; j++) {
+				textures[j] = batch->images[j]->gfx_handle;
+			}
+			
 		    D3D11_MAPPED_SUBRESOURCE buffer_mapping;
 			hr = ID3D11DeviceContext_Map(d3d11_context, (ID3D11Resource*)d3d11_quad_vbo, 0, D3D11_MAP_WRITE_DISCARD, 0, &buffer_mapping);
 			d3d11_check_hr(hr);
-			memcpy(buffer_mapping.pData, d3d11_staging_quad_buffer, number_of_rendered_quads*sizeof(D3D11_Vertex)*4);
+			D3D11_Vertex *first_vertex = (D3D11_Vertex*)d3d11_staging_quad_buffer + batch->first_quad*4;
+			memcpy(buffer_mapping.pData, first_vertex, batch->quad_count*sizeof(D3D11_Vertex)*4);
 			ID3D11DeviceContext_Unmap(d3d11_context, (ID3D11Resource*)d3d11_quad_vbo, 0);
+			
+			d3d11_draw_call(batch->quad_count, textures, batch->image_count, bind_textures, frame->highest_bound_slot_index+1, frame, render_target);
 		}
-		
-		///
-		// Draw call
-		d3d11_draw_call(number_of_rendered_quads, textures, num_textures, bind_textures, frame->highest_bound_slot_index+1, frame, render_target);
     }
     
     
@@ -933,15 +792,15 @@ void gfx_reserve_vbo_bytes(u64 number_of_bytes) {
 	if (number_of_bytes > d3d11_quad_vbo_size) {
 		if (d3d11_quad_vbo) {
 			D3D11Release(d3d11_quad_vbo);
-			dealloc(get_heap_allocator(), d3d11_staging_quad_buffer);
+			dealloc(get_tagged_heap_allocator(MEMORY_TAG_RENDERER), d3d11_staging_quad_buffer);
 		}
 		u64 new_size = get_next_power_of_two(number_of_bytes);
 		u64 new_indices = ((new_size/sizeof(D3D11_Vertex))/4)*6;
 		
 		d3d11_quad_vbo_size = new_size;
 		
-		d3d11_staging_quad_buffer = alloc(get_heap_allocator(), d3d11_quad_vbo_size);
-		u32 *indices = (u32*)alloc(get_heap_allocator(), new_indices*sizeof(u32));
+		d3d11_staging_quad_buffer = alloc(get_tagged_heap_allocator(MEMORY_TAG_RENDERER), d3d11_quad_vbo_size);
+		u32 *indices = (u32*)alloc(get_tagged_heap_allocator(MEMORY_TAG_RENDERER), new_indices*sizeof(u32));
 		
 		for (u64 i = 0; i < new_indices; i += 6) {
 			indices[i + 0] = (i/6)*4 + 0;
@@ -19,30 +19,19 @@
 #endif
 
 
-#ifdef VERTEX_2D_USER_DATA_COUNT
-	#error VERTEX_2D_USER_DATA_COUNT has been renamed to VERTEX_USER_DATA_COUNT, please use that instead
-#endif
-#ifndef VERTEX_USER_DATA_COUNT
-	#define VERTEX_USER_DATA_COUNT 1
-#endif
-
 ogb_instance const Gfx_Handle GFX_INVALID_HANDLE;
 // #Volatile reflected in 2D batch shader
 #define QUAD_TYPE_REGULAR 0
 #define QUAD_TYPE_TEXT 1
 #define QUAD_TYPE_CIRCLE 2
 
-typedef enum Gfx_Filter_Mode {
-	GFX_FILTER_MODE_NEAREST,
-	GFX_FILTER_MODE_LINEAR,
-} Gfx_Filter_Mode;
-
-typedef struct Gfx_Image {
+// typedef'd in quad_batch.c
+struct Gfx_Image {
 	u32 width, height, channels;
 	Gfx_Handle gfx_handle;
 	Gfx_Render_Target_Handle gfx_render_target;
 	Allocator allocator;
-} Gfx_Image;
+};
 
 typedef struct Draw_Frame Draw_Frame;
 
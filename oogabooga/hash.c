@@ -1,10 +1,42 @@
 
+///
+// Hashing
+//
+//     u64 get_hash(x)                                // strings, ints, floats, pointers, Vector2i/3i/4i, Vector2/3/4
+//     u64 bytes_get_hash(const void *p, u64 n)
+//     u64 bytes_get_hash_seeded(const void *p, u64 n, u64 seed)
+//
+//     // Streaming, gives the same hash as bytes_get_hash on everything added together
+//     Hash_State h;
+//     hash_state_init(&h, HASH_DEFAULT_SEED);
+//     hash_state_add(&h, &a, sizeof(a));
+//     hash_state_add(&h, name.data, name.count);
+//     u64 hash = hash_state_get(&h);
+//
+// For composite struct keys (no padding in them please, that's hashed too) you can hash the bytes:
+//     hash_table_add_raw(&table, bytes_get_hash(&key, sizeof(key)), &key, &value, sizeof(key), sizeof(value));
+//
+// Up to HASH_SHORT_MAX bytes it's a wyhash style 64x64->128 multiply & fold, which is what most keys
+// will be. Longer than that it's xxh3 style: 8 lanes of 32x32->64 multiplies over 64 byte stripes,
+// done with SSE2 when we have it. Same idea as those, but the outputs don't match theirs.
+//
 
 #define PRIME64_1 11400714785074694791ULL
 #define PRIME64_2 14029467366897019727ULL
 #define PRIME64_3 1609587929392839161ULL
 #define PRIME64_4 9650029242287828579ULL
 #define PRIME64_5 2870177450012600261ULL
+#define PRIME32_1 0x9E3779B1U
+#define PRIME32_2 0x85EBCA77U
+#define PRIME32_3 0xC2B2AE3DU
+
+#define HASH_DEFAULT_SEED 0
+#define HASH_SHORT_MAX 256
+#define HASH_STRIPE_SIZE 64
+#define HASH_SECRET_SIZE 192
+#define HASH_STRIPES_PER_BLOCK ((HASH_SECRET_SIZE - HASH_STRIPE_SIZE) / 8)
+#define HASH_BLOCK_SIZE (HASH_STRIPE_SIZE*HASH_STRIPES_PER_BLOCK)
+#define HASH_LAST_STRIPE_SECRET_OFFSET (HASH_SECRET_SIZE - HASH_STRIPE_SIZE - 7)
 
 static inline u64 xx_hash(u64 x) {
     u64 h64 = PRIME64_5 + 8;
@@ -18,45 +50,269 @@ static inline u64 xx_hash(u64 x) {
     return h64;
 }
 
-static inline u64 city_hash(string s) {
-    const u64 k = 0x9ddfea08eb382d69ULL;
-    u64 a = s.count;
-    u64 b = s.count * 5;
-    u64 c = 9;
-    u64 d = b;
+// Random bytes (splitmix64), the long hash mixes the input with these
+alignat(16) static const u64 hash_secret[HASH_SECRET_SIZE/8] = {
+	0xa49034240a1f10b2ull, 0x2ebc07599da407bcull, 0x1f564b87200afac7ull, 0x4d88905c79ef4fbdull,
+	0x258a7281c57c1897ull, 0x64eb6572942dc4b3ull, 0x61f046857cae80e0ull, 0x85a9ef6002174c96ull,
+	0x6199c60ad8176ec7ull, 0xc5df12574cde3fe3ull, 0x74ce7e08f89c42feull, 0xcb4104b2b8da2f10ull,
+	0x3c5ed92c0abe17f8ull, 0x2b052e7a1724a175ull, 0xc61ab8ccfc07b80aull, 0x4c17776d93468205ull,
+	0x7fc43041d62d0f23ull, 0xb66d791306c36d4bull, 0xc14c066a127de2a3ull, 0xaef96c0a22e08911ull,
+	0xf042063a3d7ef907ull, 0x99dffef3add00cb5ull, 0x41334355d53df808ull, 0xfcd0826952409ac2ull,
+};
+
+static inline u64 hash_read_u64(const u8 *p) { u64 x; memcpy(&x, p, sizeof(u64)); return x; }
+static inline u64 hash_read_u32(const u8 *p) { u32 x; memcpy(&x, p, sizeof(u32)); return x; }
+
+// 64x64 -> 128, lo in a & hi in b
+static inline void hash_mum(u64 *a, u64 *b) {
+#if COMPILER_MSVC
+	u64 hi;
+	u64 lo = _umul128(*a, *b, &hi);
+	*a = lo;
+	*b = hi;
+#else
+	__uint128_t r = (__uint128_t)*a * *b;
+	*a = (u64)r;
+	*b = (u64)(r >> 64);
+#endif
+}
+static inline u64 hash_mix(u64 a, u64 b) {
+	hash_mum(&a, &b);
+	return a ^ b;
+}
+
+static inline u64 hash_avalanche(u64 h) {
+	h ^= h >> 37;
+	h *= 0x165667919E3779F9ULL;
+	h ^= h >> 32;
+	return h;
+}
+
+u64 hash_short(const u8 *p, u64 n, u64 seed) {
+	const u64 *s = hash_secret;
+	seed ^= hash_mix(seed ^ s[0], s[1]);
+
+	u64 a, b;
+	if (n <= 16) {
+		if (n >= 4) {
+			// Two overlapping u32 reads from each end covers 4..16 bytes
+			u64 mid = (n >> 3) << 2;
+			a = (hash_read_u32(p) << 32) | hash_read_u32(p + mid);
+			b = (hash_read_u32(p + n - 4) << 32) | hash_read_u32(p + n - 4 - mid);
+		} else if (n > 0) {
+			a = ((u64)p[0] << 16) | ((u64)p[n >> 1] << 8) | p[n - 1];
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		u64 i = n;
+		if (i > 48) {
+			// 3 independent lanes so the multiplies can overlap
+			u64 see1 = seed, see2 = seed;
+			do {
+				seed = hash_mix(hash_read_u64(p)      ^ s[1], hash_read_u64(p + 8)  ^ seed);
+				see1 = hash_mix(hash_read_u64(p + 16) ^ s[2], hash_read_u64(p + 24) ^ see1);
+				see2 = hash_mix(hash_read_u64(p + 32) ^ s[3], hash_read_u64(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16) {
+			seed = hash_mix(hash_read_u64(p) ^ s[1], hash_read_u64(p + 8) ^ seed);
+			p += 16;
+			i -= 16;
+		}
+		// Last 16, may overlap what we already did
+		a = hash_read_u64(p + i - 16);
+		b = hash_read_u64(p + i - 8);
+	}
+
+	a ^= s[1];
+	b ^= seed;
+	hash_mum(&a, &b);
+	return hash_mix(a ^ s[0] ^ n, b ^ s[1]);
+}
+
+///
+// Long inputs
+
+static inline void hash_accumulate_stripe_scalar(u64 *acc, const u8 *stripe, const u8 *secret) {
+	for (u64 i = 0; i < 8; i++) {
+		u64 data = hash_read_u64(stripe + i*8);
+		u64 data_key = data ^ hash_read_u64(secret + i*8);
+		acc[i ^ 1] += data; // Neighbour lane, so a multiply by zero can't erase the input
+		acc[i] += (data_key & 0xFFFFFFFF) * (data_key >> 32);
+	}
+}
+static inline void hash_scramble_scalar(u64 *acc, const u8 *secret) {
+	for (u64 i = 0; i < 8; i++) {
+		u64 a = acc[i];
+		a ^= a >> 47;
+		a ^= hash_read_u64(secret + i*8);
+		acc[i] = a * PRIME32_1;
+	}
+}
+
+#if COMPILER_CAN_DO_SSE2
+// Same as the scalar ones, 2 lanes at a time
+static inline void hash_accumulate_stripe_sse2(u64 *acc, const u8 *stripe, const u8 *secret) {
+	__m128i *xacc = (__m128i*)acc;
+	for (u64 i = 0; i < 4; i++) {
+		__m128i data     = _mm_loadu_si128((const __m128i*)(stripe + i*16));
+		__m128i key      = _mm_loadu_si128((const __m128i*)(secret + i*16));
+		__m128i data_key = _mm_xor_si128(data, key);
+		__m128i key_hi   = _mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1));
+		__m128i product  = _mm_mul_epu32(data_key, key_hi);
+		__m128i swapped  = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+		xacc[i] = _mm_add_epi64(_mm_add_epi64(xacc[i], swapped), product);
+	}
+}
+static inline void hash_scramble_sse2(u64 *acc, const u8 *secret) {
+	__m128i *xacc = (__m128i*)acc;
+	const __m128i prime = _mm_set1_epi32((int)PRIME32_1);
+	for (u64 i = 0; i < 4; i++) {
+		__m128i a = xacc[i];
+		a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+		a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i*)(secret + i*16)));
+		__m128i a_hi = _mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1));
+		__m128i lo = _mm_mul_epu32(a, prime);
+		__m128i hi = _mm_mul_epu32(a_hi, prime);
+		xacc[i] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+	}
+}
+	#define hash_accumulate_stripe hash_accumulate_stripe_sse2
+	#define hash_scramble hash_scramble_sse2
+#else
+	#define hash_accumulate_stripe hash_accumulate_stripe_scalar
+	#define hash_scramble hash_scramble_scalar
+#endif
+
+static inline void hash_long_init(u64 *acc, u64 seed) {
+	acc[0] = PRIME32_3 + seed; acc[1] = PRIME64_1 - seed;
+	acc[2] = PRIME64_2 + seed; acc[3] = PRIME64_3 - seed;
+	acc[4] = PRIME64_4 + seed; acc[5] = PRIME32_2 - seed;
+	acc[6] = PRIME64_5 + seed; acc[7] = PRIME32_1 - seed;
+}
+
+static inline u64 hash_long_merge(u64 *acc, u64 n) {
+	const u8 *secret = (const u8*)hash_secret;
+	u64 r = n * PRIME64_1;
+	for (u64 i = 0; i < 4; i++) {
+		r += hash_mix(acc[i*2] ^ hash_read_u64(secret + 11 + i*16), acc[i*2+1] ^ hash_read_u64(secret + 19 + i*16));
+	}
+	return hash_avalanche(r);
+}
+
+// n > HASH_SHORT_MAX
+u64 hash_long(const u8 *p, u64 n, u64 seed) {
+	const u8 *secret = (const u8*)hash_secret;
+	alignat(16) u64 acc[8];
+	hash_long_init(acc, seed);
+
+	// Every full stripe except the very last one, which goes in with a different part of the secret
+	u64 block_count = (n - 1) / HASH_BLOCK_SIZE;
+	for (u64 b = 0; b < block_count; b++) {
+		const u8 *block = p + b*HASH_BLOCK_SIZE;
+		for (u64 s = 0; s < HASH_STRIPES_PER_BLOCK; s++) {
+			hash_accumulate_stripe(acc, block + s*HASH_STRIPE_SIZE, secret + s*8);
+		}
+		hash_scramble(acc, secret + HASH_SECRET_SIZE - HASH_STRIPE_SIZE);
+	}
+
+	const u8 *tail = p + block_count*HASH_BLOCK_SIZE;
+	u64 stripe_count = ((n - 1) - block_count*HASH_BLOCK_SIZE) / HASH_STRIPE_SIZE;
+	for (u64 s = 0; s < stripe_count; s++) {
+		hash_accumulate_stripe(acc, tail + s*HASH_STRIPE_SIZE, secret + s*8);
+	}
+	hash_accumulate_stripe(acc, p + n - HASH_STRIPE_SIZE, secret + HASH_LAST_STRIPE_SECRET_OFFSET);
+
+	return hash_long_merge(acc, n);
+}
+
+u64 bytes_get_hash_seeded(const void *p, u64 n, u64 seed) {
+	if (n <= HASH_SHORT_MAX) return hash_short((const u8*)p, n, seed);
+	return hash_long((const u8*)p, n, seed);
+}
+u64 bytes_get_hash(const void *p, u64 n) {
+	return bytes_get_hash_seeded(p, n, HASH_DEFAULT_SEED);
+}
+
+///
+// Streaming
+
+#define HASH_STATE_BUFFER_SIZE (HASH_STRIPE_SIZE*4)
 
-    if (s.count <= 16) {
-        memcpy(&a, s.data, sizeof(u64));
-        memcpy(&b, s.data + s.count - 8, sizeof(u64));
-    } else {
-        memcpy(&a, s.data, sizeof(u64));
-        memcpy(&b, s.data + 8, sizeof(u64));
-        memcpy(&c, s.data + s.count - 8, sizeof(u64));
-        memcpy(&d, s.data + s.count - 16, sizeof(u64));
-    }
+typedef struct Hash_State {
+	alignat(16) u64 acc[8];
+	u8 buffer[HASH_STATE_BUFFER_SIZE];
+	u64 buffered;
+	u64 stripes_in_block;
+	u64 total;
+	u64 seed;
+} Hash_State;
 
-    a += b;
-    a = (a << 43) | (a >> (64 - 43));
-    a += c;
-    a = a * 5 + 0x52dce729;
-    d ^= a;
-    d = (d << 44) | (d >> (64 - 44));
-    d += b;
+static inline void hash_state_consume_stripe(u64 *acc, u64 *stripes_in_block, const u8 *stripe) {
+	const u8 *secret = (const u8*)hash_secret;
+	hash_accumulate_stripe(acc, stripe, secret + *stripes_in_block*8);
+	*stripes_in_block += 1;
+	if (*stripes_in_block == HASH_STRIPES_PER_BLOCK) {
+		hash_scramble(acc, secret + HASH_SECRET_SIZE - HASH_STRIPE_SIZE);
+		*stripes_in_block = 0;
+	}
+}
+
+void hash_state_init(Hash_State *h, u64 seed) {
+	memset(h, 0, sizeof(*h));
+	h->seed = seed;
+	hash_long_init(h->acc, seed);
+}
 
-    return d * k;
+void hash_state_add(Hash_State *h, const void *data, u64 n) {
+	const u8 *p = (const u8*)data;
+	h->total += n;
+	while (n) {
+		if (h->buffered == HASH_STATE_BUFFER_SIZE) {
+			// More is coming, so none of these are the last stripe. Keep the last one around in
+			// case it turns out to be what hash_state_get needs for the final stripe.
+			for (u64 s = 0; s < 3; s++) {
+				hash_state_consume_stripe(h->acc, &h->stripes_in_block, h->buffer + s*HASH_STRIPE_SIZE);
+			}
+			memcpy(h->buffer, h->buffer + 3*HASH_STRIPE_SIZE, HASH_STRIPE_SIZE);
+			h->buffered = HASH_STRIPE_SIZE;
+		}
+		u64 take = min(n, HASH_STATE_BUFFER_SIZE - h->buffered);
+		memcpy(h->buffer + h->buffered, p, take);
+		h->buffered += take;
+		p += take;
+		n -= take;
+	}
 }
 
-u64 djb2_hash(string s) {
-    u64 hash = 5381;
-    for (u64 i = 0; i < s.count; i++) {
-        hash = ((hash << 5) + hash) + s.data[i];
-    }
-    return hash;
+// Doesn't change the state, you can keep adding after
+u64 hash_state_get(Hash_State *h) {
+	// Nothing is consumed until there's more than the buffer, so it's all in there
+	if (h->total <= HASH_SHORT_MAX) return hash_short(h->buffer, h->total, h->seed);
+
+	alignat(16) u64 acc[8];
+	memcpy(acc, h->acc, sizeof(acc));
+	u64 stripes_in_block = h->stripes_in_block;
+
+	u64 stripe_count = (h->buffered - 1) / HASH_STRIPE_SIZE;
+	for (u64 s = 0; s < stripe_count; s++) {
+		hash_state_consume_stripe(acc, &stripes_in_block, h->buffer + s*HASH_STRIPE_SIZE);
+	}
+	hash_accumulate_stripe(acc, h->buffer + h->buffered - HASH_STRIPE_SIZE, (const u8*)hash_secret + HASH_LAST_STRIPE_SECRET_OFFSET);
+
+	return hash_long_merge(acc, h->total);
 }
 
+///
+// get_hash
+
 u64 string_get_hash(string s) {
-    if (s.count > 32) return djb2_hash(s);
-    return city_hash(s);
+	return bytes_get_hash(s.data, s.count);
 }
 u64 pointer_get_hash(void *p) {
 	return xx_hash((u64)p);
@@ -67,6 +323,15 @@ u64 float64_get_hash(float64 x) {
 u64 float32_get_hash(float32 x) {
 	return float64_get_hash((float64)x);
 }
+u64 vector2i_get_hash(Vector2i v) {
+	// Tile keys, so two ints in one u64 is all we need
+	return xx_hash(((u64)(u32)v.x << 32) | (u32)v.y);
+}
+u64 vector3i_get_hash(Vector3i v) { return bytes_get_hash(&v, sizeof(v)); }
+u64 vector4i_get_hash(Vector4i v) { return bytes_get_hash(&v, sizeof(v)); }
+u64 vector2_get_hash(Vector2 v)   { return bytes_get_hash(&v, sizeof(v)); }
+u64 vector3_get_hash(Vector3 v)   { return bytes_get_hash(&v, sizeof(v)); }
+u64 vector4_get_hash(Vector4 v)   { return bytes_get_hash(&v, sizeof(v)); }
 
 #define get_hash(x) _Generic((x), \
 		    string: string_get_hash, \
@@ -80,5 +345,11 @@ u64 float32_get_hash(float32 x) {
 		    u64: xx_hash, \
 		    f32: float32_get_hash, \
 		    f64: float64_get_hash, \
+		    Vector2i: vector2i_get_hash, \
+		    Vector3i: vector3i_get_hash, \
+		    Vector4i: vector4i_get_hash, \
+		    Vector2: vector2_get_hash, \
+		    Vector3: vector3_get_hash, \
+		    Vector4: vector4_get_hash, \
 		    default: pointer_get_hash \
-		    )(x)
\ No newline at end of file
+		    )(x)
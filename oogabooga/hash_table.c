@@ -1,6 +1,9 @@
 
-// Very naive implementation but it should be very cache efficient so it's alright
-// for non-excessive use for now.
+// Open addressing with robin hood probing.
+// Entries (hash, key, value) are stored densely in insertion order, so iterating with
+// hash_table_get_nth_value() is just walking an array. A separate slot array maps hashes to
+// entries. Removing swaps the last entry into the hole and shifts the probe run back, so
+// there are no tombstones.
 
 /*
 
@@ -30,6 +33,9 @@
 		
 	}
 	
+	// Remove an entry. Returns whether or not it existed.
+	bool removed = hash_table_remove(&table, key);
+	
 	// Reset all entries (but keep allocated memory)
 	hash_table_reset(&table);
 	
@@ -37,13 +43,18 @@
 	hash_table_destroy(&table);
 	
 	
+	Pointers to values are invalidated by anything that adds or removes entries.
+	
+	String keys are copied into the table allocator, so you don't need to keep them alive.
+	
 	Limitations:
-		- Key can only be a base type or pointer
+		- Key can only be a base type, pointer or string
 		- Key and value passed to the following function needs to be lvalues (we need to be able to take their addresses with '&'):
 			- hash_table_add
 			- hash_table_find
 			- hash_table_contains
 			- hash_table_set
+			- hash_table_remove
 			
 			Example:
 			
@@ -60,95 +71,220 @@ typedef struct Hash_Table Hash_Table;
 
 // API:
 #define make_hash_table_reserve(Key_Type, Value_Type, capacity_count, allocator) \
-	make_hash_table_reserve(sizeof(Key_Type), sizeof(Value_Type), capacity_count, allocator)
+	make_hash_table_reserve_raw(sizeof(Key_Type), sizeof(Value_Type), HASH_TABLE_KEY_KIND(Key_Type), capacity_count, allocator)
 	
 #define make_hash_table(Key_Type, Value_Type, allocator) \
-	make_hash_table_raw(sizeof(Key_Type), sizeof(Value_Type), allocator)
+	make_hash_table_raw(sizeof(Key_Type), sizeof(Value_Type), HASH_TABLE_KEY_KIND(Key_Type), allocator)
 
+// Key must not already be in the table. Use hash_table_set if you're not sure.
 #define hash_table_add(table_ptr, key, value) \
 	hash_table_add_raw((table_ptr), get_hash(key), &(key), &(value), sizeof(key), sizeof(value))
 
 #define hash_table_find(table_ptr, key) \
-	hash_table_find_raw((table_ptr), get_hash(key))
+	hash_table_find_raw((table_ptr), get_hash(key), &(key), sizeof(key))
 	
 #define hash_table_contains(table_ptr, key) \
-	hash_table_contains_raw((table_ptr), get_hash(key))
+	hash_table_contains_raw((table_ptr), get_hash(key), &(key), sizeof(key))
 	
 #define hash_table_set(table_ptr, key, value) \
-	hash_table_set_raw((table_ptr), get_hash(key), &key, &value, sizeof(key), sizeof(value))
+	hash_table_set_raw((table_ptr), get_hash(key), &(key), &(value), sizeof(key), sizeof(value))
+
+#define hash_table_remove(table_ptr, key) \
+	hash_table_remove_raw((table_ptr), get_hash(key), &(key), sizeof(key))
 
 void hash_table_reserve(Hash_Table *t, u64 required_count);
 
+typedef enum Hash_Table_Key_Kind {
+	HASH_TABLE_KEY_BYTES,  // Compared with memcmp
+	HASH_TABLE_KEY_STRING, // Compared with strings_match, data is owned by the table
+} Hash_Table_Key_Kind;
+
+// Not evaluated, _Generic only looks at the type
+#define HASH_TABLE_KEY_KIND(Key_Type) _Generic(*(Key_Type*)0, string: HASH_TABLE_KEY_STRING, default: HASH_TABLE_KEY_BYTES)
+
+#define HASH_TABLE_MIN_CAPACITY 8
+
+// Slots are kept at most this full
+#define HASH_TABLE_MAX_LOAD_NUMERATOR   4
+#define HASH_TABLE_MAX_LOAD_DENOMINATOR 5
+
+typedef struct Hash_Table_Slot {
+	u32 entry_index; // 1-based, 0 means empty
+	u32 hash;        // Low bits of the hash, gives us the home slot without touching the entry
+} Hash_Table_Slot;
 
 typedef struct Hash_Table {
 	
-	// Each entry is hash-key-value
-	// Hash is sizeof(u64) bytes, key is _key_size bytes and value is _value_size bytes
+	// Each entry is hash-key-value, densely packed in insertion order (until something is removed)
+	// Hash is sizeof(u64) bytes, key is _key_size bytes and value is _value_size bytes, key & value aligned to 8
 	void *entries; 
 	
 	u64 count; // Number of valid entries
 	u64 capacity_count; // Number of allocated entries
 	
+	Hash_Table_Slot *slots;
+	u64 slot_count; // Power of two
+	
 	u64 _key_size;
 	u64 _value_size;
+	u64 _entry_size;
+	Hash_Table_Key_Kind _key_kind;
 	
 	Allocator allocator;
 } Hash_Table;
 
-Hash_Table make_hash_table_reserve_raw(u64 key_size, u64 value_size, u64 capacity_count, Allocator allocator) {
+inline u64 hash_table_key_offset()                { return sizeof(u64); }
+inline u64 hash_table_value_offset(Hash_Table *t) { return sizeof(u64) + align_next(t->_key_size, 8); }
 
-	capacity_count = min(capacity_count, 8);
+inline u8 *hash_table_entry(Hash_Table *t, u64 index) {
+	return (u8*)t->entries + index*t->_entry_size;
+}
+
+inline bool hash_table_keys_match(Hash_Table *t, void *a, void *b) {
+	if (t->_key_kind == HASH_TABLE_KEY_STRING) return strings_match(*(string*)a, *(string*)b);
+	return memcmp(a, b, t->_key_size) == 0;
+}
+
+// How far the slot is from where its hash wants it
+inline u64 hash_table_probe_distance(Hash_Table *t, u64 slot_index) {
+	u64 mask = t->slot_count-1;
+	return (slot_index - (t->slots[slot_index].hash & mask)) & mask;
+}
+
+Hash_Table make_hash_table_reserve_raw(u64 key_size, u64 value_size, Hash_Table_Key_Kind key_kind, u64 capacity_count, Allocator allocator) {
+
+	capacity_count = max(capacity_count, HASH_TABLE_MIN_CAPACITY);
 
 	Hash_Table t = ZERO(Hash_Table);
 	
 	t._key_size = key_size;
 	t._value_size = value_size;
+	t._entry_size = sizeof(u64) + align_next(key_size, 8) + align_next(value_size, 8);
+	t._key_kind = key_kind;
 	t.allocator = allocator;
 	
-	u64 entry_size = value_size+sizeof(u64);
-	t.entries = alloc(t.allocator, entry_size*capacity_count);
-	memset(t.entries, 0, entry_size*capacity_count);
-	t.capacity_count = capacity_count;
+	hash_table_reserve(&t, capacity_count);
 	
 	return t;
 }
-inline Hash_Table make_hash_table_raw(u64 key_size, u64 value_size, Allocator allocator) {
-	return make_hash_table_reserve_raw(key_size, value_size, 128, allocator);
+inline Hash_Table make_hash_table_raw(u64 key_size, u64 value_size, Hash_Table_Key_Kind key_kind, Allocator allocator) {
+	return make_hash_table_reserve_raw(key_size, value_size, key_kind, 16, allocator);
+}
+
+void hash_table_free_string_keys(Hash_Table *t) {
+	if (t->_key_kind != HASH_TABLE_KEY_STRING) return;
+	for (u64 i = 0; i < t->count; i += 1) {
+		string *key = (string*)(hash_table_entry(t, i)+hash_table_key_offset());
+		if (key->count) dealloc_string(t->allocator, *key);
+	}
 }
 
 void hash_table_reset(Hash_Table *t) {
+	hash_table_free_string_keys(t);
 	t->count = 0;
+	if (t->slots) memset(t->slots, 0, t->slot_count*sizeof(Hash_Table_Slot));
 }
 void hash_table_destroy(Hash_Table *t) {
-	dealloc(t->allocator, t->entries);
+	hash_table_free_string_keys(t);
+	if (t->entries) dealloc(t->allocator, t->entries);
+	if (t->slots)   dealloc(t->allocator, t->slots);
 	
 	t->entries = 0;
+	t->slots = 0;
 	t->count = 0;
 	t->capacity_count = 0;
+	t->slot_count = 0;
 }
 
-void hash_table_reserve(Hash_Table *t, u64 required_count) {
-	u64 entry_size = t->_value_size+sizeof(u64);
-	
-	u64 required_size = required_count*entry_size;
-	
-	u64 current_size = t->capacity_count*entry_size;
-	
-	if (current_size >= required_size) return;
-	
-	u64 new_count = get_next_power_of_two(required_count);
-	u64 new_size = new_count*entry_size;
+// Puts an entry index into the slots, robin hood style: whoever is further from home gets the slot.
+void hash_table_insert_slot(Hash_Table *t, u64 hash, u64 entry_index) {
+	u64 mask = t->slot_count-1;
+	
+	Hash_Table_Slot slot;
+	slot.entry_index = (u32)(entry_index+1);
+	slot.hash = (u32)hash;
+	
+	u64 i = hash & mask;
+	u64 dist = 0;
+	while (true) {
+		if (t->slots[i].entry_index == 0) {
+			t->slots[i] = slot;
+			return;
+		}
+		u64 existing_dist = hash_table_probe_distance(t, i);
+		if (existing_dist < dist) {
+			Hash_Table_Slot displaced = t->slots[i];
+			t->slots[i] = slot;
+			slot = displaced;
+			dist = existing_dist;
+		}
+		i = (i+1) & mask;
+		dist += 1;
+	}
+}
+
+void hash_table_rebuild_slots(Hash_Table *t, u64 new_slot_count) {
+	if (t->slots) dealloc(t->allocator, t->slots);
 	
-	void *new_entries = alloc(t->allocator, new_size);
-	memcpy(new_entries, t->entries, current_size);
+	t->slot_count = new_slot_count;
+	t->slots = alloc(t->allocator, new_slot_count*sizeof(Hash_Table_Slot));
+	memset(t->slots, 0, new_slot_count*sizeof(Hash_Table_Slot));
 	
-	dealloc(t->allocator, t->entries);
+	for (u64 i = 0; i < t->count; i += 1) {
+		hash_table_insert_slot(t, *(u64*)hash_table_entry(t, i), i);
+	}
+}
+
+void hash_table_reserve(Hash_Table *t, u64 required_count) {
+	assert(required_count < 0xFFFFFFFFull, "Hash table can't hold more than 4 billion entries");
+
+	if (t->capacity_count < required_count) {
+		u64 new_count = get_next_power_of_two(required_count);
+		
+		void *new_entries = alloc(t->allocator, new_count*t->_entry_size);
+		if (t->entries) {
+			memcpy(new_entries, t->entries, t->count*t->_entry_size);
+			dealloc(t->allocator, t->entries);
+		}
+		
+		t->entries = new_entries;
+		t->capacity_count = new_count;
+	}
 	
-	t->entries = new_entries;
-	t->capacity_count = new_count;
+	u64 required_slots = get_next_power_of_two((required_count*HASH_TABLE_MAX_LOAD_DENOMINATOR)/HASH_TABLE_MAX_LOAD_NUMERATOR + 1);
+	if (t->slot_count < required_slots) {
+		hash_table_rebuild_slots(t, required_slots);
+	}
+}
+
+// Returns slot index or -1
+s64 hash_table_find_slot(Hash_Table *t, u64 hash, void *k) {
+	if (t->count == 0) return -1;
+
+	u64 mask = t->slot_count-1;
+	u64 key_offset = hash_table_key_offset();
+	
+	u64 i = hash & mask;
+	u64 dist = 0;
+	while (true) {
+		Hash_Table_Slot slot = t->slots[i];
+		if (slot.entry_index == 0) return -1;
+		
+		// If we were here, we would have taken this slot
+		if (hash_table_probe_distance(t, i) < dist) return -1;
+		
+		if (slot.hash == (u32)hash) {
+			u8 *entry = hash_table_entry(t, slot.entry_index-1);
+			if (*(u64*)entry == hash && hash_table_keys_match(t, entry+key_offset, k)) {
+				return (s64)i;
+			}
+		}
+		
+		i = (i+1) & mask;
+		dist += 1;
+	}
 }
 
-// This can add multiple entries of same hash, beware!
 void hash_table_add_raw(Hash_Table *t, u64 hash, void *k, void *v, u64 key_size, u64 value_size) {
 
 	assert(t->_key_size == key_size, "Key type size does not match hash table initted key type size");
@@ -156,63 +292,99 @@ void hash_table_add_raw(Hash_Table *t, u64 hash, void *k, void *v, u64 key_size,
 
 	hash_table_reserve(t, t->count+1);
 	
-	u64 entry_size = t->_value_size+sizeof(u64);
-	
-	u64 index = entry_size*t->count;
+	u64 index = t->count;
 	t->count += 1;
 	
-	u64 hash_offset = 0;
-	u64 value_offset = hash_offset + sizeof(u64);
+	u8 *entry = hash_table_entry(t, index);
+	memcpy(entry, &hash, sizeof(u64));
+	memcpy(entry+hash_table_key_offset(), k, key_size);
+	memcpy(entry+hash_table_value_offset(t), v, value_size);
+	
+	if (t->_key_kind == HASH_TABLE_KEY_STRING) {
+		string *key = (string*)(entry+hash_table_key_offset());
+		if (key->count) *key = string_copy(*key, t->allocator);
+	}
 	
-	memcpy((u8*)t->entries+index+hash_offset,  &hash, sizeof(u64));
-	memcpy((u8*)t->entries+index+value_offset, v,     value_size);
+	hash_table_insert_slot(t, hash, index);
 }
 
-void *hash_table_find_raw(Hash_Table *t, u64 hash) {
-
-	// #Speed #Incomplete
-	// Do quadratic probe 'triangular numbers'
+void *hash_table_find_raw(Hash_Table *t, u64 hash, void *k, u64 key_size) {
+	assert(t->_key_size == key_size, "Key type size does not match hash table initted key type size");
 
-	u64 entry_size = t->_value_size+sizeof(u64);
-	u64 hash_offset = 0;
-	u64 value_offset = hash_offset + sizeof(u64);
+	s64 slot = hash_table_find_slot(t, hash, k);
+	if (slot == -1) return 0;
 	
-	for (u64 i = 0; i < t->count; i += 1) {
-		u64 existing_hash = *(u64*)((u8*)t->entries+i*entry_size+hash_offset);
-		if (existing_hash == hash) {
-			void *value = ((u8*)t->entries+i*entry_size+value_offset);
-			return value;
-		}
-	}
-	return 0;
+	return hash_table_entry(t, t->slots[slot].entry_index-1) + hash_table_value_offset(t);
 }
 
 void *hash_table_get_nth_value(Hash_Table *t, u64 n) {
 	assert(n < t->count, "Hash table n is out of range");
 	
-	u64 entry_size = t->_value_size+sizeof(u64);
-	u64 hash_offset = 0;
-	u64 value_offset = hash_offset + sizeof(u64);
+	return hash_table_entry(t, n) + hash_table_value_offset(t);
+}
+void *hash_table_get_nth_key(Hash_Table *t, u64 n) {
+	assert(n < t->count, "Hash table n is out of range");
 	
-	return (u8*)t->entries+entry_size*n+value_offset;
+	return hash_table_entry(t, n) + hash_table_key_offset();
 }
 
-bool hash_table_contains_raw(Hash_Table *t, u64 hash) {
-	return hash_table_find_raw(t, hash) != 0;
+bool hash_table_contains_raw(Hash_Table *t, u64 hash, void *k, u64 key_size) {
+	return hash_table_find_raw(t, hash, k, key_size) != 0;
 }
 
 // Returns true if key was newly added or false if it already existed
 bool hash_table_set_raw(Hash_Table *t, u64 hash, void *k, void *v, u64 key_size, u64 value_size) {
-	bool newly_added = true;
-	
-	if (hash_table_contains_raw(t, hash)) newly_added = false;
+	assert(t->_value_size == value_size, "Value type size does not match hash table initted value type size");
+
+	void *existing = hash_table_find_raw(t, hash, k, key_size);
 	
-	if (newly_added) {
-		hash_table_add_raw(t, hash, k, v, key_size, value_size);
-	} else {
-		memcpy(hash_table_find_raw(t, hash), v, value_size);
+	if (existing) {
+		memcpy(existing, v, value_size);
+		return false;
 	}
 	
-	return newly_added;
+	hash_table_add_raw(t, hash, k, v, key_size, value_size);
+	return true;
 }
 
+// Returns true if key existed
+bool hash_table_remove_raw(Hash_Table *t, u64 hash, void *k, u64 key_size) {
+	assert(t->_key_size == key_size, "Key type size does not match hash table initted key type size");
+
+	s64 found = hash_table_find_slot(t, hash, k);
+	if (found == -1) return false;
+	
+	u64 mask = t->slot_count-1;
+	u64 removed_index = t->slots[found].entry_index-1;
+	
+	// Shift the rest of the probe run back one step so lookups don't stop early
+	u64 i = (u64)found;
+	while (true) {
+		u64 next = (i+1) & mask;
+		if (t->slots[next].entry_index == 0 || hash_table_probe_distance(t, next) == 0) break;
+		t->slots[i] = t->slots[next];
+		i = next;
+	}
+	t->slots[i] = ZERO(Hash_Table_Slot);
+	
+	if (t->_key_kind == HASH_TABLE_KEY_STRING) {
+		string *key = (string*)(hash_table_entry(t, removed_index)+hash_table_key_offset());
+		if (key->count) dealloc_string(t->allocator, *key);
+	}
+	
+	// Move the last entry into the hole & point its slot to the new place
+	u64 last_index = t->count-1;
+	if (removed_index != last_index) {
+		u8 *last = hash_table_entry(t, last_index);
+		u64 last_hash = *(u64*)last;
+		
+		u64 j = last_hash & mask;
+		while (t->slots[j].entry_index != last_index+1) j = (j+1) & mask;
+		t->slots[j].entry_index = (u32)(removed_index+1);
+		
+		memcpy(hash_table_entry(t, removed_index), last, t->_entry_size);
+	}
+	t->count -= 1;
+	
+	return true;
+}
@@ -0,0 +1,501 @@
+
+/*
+
+	Job system: a pool of worker threads that stay alive and run jobs, with work stealing.
+
+	Every worker (and the thread that called job_system_init) has its own queue of jobs (Chase-Lev
+	deque). New jobs go on the bottom of your own queue, you take from the bottom too so the last
+	job added runs first while its data is still in cache, and idle workers steal from the top of
+	everyone else's queue. Threads outside of the job system add to a shared queue instead.
+
+	Waiting on a Job_Counter doesn't block, the waiting thread runs jobs until the counter is 0.
+	So jobs can add more jobs and wait for them.
+
+	talloc in a job is scratch memory for that job, it's given back when the job returns. Workers
+	have their own temporary storage which starts at JOB_WORKER_TEMPORARY_STORAGE_SIZE.
+
+	job_system_init is called with 0 the first time you run a job, call it yourself before that if
+	you want another worker count. If several threads run their first job at the same time only one
+	of them starts it, and that one becomes the thread that has to shut it down. With 0 workers (1 logical processor) jobs just run right away.
+
+	Usage:
+
+		void update_thing(void *data) { ... }
+
+		Job_Counter counter = {0};
+		for (u64 i = 0; i < thing_count; i++) {
+			job_run(update_thing, &things[i], &counter);
+		}
+		job_counter_wait(&counter);
+
+		void update_entities(u64 first, u64 last, void *data) { ... }
+
+		// Splits [0, entity_count) into ranges of around 64 and returns when they're all done
+		parallel_for(0, entity_count, 64, update_entities, world);
+
+	Full API:
+
+		void job_system_init(u64 worker_count); // 0 means one per logical processor, minus this thread
+		void job_system_shutdown(); // Waits for workers to finish, runs what's left on this thread
+		u64  job_system_get_worker_count();
+
+		void job_run(Job_Proc proc, void *data, Job_Counter *counter); // counter can be 0
+
+		void job_counter_wait(Job_Counter *counter);
+		bool job_counter_is_done(Job_Counter *counter);
+
+		void parallel_for(u64 first, u64 last, u64 grain_size, Parallel_For_Proc proc, void *data);
+
+*/
+
+#define JOB_MAX_WORKERS 63 // Sleeping workers are bits in a u64, +1 for the thread that started it
+#define JOB_QUEUE_CAPACITY 2048 // Power of two. If a queue is full the job runs right away instead.
+#ifndef JOB_WORKER_TEMPORARY_STORAGE_SIZE
+	#define JOB_WORKER_TEMPORARY_STORAGE_SIZE KB(256)
+#endif
+// Idle workers look for jobs this many times before yielding, and yield this many times before sleeping
+#define JOB_WORKER_SPIN_COUNT 256
+#define JOB_WORKER_YIELD_COUNT 16
+
+typedef void(*Job_Proc)(void *data);
+typedef void(*Parallel_For_Proc)(u64 first, u64 last, void *data);
+
+typedef struct Job_Counter {
+	volatile u64 pending;
+} Job_Counter;
+
+typedef struct Parallel_For {
+	Parallel_For_Proc proc;
+	void *data;
+	u64 grain_size;
+} Parallel_For;
+
+typedef struct Job {
+	Job_Proc proc;
+	void *data;
+	Job_Counter *counter;
+
+	// Set instead of proc for a range of a parallel_for
+	Parallel_For *parallel_for;
+	u64 first, last;
+} Job;
+
+typedef struct Job_Queue {
+	alignat(64) volatile u64 top; // Thieves take from here
+	alignat(64) volatile u64 bottom; // The owner adds and takes here
+	Job jobs[JOB_QUEUE_CAPACITY];
+} Job_Queue;
+
+typedef struct Job_Worker {
+	Job_Queue queue;
+	Thread thread;
+	Binary_Semaphore wake;
+	u64 index;
+	u64 random_state; // For picking who to steal from
+} Job_Worker;
+
+typedef enum Job_System_State {
+	JOB_SYSTEM_OFF = 0,
+	JOB_SYSTEM_STARTING,
+	JOB_SYSTEM_READY,
+} Job_System_State;
+
+typedef struct Job_System {
+	volatile u64 state; // Job_System_State
+	volatile bool shutting_down;
+	u64 worker_count;
+	Job_Worker *workers; // worker_count+1, [0] is the thread that called job_system_init and has no Thread
+	volatile u64 sleeping_mask; // Bit per worker
+
+	// For threads that aren't in the job system
+	Spinlock shared_lock;
+	u64 shared_first;
+	volatile u64 shared_count;
+	Job shared_jobs[JOB_QUEUE_CAPACITY];
+} Job_System;
+
+void ogb_instance
+job_system_init(u64 worker_count);
+
+void ogb_instance
+job_system_shutdown();
+
+u64 ogb_instance
+job_system_get_worker_count();
+
+void ogb_instance
+job_run(Job_Proc proc, void *data, Job_Counter *counter);
+
+void ogb_instance
+job_counter_wait(Job_Counter *counter);
+
+bool ogb_instance
+job_counter_is_done(Job_Counter *counter);
+
+void ogb_instance
+parallel_for(u64 first, u64 last, u64 grain_size, Parallel_For_Proc proc, void *data);
+
+// #Global
+ogb_instance Job_System job_system;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Job_System job_system = {0};
+thread_local s64 job_thread_index = -1; // Which worker this thread is, -1 if it's not one
+thread_local u64 job_thread_random_state = 0;
+
+///
+// Chase-Lev deque, "Dynamic Circular Work-Stealing Deque" but not dynamic: when it's full
+// push fails and the caller runs the job itself. Memory orders are from "Correct and Efficient
+// Work-Stealing for Weak Memory Models" (Lê et al.), on x86 only the seq_cst fences cost anything.
+// Sizes are (s64)(bottom - top) so bottom-1 wrapping around in pop is fine.
+
+bool job_queue_push(Job_Queue *q, Job *job) {
+	u64 b = atomic_load_64(&q->bottom, MEMORY_ORDER_RELAXED);
+	u64 t = atomic_load_64(&q->top, MEMORY_ORDER_ACQUIRE);
+	if (b - t >= JOB_QUEUE_CAPACITY) return false;
+
+	q->jobs[b & (JOB_QUEUE_CAPACITY-1)] = *job;
+	atomic_store_64(&q->bottom, b + 1, MEMORY_ORDER_RELEASE); // Thieves see the job before the new bottom
+	return true;
+}
+bool job_queue_pop(Job_Queue *q, Job *job) {
+	u64 b = atomic_load_64(&q->bottom, MEMORY_ORDER_RELAXED) - 1;
+	atomic_store_64(&q->bottom, b, MEMORY_ORDER_RELAXED);
+	// Thieves need to see the new bottom before we look at top, or we both take the last job
+	atomic_thread_fence(MEMORY_ORDER_SEQ_CST);
+	u64 t = atomic_load_64(&q->top, MEMORY_ORDER_RELAXED);
+
+	if ((s64)(b - t) < 0) {
+		atomic_store_64(&q->bottom, b + 1, MEMORY_ORDER_RELAXED);
+		return false;
+	}
+
+	*job = q->jobs[b & (JOB_QUEUE_CAPACITY-1)];
+	if (t == b) {
+		// Last job, race the thieves for it
+		bool won = atomic_compare_exchange_64(&q->top, &t, t + 1, MEMORY_ORDER_SEQ_CST);
+		atomic_store_64(&q->bottom, b + 1, MEMORY_ORDER_RELAXED);
+		return won;
+	}
+	return true;
+}
+// Can fail even if there are jobs when another thread got there first
+bool job_queue_steal(Job_Queue *q, Job *job) {
+	u64 t = atomic_load_64(&q->top, MEMORY_ORDER_ACQUIRE);
+	atomic_thread_fence(MEMORY_ORDER_SEQ_CST);
+	u64 b = atomic_load_64(&q->bottom, MEMORY_ORDER_ACQUIRE);
+	if ((s64)(b - t) <= 0) return false;
+
+	// The owner can't write over this slot before we take it, it never gets more than
+	// JOB_QUEUE_CAPACITY ahead of top. If someone else took it we just throw away what we read.
+	*job = q->jobs[t & (JOB_QUEUE_CAPACITY-1)];
+	return atomic_compare_exchange_64(&q->top, &t, t + 1, MEMORY_ORDER_SEQ_CST);
+}
+bool job_queue_maybe_has_jobs(Job_Queue *q) {
+	return (s64)(atomic_load_64(&q->bottom, MEMORY_ORDER_RELAXED) - atomic_load_64(&q->top, MEMORY_ORDER_RELAXED)) > 0;
+}
+
+bool job_shared_push(Job *job) {
+	bool ok = false;
+	spinlock_acquire_or_wait(&job_system.shared_lock);
+	if (job_system.shared_count < JOB_QUEUE_CAPACITY) {
+		u64 index = (job_system.shared_first + job_system.shared_count) & (JOB_QUEUE_CAPACITY-1);
+		job_system.shared_jobs[index] = *job;
+		job_system.shared_count += 1;
+		ok = true;
+	}
+	spinlock_release(&job_system.shared_lock);
+	return ok;
+}
+bool job_shared_pop(Job *job) {
+	if (!job_system.shared_count) return false;
+
+	bool ok = false;
+	spinlock_acquire_or_wait(&job_system.shared_lock);
+	if (job_system.shared_count) {
+		*job = job_system.shared_jobs[job_system.shared_first];
+		job_system.shared_first = (job_system.shared_first + 1) & (JOB_QUEUE_CAPACITY-1);
+		job_system.shared_count -= 1;
+		ok = true;
+	}
+	spinlock_release(&job_system.shared_lock);
+	return ok;
+}
+
+inline u64
+job_next_random(u64 *state) {
+	// xorshift64
+	u64 x = *state ? *state : 0x9E3779B97F4A7C15ull;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+	return x;
+}
+
+// Own queue first, then the shared queue, then steal starting from someone random
+bool job_get(Job *job) {
+	s64 self = job_thread_index;
+	if (self >= 0 && job_queue_pop(&job_system.workers[self].queue, job)) return true;
+	if (job_shared_pop(job)) return true;
+
+	u64 queue_count = job_system.worker_count + 1;
+	u64 *random_state = self >= 0 ? &job_system.workers[self].random_state : &job_thread_random_state;
+	u64 start = job_next_random(random_state) % queue_count;
+	for (u64 i = 0; i < queue_count; i++) {
+		u64 victim = (start + i) % queue_count;
+		if ((s64)victim == self) continue;
+		if (job_queue_steal(&job_system.workers[victim].queue, job)) return true;
+	}
+	return false;
+}
+
+bool job_any_available() {
+	if (job_system.shared_count) return true;
+	for (u64 i = 0; i <= job_system.worker_count; i++) {
+		if (job_queue_maybe_has_jobs(&job_system.workers[i].queue)) return true;
+	}
+	return false;
+}
+
+void job_wake_one() {
+	// The new job has to be visible before we look at who's sleeping, pairs with job_worker_sleep
+	atomic_thread_fence(MEMORY_ORDER_SEQ_CST);
+	while (true) {
+		u64 mask = atomic_load_64(&job_system.sleeping_mask, MEMORY_ORDER_RELAXED);
+		if (!mask) return;
+		u64 bit = 1ull << bit_scan_forward_64(mask);
+		// Whoever clears the bit wakes that worker
+		if (atomic_fetch_and_64(&job_system.sleeping_mask, ~bit, MEMORY_ORDER_SEQ_CST) & bit) {
+			os_binary_semaphore_signal(&job_system.workers[bit_scan_forward_64(bit)].wake);
+			return;
+		}
+	}
+}
+
+void job_worker_sleep(Job_Worker *w) {
+	u64 bit = 1ull << w->index;
+	atomic_fetch_or_64(&job_system.sleeping_mask, bit, MEMORY_ORDER_SEQ_CST);
+
+	// A job could have been added after we last looked but before our bit was set
+	if (job_any_available() || job_system.shutting_down) {
+		// If somebody already took our bit and signaled, we'll just wake up for nothing once later
+		atomic_fetch_and_64(&job_system.sleeping_mask, ~bit, MEMORY_ORDER_RELAXED);
+		return;
+	}
+
+	os_binary_semaphore_wait(&w->wake);
+}
+
+void parallel_for_run_range(Parallel_For *pf, u64 first, u64 last, Job_Counter *counter);
+
+void job_execute(Job *job) {
+	temp_scope() {
+		if (job->parallel_for) {
+			parallel_for_run_range(job->parallel_for, job->first, job->last, job->counter);
+		} else {
+			job->proc(job->data);
+		}
+	}
+	if (job->counter) atomic_fetch_add_64(&job->counter->pending, -1, MEMORY_ORDER_RELEASE);
+}
+
+void job_push(Job *job) {
+	if (job->counter) atomic_fetch_add_64(&job->counter->pending, 1, MEMORY_ORDER_RELAXED);
+
+	bool pushed = false;
+	if (job_system.worker_count > 0) {
+		if (job_thread_index >= 0) pushed = job_queue_push(&job_system.workers[job_thread_index].queue, job);
+		else                       pushed = job_shared_push(job);
+	}
+
+	if (pushed) job_wake_one();
+	else        job_execute(job);
+}
+
+void job_worker_proc(Thread *t) {
+	Job_Worker *w = (Job_Worker*)t->data;
+	job_thread_index = (s64)w->index;
+
+	u64 idle = 0;
+	while (!job_system.shutting_down) {
+		Job job;
+		if (job_get(&job)) {
+			job_execute(&job);
+			idle = 0;
+			continue;
+		}
+
+		idle += 1;
+		if (idle < JOB_WORKER_SPIN_COUNT) {
+			_mm_pause();
+		} else if (idle < JOB_WORKER_SPIN_COUNT + JOB_WORKER_YIELD_COUNT) {
+			os_yield_thread();
+		} else {
+			job_worker_sleep(w);
+			idle = 0;
+		}
+	}
+}
+
+inline bool job_system_is_ready() {
+	return atomic_load_64(&job_system.state, MEMORY_ORDER_ACQUIRE) == JOB_SYSTEM_READY;
+}
+
+// Expects state to be JOB_SYSTEM_STARTING, set by whoever won the compare exchange
+void job_system_start(u64 worker_count) {
+	if (worker_count == 0) worker_count = os_get_number_of_logical_processors() - 1;
+	worker_count = min(worker_count, JOB_MAX_WORKERS);
+
+	Allocator heap = get_tagged_heap_allocator(MEMORY_TAG_ENGINE);
+
+	job_system.shutting_down = false;
+	job_system.worker_count = worker_count;
+	job_system.sleeping_mask = 0;
+	job_system.shared_first = 0;
+	job_system.shared_count = 0;
+	spinlock_init(&job_system.shared_lock);
+
+	job_system.workers = (Job_Worker*)alloc(heap, (worker_count+1)*sizeof(Job_Worker));
+	memset(job_system.workers, 0, (worker_count+1)*sizeof(Job_Worker));
+	for (u64 i = 0; i <= worker_count; i++) {
+		Job_Worker *w = &job_system.workers[i];
+		w->index = i;
+		w->random_state = rdtsc() + i*0x9E3779B97F4A7C15ull;
+		os_binary_semaphore_init(&w->wake, false);
+	}
+
+	job_thread_index = 0;
+	atomic_store_64(&job_system.state, JOB_SYSTEM_READY, MEMORY_ORDER_RELEASE);
+
+	for (u64 i = 1; i <= worker_count; i++) {
+		Job_Worker *w = &job_system.workers[i];
+		os_thread_init(&w->thread, job_worker_proc);
+		w->thread.data = w;
+		w->thread.temporary_storage_size = JOB_WORKER_TEMPORARY_STORAGE_SIZE;
+		os_thread_start(&w->thread);
+	}
+}
+
+void job_system_init(u64 worker_count) {
+	u64 expected = JOB_SYSTEM_OFF;
+	bool won = atomic_compare_exchange_64(&job_system.state, &expected, JOB_SYSTEM_STARTING, MEMORY_ORDER_ACQ_REL);
+	assert(won, "Job system is already initialized");
+	job_system_start(worker_count);
+}
+
+// The first job can come from several threads at once, only the one that wins the
+// compare exchange starts the job system and the others wait for it.
+void job_system_init_if_needed() {
+	if (job_system_is_ready()) return;
+
+	u64 expected = JOB_SYSTEM_OFF;
+	if (atomic_compare_exchange_64(&job_system.state, &expected, JOB_SYSTEM_STARTING, MEMORY_ORDER_ACQ_REL)) {
+		job_system_start(0);
+		return;
+	}
+	while (!job_system_is_ready()) os_yield_thread();
+}
+
+void job_system_shutdown() {
+	if (!job_system_is_ready()) return;
+	assert(job_thread_index == 0, "Only the thread that called job_system_init can shut it down");
+
+	job_system.shutting_down = true;
+	for (u64 i = 1; i <= job_system.worker_count; i++) {
+		os_binary_semaphore_signal(&job_system.workers[i].wake);
+	}
+	for (u64 i = 1; i <= job_system.worker_count; i++) {
+		os_thread_join(&job_system.workers[i].thread);
+	}
+
+	// Whatever nobody got to
+	Job job;
+	while (job_get(&job)) job_execute(&job);
+
+	for (u64 i = 0; i <= job_system.worker_count; i++) {
+		os_binary_semaphore_destroy(&job_system.workers[i].wake);
+	}
+	dealloc(get_tagged_heap_allocator(MEMORY_TAG_ENGINE), job_system.workers);
+
+	job_system.workers = 0;
+	job_system.worker_count = 0;
+	job_thread_index = -1;
+	atomic_store_64(&job_system.state, JOB_SYSTEM_OFF, MEMORY_ORDER_RELEASE);
+}
+
+u64 job_system_get_worker_count() {
+	job_system_init_if_needed();
+	return job_system.worker_count;
+}
+
+void job_run(Job_Proc proc, void *data, Job_Counter *counter) {
+	job_system_init_if_needed();
+
+	Job job = {0};
+	job.proc = proc;
+	job.data = data;
+	job.counter = counter;
+	job_push(&job);
+}
+
+bool job_counter_is_done(Job_Counter *counter) {
+	return atomic_load_64(&counter->pending, MEMORY_ORDER_ACQUIRE) == 0;
+}
+
+void job_counter_wait(Job_Counter *counter) {
+	u64 idle = 0;
+	while (atomic_load_64(&counter->pending, MEMORY_ORDER_ACQUIRE)) {
+		Job job;
+		if (job_system_is_ready() && job_get(&job)) {
+			job_execute(&job);
+			idle = 0;
+		} else if (idle < JOB_WORKER_SPIN_COUNT) {
+			_mm_pause();
+			idle += 1;
+		} else {
+			// Whoever has the last job might need this core
+			os_yield_thread();
+		}
+	}
+}
+
+// Give away the back half until we're down to one grain. The halves at the top of the queue are
+// the biggest, which is what thieves take, so there's little stealing once everyone has work.
+void parallel_for_run_range(Parallel_For *pf, u64 first, u64 last, Job_Counter *counter) {
+	while (last - first > pf->grain_size) {
+		u64 middle = first + (last - first)/2;
+
+		Job job = {0};
+		job.parallel_for = pf;
+		job.first = middle;
+		job.last = last;
+		job.counter = counter;
+		job_push(&job);
+
+		last = middle;
+	}
+	pf->proc(first, last, pf->data);
+}
+
+void parallel_for(u64 first, u64 last, u64 grain_size, Parallel_For_Proc proc, void *data) {
+	if (last <= first) return;
+	job_system_init_if_needed();
+
+	grain_size = max(grain_size, 1);
+	if (job_system.worker_count == 0 || last - first <= grain_size) {
+		proc(first, last, data);
+		return;
+	}
+
+	Parallel_For pf;
+	pf.proc = proc;
+	pf.data = data;
+	pf.grain_size = grain_size;
+
+	Job_Counter counter = {0};
+	parallel_for_run_range(&pf, first, last, &counter);
+	job_counter_wait(&counter);
+}
+
+#endif
@@ -43,57 +43,343 @@ Allocator get_initialization_allocator() {
 
 ///
 ///
-// Basic general heap allocator, free list
+// Memory tracking
 ///
-// Technically thread safe but synchronization is horrible.
-// Fragmentation is catastrophic.
-// We could fix it by merging free nodes every now and then
+// Compile with ENABLE_MEMORY_TRACKING 1 to see who owns heap memory. Every heap allocation
+// gets a Memory_Tag and we keep live/peak bytes & alloc/free rates per tag, a list of what's
+// still allocated for the leak report at exit, and optionally the call site of each allocation.
+// Compiled out (the default) none of this exists, the heap metadata doesn't grow and the
+// functions & macros below are no-ops.
+//
+// Tag allocations with get_tagged_heap_allocator(MEMORY_TAG_AUDIO), or a whole piece of code with
+//     memory_tag_scope(MEMORY_TAG_WORLD) {
+//         ... untagged heap allocations in here get MEMORY_TAG_WORLD
+//     }
+// Call memory_tracking_update() once a frame for the rates & google_trace counters.
+//
+// Temporary storage is tagged per block, not per talloc.
+
+#ifndef MEMORY_TRACK_MAX_FRAMES
+	#define MEMORY_TRACK_MAX_FRAMES 8
+#endif
+
+typedef enum Memory_Tag {
+	MEMORY_TAG_NONE, // Use whatever memory_tag_scope we are in
+	MEMORY_TAG_UNTAGGED,
+	MEMORY_TAG_ENGINE,
+	MEMORY_TAG_RENDERER,
+	MEMORY_TAG_AUDIO,
+	MEMORY_TAG_FONTS,
+	MEMORY_TAG_WORLD,
+	MEMORY_TAG_TEMP,
+	MEMORY_TAG_GAME,
+	
+	MEMORY_TAG_COUNT
+} Memory_Tag;
+
+const char *memory_tag_names[MEMORY_TAG_COUNT] = {
+	"none", "untagged", "engine", "renderer", "audio", "fonts", "world", "temp", "game",
+};
+
+typedef struct Memory_Tag_Stats {
+	u64 live_bytes; // What was asked for, not including heap metadata
+	u64 live_count;
+	u64 peak_bytes;
+	u64 alloc_count; // Since start
+	u64 free_count;
+	u64 allocated_bytes_total;
+	f64 allocs_per_second; // Over the last memory_tracking_update() interval
+	f64 frees_per_second;
+} Memory_Tag_Stats;
+
+typedef struct Heap_Allocation_Metadata Heap_Allocation_Metadata;
+typedef struct Memory_Track_Record {
+	Heap_Allocation_Metadata *next;
+	Heap_Allocation_Metadata *prev;
+	u64 size;
+	u32 tag;
+	u32 frame_count;
+	void *frames[MEMORY_TRACK_MAX_FRAMES];
+} Memory_Track_Record;
+
+ogb_instance Allocator
+get_tagged_heap_allocator(Memory_Tag tag);
+
+ogb_instance Memory_Tag_Stats
+get_memory_tag_stats(Memory_Tag tag);
+
+#if ENABLE_MEMORY_TRACKING
+
+// #Global
+ogb_instance thread_local u64 memory_tag_current;
+ogb_instance bool memory_tracking_capture_call_sites; // Slow, off by default
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+thread_local u64 memory_tag_current = MEMORY_TAG_UNTAGGED;
+bool memory_tracking_capture_call_sites = false;
+#endif
+
+#define memory_tag_scope(tag) \
+	for (u64 _prev_memory_tag = memory_tag_current, _memory_tag_once = (memory_tag_current = (tag), 1); \
+	     _memory_tag_once; \
+	     _memory_tag_once = 0, memory_tag_current = _prev_memory_tag)
+
+ogb_instance void
+memory_tracking_update();
+
+// Prints everything that is still allocated, biggest first (with call sites if we captured them)
+ogb_instance void
+memory_tracking_report_leaks();
+
+void memory_track_alloc(Heap_Allocation_Metadata *chunk, u64 size, u64 tag);
+void memory_track_free(Heap_Allocation_Metadata *chunk);
+void memory_track_resize(Heap_Allocation_Metadata *chunk, u64 size);
+u64 memory_track_tag(Heap_Allocation_Metadata *chunk);
+
+#else
+
+#define memory_tag_scope(...)
+#define memory_tracking_update(...)
+#define memory_tracking_report_leaks(...)
+#define memory_track_alloc(...)
+#define memory_track_free(...)
+#define memory_track_resize(...)
+#define memory_track_tag(...) MEMORY_TAG_NONE
+
+#endif
+
+///
+///
+// Basic general heap allocator, segregated free lists
+///
+// Two-level segregated fit (like TLSF).
+// Free chunks are kept in lists by size class. The first level is the power of two range
+// and the second level splits that range into HEAP_SL_COUNT linear steps. Everything below
+// HEAP_SMALL_SIZE gets exact 16 byte size classes.
+// Bitmaps tell us which lists have anything in them, so finding a fit is a couple of bit
+// scans instead of walking free nodes. Every chunk knows the size of the chunk before it in
+// memory, so coalescing on free is O(1) too.
+//
+// Technically thread safe but synchronization is horrible (one lock for everything).
 // BUT: We aren't really supposed to allocate/deallocate directly on the heap too much anyways...
 
 #define MAX_HEAP_BLOCK_SIZE align_next(MB(500), os.page_size)
 #define DEFAULT_HEAP_BLOCK_SIZE (min(MAX_HEAP_BLOCK_SIZE, program_memory_capacity))
-#define HEAP_ALIGNMENT (sizeof(Heap_Free_Node))
+#define HEAP_ALIGNMENT 16
+#define HEAP_ALIGNMENT_LOG2 4
+
+#define HEAP_SL_LOG2    5
+#define HEAP_SL_COUNT   (1ull << HEAP_SL_LOG2)
+#define HEAP_FL_SHIFT   (HEAP_SL_LOG2 + HEAP_ALIGNMENT_LOG2)
+#define HEAP_SMALL_SIZE (1ull << HEAP_FL_SHIFT)
+#define HEAP_FL_MAX     38 // Chunks must be smaller than 2^HEAP_FL_MAX (256GB)
+#define HEAP_FL_COUNT   (HEAP_FL_MAX - HEAP_FL_SHIFT + 1)
+
 typedef struct Heap_Free_Node Heap_Free_Node;
 typedef struct Heap_Block Heap_Block;
-
-typedef struct Heap_Free_Node {
-	u64 size;
-	Heap_Free_Node *next;
-} Heap_Free_Node;
+typedef struct Heap_Allocation_Metadata Heap_Allocation_Metadata;
 
 typedef struct Heap_Block {
 	u64 size;
-	Heap_Free_Node *free_head;
 	void* start;
 	Heap_Block *next;
+	u64 padding;
 	// 32 bytes !!
 #if CONFIGURATION == DEBUG
 	u64 total_allocated;
-	u64 padding;
+	u64 padding2;
 #endif
 } Heap_Block;
 
-#define HEAP_META_SIGNATURE 6969694206942069ull
+// Low bits of Heap_Allocation_Metadata.size
+#define HEAP_CHUNK_FREE      1ull // This chunk is free
+#define HEAP_CHUNK_PREV_FREE 2ull // The chunk before this one in memory is free
+#define HEAP_CHUNK_LARGE     4ull // Not in a heap block, has its own OS reservation (see Large allocations)
+#define HEAP_CHUNK_DECOMMITTED 8ull // Free chunk that might have decommitted pages in it (see Freed pages)
+#define HEAP_CHUNK_FLAGS     (HEAP_CHUNK_FREE | HEAP_CHUNK_PREV_FREE | HEAP_CHUNK_LARGE | HEAP_CHUNK_DECOMMITTED)
+// High bits of Heap_Allocation_Metadata.size are the id of the thread cache the chunk belongs to (0 for none)
+#define HEAP_CHUNK_OWNER_SHIFT 48
+#define HEAP_CHUNK_SIZE_MASK   (((1ull << HEAP_CHUNK_OWNER_SHIFT)-1) & ~HEAP_CHUNK_FLAGS)
+
+#define HEAP_META_SIGNATURE   6969694206942069ull
+#define HEAP_CACHED_SIGNATURE 4206942069696969ull // Freed but sitting in a thread cache
 typedef alignat(16) struct Heap_Allocation_Metadata {
-	u64 size;
-	Heap_Block *block;
+	u64 prev_size; // Size of the chunk before this one in memory (0 if first in block)
+	u64 size;      // Size of this chunk including metadata, HEAP_CHUNK_xxx flags in low bits, owner in high bits
 #if CONFIGURATION == DEBUG
-	u64 signature;
-	u64 padding;
+	Heap_Block *block;
+	u64 signature; // Cleared when freed
+#endif
+#if ENABLE_MEMORY_TRACKING
+	Memory_Track_Record track;
 #endif
 } Heap_Allocation_Metadata;
 
+// Lives right after the metadata in free chunks
+typedef struct Heap_Free_Node {
+	Heap_Allocation_Metadata *next;
+	Heap_Allocation_Metadata *prev;
+} Heap_Free_Node;
+
+#define HEAP_MIN_CHUNK_SIZE (sizeof(Heap_Allocation_Metadata)+sizeof(Heap_Free_Node))
+
+///
+// Large allocations
+// Anything at or above HEAP_LARGE_ALLOCATION_SIZE gets its own reservation from the OS and is
+// released straight back to the OS on free. That way big asset buffers don't chop up the heap
+// blocks, and there's no size limit. We reserve more address space than asked for (nothing is
+// backed until committed) so growing one with realloc can usually just commit more pages.
+#ifndef HEAP_LARGE_ALLOCATION_SIZE
+	#define HEAP_LARGE_ALLOCATION_SIZE MB(1)
+#endif
+#define HEAP_LARGE_RESERVE_FACTOR 4
+
+typedef struct Heap_Large_Allocation Heap_Large_Allocation;
+typedef alignat(16) struct Heap_Large_Allocation {
+	Heap_Large_Allocation *next;
+	Heap_Large_Allocation *prev;
+	u64 reserved;
+	u64 committed;
+	// Heap_Allocation_Metadata comes right after, then the memory
+} Heap_Large_Allocation;
+
+///
+// Freed pages
+// Freed memory is left alone on dealloc, no syscalls. Once a frame (from os_update)
+// heap_decommit_free_pages gives the whole pages inside big free chunks back to the OS.
+// It only does that to chunks that have sat there unchanged for HEAP_DECOMMIT_DELAY_PASSES
+// passes, so memory that's reused every frame doesn't bounce between committed & decommitted,
+// and it stops after HEAP_DECOMMIT_BUDGET bytes per pass.
+// Pages are committed again when an allocation takes them (which costs nothing on linux).
+//
+// HEAP_GUARD_FREED_PAGES 1, or heap_set_guard_freed_pages(true), locks the whole pages inside
+// free chunks instead, so touching freed memory crashes right away. Great for hunting
+// use-after-free but it's an mprotect/VirtualProtect on almost every alloc & free.
+// Decommitting is off while guarding.
+#ifndef HEAP_GUARD_FREED_PAGES
+	#define HEAP_GUARD_FREED_PAGES 0
+#endif
+#ifndef HEAP_DECOMMIT_MIN_SIZE
+	#define HEAP_DECOMMIT_MIN_SIZE KB(256) // Smaller free chunks keep their pages
+#endif
+#ifndef HEAP_DECOMMIT_DELAY_PASSES
+	#define HEAP_DECOMMIT_DELAY_PASSES 60
+#endif
+#ifndef HEAP_DECOMMIT_BUDGET
+	#define HEAP_DECOMMIT_BUDGET MB(64)
+#endif
+#define HEAP_DECOMMIT_MAX_CANDIDATES 64
+
+// A big free chunk we've seen in the last pass
+typedef struct Heap_Decommit_Candidate {
+	Heap_Allocation_Metadata *chunk;
+	u64 size;
+	u64 passes; // How many passes in a row it's been free with this size
+	bool decommitted;
+} Heap_Decommit_Candidate;
+
+typedef struct Heap_Free_Lists {
+	u64 fl_bitmap;
+	u32 sl_bitmap[HEAP_FL_COUNT];
+	Heap_Allocation_Metadata *heads[HEAP_FL_COUNT][HEAP_SL_COUNT];
+} Heap_Free_Lists;
+
+///
+// Thread caches
+// Small chunks are cached per thread so most allocations & frees don't touch the heap lock.
+// Caches are refilled from and flushed back to the heap in batches, one lock per batch.
+// A chunk remembers which cache it was handed out from. If another thread frees it, it's
+// pushed back to that cache through a lock-free stack which the owner drains when it runs dry.
+#define HEAP_CACHE_MAX_CHUNK_LOG2 12
+#define HEAP_CACHE_MAX_CHUNK_SIZE (1ull << HEAP_CACHE_MAX_CHUNK_LOG2)
+#define HEAP_CACHE_CLASS_COUNT    ((HEAP_CACHE_MAX_CHUNK_LOG2-HEAP_FL_SHIFT+1)*HEAP_SL_COUNT)
+#define HEAP_CACHE_BATCH_BYTES    KB(8)
+#define HEAP_MAX_THREAD_CACHES    1024
+
+typedef struct Heap_Thread_Cache {
+	Heap_Allocation_Metadata *lists[HEAP_CACHE_CLASS_COUNT];
+	u32 counts[HEAP_CACHE_CLASS_COUNT];
+	volatile u64 remote_free_head; // Heap_Allocation_Metadata*, pushed by other threads
+	u64 cached_bytes;
+	u64 id;
+	volatile bool active;
+} Heap_Thread_Cache;
+
+typedef struct Heap_Stats {
+	u64 block_count;
+	u64 reserved_bytes;  // Sum of all heap block sizes
+	u64 allocated_bytes; // Allocated chunks, including metadata, alignment and chunks sitting in thread caches
+	u64 allocation_count;
+	u64 thread_cached_bytes;
+	u64 thread_cache_count;
+	u64 free_bytes;
+	u64 free_chunk_count;
+	u64 largest_free_chunk;
+	u64 realloc_count;
+	u64 realloc_in_place_count; // Grew into the next free chunk, shrunk, or already fit
+	u64 realloc_copied_bytes;   // What the rest had to memcpy
+	u64 large_allocation_count;
+	u64 large_committed_bytes;  // Including the headers. Not in allocated_bytes or reserved_bytes
+	u64 large_reserved_bytes;
+	u64 page_protect_calls;  // Guard page locks & unlocks
+	u64 page_commit_calls;
+	u64 page_decommit_calls;
+	u64 decommitted_bytes;   // Total given back by heap_decommit_free_pages
+} Heap_Stats;
+
 // #Global
 ogb_instance Heap_Block *heap_head;
 ogb_instance bool heap_initted;
 ogb_instance Spinlock heap_lock;
+ogb_instance Heap_Free_Lists heap_free_lists;
+ogb_instance u64 heap_allocated_bytes;
+ogb_instance u64 heap_allocation_count;
+ogb_instance u64 heap_realloc_count;
+ogb_instance u64 heap_realloc_in_place_count;
+ogb_instance u64 heap_realloc_copied_bytes;
+ogb_instance Spinlock heap_large_lock;
+ogb_instance Heap_Large_Allocation *heap_large_head;
+ogb_instance u64 heap_large_allocation_count;
+ogb_instance u64 heap_large_committed_bytes;
+ogb_instance u64 heap_large_reserved_bytes;
+ogb_instance bool heap_guard_freed_pages;
+ogb_instance Heap_Decommit_Candidate heap_decommit_candidates[HEAP_DECOMMIT_MAX_CANDIDATES];
+ogb_instance u64 heap_decommit_candidate_count;
+ogb_instance u64 heap_page_protect_calls;
+ogb_instance u64 heap_page_commit_calls;
+ogb_instance u64 heap_page_decommit_calls;
+ogb_instance u64 heap_decommitted_bytes;
+ogb_instance Heap_Thread_Cache *heap_thread_caches[HEAP_MAX_THREAD_CACHES];
+ogb_instance u64 heap_thread_cache_count;
+ogb_instance thread_local Heap_Thread_Cache *heap_thread_cache;
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 Heap_Block *heap_head;
 bool heap_initted = false;
 Spinlock heap_lock;
+Heap_Free_Lists heap_free_lists;
+u64 heap_allocated_bytes = 0;
+u64 heap_allocation_count = 0;
+u64 heap_realloc_count = 0;
+u64 heap_realloc_in_place_count = 0;
+u64 heap_realloc_copied_bytes = 0;
+Spinlock heap_large_lock;
+Heap_Large_Allocation *heap_large_head = 0;
+u64 heap_large_allocation_count = 0;
+u64 heap_large_committed_bytes = 0;
+u64 heap_large_reserved_bytes = 0;
+bool heap_guard_freed_pages = HEAP_GUARD_FREED_PAGES;
+Heap_Decommit_Candidate heap_decommit_candidates[HEAP_DECOMMIT_MAX_CANDIDATES];
+u64 heap_decommit_candidate_count = 0;
+u64 heap_page_protect_calls = 0;
+u64 heap_page_commit_calls = 0;
+u64 heap_page_decommit_calls = 0;
+u64 heap_decommitted_bytes = 0;
+Heap_Thread_Cache *heap_thread_caches[HEAP_MAX_THREAD_CACHES];
+u64 heap_thread_cache_count = 1; // 0 means no owner
+thread_local Heap_Thread_Cache *heap_thread_cache = 0;
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
-	
+
 
 u64 get_heap_block_size_excluding_metadata(Heap_Block *block) {
 	return block->size - sizeof(Heap_Block);
@@ -113,8 +399,35 @@ bool is_pointer_in_stack(void* p) {
 bool is_pointer_in_static_memory(void* p) {
     return (uintptr_t)p >= (uintptr_t)os.static_memory_start && (uintptr_t)p < (uintptr_t)os.static_memory_end;
 }
+bool is_pointer_in_large_allocation(void *p);
 bool is_pointer_valid(void *p) {
-	return is_pointer_in_program_memory(p) || is_pointer_in_stack(p) || is_pointer_in_static_memory(p);
+	return is_pointer_in_program_memory(p) || is_pointer_in_stack(p) || is_pointer_in_static_memory(p) || is_pointer_in_large_allocation(p);
+}
+
+inline u64
+heap_chunk_size(Heap_Allocation_Metadata *chunk) {
+	return chunk->size & HEAP_CHUNK_SIZE_MASK;
+}
+inline u64
+heap_chunk_owner(Heap_Allocation_Metadata *chunk) {
+	return chunk->size >> HEAP_CHUNK_OWNER_SHIFT;
+}
+inline Heap_Allocation_Metadata *
+heap_chunk_next(Heap_Allocation_Metadata *chunk) {
+	return (Heap_Allocation_Metadata*)((u8*)chunk + heap_chunk_size(chunk));
+}
+inline Heap_Allocation_Metadata *
+heap_chunk_prev(Heap_Allocation_Metadata *chunk) {
+	return (Heap_Allocation_Metadata*)((u8*)chunk - chunk->prev_size);
+}
+inline Heap_Free_Node *
+heap_chunk_free_node(Heap_Allocation_Metadata *chunk) {
+	return (Heap_Free_Node*)((u8*)chunk + sizeof(Heap_Allocation_Metadata));
+}
+// The chunk at the end of each block. Zero size and never free so we don't coalesce past it.
+inline Heap_Allocation_Metadata *
+heap_block_end_chunk(Heap_Block *block) {
+	return (Heap_Allocation_Metadata*)((u8*)block + block->size - sizeof(Heap_Allocation_Metadata));
 }
 
 // Meant for debug
@@ -126,117 +439,223 @@ void sanity_check_block(Heap_Block *block) {
 	assert(block->size < GB(256), "A heap block is corrupt.");
 	assert(block->size >= INITIAL_PROGRAM_MEMORY_SIZE, "A heap block is corrupt.");
 	assert((u64)block->start == (u64)block + sizeof(Heap_Block), "A heap block is corrupt.");
-	
 
-	Heap_Free_Node *node = block->free_head;	
-	
+	Heap_Allocation_Metadata *end = heap_block_end_chunk(block);
+	Heap_Allocation_Metadata *chunk = (Heap_Allocation_Metadata*)block->start;
+	u64 prev_size = 0;
+	bool prev_free = false;
+
 	u64 total_free = 0;
-	while (node != 0) {
-		Heap_Free_Node *other_node = node->next;
-		
-		assert(node->size < GB(256), "Heap is corrupt");
-		assert(is_pointer_in_program_memory(node), "Heap is corrupt");
-		
-		while (other_node != 0) {
-			assert(is_pointer_in_program_memory(other_node), "Heap is corrupt");
-			assert(other_node != node, "Circular reference in heap free node tree. This is probably an internal error, or an extremely unlucky result from heap corruption.");
-			other_node = other_node->next;
+	u64 total_used = 0;
+	while (chunk != end) {
+		assert((u8*)chunk < (u8*)end, "Heap is corrupt, chunk is past the end of its block");
+
+		u64 size = heap_chunk_size(chunk);
+		bool is_free = (chunk->size & HEAP_CHUNK_FREE) != 0;
+
+		assert(size >= HEAP_MIN_CHUNK_SIZE && size % HEAP_ALIGNMENT == 0, "Heap is corrupt, bad chunk size");
+		assert(chunk->prev_size == prev_size, "Heap is corrupt, prev_size does not match previous chunk");
+		assert(((chunk->size & HEAP_CHUNK_PREV_FREE) != 0) == prev_free, "Heap is corrupt, HEAP_CHUNK_PREV_FREE is wrong");
+		assert(chunk->block == block, "Heap is corrupt, chunk has the wrong block");
+		if (is_free) {
+			assert(!prev_free, "Two free chunks next to each other should have been coalesced. This is probably an internal error.");
+			Heap_Free_Node *node = heap_chunk_free_node(chunk);
+			if (node->next) { assert(is_pointer_in_program_memory(node->next), "Heap is corrupt, bad free node"); }
+			if (node->prev) { assert(is_pointer_in_program_memory(node->prev), "Heap is corrupt, bad free node"); }
+			total_free += size;
+		} else {
+			assert(chunk->signature == HEAP_META_SIGNATURE || chunk->signature == HEAP_CACHED_SIGNATURE, "Heap is corrupt, bad signature on allocated chunk");
+			total_used += size;
 		}
-		total_free += node->size;
-		assert(total_free <= block->size, "Free nodes are fucky wucky. This might be heap corruption, or possibly an internal error.");
-		node = node->next;
+
+		prev_size = size;
+		prev_free = is_free;
+		chunk = heap_chunk_next(chunk);
 	}
-	
-	u64 expected_size = get_heap_block_size_excluding_metadata(block);
-	assert(block->total_allocated+total_free == expected_size, "Heap is corrupt.")
+	assert(end->prev_size == prev_size, "Heap is corrupt, bad end chunk");
+
+	u64 expected_size = get_heap_block_size_excluding_metadata(block) - sizeof(Heap_Allocation_Metadata);
+	assert(total_used+total_free == expected_size, "Heap is corrupt.");
+	assert(block->total_allocated == total_used, "Heap is corrupt.");
 #endif
 }
 inline void check_meta(Heap_Allocation_Metadata *meta) {
 #if CONFIGURATION == DEBUG
-	assert(meta->signature == HEAP_META_SIGNATURE, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
+	assert(meta->signature == HEAP_META_SIGNATURE, "Heap error. Either 1) You passed a bad pointer to dealloc, 2) You freed the same pointer twice or 3) You corrupted the heap.");
+	if (!(meta->size & HEAP_CHUNK_LARGE)) {
+		assert(is_pointer_in_program_memory(meta->block), "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
+
+		assert((u64)meta >= (u64)meta->block->start && (u64)meta < (u64)meta->block+meta->block->size, "Heap error: Pointer is not in it's metadata block. This could be heap corruption but it's more likely an internal error. That's not good.");
+	}
 #endif
+	assert(!(meta->size & HEAP_CHUNK_FREE), "Heap error. Either 1) You freed the same pointer twice or 2) You corrupted the heap.");
 // If > 256GB then prolly not legit lol
-	assert(meta->size < 1024ULL*1024ULL*1024ULL*256ULL, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");	
-	assert(is_pointer_in_program_memory(meta->block), "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap."); 
+	assert(heap_chunk_size(meta) < 1024ULL*1024ULL*1024ULL*256ULL, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
+}
 
-	assert((u64)meta >= (u64)meta->block->start && (u64)meta < (u64)meta->block->start+meta->block->size, "Heap error: Pointer is not in it's metadata block. This could be heap corruption but it's more likely an internal error. That's not good.");
+///
+// Free lists
+
+inline void
+heap_size_to_list_index(u64 size, u64 *fl, u64 *sl) {
+	if (size < HEAP_SMALL_SIZE) {
+		*fl = 0;
+		*sl = size / HEAP_ALIGNMENT;
+	} else {
+		u64 msb = bit_scan_reverse_64(size);
+		*sl = (size >> (msb - HEAP_SL_LOG2)) ^ HEAP_SL_COUNT;
+		*fl = msb - HEAP_FL_SHIFT + 1;
+	}
 }
 
-typedef struct {
-	Heap_Free_Node *best_fit;
-	Heap_Free_Node *previous;
-	u64 delta;
-} Heap_Search_Result;
-Heap_Search_Result search_heap_block(Heap_Block *block, u64 size) {
-	
-	if (block->free_head == 0)  return (Heap_Search_Result){0, 0, 0};
-		
-	Heap_Free_Node *node = block->free_head;
-	Heap_Free_Node *previous = 0;
-	
-	Heap_Free_Node *best_fit = 0;
-	Heap_Free_Node *before_best_fit = 0;
-	u64 best_fit_delta = 0;
-	
-	while (node != 0) {
-		
-		if (node->size == size) {
-			Heap_Search_Result result;
-			result.best_fit = node;
-			result.previous = previous;
-			result.delta = 0;
-			assert(result.previous != result.best_fit, "Internal goof");
-			return result;
+void heap_insert_free_chunk(Heap_Allocation_Metadata *chunk) {
+	u64 fl, sl;
+	heap_size_to_list_index(heap_chunk_size(chunk), &fl, &sl);
+
+	Heap_Allocation_Metadata *head = heap_free_lists.heads[fl][sl];
+	Heap_Free_Node *node = heap_chunk_free_node(chunk);
+	node->next = head;
+	node->prev = 0;
+	if (head) heap_chunk_free_node(head)->prev = chunk;
+
+	heap_free_lists.heads[fl][sl] = chunk;
+	heap_free_lists.fl_bitmap     |= 1ull << fl;
+	heap_free_lists.sl_bitmap[fl] |= 1u << sl;
+}
+
+void heap_remove_free_chunk(Heap_Allocation_Metadata *chunk) {
+	u64 fl, sl;
+	heap_size_to_list_index(heap_chunk_size(chunk), &fl, &sl);
+
+	Heap_Free_Node *node = heap_chunk_free_node(chunk);
+	if (node->prev) heap_chunk_free_node(node->prev)->next = node->next;
+	else            heap_free_lists.heads[fl][sl] = node->next;
+	if (node->next) heap_chunk_free_node(node->next)->prev = node->prev;
+
+	if (!heap_free_lists.heads[fl][sl]) {
+		heap_free_lists.sl_bitmap[fl] &= ~(1u << sl);
+		if (!heap_free_lists.sl_bitmap[fl]) heap_free_lists.fl_bitmap &= ~(1ull << fl);
+	}
+}
+
+// Returns a free chunk of at least size, or 0 if there is none
+Heap_Allocation_Metadata *heap_find_free_chunk(u64 size) {
+
+	// Round up to the next list so whatever we find there is big enough
+	if (size >= HEAP_SMALL_SIZE) size += (1ull << (bit_scan_reverse_64(size) - HEAP_SL_LOG2)) - 1;
+
+	u64 fl, sl;
+	heap_size_to_list_index(size, &fl, &sl);
+	if (fl >= HEAP_FL_COUNT) return 0;
+
+	u32 sl_map = heap_free_lists.sl_bitmap[fl] & (~0u << sl);
+	if (!sl_map) {
+		u64 fl_map = heap_free_lists.fl_bitmap & (~0ull << (fl+1));
+		if (!fl_map) return 0;
+		fl = bit_scan_forward_64(fl_map);
+		sl_map = heap_free_lists.sl_bitmap[fl];
+	}
+	sl = bit_scan_forward_64(sl_map);
+
+	return heap_free_lists.heads[fl][sl];
+}
+
+// Some chunk from the biggest list there is, or 0 if nothing is free
+Heap_Allocation_Metadata *heap_find_largest_free_chunk() {
+	if (!heap_free_lists.fl_bitmap) return 0;
+	u64 fl = bit_scan_reverse_64(heap_free_lists.fl_bitmap);
+	u64 sl = bit_scan_reverse_64(heap_free_lists.sl_bitmap[fl]);
+	return heap_free_lists.heads[fl][sl];
+}
+
+///
+// Freed pages implementation
+// The pages we lock or decommit are the whole pages inside a free chunk after its metadata &
+// free node, so walking the free lists never touches them.
+
+inline void *heap_free_chunk_first_page(Heap_Allocation_Metadata *chunk) {
+	return (void*)align_next((u8*)heap_chunk_free_node(chunk)+sizeof(Heap_Free_Node), os.page_size);
+}
+inline void *heap_free_chunk_pages_end(Heap_Allocation_Metadata *chunk) {
+	return (void*)align_previous((u8*)chunk+heap_chunk_size(chunk), os.page_size);
+}
+
+void heap_lock_free_chunk_pages(Heap_Allocation_Metadata *chunk) {
+	if (!heap_guard_freed_pages) return;
+	u8 *first_page    = (u8*)heap_free_chunk_first_page(chunk);
+	u8 *last_page_end = (u8*)heap_free_chunk_pages_end(chunk);
+	if (last_page_end > first_page) {
+		os_lock_program_memory_pages(first_page, (u64)(last_page_end-first_page));
+		heap_page_protect_calls += 1;
+	}
+}
+// Makes the pages we are about to touch usable when we use the first used_size bytes of a free chunk.
+// If there is a remainder we also need its metadata & free node.
+void heap_unlock_free_chunk_pages(Heap_Allocation_Metadata *chunk, u64 used_size) {
+	bool decommitted = (chunk->size & HEAP_CHUNK_DECOMMITTED) != 0;
+	if (!heap_guard_freed_pages && !decommitted) return;
+
+	u64 chunk_size = heap_chunk_size(chunk);
+	u8 *touched_end = (u8*)chunk + used_size;
+	if (used_size < chunk_size) touched_end += HEAP_MIN_CHUNK_SIZE;
+
+	u8 *first_page    = (u8*)heap_free_chunk_first_page(chunk);
+	u8 *last_page_end = (u8*)min(align_next(touched_end, os.page_size), (u64)heap_free_chunk_pages_end(chunk));
+	if (last_page_end > first_page) {
+		if (decommitted) {
+			os_commit_program_memory_pages(first_page, (u64)(last_page_end-first_page));
+			heap_page_commit_calls += 1;
 		}
-		
-		if (node->size >= size) {
-			u64 delta = node->size - size;
-			
-			if (delta < best_fit_delta || !best_fit) {
-				before_best_fit = previous;
-				best_fit = node;
-				best_fit_delta = delta;
-			}
+		if (heap_guard_freed_pages) {
+			os_unlock_program_memory_pages(first_page, (u64)(last_page_end-first_page));
+			heap_page_protect_calls += 1;
 		}
-		
-		if (node->next) previous = node;
-		node = node->next;
 	}
-	
-	if (!best_fit)  return (Heap_Search_Result){0, 0, 0};
-
-	Heap_Search_Result result;
-	result.best_fit = best_fit;
-	result.previous = before_best_fit;
-	result.delta = best_fit_delta;
-	assert(result.previous != result.best_fit, "Internal goof");
-	return result;
 }
 
 Heap_Block *make_heap_block(Heap_Block *parent, u64 size) {
 
-	size += sizeof(Heap_Block);
+	size += sizeof(Heap_Block) + sizeof(Heap_Allocation_Metadata);
 
 	size = align_next(size, os.page_size);
 
 	Heap_Block *block = (Heap_Block*)os_reserve_next_memory_pages(size);
-		
+
 	assert((u64)block % os.page_size == 0, "Heap block not aligned to page size");
-	
+
 	if (parent) parent->next = block;
+#if CONFIGURATION == DEBUG
+	// Program memory starts out locked in debug
 	os_unlock_program_memory_pages(block, size);
-	
+#endif
+
 #if CONFIGURATION == DEBUG
 	block->total_allocated = 0;
 #endif
-	
+
 	block->start = ((u8*)block)+sizeof(Heap_Block);
 	block->size = size;
 	block->next = 0;
-	block->free_head = (Heap_Free_Node*)block->start;
-	block->free_head->size = get_heap_block_size_excluding_metadata(block);
-	block->free_head->next = 0;
-	
+
+	// One big free chunk and the end chunk
+	Heap_Allocation_Metadata *chunk = (Heap_Allocation_Metadata*)block->start;
+	Heap_Allocation_Metadata *end = heap_block_end_chunk(block);
+	u64 chunk_size = (u64)end - (u64)chunk;
+
+	chunk->prev_size = 0;
+	chunk->size = chunk_size | HEAP_CHUNK_FREE;
+	end->prev_size = chunk_size;
+	end->size = 0 | HEAP_CHUNK_PREV_FREE;
+#if CONFIGURATION == DEBUG
+	chunk->block = block;
+	chunk->signature = 0;
+	end->block = block;
+	end->signature = HEAP_META_SIGNATURE;
+#endif
+
+	heap_insert_free_chunk(chunk);
+	heap_lock_free_chunk_pages(chunk);
+
 	return block;
 }
 
@@ -244,297 +663,819 @@ void heap_init() {
 	if (heap_initted) return;
 	assert(HEAP_ALIGNMENT == 16);
 	assert(sizeof(Heap_Allocation_Metadata) % HEAP_ALIGNMENT == 0);
+	assert(sizeof(Heap_Block) % HEAP_ALIGNMENT == 0);
 	heap_initted = true;
+	memset(&heap_free_lists, 0, sizeof(heap_free_lists));
 	heap_head = make_heap_block(0, DEFAULT_HEAP_BLOCK_SIZE);
 	spinlock_init(&heap_lock);
+	spinlock_init(&heap_large_lock);
 }
 
-void *heap_alloc(u64 size) {
-
-	if (!heap_initted) heap_init();
+// Expects size to include metadata & be aligned. Caller holds heap_lock.
+// Takes size from the front of chunk if one is given, otherwise finds one.
+Heap_Allocation_Metadata *heap_alloc_chunk_from_locked(Heap_Allocation_Metadata *chunk, u64 size) {
 
-	// #Sync #Speed oof
-	spinlock_acquire_or_wait(&heap_lock);
-	
-
-
-
-	
-	size += sizeof(Heap_Allocation_Metadata);
-	
-	size = (size+HEAP_ALIGNMENT) & ~(HEAP_ALIGNMENT-1);
-	
-	assert(size < MAX_HEAP_BLOCK_SIZE, "Past Charlie has been lazy and did not handle large allocations like this. I apologize on behalf of past Charlie. A quick fix could be to increase the heap block size for now. #Incomplete #Limitation");
-	
-	
 #if VERY_DEBUG
 	{
 		Heap_Block *block = heap_head;
-		
+
 		while (block != 0) {
 			sanity_check_block(block);
 			block = block->next;
 		}
 	}
 #endif
-	
-	Heap_Block *block = heap_head;
-	Heap_Block *last_block = 0;
-	Heap_Free_Node *best_fit = 0;
-	Heap_Block *best_fit_block = 0;
-	Heap_Free_Node *previous = 0;
-	u64 best_fit_delta = 0;
-	// #Speed
-	// Maybe instead of going through EVERY free node to find best fit we do a good-enough fit
-	while (block != 0) {
-
-		if (get_heap_block_size_excluding_metadata(block) < size) {
-			last_block = block;
-			block = block->next;
-			continue;
-		}
-	
-		Heap_Search_Result result = search_heap_block(block, size);
-		Heap_Free_Node *node = result.best_fit;
-		if (node) {
-			if (node->size < size) continue;
-			if (node->size == size) {
-				best_fit = node;
-				best_fit_block = block;
-				previous = result.previous;
-				best_fit_delta = 0;
-				break;
-			}
-			
-			u64 delta = node->size-size;
-			if (delta < best_fit_delta || !best_fit) {
-				best_fit = node;
-				best_fit_block = block;
-				previous = result.previous;
-				best_fit_delta = delta;
-			}
+
+	if (!chunk) chunk = heap_find_free_chunk(size);
+
+	if (!chunk) {
+		Heap_Block *last_block = heap_head;
+		while (last_block->next) last_block = last_block->next;
+
+		Heap_Block *block = make_heap_block(last_block, max(DEFAULT_HEAP_BLOCK_SIZE, size));
+		chunk = (Heap_Allocation_Metadata*)block->start;
+	}
+
+	assert(chunk != 0, "Internal heap error");
+	assert(chunk->size & HEAP_CHUNK_FREE, "Internal heap error");
+
+	heap_remove_free_chunk(chunk);
+
+	u64 chunk_size = heap_chunk_size(chunk);
+	Heap_Allocation_Metadata *next = heap_chunk_next(chunk);
+
+	bool split = chunk_size-size >= HEAP_MIN_CHUNK_SIZE;
+	if (!split) size = chunk_size;
+
+	heap_unlock_free_chunk_pages(chunk, size);
+
+	if (split) {
+		// Give back the remainder
+		Heap_Allocation_Metadata *rest = (Heap_Allocation_Metadata*)((u8*)chunk + size);
+		u64 rest_size = chunk_size-size;
+		rest->prev_size = size;
+		rest->size = rest_size | HEAP_CHUNK_FREE | (chunk->size & HEAP_CHUNK_DECOMMITTED);
+#if CONFIGURATION == DEBUG
+		rest->block = chunk->block;
+		rest->signature = 0;
+#endif
+		next->prev_size = rest_size;
+		heap_insert_free_chunk(rest);
+	} else {
+		next->size &= ~HEAP_CHUNK_PREV_FREE;
+	}
+
+	// Previous chunk can't be free since we coalesce
+	chunk->size = size;
+#if CONFIGURATION == DEBUG
+	chunk->signature = HEAP_META_SIGNATURE;
+	chunk->block->total_allocated += size;
+#endif
+	heap_allocated_bytes  += size;
+	heap_allocation_count += 1;
+
+	check_meta(chunk);
+
+#if VERY_DEBUG && CONFIGURATION == DEBUG
+	sanity_check_block(chunk->block);
+#endif
+
+	return chunk;
+}
+inline Heap_Allocation_Metadata *heap_alloc_chunk_locked(u64 size) {
+	return heap_alloc_chunk_from_locked(0, size);
+}
+
+// Caller holds heap_lock. This also takes the chunk back from whichever thread cache it was in.
+void heap_free_chunk_locked(Heap_Allocation_Metadata *chunk) {
+
+	u64 size = heap_chunk_size(chunk);
+
+#if CONFIGURATION == DEBUG
+	Heap_Block *block = chunk->block;
+	#if VERY_DEBUG
+		sanity_check_block(block);
+	#endif
+	memset((u8*)chunk+sizeof(Heap_Allocation_Metadata), 0x69, size-sizeof(Heap_Allocation_Metadata));
+	chunk->signature = 0;
+	block->total_allocated -= size;
+#endif
+	heap_allocated_bytes  -= size;
+	heap_allocation_count -= 1;
+
+	// Coalesce with neighbours
+	u64 decommitted = 0;
+	if (chunk->size & HEAP_CHUNK_PREV_FREE) {
+		Heap_Allocation_Metadata *prev = heap_chunk_prev(chunk);
+		assert(prev->size & HEAP_CHUNK_FREE, "Heap is corrupt, previous chunk should be free.");
+		heap_remove_free_chunk(prev);
+		size += heap_chunk_size(prev);
+		decommitted |= prev->size & HEAP_CHUNK_DECOMMITTED;
+		chunk = prev;
+	}
+	Heap_Allocation_Metadata *next = (Heap_Allocation_Metadata*)((u8*)chunk + size);
+	if (next->size & HEAP_CHUNK_FREE) {
+		heap_remove_free_chunk(next);
+		size += heap_chunk_size(next);
+		decommitted |= next->size & HEAP_CHUNK_DECOMMITTED;
+		next = (Heap_Allocation_Metadata*)((u8*)chunk + size);
+	}
+
+	chunk->size = size | HEAP_CHUNK_FREE | decommitted;
+	next->prev_size = size;
+	next->size |= HEAP_CHUNK_PREV_FREE;
+
+	heap_lock_free_chunk_pages(chunk);
+	heap_insert_free_chunk(chunk);
+
+#if VERY_DEBUG && CONFIGURATION == DEBUG
+	sanity_check_block(block);
+#endif
+}
+
+///
+// Thread cache implementation
+
+// Rounds size up to the start of its size class so any chunk in that class fits
+inline u64
+heap_cache_class_for_alloc(u64 *size) {
+	u64 s = *size;
+	if (s >= HEAP_SMALL_SIZE) s = align_next(s, 1ull << (bit_scan_reverse_64(s) - HEAP_SL_LOG2));
+	*size = s;
+
+	u64 fl, sl;
+	heap_size_to_list_index(s, &fl, &sl);
+	return fl*HEAP_SL_COUNT + sl;
+}
+// A chunk goes in the class it's at least as big as.
+// Chunks in the top class can be a little bigger than HEAP_CACHE_MAX_CHUNK_SIZE when the heap didn't split off the remainder.
+inline u64
+heap_cache_class_for_chunk(Heap_Allocation_Metadata *chunk) {
+	u64 fl, sl;
+	heap_size_to_list_index(heap_chunk_size(chunk), &fl, &sl);
+	return min(fl*HEAP_SL_COUNT + sl, HEAP_CACHE_CLASS_COUNT-1);
+}
+inline u64
+heap_cache_batch_count(u64 class_size) {
+	return clamp(HEAP_CACHE_BATCH_BYTES/class_size, 2, 64);
+}
+
+inline void
+heap_cache_push(Heap_Thread_Cache *cache, u64 class_index, Heap_Allocation_Metadata *chunk) {
+	heap_chunk_free_node(chunk)->next = cache->lists[class_index];
+	cache->lists[class_index] = chunk;
+	cache->counts[class_index] += 1;
+	cache->cached_bytes += heap_chunk_size(chunk);
+}
+inline Heap_Allocation_Metadata *
+heap_cache_pop(Heap_Thread_Cache *cache, u64 class_index) {
+	Heap_Allocation_Metadata *chunk = cache->lists[class_index];
+	cache->lists[class_index] = heap_chunk_free_node(chunk)->next;
+	cache->counts[class_index] -= 1;
+	cache->cached_bytes -= heap_chunk_size(chunk);
+	return chunk;
+}
+
+void heap_cache_drain_remote_frees(Heap_Thread_Cache *cache) {
+	if (!cache->remote_free_head) return;
+
+	// Take the whole stack at once. Others only ever push so there's no ABA problem.
+	u64 head;
+	do {
+		head = cache->remote_free_head;
+	} while (!compare_and_swap_64(&cache->remote_free_head, 0, head));
+
+	Heap_Allocation_Metadata *chunk = (Heap_Allocation_Metadata*)head;
+	while (chunk) {
+		Heap_Allocation_Metadata *next = heap_chunk_free_node(chunk)->next;
+		heap_cache_push(cache, heap_cache_class_for_chunk(chunk), chunk);
+		chunk = next;
+	}
+}
+
+// For when nobody owns the cache, takes the remote stack and frees it straight to the heap
+void heap_cache_return_remote_frees(Heap_Thread_Cache *cache) {
+	u64 head = atomic_exchange_64(&cache->remote_free_head, 0, MEMORY_ORDER_ACQ_REL);
+	if (!head) return;
+
+	spinlock_acquire_or_wait(&heap_lock);
+	Heap_Allocation_Metadata *chunk = (Heap_Allocation_Metadata*)head;
+	while (chunk) {
+		Heap_Allocation_Metadata *next = heap_chunk_free_node(chunk)->next;
+		heap_free_chunk_locked(chunk);
+		chunk = next;
+	}
+	spinlock_release(&heap_lock);
+}
+
+Heap_Thread_Cache *heap_get_thread_cache() {
+	if (heap_thread_cache) return heap_thread_cache;
+
+	Heap_Thread_Cache *cache = 0;
+
+	spinlock_acquire_or_wait(&heap_lock);
+
+	// Reuse the cache of a thread that exited, otherwise make a new one
+	for (u64 i = 1; i < heap_thread_cache_count; i += 1) {
+		if (!heap_thread_caches[i]->active) {
+			cache = heap_thread_caches[i];
+			break;
 		}
-		
-		last_block = block;
-		block = block->next;
 	}
-	
-	if (!best_fit) {
-		block = make_heap_block(last_block, max(DEFAULT_HEAP_BLOCK_SIZE, size));
-		previous = 0;
-		best_fit = block->free_head;
-		best_fit_block = block;
+	if (!cache && heap_thread_cache_count < HEAP_MAX_THREAD_CACHES) {
+		u64 size = align_next(sizeof(Heap_Allocation_Metadata)+sizeof(Heap_Thread_Cache), HEAP_ALIGNMENT);
+		Heap_Allocation_Metadata *chunk = heap_alloc_chunk_locked(size);
+		cache = (Heap_Thread_Cache*)((u8*)chunk+sizeof(Heap_Allocation_Metadata));
+		memset(cache, 0, sizeof(Heap_Thread_Cache));
+		cache->id = heap_thread_cache_count;
+		heap_thread_caches[heap_thread_cache_count] = cache;
+		heap_thread_cache_count += 1;
 	}
-		
-	
-	assert(best_fit != 0, "Internal heap error");
-	
-	// Unlock best fit
-	
-	// #Copypaste
-	void *free_tail = (u8*)best_fit + best_fit->size;
-	void *first_page = (void*)align_previous(best_fit, os.page_size);
-	void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-	if ((u8*)last_page_end > (u8*)first_page) {
-		os_unlock_program_memory_pages(first_page, (u64)last_page_end-(u64)first_page);
+	if (cache) cache->active = true;
+
+	spinlock_release(&heap_lock);
+
+	// Pick up anything that was pushed after the previous owner drained
+	if (cache) heap_cache_drain_remote_frees(cache);
+
+	heap_thread_cache = cache;
+	return cache;
+}
+
+// Gives everything in this threads cache back to the heap.
+// Called when oogabooga threads exit, call it yourself for threads you made some other way.
+void heap_release_thread_cache() {
+	Heap_Thread_Cache *cache = heap_thread_cache;
+	if (!cache) return;
+
+	// Other threads freeing our chunks now go straight to the heap
+	cache->active = false;
+	MEMORY_BARRIER;
+
+	heap_cache_drain_remote_frees(cache);
+
+	spinlock_acquire_or_wait(&heap_lock);
+	for (u64 i = 0; i < HEAP_CACHE_CLASS_COUNT; i += 1) {
+		while (cache->lists[i]) {
+			heap_free_chunk_locked(heap_cache_pop(cache, i));
+		}
 	}
-	
-	Heap_Free_Node *new_free_node = 0;
-	if (size != best_fit->size) {
-		u64 remainder = best_fit->size - size;
-		new_free_node = (Heap_Free_Node*)(((u8*)best_fit)+size);
-		new_free_node->size = remainder;
-		new_free_node->next = best_fit->next;
-		
-		// Lock remaining free node
-		// #Copypaste
-		void *free_tail = (u8*)new_free_node + new_free_node->size;
-		void *next_page = (void*)align_next(new_free_node, os.page_size);
-		void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-		if ((u8*)last_page_end > (u8*)next_page) {
-			os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
+	spinlock_release(&heap_lock);
+
+	heap_thread_cache = 0;
+}
+
+// Returns 0 if the size isn't cached or we don't have a cache
+Heap_Allocation_Metadata *heap_cache_alloc(u64 size) {
+	u64 class_size = size;
+	u64 class_index = heap_cache_class_for_alloc(&class_size);
+	if (class_size >= HEAP_CACHE_MAX_CHUNK_SIZE) return 0;
+
+	Heap_Thread_Cache *cache = heap_get_thread_cache();
+	if (!cache) return 0;
+
+	if (!cache->lists[class_index]) {
+		heap_cache_drain_remote_frees(cache);
+	}
+	if (!cache->lists[class_index]) {
+		// Refill a batch
+		u64 count = heap_cache_batch_count(class_size);
+		spinlock_acquire_or_wait(&heap_lock);
+		for (u64 i = 0; i < count; i += 1) {
+			Heap_Allocation_Metadata *chunk = heap_alloc_chunk_locked(class_size);
+			chunk->size |= cache->id << HEAP_CHUNK_OWNER_SHIFT;
+			heap_cache_push(cache, class_index, chunk);
 		}
+		spinlock_release(&heap_lock);
 	}
-	
-	
-	if (previous && new_free_node) {
-		assert(previous->next == best_fit, "Internal heap error");
-		previous->next = new_free_node;
-	} else if (previous) {
-		assert(previous->next == best_fit, "Internal heap error");
-		previous->next = best_fit->next;
+
+	Heap_Allocation_Metadata *chunk = heap_cache_pop(cache, class_index);
+#if CONFIGURATION == DEBUG
+	assert(chunk->signature == HEAP_CACHED_SIGNATURE || chunk->signature == HEAP_META_SIGNATURE, "Heap is corrupt, chunk in thread cache has a bad signature");
+	chunk->signature = HEAP_META_SIGNATURE;
+#endif
+	return chunk;
+}
+
+void heap_cache_free(Heap_Allocation_Metadata *chunk) {
+	Heap_Thread_Cache *cache = heap_thread_caches[heap_chunk_owner(chunk)];
+
+#if CONFIGURATION == DEBUG
+	memset((u8*)chunk+sizeof(Heap_Allocation_Metadata), 0x69, heap_chunk_size(chunk)-sizeof(Heap_Allocation_Metadata));
+	chunk->signature = HEAP_CACHED_SIGNATURE;
+#endif
+
+	if (cache == heap_thread_cache) {
+		u64 class_index = heap_cache_class_for_chunk(chunk);
+		heap_cache_push(cache, class_index, chunk);
+
+		// Too much in this class, flush a batch back to the heap
+		u64 batch = heap_cache_batch_count(heap_chunk_size(chunk));
+		if (cache->counts[class_index] > batch*2) {
+			spinlock_acquire_or_wait(&heap_lock);
+			for (u64 i = 0; i < batch; i += 1) {
+				heap_free_chunk_locked(heap_cache_pop(cache, class_index));
+			}
+			spinlock_release(&heap_lock);
+		}
+	} else if (cache->active) {
+		u64 head;
+		do {
+			head = cache->remote_free_head;
+			heap_chunk_free_node(chunk)->next = (Heap_Allocation_Metadata*)head;
+		} while (!compare_and_swap_64(&cache->remote_free_head, (u64)chunk, head));
+
+		// The owner may have released the cache after we checked active. It clears active before
+		// draining, so either it saw our push or we see it's gone and give the stack back ourselves.
+		if (!cache->active) heap_cache_return_remote_frees(cache);
+	} else {
+		spinlock_acquire_or_wait(&heap_lock);
+		heap_free_chunk_locked(chunk);
+		spinlock_release(&heap_lock);
 	}
-	
-	if (best_fit_block->free_head == best_fit) {
-		// If we allocated the first free node then replace with new free node or just
-		// remove it if perfect fit.
-		if (new_free_node) {
-			new_free_node->next = best_fit_block->free_head->next;
-			best_fit_block->free_head = new_free_node;
-		} else best_fit_block->free_head = best_fit_block->free_head->next;
+}
+
+///
+// Large allocations
+
+inline Heap_Large_Allocation *
+heap_large_from_chunk(Heap_Allocation_Metadata *chunk) {
+	return (Heap_Large_Allocation*)chunk - 1;
+}
+
+// Expects size to include metadata & be aligned
+Heap_Allocation_Metadata *heap_large_alloc(u64 size) {
+	u64 committed = align_next(size + sizeof(Heap_Large_Allocation), os.page_size);
+	u64 reserved  = committed*HEAP_LARGE_RESERVE_FACTOR;
+
+	Heap_Large_Allocation *large = (Heap_Large_Allocation*)os_reserve_memory(reserved);
+	if (!large) {
+		// Maybe we are tight on address space, try without the room to grow
+		reserved = committed;
+		large = (Heap_Large_Allocation*)os_reserve_memory(reserved);
 	}
-	
-	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)best_fit;
-	meta->size = size;
-	meta->block = best_fit_block;
+	assert(large, "Failed reserving %llu bytes for a large heap allocation", reserved);
+	bool ok = os_commit_memory(large, committed);
+	assert(ok, "Failed committing %llu bytes for a large heap allocation", committed);
+
+	large->reserved  = reserved;
+	large->committed = committed;
+	large->prev = 0;
+
+	Heap_Allocation_Metadata *chunk = (Heap_Allocation_Metadata*)(large+1);
+	chunk->prev_size = 0;
+	chunk->size = (committed - sizeof(Heap_Large_Allocation)) | HEAP_CHUNK_LARGE;
 #if CONFIGURATION == DEBUG
-	meta->signature = HEAP_META_SIGNATURE;
-	meta->block->total_allocated += size;
+	chunk->block = 0;
+	chunk->signature = HEAP_META_SIGNATURE;
 #endif
 
-	check_meta(meta);
+	spinlock_acquire_or_wait(&heap_large_lock);
+	large->next = heap_large_head;
+	if (heap_large_head) heap_large_head->prev = large;
+	heap_large_head = large;
+	heap_large_allocation_count += 1;
+	heap_large_committed_bytes  += committed;
+	heap_large_reserved_bytes   += reserved;
+	spinlock_release(&heap_large_lock);
 
-#if VERY_DEBUG
-	sanity_check_block(meta->block);
+	return chunk;
+}
+
+void heap_large_dealloc(Heap_Allocation_Metadata *chunk) {
+	Heap_Large_Allocation *large = heap_large_from_chunk(chunk);
+
+	spinlock_acquire_or_wait(&heap_large_lock);
+	if (large->prev) large->prev->next = large->next;
+	else             heap_large_head = large->next;
+	if (large->next) large->next->prev = large->prev;
+	heap_large_allocation_count -= 1;
+	heap_large_committed_bytes  -= large->committed;
+	heap_large_reserved_bytes   -= large->reserved;
+	spinlock_release(&heap_large_lock);
+
+	os_release_memory(large, large->reserved);
+}
+
+// Commits or decommits pages at the end if the new size fits in what we reserved.
+// Expects size to include metadata & be aligned.
+bool heap_large_resize_in_place(Heap_Allocation_Metadata *chunk, u64 size) {
+	Heap_Large_Allocation *large = heap_large_from_chunk(chunk);
+	u64 committed = align_next(size + sizeof(Heap_Large_Allocation), os.page_size);
+	if (committed > large->reserved) return false;
+
+	u64 old_committed = large->committed;
+	if (committed > old_committed) {
+		if (!os_commit_memory((u8*)large + old_committed, committed - old_committed)) return false;
+	}
+
+	// is_pointer_in_large_allocation reads committed under the lock
+	spinlock_acquire_or_wait(&heap_large_lock);
+	heap_large_committed_bytes += committed;
+	heap_large_committed_bytes -= old_committed;
+	large->committed = committed;
+	spinlock_release(&heap_large_lock);
+
+	// Only decommit once the smaller size is visible
+	if (committed < old_committed) {
+		os_decommit_memory((u8*)large + committed, old_committed - committed);
+	}
+
+	chunk->size = (committed - sizeof(Heap_Large_Allocation)) | HEAP_CHUNK_LARGE;
+	return true;
+}
+
+bool is_pointer_in_large_allocation(void *p) {
+	bool found = false;
+	spinlock_acquire_or_wait(&heap_large_lock);
+	for (Heap_Large_Allocation *large = heap_large_head; large; large = large->next) {
+		if ((u8*)p >= (u8*)large && (u8*)p < (u8*)large + large->committed) {
+			found = true;
+			break;
+		}
+	}
+	spinlock_release(&heap_large_lock);
+	return found;
+}
+
+void *heap_alloc_tagged(u64 size, Memory_Tag tag) {
+
+	if (!heap_initted) heap_init();
+
+#if ENABLE_MEMORY_TRACKING
+	u64 requested_size = size;
 #endif
-	
-	// #Sync #Speed oof
-	spinlock_release(&heap_lock);
-	
-	
-	void *p = ((u8*)meta)+sizeof(Heap_Allocation_Metadata);
+	size += sizeof(Heap_Allocation_Metadata);
+
+	size = align_next(size, HEAP_ALIGNMENT);
+	size = max(size, HEAP_MIN_CHUNK_SIZE);
+
+	Heap_Allocation_Metadata *chunk = 0;
+	if (size < HEAP_CACHE_MAX_CHUNK_SIZE) {
+		chunk = heap_cache_alloc(size);
+	} else if (size >= HEAP_LARGE_ALLOCATION_SIZE) {
+		chunk = heap_large_alloc(size);
+	}
+	if (!chunk) {
+		// #Sync #Speed oof
+		spinlock_acquire_or_wait(&heap_lock);
+		chunk = heap_alloc_chunk_locked(size);
+		spinlock_release(&heap_lock);
+	}
+
+	memory_track_alloc(chunk, requested_size, tag);
+
+	void *p = ((u8*)chunk)+sizeof(Heap_Allocation_Metadata);
 	assert((u64)p % HEAP_ALIGNMENT == 0, "Internal heap error. Result pointer is not aligned to HEAP_ALIGNMENT");
 	return p;
 }
+void *heap_alloc(u64 size) {
+	return heap_alloc_tagged(size, MEMORY_TAG_NONE);
+}
 void heap_dealloc(void *p) {
-	// #Sync #Speed oof
-	
+
 	if (!heap_initted) heap_init();
 
+	Heap_Allocation_Metadata *chunk = (Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata));
+
+	if (!is_pointer_in_program_memory(p)) {
+		assert(is_pointer_in_large_allocation(p), "A bad pointer was passed tp heap_dealloc: it is out of program memory bounds!");
+		check_meta(chunk);
+		memory_track_free(chunk);
+		heap_large_dealloc(chunk);
+		return;
+	}
+
+	check_meta(chunk);
+	memory_track_free(chunk);
+
+	if (heap_chunk_owner(chunk)) {
+		heap_cache_free(chunk);
+		return;
+	}
+
+	// #Sync #Speed oof
 	spinlock_acquire_or_wait(&heap_lock);
-	
-	assert(is_pointer_in_program_memory(p), "A bad pointer was passed tp heap_dealloc: it is out of program memory bounds!"); 
-	p = (u8*)p-sizeof(Heap_Allocation_Metadata);
-	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(p);
-	check_meta(meta);
-	
-	// Yoink meta data before we start overwriting it
-	Heap_Block *block = meta->block;
-	u64 size = meta->size;
-	
+	heap_free_chunk_locked(chunk);
+	spinlock_release(&heap_lock);
+}
+
+// Caller holds heap_lock. Tries to make chunk size bytes without moving it, returns false if it can't.
+bool heap_resize_chunk_in_place_locked(Heap_Allocation_Metadata *chunk, u64 size) {
+	u64 old_size = heap_chunk_size(chunk);
+	Heap_Allocation_Metadata *next = heap_chunk_next(chunk);
+
+	if (size <= old_size) {
+		u64 tail_size = old_size - size;
+		if (tail_size < HEAP_MIN_CHUNK_SIZE) return true;
+
+		// Cut off the tail as its own allocated chunk and free it, that takes care of coalescing
+		Heap_Allocation_Metadata *tail = (Heap_Allocation_Metadata*)((u8*)chunk + size);
+		tail->prev_size = size;
+		tail->size = tail_size;
 #if CONFIGURATION == DEBUG
-	memset(p, 0x69696969, size);
+		tail->block = chunk->block;
+		tail->signature = HEAP_META_SIGNATURE;
 #endif
-	
-	#if VERY_DEBUG
-		sanity_check_block(block);
-	#endif
-	
-	Heap_Free_Node *new_node = cast(Heap_Free_Node*)p;
-	new_node->size = size;
-	
-	if (new_node < block->free_head) {
-		// #Copypaste
-		void *free_tail = (u8*)new_node + new_node->size;
-		void *next_page = (void*)align_next(new_node, os.page_size);
-		void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-		if ((u8*)last_page_end > (u8*)next_page) {
-			os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
+		next->prev_size = tail_size;
+		chunk->size = size | (chunk->size & ~HEAP_CHUNK_SIZE_MASK);
+		heap_allocation_count += 1;
+
+		heap_free_chunk_locked(tail);
+		return true;
+	}
+
+	if (!(next->size & HEAP_CHUNK_FREE)) return false;
+	u64 next_size = heap_chunk_size(next);
+	if (old_size + next_size < size) return false;
+
+	// Grow into the free chunk after us
+	heap_remove_free_chunk(next);
+	u64 taken = size - old_size;
+	u64 rest_size = next_size - taken;
+	bool split = rest_size >= HEAP_MIN_CHUNK_SIZE;
+	if (!split) {
+		taken = next_size;
+		size = old_size + next_size;
+	}
+
+	heap_unlock_free_chunk_pages(next, taken);
+
+	Heap_Allocation_Metadata *after = (Heap_Allocation_Metadata*)((u8*)next + next_size);
+	if (split) {
+		Heap_Allocation_Metadata *rest = (Heap_Allocation_Metadata*)((u8*)chunk + size);
+		rest->prev_size = size;
+		rest->size = rest_size | HEAP_CHUNK_FREE | (next->size & HEAP_CHUNK_DECOMMITTED);
+#if CONFIGURATION == DEBUG
+		rest->block = chunk->block;
+		rest->signature = 0;
+#endif
+		after->prev_size = rest_size;
+		heap_insert_free_chunk(rest);
+	} else {
+		after->prev_size = size;
+		after->size &= ~HEAP_CHUNK_PREV_FREE;
+	}
+
+	chunk->size = size | (chunk->size & ~HEAP_CHUNK_SIZE_MASK);
+#if CONFIGURATION == DEBUG
+	chunk->block->total_allocated += taken;
+#endif
+	heap_allocated_bytes += taken;
+
+	return true;
+}
+
+// Atomic so large reallocs don't need heap_lock just for the stats
+void heap_count_realloc(bool in_place, u64 copy_size) {
+	atomic_fetch_add_64(&heap_realloc_count, 1, MEMORY_ORDER_RELAXED);
+	if (in_place) atomic_fetch_add_64(&heap_realloc_in_place_count, 1, MEMORY_ORDER_RELAXED);
+	else atomic_fetch_add_64(&heap_realloc_copied_bytes, copy_size, MEMORY_ORDER_RELAXED);
+}
+
+void *heap_realloc(void *p, u64 size) {
+	if (!p) return heap_alloc(size);
+
+	Heap_Allocation_Metadata *chunk = (Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata));
+	if (!is_pointer_in_program_memory(p)) {
+		assert(is_pointer_in_large_allocation(p), "A bad pointer was passed to heap_realloc: it is out of program memory bounds!");
+	}
+	check_meta(chunk);
+
+	u64 chunk_size = size + sizeof(Heap_Allocation_Metadata);
+	chunk_size = align_next(chunk_size, HEAP_ALIGNMENT);
+	chunk_size = max(chunk_size, HEAP_MIN_CHUNK_SIZE);
+
+	u64 old_chunk_size = heap_chunk_size(chunk);
+	u64 copy_size = min(size, old_chunk_size-sizeof(Heap_Allocation_Metadata));
+
+	// Large allocations stay large (unless they shrink a lot), small ones that get large move out of the heap blocks
+	bool was_large = (chunk->size & HEAP_CHUNK_LARGE) != 0;
+	if (was_large || chunk_size >= HEAP_LARGE_ALLOCATION_SIZE) {
+		bool in_place = was_large && chunk_size >= HEAP_LARGE_ALLOCATION_SIZE/2 && heap_large_resize_in_place(chunk, chunk_size);
+
+		heap_count_realloc(in_place, copy_size);
+
+		if (in_place) {
+			memory_track_resize(chunk, size);
+			return p;
 		}
+
+		void *new = heap_alloc_tagged(size, memory_track_tag(chunk));
+		memcpy(new, p, copy_size);
+		heap_dealloc(p);
+		return new;
+	}
+
+	// Chunks from thread caches have to stay in their size class, so those only stay put if they already fit.
+	// That doesn't touch the heap so it doesn't need the lock.
+	bool in_place;
+	Heap_Allocation_Metadata *new_chunk = 0;
+	if (heap_chunk_owner(chunk)) {
+		in_place = chunk_size <= old_chunk_size;
+	} else {
+		spinlock_acquire_or_wait(&heap_lock);
+		in_place = heap_resize_chunk_in_place_locked(chunk, chunk_size);
 		
-		if ((u8*)new_node+size == (u8*)block->free_head) {
-			new_node->size = size + block->free_head->size;
-			new_node->next = block->free_head->next;
-			block->free_head = new_node;
-		} else {
-			new_node->next = block->free_head;
-			block->free_head = new_node;
+		// Something that grows once probably grows again, so if the best fit has no room to grow
+		// into we move it to the front of the biggest free chunk instead. Then next time there's room right after it.
+		if (!in_place && chunk_size >= HEAP_CACHE_MAX_CHUNK_SIZE) {
+			Heap_Allocation_Metadata *target = heap_find_free_chunk(chunk_size);
+			if (!target || heap_chunk_size(target) < chunk_size*2) {
+				Heap_Allocation_Metadata *largest = heap_find_largest_free_chunk();
+				if (largest && heap_chunk_size(largest) >= chunk_size) target = largest;
+			}
+			new_chunk = heap_alloc_chunk_from_locked(target, chunk_size);
 		}
-		
+#if VERY_DEBUG && CONFIGURATION == DEBUG
+		sanity_check_block(chunk->block);
+#endif
+		spinlock_release(&heap_lock);
+	}
+	heap_count_realloc(in_place, copy_size);
+
+	if (in_place) {
+		memory_track_resize(chunk, size);
+		return p;
+	}
+
+	void *new;
+	if (new_chunk) {
+		memory_track_alloc(new_chunk, size, memory_track_tag(chunk));
+		new = (u8*)new_chunk+sizeof(Heap_Allocation_Metadata);
 	} else {
-	
-		if (!block->free_head) {
-			block->free_head = new_node;
-			new_node->next = 0;
-			
-			// #Copypaste
-			void *free_tail = (u8*)new_node + new_node->size;
-			void *next_page = (void*)align_next(new_node, os.page_size);
-			void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-			if ((u8*)last_page_end > (u8*)next_page) {
-				os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
+		new = heap_alloc_tagged(size, memory_track_tag(chunk));
+	}
+	memcpy(new, p, copy_size);
+	heap_dealloc(p);
+	return new;
+}
+
+// Walks the whole heap, meant for debugging & benchmarks
+Heap_Stats heap_get_stats() {
+	if (!heap_initted) heap_init();
+
+	Heap_Stats stats = ZERO(Heap_Stats);
+
+	spinlock_acquire_or_wait(&heap_lock);
+
+	stats.allocated_bytes  = heap_allocated_bytes;
+	stats.allocation_count = heap_allocation_count;
+	stats.realloc_count          = atomic_load_64(&heap_realloc_count, MEMORY_ORDER_RELAXED);
+	stats.realloc_in_place_count = atomic_load_64(&heap_realloc_in_place_count, MEMORY_ORDER_RELAXED);
+	stats.realloc_copied_bytes   = atomic_load_64(&heap_realloc_copied_bytes, MEMORY_ORDER_RELAXED);
+	stats.page_protect_calls     = heap_page_protect_calls;
+	stats.page_commit_calls      = heap_page_commit_calls;
+	stats.page_decommit_calls    = heap_page_decommit_calls;
+	stats.decommitted_bytes      = heap_decommitted_bytes;
+
+	spinlock_acquire_or_wait(&heap_large_lock);
+	stats.large_allocation_count = heap_large_allocation_count;
+	stats.large_committed_bytes  = heap_large_committed_bytes;
+	stats.large_reserved_bytes   = heap_large_reserved_bytes;
+	spinlock_release(&heap_large_lock);
+
+	// Other threads may be touching their caches, so this is just a rough number
+	for (u64 i = 1; i < heap_thread_cache_count; i += 1) {
+		stats.thread_cached_bytes += heap_thread_caches[i]->cached_bytes;
+		if (heap_thread_caches[i]->active) stats.thread_cache_count += 1;
+	}
+
+	Heap_Block *block = heap_head;
+	while (block) {
+		stats.block_count += 1;
+		stats.reserved_bytes += block->size;
+
+		Heap_Allocation_Metadata *end = heap_block_end_chunk(block);
+		Heap_Allocation_Metadata *chunk = (Heap_Allocation_Metadata*)block->start;
+		while (chunk != end) {
+			if (chunk->size & HEAP_CHUNK_FREE) {
+				u64 size = heap_chunk_size(chunk);
+				stats.free_bytes += size;
+				stats.free_chunk_count += 1;
+				stats.largest_free_chunk = max(stats.largest_free_chunk, size);
 			}
-			
-		} else {
-			Heap_Free_Node *node = block->free_head;
-		
-			while (true) {
-			
-				assert(node != 0, "We didn't find where the free node should be! This is likely heap corruption (or, hopefully not, an internal error)");
-				
-				// In retrospect, I don't remember a good reason to care about where the
-				// free nodes are... maybe I'm just dumb right now? #Speed #Memory
-				// ... ACtually, it's probably to easily know when to merge free nodes.
-				// BUT. Maybe it's not worth the performance hit? Then again, if the heap
-				// allocator slows down your program you should rethink your memory management
-				// anyways...
-				
-				if (new_node >= node) {
-					u8* node_tail = (u8*)node + node->size;
-					if (cast(u8*)new_node == node_tail) {
-						
-						// We need to account for the cases where we coalesce free blocks with start/end in the middle
-						// of a page.
-						
-						u64 new_node_size = new_node->size;
-						
-						// #Copypaste
-						void *free_tail = (u8*)new_node + new_node->size;
-						void *next_page = (void*)align_previous(node_tail, os.page_size);
-						void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-
-						if ((u8*)next_page < (u8*)node) next_page = (u8*)next_page + os.page_size;
-						
-						if ((u8*)last_page_end > (u8*)next_page) {
-							os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
+			chunk = heap_chunk_next(chunk);
+		}
+
+		block = block->next;
+	}
+
+	spinlock_release(&heap_lock);
+
+	return stats;
+}
+
+// Once a frame is plenty, os_update does it for you. Returns how many bytes were decommitted.
+u64 heap_decommit_free_pages(u64 budget) {
+	if (!heap_initted) return 0;
+
+	spinlock_acquire_or_wait(&heap_lock);
+	if (heap_guard_freed_pages) {
+		spinlock_release(&heap_lock);
+		return 0;
+	}
+
+	Heap_Decommit_Candidate seen[HEAP_DECOMMIT_MAX_CANDIDATES];
+	u64 seen_count = 0;
+	u64 decommitted = 0;
+
+	// Biggest lists first, so if we run out of candidates or budget it's the small stuff that waits
+	u64 min_fl, min_sl;
+	heap_size_to_list_index(HEAP_DECOMMIT_MIN_SIZE, &min_fl, &min_sl);
+	u64 fl_map = heap_free_lists.fl_bitmap & (~0ull << min_fl);
+	while (fl_map && seen_count < HEAP_DECOMMIT_MAX_CANDIDATES) {
+		u64 fl = bit_scan_reverse_64(fl_map);
+		fl_map &= ~(1ull << fl);
+
+		u32 sl_map = heap_free_lists.sl_bitmap[fl];
+		while (sl_map && seen_count < HEAP_DECOMMIT_MAX_CANDIDATES) {
+			u64 sl = bit_scan_reverse_64(sl_map);
+			sl_map &= ~(1u << sl);
+
+			Heap_Allocation_Metadata *chunk = heap_free_lists.heads[fl][sl];
+			for (; chunk && seen_count < HEAP_DECOMMIT_MAX_CANDIDATES; chunk = heap_chunk_free_node(chunk)->next) {
+				u64 size = heap_chunk_size(chunk);
+				if (size < HEAP_DECOMMIT_MIN_SIZE) continue;
+
+				// Anything that changed since last pass starts over
+				Heap_Decommit_Candidate c = { chunk, size, 1, false };
+				for (u64 i = 0; i < heap_decommit_candidate_count; i += 1) {
+					Heap_Decommit_Candidate *last = &heap_decommit_candidates[i];
+					if (last->chunk == chunk && last->size == size) {
+						c.passes = last->passes + 1;
+						c.decommitted = last->decommitted;
+						break;
+					}
+				}
+
+				if (!c.decommitted && c.passes >= HEAP_DECOMMIT_DELAY_PASSES && decommitted < budget) {
+					u8 *first_page    = (u8*)heap_free_chunk_first_page(chunk);
+					u8 *last_page_end = (u8*)heap_free_chunk_pages_end(chunk);
+					if (last_page_end > first_page) {
+						os_decommit_program_memory_pages(first_page, (u64)(last_page_end-first_page));
+						chunk->size |= HEAP_CHUNK_DECOMMITTED;
+						decommitted += (u64)(last_page_end-first_page);
+						heap_page_decommit_calls += 1;
+					}
+					c.decommitted = true;
+				}
+
+				seen[seen_count] = c;
+				seen_count += 1;
+			}
+		}
+	}
+
+	memcpy(heap_decommit_candidates, seen, seen_count*sizeof(Heap_Decommit_Candidate));
+	heap_decommit_candidate_count = seen_count;
+	heap_decommitted_bytes += decommitted;
+
+	spinlock_release(&heap_lock);
+
+	return decommitted;
+}
+
+// Turning it on commits & locks everything that's free, turning it off unlocks it again
+void heap_set_guard_freed_pages(bool guard) {
+	if (!heap_initted) heap_init();
+
+	spinlock_acquire_or_wait(&heap_lock);
+	if (guard != heap_guard_freed_pages) {
+		for (u64 fl = 0; fl < HEAP_FL_COUNT; fl += 1) {
+			for (u64 sl = 0; sl < HEAP_SL_COUNT; sl += 1) {
+				Heap_Allocation_Metadata *chunk = heap_free_lists.heads[fl][sl];
+				for (; chunk; chunk = heap_chunk_free_node(chunk)->next) {
+					u8 *first_page    = (u8*)heap_free_chunk_first_page(chunk);
+					u8 *last_page_end = (u8*)heap_free_chunk_pages_end(chunk);
+					if (last_page_end <= first_page) continue;
+					u64 size = (u64)(last_page_end-first_page);
+
+					if (guard) {
+						if (chunk->size & HEAP_CHUNK_DECOMMITTED) {
+							os_commit_program_memory_pages(first_page, size);
+							chunk->size &= ~HEAP_CHUNK_DECOMMITTED;
+							heap_page_commit_calls += 1;
 						}
-						
-						node->size += new_node_size;
-						
-						break;
+						os_lock_program_memory_pages(first_page, size);
 					} else {
-						new_node->next = node->next;
-						node->next = new_node;
-						
-						u8* new_node_tail = (u8*)new_node + new_node->size;
-						if (new_node->next && (u8*)new_node->next == new_node_tail) {
-							new_node->size += new_node->next->size;
-							new_node->next = new_node->next->next;
-						}
-						
-						// #Copypaste
-						void *free_tail = (u8*)new_node + new_node->size;
-						void *next_page = (void*)align_next(new_node, os.page_size);
-						void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-						if ((u8*)last_page_end > (u8*)next_page) {
-							os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
-						}
-						
-						break;
+						os_unlock_program_memory_pages(first_page, size);
 					}
+					heap_page_protect_calls += 1;
 				}
-				
-				node = node->next;
 			}
 		}
+		heap_guard_freed_pages = guard;
+		heap_decommit_candidate_count = 0;
 	}
-	
-
-#if CONFIGURATION == DEBUG
-	block->total_allocated -= size;
-#endif
-
-#if VERY_DEBUG
-	sanity_check_block(block);
-#endif
-	// #Sync #Speed oof
 	spinlock_release(&heap_lock);
 }
 
 void* heap_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
 	switch (message) {
 		case ALLOCATOR_ALLOCATE: {
-			return heap_alloc(size);
+			// data is the Memory_Tag (see get_tagged_heap_allocator)
+			return heap_alloc_tagged(size, (Memory_Tag)(u64)data);
 			break;
 		}
 		case ALLOCATOR_DEALLOCATE: {
@@ -542,16 +1483,7 @@ void* heap_allocator_proc(u64 size, void *p, Allocator_Message message, void* da
 			return 0;
 		}
 		case ALLOCATOR_REALLOCATE: {
-			if (!p) {
-				return heap_alloc(size);
-			}
-			assert(is_pointer_valid(p), "Invalid pointer passed to heap allocator reallocate");
-			Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(((u64)p)-sizeof(Heap_Allocation_Metadata));
-			check_meta(meta);
-			void *new = heap_alloc(size);
-			memcpy(new, p, min(size, meta->size));
-			heap_dealloc(p);
-			return new;
+			return heap_realloc(p, size);
 		}
 	}
 	return 0;
@@ -559,21 +1491,246 @@ void* heap_allocator_proc(u64 size, void *p, Allocator_Message message, void* da
 
 Allocator get_heap_allocator() {
 	Allocator heap_allocator;
-	
+
 	heap_allocator.proc = heap_allocator_proc;
 	heap_allocator.data = 0;
-	
+
 	return heap_allocator;
 }
 
+///
+///
+// Memory tracking implementation
+///
+
+Allocator get_tagged_heap_allocator(Memory_Tag tag) {
+	Allocator a = get_heap_allocator();
+#if ENABLE_MEMORY_TRACKING
+	a.data = (void*)(u64)tag;
+#endif
+	return a;
+}
+
+#if ENABLE_MEMORY_TRACKING
+
+// #Global
+ogb_instance Spinlock memory_tracking_lock;
+ogb_instance Heap_Allocation_Metadata *memory_track_head;
+ogb_instance Memory_Tag_Stats memory_tag_stats[MEMORY_TAG_COUNT];
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Spinlock memory_tracking_lock;
+Heap_Allocation_Metadata *memory_track_head = 0;
+Memory_Tag_Stats memory_tag_stats[MEMORY_TAG_COUNT];
+#endif
+
+void memory_track_alloc(Heap_Allocation_Metadata *chunk, u64 size, u64 tag) {
+	if (tag == MEMORY_TAG_NONE) tag = memory_tag_current;
+	assert(tag > MEMORY_TAG_NONE && tag < MEMORY_TAG_COUNT, "Bad memory tag %llu", tag);
+
+	Memory_Track_Record *r = &chunk->track;
+	r->size = size;
+	r->tag = (u32)tag;
+	r->frame_count = 0;
+	if (memory_tracking_capture_call_sites) {
+		// Skip ourselves & heap_alloc_tagged
+		r->frame_count = (u32)os_capture_stack_frames(r->frames, MEMORY_TRACK_MAX_FRAMES, 2);
+	}
+
+	spinlock_acquire_or_wait(&memory_tracking_lock);
+	r->prev = 0;
+	r->next = memory_track_head;
+	if (memory_track_head) memory_track_head->track.prev = chunk;
+	memory_track_head = chunk;
+
+	Memory_Tag_Stats *stats = &memory_tag_stats[tag];
+	stats->live_bytes += size;
+	stats->live_count += 1;
+	stats->alloc_count += 1;
+	stats->allocated_bytes_total += size;
+	stats->peak_bytes = max(stats->peak_bytes, stats->live_bytes);
+	spinlock_release(&memory_tracking_lock);
+}
+void memory_track_free(Heap_Allocation_Metadata *chunk) {
+	Memory_Track_Record *r = &chunk->track;
+
+	spinlock_acquire_or_wait(&memory_tracking_lock);
+	if (r->prev) r->prev->track.next = r->next;
+	else         memory_track_head = r->next;
+	if (r->next) r->next->track.prev = r->prev;
+
+	Memory_Tag_Stats *stats = &memory_tag_stats[r->tag];
+	stats->live_bytes -= r->size;
+	stats->live_count -= 1;
+	stats->free_count += 1;
+	spinlock_release(&memory_tracking_lock);
+}
+void memory_track_resize(Heap_Allocation_Metadata *chunk, u64 size) {
+	Memory_Track_Record *r = &chunk->track;
+
+	spinlock_acquire_or_wait(&memory_tracking_lock);
+	Memory_Tag_Stats *stats = &memory_tag_stats[r->tag];
+	stats->live_bytes -= r->size;
+	stats->live_bytes += size;
+	if (size > r->size) stats->allocated_bytes_total += size - r->size;
+	stats->peak_bytes = max(stats->peak_bytes, stats->live_bytes);
+	r->size = size;
+	spinlock_release(&memory_tracking_lock);
+}
+u64 memory_track_tag(Heap_Allocation_Metadata *chunk) {
+	return chunk->track.tag;
+}
+
+Memory_Tag_Stats get_memory_tag_stats(Memory_Tag tag) {
+	assert(tag < MEMORY_TAG_COUNT, "Bad memory tag %d", tag);
+	spinlock_acquire_or_wait(&memory_tracking_lock);
+	Memory_Tag_Stats stats = memory_tag_stats[tag];
+	spinlock_release(&memory_tracking_lock);
+	return stats;
+}
+
+void memory_tracking_update() {
+	local_persist f64 last_time = 0;
+	local_persist u64 last_alloc_counts[MEMORY_TAG_COUNT];
+	local_persist u64 last_free_counts[MEMORY_TAG_COUNT];
+
+	f64 now = os_get_elapsed_seconds();
+	f64 delta = now - last_time;
+
+#if ENABLE_PROFILING
+	Memory_Tag_Stats stats[MEMORY_TAG_COUNT];
+#endif
+	spinlock_acquire_or_wait(&memory_tracking_lock);
+	for (u64 i = 0; i < MEMORY_TAG_COUNT; i += 1) {
+		Memory_Tag_Stats *s = &memory_tag_stats[i];
+		if (last_time > 0 && delta > 0) {
+			s->allocs_per_second = (f64)(s->alloc_count - last_alloc_counts[i]) / delta;
+			s->frees_per_second  = (f64)(s->free_count  - last_free_counts[i])  / delta;
+		}
+		last_alloc_counts[i] = s->alloc_count;
+		last_free_counts[i]  = s->free_count;
+#if ENABLE_PROFILING
+		stats[i] = *s;
+#endif
+	}
+	spinlock_release(&memory_tracking_lock);
+
+	last_time = now;
+
+#if ENABLE_PROFILING
+	// One counter track with the live bytes of every tag
+	String_Builder args;
+	string_builder_init_reserve(&args, 512, get_temporary_allocator());
+	for (u64 i = MEMORY_TAG_UNTAGGED; i < MEMORY_TAG_COUNT; i += 1) {
+		string_builder_print(&args, "%s\"%cs\":%llu", i == MEMORY_TAG_UNTAGGED ? STR("") : STR(","), memory_tag_names[i], stats[i].live_bytes);
+	}
+	_profiler_report_counters(STR("heap live bytes"), args.result, now);
+#endif
+}
+
+void memory_tracking_report_leaks() {
+	// Copy what we need out first, printing may allocate
+	#define MEMORY_REPORT_MAX 32
+	Memory_Tag_Stats stats[MEMORY_TAG_COUNT];
+	Heap_Allocation_Metadata *biggest[MEMORY_REPORT_MAX];
+	Memory_Track_Record records[MEMORY_REPORT_MAX];
+	u64 biggest_count = 0;
+
+	spinlock_acquire_or_wait(&memory_tracking_lock);
+	memcpy(stats, memory_tag_stats, sizeof(stats));
+	for (Heap_Allocation_Metadata *c = memory_track_head; c; c = c->track.next) {
+		u64 i = biggest_count;
+		while (i > 0 && biggest[i-1]->track.size < c->track.size) i -= 1;
+		if (i >= MEMORY_REPORT_MAX) continue;
+		u64 move_count = min(biggest_count, MEMORY_REPORT_MAX-1) - i;
+		memmove(biggest+i+1, biggest+i, move_count*sizeof(*biggest));
+		biggest[i] = c;
+		biggest_count = min(biggest_count+1, MEMORY_REPORT_MAX);
+	}
+	for (u64 i = 0; i < biggest_count; i += 1) records[i] = biggest[i]->track;
+	spinlock_release(&memory_tracking_lock);
+
+	u64 total_count = 0;
+	u64 total_bytes = 0;
+	for (u64 i = 0; i < MEMORY_TAG_COUNT; i += 1) {
+		total_count += stats[i].live_count;
+		total_bytes += stats[i].live_bytes;
+	}
+	print("Memory tracking: %llu allocations (%llu bytes) still allocated\n", total_count, total_bytes);
+	for (u64 i = MEMORY_TAG_UNTAGGED; i < MEMORY_TAG_COUNT; i += 1) {
+		Memory_Tag_Stats s = stats[i];
+		if (!s.alloc_count) continue;
+		print("    %cs: %llu live (%llu bytes), peak %llu bytes, %llu allocs, %llu frees\n",
+			memory_tag_names[i], s.live_count, s.live_bytes, s.peak_bytes, s.alloc_count, s.free_count);
+	}
+
+	// The biggest ones, with call sites if we captured them
+	for (u64 n = 0; n < biggest_count; n += 1) {
+		Memory_Track_Record *r = &records[n];
+		print("    %llu bytes (%cs) at %p\n", r->size, memory_tag_names[r->tag], (u8*)biggest[n]+sizeof(Heap_Allocation_Metadata));
+		if (r->frame_count) {
+			string *names = os_get_stack_frame_names(r->frames, r->frame_count, get_temporary_allocator());
+			for (u64 i = 0; i < r->frame_count; i += 1) {
+				print("        %s\n", names[i]);
+			}
+		}
+	}
+}
+
+#else
+
+Memory_Tag_Stats get_memory_tag_stats(Memory_Tag tag) {
+	return ZERO(Memory_Tag_Stats);
+}
+
+#endif // ENABLE_MEMORY_TRACKING
+
+
 ///
 ///
 // Temporary storage
 ///
+// Per thread chain of blocks. When the current block is full we move on to the next one
+// (allocating it if needed) instead of wrapping around and stomping on memory that's still in use.
+// reset_temporary_storage() goes back to the start, and if we needed more than one block that
+// frame they are merged into one big block so the chain settles at a single block.
+//
+// Scopes:
+//     temp_scope() {
+//         ... everything talloc'd in here is given back after the scope
+//     }
+// or temporary_storage_mark() / temporary_storage_pop_to_mark() if you need it across functions.
+//
+// get_temporary_storage_stats() tells you how much this thread actually uses, so the
+// TEMPORARY_STORAGE_SIZE & Thread.temporary_storage_size budgets can be set from that.
 
 #ifndef TEMPORARY_STORAGE_SIZE
 	#define TEMPORARY_STORAGE_SIZE (1024ULL*1024ULL*2ULL) // 2mb
 #endif
+#define TEMPORARY_STORAGE_ALIGNMENT 8
+
+typedef struct Temporary_Storage_Block Temporary_Storage_Block;
+typedef struct Temporary_Storage_Block {
+	Temporary_Storage_Block *next;
+	u64 size; // Usable bytes after the header
+} Temporary_Storage_Block;
+
+typedef struct Temporary_Storage_Mark {
+	Temporary_Storage_Block *block;
+	u8 *pointer;
+	u64 used_before_block;
+} Temporary_Storage_Mark;
+
+typedef struct Temporary_Storage_Stats {
+	u64 used; // Right now
+	u64 capacity; // All blocks in the chain
+	u64 block_count;
+	u64 frame_peak; // Since the last reset_temporary_storage
+	u64 last_frame_peak; // Between the last two resets
+	u64 peak; // Ever, on this thread
+	u64 grow_count; // How many times we had to allocate a new block
+	u64 frame_count; // How many times reset_temporary_storage was called
+} Temporary_Storage_Stats;
 
 ogb_instance void* talloc(u64);
 ogb_instance void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void*);
@@ -583,9 +1740,12 @@ ogb_instance Allocator
 get_temporary_allocator();
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
-thread_local void * temporary_storage = 0;
-thread_local void * temporary_storage_pointer = 0;
-thread_local bool   has_warned_temporary_storage_overflow = false;
+thread_local Temporary_Storage_Block *temporary_storage = 0; // First block
+thread_local Temporary_Storage_Block *temporary_storage_block = 0; // Current block
+thread_local u8 *temporary_storage_pointer = 0;
+thread_local u8 *temporary_storage_end = 0;
+thread_local u64 temporary_storage_used_before_block = 0;
+thread_local Temporary_Storage_Stats temporary_storage_stats;
 thread_local Allocator temp_allocator;
 
 ogb_instance Allocator 
@@ -601,12 +1761,30 @@ temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data);
 ogb_instance void 
 temporary_storage_init(u64 arena_size);
 
+// Frees all blocks, called when a thread exits
+ogb_instance void 
+temporary_storage_deinit();
+
 ogb_instance void* 
 talloc(u64 size);
 
 ogb_instance void 
 reset_temporary_storage();
 
+ogb_instance Temporary_Storage_Mark
+temporary_storage_mark();
+
+ogb_instance void
+temporary_storage_pop_to_mark(Temporary_Storage_Mark mark);
+
+// For the calling thread
+ogb_instance Temporary_Storage_Stats
+get_temporary_storage_stats();
+
+#define temp_scope() \
+	for (Temporary_Storage_Mark _temp_mark = temporary_storage_mark(), *_temp_once = &_temp_mark; \
+		_temp_once; \
+		temporary_storage_pop_to_mark(_temp_mark), _temp_once = 0)
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
@@ -619,82 +1797,321 @@ void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* da
 			return 0;
 		}
 		case ALLOCATOR_REALLOCATE: {
-			panic("Temporary allocator cannot 'reallocate'");
+			// Can't, reallocate() will alloc + copy
 			return 0;
 		}
 	}
 	return 0;
 }
 
+Temporary_Storage_Block *temporary_storage_make_block(u64 size) {
+	Temporary_Storage_Block *block = (Temporary_Storage_Block*)heap_alloc_tagged(sizeof(Temporary_Storage_Block) + size, MEMORY_TAG_TEMP);
+	assert(block, "Failed allocating temporary storage");
+	block->next = 0;
+	block->size = size;
+	temporary_storage_stats.capacity += size;
+	temporary_storage_stats.block_count += 1;
+	return block;
+}
+
+void temporary_storage_free_chain(Temporary_Storage_Block *block) {
+	while (block) {
+		Temporary_Storage_Block *next = block->next;
+		temporary_storage_stats.capacity -= block->size;
+		temporary_storage_stats.block_count -= 1;
+		heap_dealloc(block);
+		block = next;
+	}
+}
+
+void temporary_storage_use_block(Temporary_Storage_Block *block, u64 used_before_block) {
+	temporary_storage_block = block;
+	temporary_storage_pointer = (u8*)(block+1);
+	temporary_storage_end = temporary_storage_pointer + block->size;
+	temporary_storage_used_before_block = used_before_block;
+}
+
 void temporary_storage_init(u64 arena_size) {
 	
-	temporary_storage = heap_alloc(arena_size);
-	assert(temporary_storage, "Failed allocating temporary storage");
-	temporary_storage_pointer = temporary_storage;
+	temporary_storage_stats = (Temporary_Storage_Stats){0};
+	temporary_storage = temporary_storage_make_block(arena_size);
+	temporary_storage_use_block(temporary_storage, 0);
 
 	temp_allocator.proc = temp_allocator_proc;
 	temp_allocator.data = 0;
-	
-	temp_allocator.proc = temp_allocator_proc;
+}
+
+void temporary_storage_deinit() {
+	temporary_storage_free_chain(temporary_storage);
+	temporary_storage = 0;
+	temporary_storage_block = 0;
+	temporary_storage_pointer = 0;
+	temporary_storage_end = 0;
+}
+
+void* temporary_storage_grow(u64 size) {
+	Temporary_Storage_Block *block = temporary_storage_block;
+	u64 used_before_next = temporary_storage_used_before_block + (u64)(temporary_storage_pointer - (u8*)(block+1));
+
+	// Blocks after the current one aren't used by anyone, reuse the next one if it's big enough
+	if (!block->next || block->next->size < size) {
+		temporary_storage_free_chain(block->next);
+		block->next = temporary_storage_make_block(max(block->size*2, size));
+		temporary_storage_stats.grow_count += 1;
+	}
+
+	temporary_storage_use_block(block->next, used_before_next);
+	return talloc(size);
 }
 
 void* talloc(u64 size) {
-	
-	assert(size < TEMPORARY_STORAGE_SIZE, "Bruddah this is too large for temp allocator");
-	
-	void* p = temporary_storage_pointer;
-	
-	temporary_storage_pointer = (u8*)temporary_storage_pointer + size;
-	
-	if ((u8*)temporary_storage_pointer >= (u8*)temporary_storage+TEMPORARY_STORAGE_SIZE) {
-		if (!has_warned_temporary_storage_overflow) {
-			os_write_string_to_stdout(STR("WARNING: temporary storage was overflown, we wrap around at the start.\n"));
-			has_warned_temporary_storage_overflow = true;
-		}
-		temporary_storage_pointer = temporary_storage;
-		return talloc(size);;
+	size = align_next(size, TEMPORARY_STORAGE_ALIGNMENT);
+
+	if (size > (u64)(temporary_storage_end - temporary_storage_pointer)) {
+		return temporary_storage_grow(size);
 	}
+
+	void* p = temporary_storage_pointer;
+	temporary_storage_pointer += size;
+
+	u64 used = temporary_storage_used_before_block + (u64)(temporary_storage_pointer - (u8*)(temporary_storage_block+1));
+	if (used > temporary_storage_stats.frame_peak) temporary_storage_stats.frame_peak = used;
 	
 	return p;
 }
 
 void reset_temporary_storage() {
-	temporary_storage_pointer = temporary_storage;	
-	has_warned_temporary_storage_overflow = false;
+	if (!temporary_storage) return;
+
+	Temporary_Storage_Stats *stats = &temporary_storage_stats;
+	stats->last_frame_peak = stats->frame_peak;
+	stats->peak = max(stats->peak, stats->frame_peak);
+	stats->frame_peak = 0;
+	stats->frame_count += 1;
+
+	// We needed more than one block, replace the chain with one block big enough for last frame
+	if (temporary_storage->next) {
+		u64 size = get_next_power_of_two(max(stats->last_frame_peak, temporary_storage->size));
+		temporary_storage_free_chain(temporary_storage);
+		temporary_storage = temporary_storage_make_block(size);
+	}
+
+	temporary_storage_use_block(temporary_storage, 0);
+}
+
+Temporary_Storage_Mark temporary_storage_mark() {
+	Temporary_Storage_Mark mark;
+	mark.block = temporary_storage_block;
+	mark.pointer = temporary_storage_pointer;
+	mark.used_before_block = temporary_storage_used_before_block;
+	return mark;
+}
+
+void temporary_storage_pop_to_mark(Temporary_Storage_Mark mark) {
+	// Blocks after mark.block stay in the chain, they'll get reused
+	temporary_storage_block = mark.block;
+	temporary_storage_pointer = mark.pointer;
+	temporary_storage_end = (u8*)(mark.block+1) + mark.block->size;
+	temporary_storage_used_before_block = mark.used_before_block;
+}
+
+Temporary_Storage_Stats get_temporary_storage_stats() {
+	Temporary_Storage_Stats stats = temporary_storage_stats;
+	stats.used = temporary_storage_used_before_block + (u64)(temporary_storage_pointer - (u8*)(temporary_storage_block+1));
+	stats.peak = max(stats.peak, stats.frame_peak);
+	return stats;
 }
 
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
 
+///
+///
+// Arena
+///
+// Reserves a big range of address space up front and commits it as you push, so you can just
+// give it a size you'll never hit (like GB(1)) and only pay for what you actually use.
+// Pushes are a pointer bump. Rewind with marks or reset the whole thing.
+//
+//     Arena arena = make_arena(GB(1));
+//     Arena_Mark mark = arena_mark(&arena);
+//     Entity *scratch = arena_push(&arena, count*sizeof(Entity));
+//     ...
+//     arena_pop_to_mark(&arena, mark);
+//
+// Pushed memory is NOT zeroed (unless it's fresh pages), use alloc() through
+// make_arena_allocator if you want DO_ZERO_INITIALIZATION.
+// Pushing past the end asserts, arena_try_push returns 0 instead.
+//
+// Not thread safe, give each thread its own arena.
+
+#define ARENA_DEFAULT_ALIGNMENT 8
+#ifndef ARENA_COMMIT_SIZE
+	// How much we commit at a time. Bigger means fewer syscalls but more memory that's committed
+	// and not used.
+	#define ARENA_COMMIT_SIZE KB(64)
+#endif
+
 typedef struct Arena {
 	void *start;
 	void *next;
-	u64 size;
+	void *last; // Most recent push, so reallocate can grow it in place
+	u64 size; // How much we can push before overflowing
+	u64 committed; // Bytes from start that are backed by memory
+	u64 peak; // The most that's ever been used
+	bool owns_memory; // Reserved by make_arena, released in arena_destroy
+	bool decommit_on_reset; // Give memory back to the OS in arena_reset
 } Arena;
 
+typedef struct Arena_Mark {
+	u64 used;
+} Arena_Mark;
+
+// Reserves size bytes of address space, commits as needed
+ogb_instance Arena
+make_arena(u64 size);
+
+// Uses memory you provide, never grows
+ogb_instance Arena
+make_arena_with_memory(u64 size, void *p);
+
+ogb_instance void
+arena_destroy(Arena *arena);
+
+// Returns 0 if it doesn't fit
+ogb_instance void*
+arena_try_push_aligned(Arena *arena, u64 size, u64 alignment);
+
+ogb_instance void*
+arena_push_aligned(Arena *arena, u64 size, u64 alignment);
+
+ogb_instance void*
+arena_push(Arena *arena, u64 size);
+#define arena_push_struct(parena, type) ((type*)arena_push_aligned((parena), sizeof(type), _Alignof(type)))
+#define arena_push_array(parena, type, count) ((type*)arena_push_aligned((parena), sizeof(type)*(count), _Alignof(type)))
+
+ogb_instance Arena_Mark
+arena_mark(Arena *arena);
+
+ogb_instance void
+arena_pop_to_mark(Arena *arena, Arena_Mark mark);
+
+ogb_instance void
+arena_reset(Arena *arena);
 
+inline u64 arena_used(Arena *arena) { return (u64)arena->next - (u64)arena->start; }
+
+ogb_instance void*
+arena_allocator_proc(u64 size, void *p, Allocator_Message message, void* data);
+
+// Arena header lives on the heap, free everything with arena_allocator_destroy
+ogb_instance Allocator
+make_arena_allocator(u64 size);
+
+ogb_instance Allocator
+make_arena_allocator_with_memory(u64 size, void *p);
+
+ogb_instance Allocator
+make_arena_allocator_from_arena(Arena *arena);
+
+ogb_instance void
+arena_allocator_destroy(Allocator allocator);
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
-// Allocates arena from heap
 Arena make_arena(u64 size) {
-	size = align_next(size, 8);
-	Arena arena;
-	
-	arena.start = alloc(get_heap_allocator(), size);
+	Arena arena = ZERO(Arena);
+
+	size = align_next(size, os.page_size);
+	arena.start = os_reserve_memory(size);
+	assert(arena.start, "Failed reserving %llu bytes for arena", size);
 	arena.next = arena.start;
 	arena.size = size;
-	
+	arena.owns_memory = true;
+
 	return arena;
 }
 
-void *arena_push(Arena *arena, u64 size) {
-	void *p = arena->next;
-	arena->next = (u8*)arena->next + size;
+Arena make_arena_with_memory(u64 size, void *p) {
+	Arena arena = ZERO(Arena);
+
+	arena.start = p;
+	arena.next = p;
+	arena.size = size;
+	arena.committed = size;
+
+	return arena;
+}
+
+void arena_destroy(Arena *arena) {
+	if (arena->owns_memory) os_release_memory(arena->start, arena->size);
+	*arena = ZERO(Arena);
+}
+
+bool arena_commit(Arena *arena, u64 used) {
+	u64 new_committed = min(align_next(used, ARENA_COMMIT_SIZE), arena->size);
+	new_committed = align_next(new_committed, os.page_size);
+
+	u8 *commit_start = (u8*)arena->start + arena->committed;
+	if (!os_commit_memory(commit_start, new_committed - arena->committed)) return false;
+	arena->committed = new_committed;
+	return true;
+}
+
+void *arena_try_push_aligned(Arena *arena, u64 size, u64 alignment) {
+	assert(alignment != 0 && (alignment & (alignment-1)) == 0, "Arena alignment must be a power of two, got %llu", alignment);
+
+	u64 at = align_next((u64)arena->next, alignment);
+	u64 used = at - (u64)arena->start;
+
+	// Careful with the order here so a silly size can't wrap around
+	if (used > arena->size || size > arena->size - used) return 0;
+
+	u64 new_used = used + size;
+	if (new_used > arena->committed) {
+		assert(arena->owns_memory, "Arena committed size is wrong");
+		if (!arena_commit(arena, new_used)) return 0;
+	}
+
+	arena->next = (void*)(at + size);
+	arena->last = (void*)at;
+	if (new_used > arena->peak) arena->peak = new_used;
+	return (void*)at;
+}
+
+void *arena_push_aligned(Arena *arena, u64 size, u64 alignment) {
+	void *p = arena_try_push_aligned(arena, size, alignment);
+	assert(p, "Arena overflow: tried pushing %llu bytes with %llu/%llu used", size, arena_used(arena), arena->size);
 	return p;
 }
-#define arena_push_struct(parena, type) arena_push((parena), sizeof(type))
+
+void *arena_push(Arena *arena, u64 size) {
+	return arena_push_aligned(arena, size, ARENA_DEFAULT_ALIGNMENT);
+}
+
+Arena_Mark arena_mark(Arena *arena) {
+	return (Arena_Mark){ arena_used(arena) };
+}
+
+void arena_pop_to_mark(Arena *arena, Arena_Mark mark) {
+	assert(mark.used <= arena_used(arena), "Arena mark is ahead of the arena, popped marks in the wrong order?");
+	arena->next = (u8*)arena->start + mark.used;
+	arena->last = 0;
+}
+
+void arena_reset(Arena *arena) {
+	arena->next = arena->start;
+	arena->last = 0;
+
+	// Keep the first commit chunk around, that's probably going to be used again right away
+	if (arena->decommit_on_reset && arena->owns_memory && arena->committed > ARENA_COMMIT_SIZE) {
+		u64 keep = align_next(min(ARENA_COMMIT_SIZE, arena->size), os.page_size);
+		os_decommit_memory((u8*)arena->start + keep, arena->committed - keep);
+		arena->committed = keep;
+	}
+}
 
 void* arena_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
-	if (size > 8) size = align_next(size, 8);
 	Arena *arena = (Arena*)data;
 	switch (message) {
 		case ALLOCATOR_ALLOCATE: {
@@ -704,48 +2121,283 @@ void* arena_allocator_proc(u64 size, void *p, Allocator_Message message, void* d
 			return 0;
 		}
 		case ALLOCATOR_REALLOCATE: {
-			panic("Arena allocator cannot 'reallocate'");
-			return 0;
+			if (!p) return arena_push(arena, size);
+
+			// Last thing pushed can just grow/shrink in place
+			if (p == arena->last) {
+				void *next = arena->next;
+				arena->next = p;
+				void *same = arena_try_push_aligned(arena, size, 1);
+				if (same) return same;
+				arena->next = next;
+			}
+
+			// We don't know the old size, but everything between p and next is ours to read
+			u64 readable = (u64)arena->next - (u64)p;
+			void *new = arena_push(arena, size);
+			memcpy(new, p, min(size, readable));
+			return new;
 		}
 	}
 	return 0;
 }
 
-// Allocates arena from heap
 Allocator make_arena_allocator(u64 size) {
-	void *mem = alloc(get_heap_allocator(), size + sizeof(Arena));
-	
-	Arena *arena = (Arena*)mem;
-	
-	arena->start = (u8*)mem + sizeof(Arena);
-	arena->next = arena->start;
-	arena->size = size;
-	
-	Allocator allocator;
-	allocator.data = arena;
-	allocator.proc = arena_allocator_proc;
-	
-	return allocator;
+	Arena *arena = (Arena*)alloc(get_heap_allocator(), sizeof(Arena));
+	*arena = make_arena(size);
+
+	return make_arena_allocator_from_arena(arena);
 }
 Allocator make_arena_allocator_with_memory(u64 size, void *p) {
-	void *mem = alloc(get_heap_allocator(), size + sizeof(Arena));
-	
 	Arena *arena = (Arena*)alloc(get_heap_allocator(), sizeof(Arena));
-	
-	arena->start = p;
-	arena->next = arena->start;
-	arena->size = size;
-	
-	Allocator allocator;
-	allocator.data = arena;
-	allocator.proc = arena_allocator_proc;
-	
-	return allocator;
+	*arena = make_arena_with_memory(size, p);
+
+	return make_arena_allocator_from_arena(arena);
 }
 Allocator make_arena_allocator_from_arena(Arena *arena) {
 	Allocator allocator;
 	allocator.data = arena;
 	allocator.proc = arena_allocator_proc;
-	
+
 	return allocator;
 }
+void arena_allocator_destroy(Allocator allocator) {
+	assert(allocator.proc == arena_allocator_proc, "Not an arena allocator");
+	Arena *arena = (Arena*)allocator.data;
+	arena_destroy(arena);
+	dealloc(get_heap_allocator(), arena);
+}
+
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+
+///
+///
+// Pool
+///
+// Fixed size objects carved out of chunks, for things that are made & destroyed all the time
+// (audio players, particles, emissions...).
+// - Objects never move, a pointer stays good until that object is freed.
+// - Free slots are an intrusive list (the next free index is written into the freed object),
+//   so pool_alloc & pool_free are O(1). No scanning for an unused slot.
+// - Every slot has a generation that changes on alloc & free. A Pool_Handle to something that
+//   was freed (and maybe reused since) gives 0 from pool_get instead of the new object.
+// - Live objects are listed densely, so iterating doesn't walk over the free ones.
+//
+//     Pool pool = make_typed_pool(Particle, 1024, get_heap_allocator());
+//     Particle *p = pool_alloc(&pool);
+//     Pool_Handle h = pool_get_handle(&pool, p);
+//     ...
+//     for (u64 i = pool.count; i-- > 0;) {
+//         Particle *p = pool_get_live(&pool, i);
+//         if (dead) pool_free(&pool, p); // Fine as long as you iterate backwards
+//     }
+//     ...
+//     p = pool_get(&pool, h); // 0 if it was freed
+//
+// Freeing moves the last live object into the freed one's spot in the dense list, so the
+// iteration order changes as things are freed.
+// Objects are zeroed on pool_alloc if DO_ZERO_INITIALIZATION.
+// Not thread safe.
+
+typedef struct Pool_Handle {
+	u32 index;
+	u32 generation; // Odd while alive, so a zeroed handle is never valid
+} Pool_Handle;
+
+// Lives in front of every object
+typedef struct Pool_Slot {
+	u32 index;
+	u32 generation;
+	u32 dense_index;
+} Pool_Slot;
+
+typedef struct Pool {
+	Allocator allocator;
+	u64 element_size;
+	u64 alignment;
+	u64 header_size; // Pool_Slot padded to the alignment
+	u64 stride;
+	u64 chunk_shift; // 1 << chunk_shift slots per chunk
+	u8 **chunks;
+	u64 chunk_count;
+	u64 chunk_capacity;
+	u32 *dense; // Slot index of each live object
+	u64 count; // Live objects
+	u64 dense_capacity;
+	u64 used_slots; // Slots that have been handed out at least once
+	u32 first_free; // Slot index + 1, 0 for none
+} Pool;
+
+// objects_per_chunk is rounded up to a power of two
+ogb_instance Pool
+make_pool(u64 element_size, u64 alignment, u64 objects_per_chunk, Allocator allocator);
+#define make_typed_pool(type, objects_per_chunk, allocator) make_pool(sizeof(type), _Alignof(type), (objects_per_chunk), (allocator))
+
+ogb_instance void
+pool_destroy(Pool *pool);
+
+ogb_instance void*
+pool_alloc(Pool *pool);
+
+ogb_instance void
+pool_free(Pool *pool, void *p);
+
+// Returns false if the handle was stale
+ogb_instance bool
+pool_free_handle(Pool *pool, Pool_Handle handle);
+
+// Frees every live object, keeps the chunks
+ogb_instance void
+pool_clear(Pool *pool);
+
+ogb_instance Pool_Handle
+pool_get_handle(Pool *pool, void *p);
+
+// 0 if the object was freed
+ogb_instance void*
+pool_get(Pool *pool, Pool_Handle handle);
+
+inline Pool_Slot *pool_slot_from_index(Pool *pool, u64 index) {
+	u64 mask = (1ull << pool->chunk_shift) - 1;
+	return (Pool_Slot*)(pool->chunks[index >> pool->chunk_shift] + (index & mask)*pool->stride);
+}
+
+// i < pool->count
+inline void *pool_get_live(Pool *pool, u64 i) {
+	assert(i < pool->count, "Pool live index out of range");
+	return (u8*)pool_slot_from_index(pool, pool->dense[i]) + pool->header_size;
+}
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+Pool make_pool(u64 element_size, u64 alignment, u64 objects_per_chunk, Allocator allocator) {
+	assert(alignment && (alignment & (alignment-1)) == 0, "Pool alignment must be a power of two");
+	assert(alignment <= 16, "Pool objects can't be aligned to more than 16");
+	assert(element_size, "Pool element size can't be 0");
+
+	alignment = max(alignment, _Alignof(Pool_Slot));
+
+	Pool pool = ZERO(Pool);
+	pool.allocator = allocator;
+	pool.element_size = element_size;
+	pool.alignment = alignment;
+	pool.header_size = align_next(sizeof(Pool_Slot), alignment);
+	// Freed objects hold the next free index
+	pool.stride = align_next(pool.header_size + max(element_size, sizeof(u32)), alignment);
+	pool.chunk_shift = bit_scan_reverse_64(get_next_power_of_two(max(objects_per_chunk, 1)));
+
+	return pool;
+}
+
+void pool_destroy(Pool *pool) {
+	for (u64 i = 0; i < pool->chunk_count; i += 1) {
+		dealloc(pool->allocator, pool->chunks[i]);
+	}
+	if (pool->chunks) dealloc(pool->allocator, pool->chunks);
+	if (pool->dense)  dealloc(pool->allocator, pool->dense);
+	*pool = ZERO(Pool);
+}
+
+inline Pool_Slot *pool_slot_from_pointer(Pool *pool, void *p) {
+	Pool_Slot *slot = (Pool_Slot*)((u8*)p - pool->header_size);
+	assert(slot->index < pool->used_slots && pool_slot_from_index(pool, slot->index) == slot, "Pointer is not from this pool");
+	return slot;
+}
+
+void pool_add_chunk(Pool *pool) {
+	u64 slots_per_chunk = 1ull << pool->chunk_shift;
+	assert((pool->chunk_count+1)*slots_per_chunk <= 0xFFFFFFFFull, "Pool is full");
+
+	if (pool->chunk_count == pool->chunk_capacity) {
+		u64 new_capacity = max(pool->chunk_capacity*2, 8);
+		pool->chunks = (u8**)reallocate(pool->allocator, pool->chunks, pool->chunk_capacity*sizeof(u8*), new_capacity*sizeof(u8*));
+		pool->chunk_capacity = new_capacity;
+	}
+
+	// Slot headers are written as slots get used, no need to touch the whole chunk now
+	u8 *chunk = (u8*)alloc_uninitialized(pool->allocator, slots_per_chunk*pool->stride);
+	assert(chunk, "Pool allocator returned 0");
+	assert((u64)chunk % pool->alignment == 0, "Pool allocator gave a misaligned chunk");
+	pool->chunks[pool->chunk_count] = chunk;
+	pool->chunk_count += 1;
+}
+
+void *pool_alloc(Pool *pool) {
+	assert(pool->stride, "Pool is not initialized, use make_pool");
+
+	Pool_Slot *slot;
+	if (pool->first_free) {
+		slot = pool_slot_from_index(pool, pool->first_free-1);
+		pool->first_free = *(u32*)((u8*)slot + pool->header_size);
+	} else {
+		if (pool->used_slots == (pool->chunk_count << pool->chunk_shift)) pool_add_chunk(pool);
+		slot = pool_slot_from_index(pool, pool->used_slots);
+		slot->index = (u32)pool->used_slots;
+		slot->generation = 0;
+		pool->used_slots += 1;
+	}
+
+	if (pool->count == pool->dense_capacity) {
+		u64 new_capacity = max(pool->dense_capacity*2, 1ull << pool->chunk_shift);
+		pool->dense = (u32*)reallocate(pool->allocator, pool->dense, pool->dense_capacity*sizeof(u32), new_capacity*sizeof(u32));
+		pool->dense_capacity = new_capacity;
+	}
+
+	slot->generation += 1;
+	slot->dense_index = (u32)pool->count;
+	pool->dense[pool->count] = slot->index;
+	pool->count += 1;
+
+	void *p = (u8*)slot + pool->header_size;
+#if DO_ZERO_INITIALIZATION
+	memset(p, 0, pool->element_size);
+#endif
+	return p;
+}
+
+void pool_free(Pool *pool, void *p) {
+	Pool_Slot *slot = pool_slot_from_pointer(pool, p);
+	assert(slot->generation & 1, "Pool object was already freed");
+
+	slot->generation += 1;
+
+	u32 last = pool->dense[pool->count-1];
+	pool->dense[slot->dense_index] = last;
+	pool_slot_from_index(pool, last)->dense_index = slot->dense_index;
+	pool->count -= 1;
+
+#if CONFIGURATION == DEBUG
+	memset(p, 0x69, pool->element_size);
+#endif
+	*(u32*)p = pool->first_free;
+	pool->first_free = slot->index + 1;
+}
+
+bool pool_free_handle(Pool *pool, Pool_Handle handle) {
+	void *p = pool_get(pool, handle);
+	if (!p) return false;
+	pool_free(pool, p);
+	return true;
+}
+
+void pool_clear(Pool *pool) {
+	while (pool->count) {
+		pool_free(pool, pool_get_live(pool, pool->count-1));
+	}
+}
+
+Pool_Handle pool_get_handle(Pool *pool, void *p) {
+	Pool_Slot *slot = pool_slot_from_pointer(pool, p);
+	assert(slot->generation & 1, "Pool object is not alive");
+	return (Pool_Handle){ slot->index, slot->generation };
+}
+
+void *pool_get(Pool *pool, Pool_Handle handle) {
+	if (!(handle.generation & 1) || handle.index >= pool->used_slots) return 0;
+	Pool_Slot *slot = pool_slot_from_index(pool, handle.index);
+	if (slot->generation != handle.generation) return 0;
+	return (u8*)slot + pool->header_size;
+}
+
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
@@ -121,10 +121,55 @@
 				#define ENABLE_PROFILING 1
 				
 			Note:
-				See timing macros in profile.c
+				See timing macros in profiling.c
 					tm_scope
 					tm_scope_var
 					tm_scope_accum
+				profiler_keep_last_frames() to only keep the last N frames (bounded memory).
+					
+		- ENABLE_MEMORY_TRACKING
+			Track heap allocations per Memory_Tag (live/peak bytes, alloc/free rates), optionally 
+			with call sites, and print what's still allocated at exit.
+		
+			0: Disable
+			1: Enable
+			
+			Example:
+			
+				#define ENABLE_MEMORY_TRACKING 1
+				
+			Note:
+				See Memory tracking in memory.c
+				Compiled out it costs nothing, enabled every heap allocation gets bigger metadata.
+					
+		- ENABLE_LOCK_STATS
+			Count acquisitions, contended acquisitions, spins and sleeps on every Spinlock, Mutex 
+			and RW_Lock.
+		
+			0: Disable
+			1: Enable
+			
+			Example:
+			
+				#define ENABLE_LOCK_STATS 1
+				
+			Note:
+				See concurrency.c. profiler_report_lock_stats() puts them in the profile.
+					
+		- HEAP_GUARD_FREED_PAGES
+			Lock the pages inside freed heap memory so touching it crashes right away.
+			Can also be switched at runtime with heap_set_guard_freed_pages().
+		
+			0: Disable (default, freed pages are decommitted lazily instead)
+			1: Enable
+			
+			Example:
+			
+				#define HEAP_GUARD_FREED_PAGES 1
+				
+			Note:
+				See Freed pages in memory.c
+				This used to always be on in debug builds. It's a syscall on most heap allocs & frees.
 					
 		- OOGABOOGA_HEADLESS
             Run oogabooga in headless mode, i.e. no window, no graphics, no audio.
@@ -144,9 +189,18 @@
 
 #define OGB_VERSION (OGB_VERSION_MAJOR*1000000+OGB_VERSION_MINOR*1000+OGB_VERSION_PATCH)
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+	// Needs to be defined before any system header is included
+	#define _GNU_SOURCE
+#endif
+
 #include <math.h>
 #include <immintrin.h>
-#include <intrin.h>
+#ifdef _WIN32
+	#include <intrin.h>
+#else
+	#include <x86intrin.h>
+#endif
 #include <stdint.h>
 
 typedef uint8_t  u8;
@@ -203,6 +257,7 @@ typedef u8 bool;
 
 
 #include "cpu.c"
+#include "atomics.c"
 
 
 
@@ -258,9 +313,17 @@ typedef u8 bool;
 	#define TARGET_OS WINDOWS
 	#define OS_PATHS_HAVE_BACKSLASH 1
 #elif defined(__linux__)
-	// Include whatever #Incomplete #Portability
+	// Windows.h drags these in for us, on linux we need to ask for them.
+	// The rest of the posix headers are included in os_impl_linux.c
+	#include <stdarg.h>
+	#include <stddef.h>
+	#include <string.h>
+	#include <limits.h>
+	#include <unistd.h> // SEEK_SET & friends for stb
+	#define __cdecl // Only one calling convention on x64 sysv
+	#define max(a, b) ((a) > (b) ? (a) : (b))
+	#define min(a, b) ((a) < (b) ? (a) : (b))
 	#define TARGET_OS LINUX
-	#error "Linux is not supported yet";
 	#define OS_PATHS_HAVE_BACKSLASH 0
 #elif defined(__APPLE__) && defined(__MACH__)
 	// Include whatever #Incomplete #Portability
@@ -305,13 +368,16 @@ typedef u8 bool;
 #include "string.c"
 #include "unicode.c"
 #include "string_format.c"
-#include "hash.c"
+#include "compression.c"
 #include "path_utils.c"
 #include "utility.c"
 #include "linmath.c"
 
+#include "hash.c"
 #include "hash_table.c"
 #include "growing_array.c"
+#include "bucket_array.c"
+#include "concurrent_queue.c"
 
 #include "os_interface.c"
 
@@ -332,6 +398,8 @@ typedef u8 bool;
 #include "random.c"
 #include "color.c"
 #include "memory.c"
+#include "job_system.c"
+#include "quad_batch.c"
 #include "input.c"
 
 #ifndef OOGABOOGA_HEADLESS
@@ -467,6 +535,10 @@ int main(int argc, char **argv) {
 	
 	int code = ENTRY_PROC(argc, argv);
 	
+#if ENABLE_MEMORY_TRACKING
+	memory_tracking_report_leaks();
+#endif
+	
 #if ENABLE_PROFILING
 	
 	dump_profile_result();
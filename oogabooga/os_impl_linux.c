@@ -0,0 +1,1089 @@
+
+// Linux os layer.
+// This is headless only (no window, no gfx, no audio, no input) for now, which is enough to
+// run the standard library, tests & benchmarks, servers etc. on linux machines.
+// See build_linux.sh for how to build.
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <execinfo.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define VIRTUAL_MEMORY_BASE ((void*)0x0000690000000000ULL)
+void* heap_alloc(u64);
+void heap_dealloc(void*);
+
+// Linker defined, start & end of the executable image
+extern char __executable_start[];
+extern char _end[];
+
+// #Global
+struct timespec linux_time_at_start;
+bool has_os_update_been_called_at_all = false;
+
+thread_local void *linux_stack_base = 0;
+thread_local void *linux_stack_limit = 0;
+
+// impl input.c
+const u64 MAX_NUMBER_OF_GAMEPADS = 0;
+
+void s64_to_null_terminated_string(s64 num, char* str, int base);
+
+char *
+linux_temp_null_terminated_path(string path) {
+	return temp_convert_to_null_terminated_string(path);
+}
+
+void
+linux_query_monitors() {
+
+	window.monitor = 0;
+
+	if (os.monitors) growing_array_clear((void**)&os.monitors);
+	else growing_array_init((void**)&os.monitors, sizeof(Os_Monitor), get_heap_allocator());
+
+	// We don't have any displays in headless, but a lot of code expects a monitor to be there
+	// so we just make a fake one.
+	Os_Monitor *monitor = (Os_Monitor*)growing_array_add_empty((void**)&os.monitors);
+	memset(monitor, 0, sizeof(Os_Monitor));
+	monitor->name = STR("Headless");
+	monitor->refresh_rate = 60;
+	monitor->dpi = 72;
+	monitor->dpi_y = 72;
+
+	os.primary_monitor = monitor;
+	os.number_of_connected_monitors = growing_array_get_valid_count(os.monitors);
+	window.monitor = os.primary_monitor;
+}
+
+void os_init(u64 program_memory_capacity) {
+
+#if RUN_TESTS
+	// Printing goes through our own formatter in string_format.c now, so the crt is only
+	// loaded for the tests, which check the formatter against vsnprintf & strtod.
+	os.crt = os_load_dynamic_library(STR("libc.so.6"));
+	assert(os.crt != 0, "Could not load libc.so.6 #Incomplete #Portability");
+	os.crt_vsnprintf = (Crt_Vsnprintf_Proc)os_dynamic_library_load_symbol(os.crt, STR("vsnprintf"));
+	assert(os.crt_vsnprintf, "Missing vsnprintf in crt");
+#endif
+
+	context.thread_id = (u64)pthread_self();
+
+	os.page_size = (u64)sysconf(_SC_PAGESIZE);
+	// There is no separate allocation granularity on linux, mmap works in pages
+	os.granularity = os.page_size;
+
+	os.static_memory_start = __executable_start;
+	os.static_memory_end   = _end;
+
+	program_memory_mutex = os_make_mutex();
+	os_grow_program_memory(program_memory_capacity);
+
+	heap_init();
+
+	clock_gettime(CLOCK_MONOTONIC, &linux_time_at_start);
+
+	memset(&window, 0, sizeof(window));
+	window.title = STR("Headless");
+
+	linux_query_monitors();
+}
+
+void s64_to_null_terminated_string_reverse(char str[], int length)
+{
+    int start = 0;
+    int end = length - 1;
+    while (start < end) {
+        char temp = str[start];
+        str[start] = str[end];
+        str[end] = temp;
+        end--;
+        start++;
+    }
+}
+
+void s64_to_null_terminated_string(s64 num, char* str, int base)
+{
+    int i = 0;
+    bool neg = false;
+
+    if (num == 0) {
+        str[i++] = '0';
+        str[i] = '\0';
+        return;
+    }
+
+    if (num < 0 && base == 10) {
+        neg = true;
+        num = -num;
+    }
+
+    while (num != 0) {
+        int rem = num % base;
+        str[i++] = (rem > 9) ? (rem - 10) + 'a' : rem + '0';
+        num = num / base;
+    }
+
+    if (neg)
+        str[i++] = '-';
+
+    str[i] = '\0';
+    s64_to_null_terminated_string_reverse(str, i);
+}
+
+///
+///
+// Threading
+///
+
+
+///
+// Thread primitive
+
+void *linux_thread_invoker(void *param) {
+
+	Thread *t = (Thread*)param;
+
+	temporary_storage_init(t->temporary_storage_size);
+
+	context = t->initial_context;
+	context.thread_id = (u64)pthread_self();
+
+	t->proc(t);
+
+	temporary_storage_deinit();
+	heap_release_thread_cache();
+
+	return 0;
+}
+
+////// DEPRECATED   vvvvvvvvvvvvvvvvv
+Thread* os_make_thread(Thread_Proc proc, Allocator allocator) {
+	Thread *t = (Thread*)alloc(allocator, sizeof(Thread));
+	t->id = 0; // This is set when we start it
+	t->proc = proc;
+	t->initial_context = context;
+	t->allocator = allocator;
+	t->temporary_storage_size = KB(10);
+
+	return t;
+}
+void os_destroy_thread(Thread *t) {
+	os_thread_join(t);
+	dealloc(t->allocator, t);
+}
+void os_start_thread(Thread *t) {
+	os_thread_start(t);
+}
+void os_join_thread(Thread *t) {
+	os_thread_join(t);
+}
+////// DEPRECATED   ^^^^^^^^^^^^^^^^
+
+
+
+void os_thread_init(Thread *t, Thread_Proc proc) {
+	memset(t, 0, sizeof(Thread));
+	t->id = 0;
+	t->proc = proc;
+	t->initial_context = context;
+	t->temporary_storage_size = KB(10);
+}
+void os_thread_destroy(Thread *t) {
+	os_thread_join(t);
+}
+void os_thread_start(Thread *t) {
+	pthread_t handle;
+	int err = pthread_create(&handle, 0, linux_thread_invoker, t);
+	assert(err == 0, "Failed creating thread (error %d)", err);
+
+	t->os_handle = (Thread_Handle)handle;
+	t->id = (u64)handle;
+}
+void os_thread_join(Thread *t) {
+	// Joining a pthread twice is undefined, but it's fine to wait twice for a win32 thread,
+	// so we clear the handle to keep the same behaviour.
+	if (!t->os_handle) return;
+	pthread_join((pthread_t)t->os_handle, 0);
+	t->os_handle = 0;
+}
+
+///
+// Mutex primitive
+
+Mutex_Handle os_make_mutex() {
+	// The program memory mutex is made before we have a heap
+	Allocator allocator = heap_initted ? get_heap_allocator() : get_initialization_allocator();
+
+	pthread_mutex_t *m = (pthread_mutex_t*)alloc(allocator, sizeof(pthread_mutex_t));
+	int err = pthread_mutex_init(m, 0);
+	assert(err == 0, "Failed creating pthread mutex. error %d", err);
+
+	return m;
+}
+void os_destroy_mutex(Mutex_Handle m) {
+	pthread_mutex_destroy((pthread_mutex_t*)m);
+	if (is_pointer_in_program_memory(m)) dealloc(get_heap_allocator(), m);
+}
+void os_lock_mutex(Mutex_Handle m) {
+	int err = pthread_mutex_lock((pthread_mutex_t*)m);
+	assert(err == 0, "Unexpected mutex lock result %d", err);
+}
+void os_unlock_mutex(Mutex_Handle m) {
+	int err = pthread_mutex_unlock((pthread_mutex_t*)m);
+	assert(err == 0, "Unlock mutex 0x%x failed with error %d", m, err);
+}
+
+typedef struct Linux_Event {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool signaled;
+} Linux_Event;
+
+void os_binary_semaphore_init(Binary_Semaphore *sem, bool initial_state) {
+	Linux_Event *e = (Linux_Event*)alloc(get_heap_allocator(), sizeof(Linux_Event));
+	pthread_mutex_init(&e->mutex, 0);
+	pthread_cond_init(&e->cond, 0);
+	e->signaled = initial_state;
+	sem->os_event = e;
+}
+
+void os_binary_semaphore_destroy(Binary_Semaphore *sem) {
+	Linux_Event *e = (Linux_Event*)sem->os_event;
+	pthread_cond_destroy(&e->cond);
+	pthread_mutex_destroy(&e->mutex);
+	dealloc(get_heap_allocator(), e);
+	sem->os_event = 0;
+}
+
+void os_binary_semaphore_wait(Binary_Semaphore *sem) {
+	Linux_Event *e = (Linux_Event*)sem->os_event;
+	pthread_mutex_lock(&e->mutex);
+	while (!e->signaled) pthread_cond_wait(&e->cond, &e->mutex);
+	e->signaled = false;
+	pthread_mutex_unlock(&e->mutex);
+}
+
+void os_binary_semaphore_signal(Binary_Semaphore *sem) {
+	Linux_Event *e = (Linux_Event*)sem->os_event;
+	pthread_mutex_lock(&e->mutex);
+	e->signaled = true;
+	pthread_cond_signal(&e->cond);
+	pthread_mutex_unlock(&e->mutex);
+}
+
+void os_wait_on_address(volatile u32 *address, u32 expected) {
+	// Returns right away with EAGAIN if *address != expected
+	syscall(SYS_futex, (u32*)address, FUTEX_WAIT_PRIVATE, expected, 0, 0, 0);
+}
+
+void os_wake_one_on_address(volatile u32 *address) {
+	syscall(SYS_futex, (u32*)address, FUTEX_WAKE_PRIVATE, 1, 0, 0, 0);
+}
+
+void os_wake_all_on_address(volatile u32 *address) {
+	syscall(SYS_futex, (u32*)address, FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0);
+}
+
+
+void os_sleep(u32 ms) {
+	struct timespec ts;
+	ts.tv_sec  = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {}
+}
+
+void os_yield_thread() {
+	sched_yield();
+}
+
+void os_high_precision_sleep(f64 ms) {
+
+	const f64 s = ms/1000.0;
+
+	f64 start = os_get_elapsed_seconds();
+	f64 end = start + (f64)s;
+
+	// The scheduler is usually accurate to well under a millisecond on linux, but we sleep
+	// until slightly before and spin the rest of the way to be sure.
+	s32 sleep_time = (s32)(ms-1.0);
+	bool do_sleep = sleep_time >= 1;
+
+	if (do_sleep)  os_sleep(sleep_time);
+
+	while (os_get_elapsed_seconds() < end) {
+		os_yield_thread();
+	}
+}
+
+
+///
+///
+// Time
+///
+
+
+// #Cleanup deprecated
+float64
+os_get_current_time_in_seconds() {
+	struct timespec now;
+	if (clock_gettime(CLOCK_MONOTONIC, &now) != 0) return -1.0;
+	return (float64)now.tv_sec + (float64)now.tv_nsec / 1000000000.0;
+}
+
+float64
+os_get_elapsed_seconds() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (float64)(now.tv_sec-linux_time_at_start.tv_sec) + (float64)(now.tv_nsec-linux_time_at_start.tv_nsec) / 1000000000.0;
+}
+
+
+///
+///
+// Dynamic Libraries
+///
+
+Dynamic_Library_Handle os_load_dynamic_library(string path) {
+	return dlopen(linux_temp_null_terminated_path(path), RTLD_NOW | RTLD_LOCAL);
+}
+void *os_dynamic_library_load_symbol(Dynamic_Library_Handle l, string identifier) {
+	return dlsym(l, temp_convert_to_null_terminated_string(identifier));
+}
+void os_unload_dynamic_library(Dynamic_Library_Handle l) {
+	dlclose(l);
+}
+
+
+///
+///
+// IO
+///
+
+// #Global
+const File OS_INVALID_FILE = -1;
+void os_write_string_to_stdout(string s) {
+	u64 written = 0;
+	while (written < s.count) {
+		ssize_t n = write(STDOUT_FILENO, s.data+written, s.count-written);
+		if (n <= 0) return;
+		written += n;
+	}
+}
+
+
+
+
+File os_file_open_s(string path, Os_Io_Open_Flags flags) {
+	int linux_flags = O_RDONLY;
+
+	if (flags & O_WRITE) {
+		linux_flags = O_RDWR;
+	}
+	if (flags & O_CREATE) {
+		linux_flags = O_RDWR | O_CREAT | O_TRUNC;
+	}
+
+	File f = open(linux_temp_null_terminated_path(path), linux_flags | O_CLOEXEC, 0644);
+
+	if (f != OS_INVALID_FILE && (flags & O_WRITE) && !(flags & O_CREATE)) {
+		// Writing without create means append
+		lseek(f, 0, SEEK_END);
+	}
+
+	return f;
+}
+
+void os_file_close(File f) {
+	if (f == OS_INVALID_FILE) return;
+	close(f);
+}
+
+bool os_file_delete_s(string path) {
+	return unlink(linux_temp_null_terminated_path(path)) == 0;
+}
+
+bool os_file_copy_s(string from, string to, bool replace_if_exists) {
+	if (!replace_if_exists && os_is_file_s(to)) return false;
+
+	File src = os_file_open_s(from, O_READ);
+	if (src == OS_INVALID_FILE) return false;
+
+	File dst = os_file_open_s(to, O_WRITE | O_CREATE);
+	if (dst == OS_INVALID_FILE) {
+		os_file_close(src);
+		return false;
+	}
+
+	u8 buffer[KB(16)];
+	bool ok = true;
+	while (true) {
+		u64 read_bytes = 0;
+		if (!os_file_read(src, buffer, sizeof(buffer), &read_bytes)) { ok = false; break; }
+		if (read_bytes == 0) break;
+		if (!os_file_write_bytes(dst, buffer, read_bytes)) { ok = false; break; }
+	}
+
+	os_file_close(src);
+	os_file_close(dst);
+
+	return ok;
+}
+
+bool os_make_directory_s(string path, bool recursive) {
+	char *cpath = linux_temp_null_terminated_path(path);
+
+	// Convert backslashes to forward slashes
+	for (char *p = cpath; *p; ++p) {
+		if (*p == '\\') {
+			*p = '/';
+		}
+	}
+
+	if (recursive) {
+		char *sep = strchr(cpath + 1, '/');
+		while (sep) {
+			*sep = 0;
+			if (mkdir(cpath, 0755) != 0 && errno != EEXIST) {
+				return false;
+			}
+			*sep = '/';
+			sep = strchr(sep + 1, '/');
+		}
+	}
+
+	if (mkdir(cpath, 0755) != 0 && errno != EEXIST) {
+		return false;
+	}
+
+	return true;
+}
+bool os_delete_directory_s(string path, bool recursive) {
+	char *cpath = linux_temp_null_terminated_path(path);
+
+	if (recursive) {
+		DIR *dir = opendir(cpath);
+		if (!dir) return false;
+
+		struct dirent *entry;
+		while ((entry = readdir(dir)) != 0) {
+			// d_name lives in libc's heap which print doesn't consider valid memory for %s
+			string name = string_copy(STR(entry->d_name), get_temporary_allocator());
+			if (strings_match(name, STR(".")) || strings_match(name, STR(".."))) continue;
+
+			string child_path = tprint("%cs/%s", cpath, name);
+
+			if (os_is_directory_s(child_path)) {
+				if (!os_delete_directory_s(child_path, true)) {
+					closedir(dir);
+					return false;
+				}
+			} else {
+				if (!os_file_delete_s(child_path)) {
+					closedir(dir);
+					return false;
+				}
+			}
+		}
+		closedir(dir);
+	}
+
+	return rmdir(cpath) == 0;
+}
+
+bool os_file_write_string(File f, string s) {
+	return os_file_write_bytes(f, s.data, s.count);
+}
+
+bool os_file_write_bytes(File f, void *buffer, u64 size_in_bytes) {
+	u64 written = 0;
+	while (written < size_in_bytes) {
+		ssize_t n = write(f, (u8*)buffer+written, size_in_bytes-written);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		written += n;
+	}
+	return true;
+}
+
+bool os_file_read(File f, void* buffer, u64 bytes_to_read, u64 *actual_read_bytes) {
+	u64 read_bytes = 0;
+	bool ok = true;
+	while (read_bytes < bytes_to_read) {
+		ssize_t n = read(f, (u8*)buffer+read_bytes, bytes_to_read-read_bytes);
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) { ok = false; break; }
+		if (n == 0) break; // EOF
+		read_bytes += n;
+	}
+	if (actual_read_bytes) {
+		*actual_read_bytes = read_bytes;
+	}
+	return ok;
+}
+
+bool os_file_set_pos(File f, s64 pos_in_bytes) {
+	if (pos_in_bytes < 0) return false;
+	return lseek(f, pos_in_bytes, SEEK_SET) == pos_in_bytes;
+}
+
+s64
+os_file_get_size(File f) {
+	struct stat st;
+	if (fstat(f, &st) != 0) return -1;
+	return (s64)st.st_size;
+}
+
+s64
+os_file_get_size_from_path(string path) {
+	struct stat st;
+	if (stat(linux_temp_null_terminated_path(path), &st) != 0) return -1;
+	return (s64)st.st_size;
+}
+
+s64 os_file_get_pos(File f) {
+	off_t pos = lseek(f, 0, SEEK_CUR);
+	if (pos < 0) return (s64)-1;
+	return (s64)pos;
+}
+
+bool os_write_entire_file_handle(File f, string data) {
+    return os_file_write_string(f, data);
+}
+
+bool os_write_entire_file_s(string path, string data) {
+    File file = os_file_open_s(path, O_WRITE | O_CREATE);
+    if (file == OS_INVALID_FILE) {
+        return false;
+    }
+    bool result = os_file_write_string(file, data);
+    os_file_close(file);
+    return result;
+}
+
+bool os_read_entire_file_handle(File f, string *result, Allocator allocator) {
+	s64 file_size = os_file_get_size(f);
+	if (file_size < 0) {
+		return false;
+	}
+
+	result->count = file_size;
+	result->data = 0;
+	if (file_size == 0) return true;
+
+	u64 actual_read = 0;
+	result->data = (u8*)alloc(allocator, file_size);
+
+	bool ok = os_file_read(f, result->data, file_size, &actual_read);
+	if (!ok) {
+		dealloc(allocator, result->data);
+		result->data = 0;
+		return false;
+	}
+
+	return actual_read == (u64)file_size;
+}
+
+bool os_read_entire_file_s(string path, string *result, Allocator allocator) {
+    File file = os_file_open_s(path, O_READ);
+    if (file == OS_INVALID_FILE) {
+        return false;
+    }
+    bool res = os_read_entire_file_handle(file, result, allocator);
+    os_file_close(file);
+    return res;
+}
+
+bool os_is_file_s(string path) {
+	struct stat st;
+	if (stat(linux_temp_null_terminated_path(path), &st) != 0) return false;
+	return !S_ISDIR(st.st_mode);
+}
+
+bool os_is_directory_s(string path) {
+	struct stat st;
+	if (stat(linux_temp_null_terminated_path(path), &st) != 0) return false;
+	return S_ISDIR(st.st_mode);
+}
+
+bool os_is_path_absolute(string path) {
+	return path.count > 0 && path.data[0] == '/';
+}
+
+// Resolves '.', '..' and repeated separators without touching the file system
+// (like GetFullPathName on windows, the path does not need to exist).
+string linux_normalize_absolute_path(string path, Allocator allocator) {
+	assert(os_is_path_absolute(path), "linux_normalize_absolute_path expects an absolute path");
+
+	u8 *buffer = (u8*)alloc(allocator, path.count+1);
+	u64 count = 0;
+
+	u64 i = 0;
+	while (i < path.count) {
+		while (i < path.count && (path.data[i] == '/' || path.data[i] == '\\')) i += 1;
+
+		u64 start = i;
+		while (i < path.count && path.data[i] != '/' && path.data[i] != '\\') i += 1;
+		u64 length = i-start;
+
+		if (length == 0) break;
+		if (length == 1 && path.data[start] == '.') continue;
+		if (length == 2 && path.data[start] == '.' && path.data[start+1] == '.') {
+			while (count > 0 && buffer[count-1] != '/') count -= 1;
+			if (count > 0) count -= 1;
+			continue;
+		}
+
+		buffer[count++] = '/';
+		memcpy(buffer+count, path.data+start, length);
+		count += length;
+	}
+
+	if (count == 0) buffer[count++] = '/';
+
+	string result;
+	result.data = buffer;
+	result.count = count;
+	return result;
+}
+
+bool os_get_absolute_path(string path, string *result, Allocator allocator) {
+	if (os_is_path_absolute(path)) {
+		*result = linux_normalize_absolute_path(path, allocator);
+		return true;
+	}
+
+	char cwd[4096];
+	if (!getcwd(cwd, sizeof(cwd))) {
+		return false;
+	}
+
+	string joined = tprint("%cs/%s", cwd, path);
+	*result = linux_normalize_absolute_path(joined, allocator);
+
+	return true;
+}
+
+bool os_get_relative_path(string from, string to, string *result, Allocator allocator) {
+
+	if (!os_get_absolute_path(from, &from, get_temporary_allocator())) return false;
+	if (!os_get_absolute_path(to, &to, get_temporary_allocator())) return false;
+
+	// Like PathRelativePathTo, relative to a file means relative to the directory of that file
+	// #Speed is_file potentially slow
+	if (os_is_file(from)) {
+		from = get_directory_of(from);
+		if (from.count == 0) from = STR("/");
+	}
+
+	// Find the last separator where the paths still match
+	u64 common = 0;
+	u64 min_count = min(from.count, to.count);
+	for (u64 i = 0; i <= min_count; i += 1) {
+		bool from_end = i == from.count || from.data[i] == '/';
+		bool to_end   = i == to.count   || to.data[i]   == '/';
+		if (from_end && to_end) common = i;
+		if (i == min_count || from.data[i] != to.data[i]) break;
+	}
+
+	String_Builder builder;
+	string_builder_init_reserve(&builder, from.count+to.count+2, allocator);
+
+	u64 levels_up = 0;
+	for (u64 i = common; i < from.count; i += 1) {
+		if (from.data[i] == '/' && i+1 < from.count) levels_up += 1;
+	}
+	if (levels_up == 0) {
+		string_builder_append(&builder, STR("."));
+	}
+	for (u64 i = 0; i < levels_up; i += 1) {
+		if (i != 0) string_builder_append(&builder, STR("/"));
+		string_builder_append(&builder, STR(".."));
+	}
+
+	if (common < to.count) {
+		string rest = string_view(to, common, to.count-common);
+		if (rest.data[0] != '/') string_builder_append(&builder, STR("/"));
+		string_builder_append(&builder, rest);
+	}
+
+	*result = string_builder_get_string(builder);
+
+	return true;
+}
+
+bool os_do_paths_match(string a, string b) {
+	string full_path_a, full_path_b;
+
+	if (!os_get_absolute_path(a, &full_path_a, get_temporary_allocator())) {
+		return false;
+	}
+	if (!os_get_absolute_path(b, &full_path_b, get_temporary_allocator())) {
+		return false;
+	}
+
+	return strings_match(full_path_a, full_path_b);
+}
+
+// #Cleanup
+// These are not os-specific, why are they here?
+void fprints(File f, string fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	fprint_va_list_buffered(f, fmt, args);
+	va_end(args);
+}
+void fprintf(File f, const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	string s;
+	s.data = cast(u8*)fmt;
+	s.count = strlen(fmt);
+	fprint_va_list_buffered(f, s, args);
+	va_end(args);
+}
+
+void os_wait_and_read_stdin(string *result, u64 max_count, Allocator allocator) {
+	char *buffer = talloc(max_count);
+
+	ssize_t n = read(STDIN_FILENO, buffer, max_count);
+
+	if (n < 0) {
+		*result = string_copy(STR("STDIN is not available"), allocator);
+	} else if (n == 0) {
+		*result = null_string;
+	} else {
+		*result = alloc_string(allocator, n);
+		memcpy(result->data, buffer, n);
+		if (result->count >= 1 && result->data[result->count-1] == '\n') result->count -= 1;
+	}
+}
+
+
+
+///
+///
+// Queries
+///
+
+void
+linux_query_stack_bounds() {
+	pthread_attr_t attr;
+	void *stack_addr = 0;
+	size_t stack_size = 0;
+
+	// This is slow for the main thread (parses /proc/self/maps) so we only do it once per thread
+	if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+		pthread_attr_getstack(&attr, &stack_addr, &stack_size);
+		pthread_attr_destroy(&attr);
+	}
+
+	linux_stack_limit = stack_addr;
+	linux_stack_base  = (u8*)stack_addr + stack_size;
+}
+
+void*
+os_get_stack_base() {
+	if (!linux_stack_base) linux_query_stack_bounds();
+	return linux_stack_base;
+}
+void*
+os_get_stack_limit() {
+	if (!linux_stack_base) linux_query_stack_bounds();
+	return linux_stack_limit;
+}
+
+u64
+os_get_number_of_logical_processors() {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (u64)count : 1;
+}
+
+///
+///
+// Debug
+///
+#define LINUX_MAX_STACK_FRAMES 64
+string *
+os_get_stack_trace(u64 *trace_count, Allocator allocator) {
+#if CONFIGURATION == DEBUG
+	void *frames[LINUX_MAX_STACK_FRAMES];
+	int frame_count = backtrace(frames, LINUX_MAX_STACK_FRAMES);
+
+	// Symbol names need -rdynamic, otherwise we only get addresses
+	char **symbols = backtrace_symbols(frames, frame_count);
+
+	string *stack_strings = (string *)alloc(allocator, LINUX_MAX_STACK_FRAMES * sizeof(string));
+	*trace_count = 0;
+
+	for (int i = 0; i < frame_count; i++) {
+		if (symbols && symbols[i]) {
+			stack_strings[*trace_count] = string_copy(STR(symbols[i]), allocator);
+		} else {
+			stack_strings[*trace_count].data = (u8 *)alloc(allocator, 32);
+			stack_strings[*trace_count].count = format_string_to_buffer_va((char *)stack_strings[*trace_count].data, 32, "0x%llx", (u64)frames[i]);
+		}
+		(*trace_count)++;
+	}
+
+	// backtrace_symbols mallocs the whole thing as one block
+	if (symbols) free(symbols);
+
+	return stack_strings;
+#else // DEBUG
+
+	*trace_count = 1;
+	string *result = alloc(allocator, 3+sizeof(string));
+	result->count = 3;
+	result->data = (u8*)result+sizeof(string);
+	string s = STR("<0>");
+	memcpy(result->data, s.data, 3);
+	return result;
+
+#endif // NOT DEBUG
+}
+
+u64
+os_capture_stack_frames(void **frames, u64 max_count, u64 skip_count) {
+	void *all_frames[LINUX_MAX_STACK_FRAMES];
+	int frame_count = backtrace(all_frames, (int)min(max_count+skip_count+1, LINUX_MAX_STACK_FRAMES));
+
+	u64 first = skip_count+1;
+	if ((u64)frame_count <= first) return 0;
+	u64 count = min((u64)frame_count-first, max_count);
+	memcpy(frames, all_frames+first, count*sizeof(void*));
+	return count;
+}
+
+string *
+os_get_stack_frame_names(void **frames, u64 count, Allocator allocator) {
+	char **symbols = backtrace_symbols(frames, (int)count);
+
+	string *names = (string *)alloc(allocator, count * sizeof(string));
+	for (u64 i = 0; i < count; i++) {
+		if (symbols && symbols[i]) {
+			names[i] = string_copy(STR(symbols[i]), allocator);
+		} else {
+			names[i].data = (u8 *)alloc(allocator, 32);
+			names[i].count = format_string_to_buffer_va((char *)names[i].data, 32, "0x%llx", (u64)frames[i]);
+		}
+	}
+
+	if (symbols) free(symbols);
+
+	return names;
+}
+
+void *
+linux_map_fixed(void *base, u64 size) {
+	void *result = mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if (result == MAP_FAILED) return 0;
+
+	// Old kernels ignore MAP_FIXED_NOREPLACE and treat base as a hint
+	if (result != base) {
+		munmap(result, size);
+		return 0;
+	}
+
+	return result;
+}
+
+bool os_grow_program_memory(u64 new_size) {
+	os_lock_mutex(program_memory_mutex); // #Sync
+	if (program_memory_capacity >= new_size) {
+		os_unlock_mutex(program_memory_mutex); // #Sync
+		return true;
+	}
+
+	bool is_first_time = program_memory == 0;
+
+	if (is_first_time) {
+		u64 aligned_size = align_next(new_size, os.granularity);
+		void *aligned_base = (void*)align_next(VIRTUAL_MEMORY_BASE, os.granularity);
+
+		program_memory = linux_map_fixed(aligned_base, aligned_size);
+		if (program_memory == 0) {
+			os_unlock_mutex(program_memory_mutex); // #Sync
+			return false;
+		}
+		program_memory_next = program_memory;
+		program_memory_capacity = aligned_size;
+#if CONFIGURATION == DEBUG
+		memset(program_memory, 0xBA, program_memory_capacity);
+		mprotect(aligned_base, aligned_size, PROT_NONE);
+#endif
+	} else {
+		void* tail = (u8*)program_memory + program_memory_capacity;
+
+		assert((u64)program_memory_capacity % os.granularity == 0, "program_memory_capacity is not aligned to granularity!");
+		assert((u64)tail % os.granularity == 0, "Tail is not aligned to granularity!");
+
+		u64 amount_to_allocate = align_next(new_size-program_memory_capacity, os.granularity);
+
+		// Just keep allocating at the tail of the current chunk
+		void* result = linux_map_fixed(tail, amount_to_allocate);
+		if (result == 0) {
+			os_unlock_mutex(program_memory_mutex); // #Sync
+			return false;
+		}
+#if CONFIGURATION == DEBUG
+		memset(result, 0xBA, amount_to_allocate);
+		mprotect(tail, amount_to_allocate, PROT_NONE);
+#endif
+		assert(tail == result, "It seems tail is not aligned properly. o nein");
+
+		program_memory_capacity += amount_to_allocate;
+	}
+
+
+	char size_str[32];
+	s64_to_null_terminated_string(program_memory_capacity/1024, size_str, 10);
+
+	os_write_string_to_stdout(STR("Program memory grew to "));
+	os_write_string_to_stdout(STR(size_str));
+	os_write_string_to_stdout(STR(" kb\n"));
+	os_unlock_mutex(program_memory_mutex); // #Sync
+	return true;
+}
+
+void*
+os_reserve_next_memory_pages(u64 size) {
+	assert(size % os.page_size == 0, "size was not aligned to page size in os_reserve_next_memory_pages");
+
+	void *p = program_memory_next;
+
+	program_memory_next = (u8*)program_memory_next + size;
+
+	void *program_tail = (u8*)program_memory + program_memory_capacity;
+
+	if ((u64)program_memory_next > (u64)program_tail) {
+		u64 minimum_size = ((u64)program_memory_next) - (u64)program_memory + 1;
+		u64 new_program_size = get_next_power_of_two(minimum_size);
+
+		const u64 ATTEMPTS = 1000;
+		for (u64 i = 0; i <= ATTEMPTS; i++) {
+			if (program_memory_capacity >= new_program_size) break; // Another thread might have resized already, causing it to fail here.
+			assert(i < ATTEMPTS, "OS is not letting us allocate more memory. Maybe we are out of memory? You sure must be using a lot of memory then.");
+			if (os_grow_program_memory(new_program_size))
+				break;
+		}
+	}
+
+	return p;
+}
+
+void
+os_unlock_program_memory_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When unlocking memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When unlocking memory pages, the size must be aligned to page_size");
+	// Unlike VirtualProtect, mprotect is fine with ranges spanning multiple mappings
+	int err = mprotect(start, size, PROT_READ | PROT_WRITE);
+	assert(err == 0, "mprotect Failed with error %d", errno);
+}
+
+void
+os_lock_program_memory_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When unlocking memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When unlocking memory pages, the size must be aligned to page_size");
+	int err = mprotect(start, size, PROT_NONE);
+	assert(err == 0, "mprotect Failed with error %d", errno);
+}
+
+void
+os_decommit_program_memory_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When decommitting memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When decommitting memory pages, the size must be aligned to page_size");
+	int err = madvise(start, size, MADV_DONTNEED);
+	assert(err == 0, "madvise Failed with error %d", errno);
+}
+
+void
+os_commit_program_memory_pages(void *start, u64 size) {
+	// Nothing to do, MADV_DONTNEED pages get backed again (zeroed) on first touch
+}
+
+void*
+os_reserve_memory(u64 size) {
+	size = align_next(size, os.page_size);
+	void *p = mmap(0, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return p == MAP_FAILED ? 0 : p;
+}
+
+bool
+os_commit_memory(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When committing memory, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When committing memory, the size must be aligned to page_size");
+	// Pages get backed on first touch, this just makes them accessible
+	return mprotect(start, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+void
+os_decommit_memory(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When decommitting memory, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When decommitting memory, the size must be aligned to page_size");
+	// Give the pages back, they read as zero if they are committed again
+	int err = madvise(start, size, MADV_DONTNEED);
+	assert(err == 0, "madvise Failed with error %d", errno);
+	err = mprotect(start, size, PROT_NONE);
+	assert(err == 0, "mprotect Failed with error %d", errno);
+}
+
+void
+os_release_memory(void *start, u64 size) {
+	int err = munmap(start, align_next(size, os.page_size));
+	assert(err == 0, "munmap Failed with error %d", errno);
+}
+
+///
+///
+// Mouse pointer
+// (No mouse in headless)
+
+void
+os_set_mouse_pointer_standard(Mouse_Pointer_Kind kind) {
+}
+
+void
+os_set_mouse_pointer_custom(Custom_Mouse_Pointer p) {
+}
+
+Custom_Mouse_Pointer
+os_make_custom_mouse_pointer(void *image, int width, int height, int hotspot_x, int hotspot_y) {
+	return 0;
+}
+
+Custom_Mouse_Pointer
+os_make_custom_mouse_pointer_from_file(string path, int hotspot_x, int hotspot_y, Allocator allocator) {
+	return 0;
+}
+
+///
+///
+// Gamepads
+// (No gamepads in headless)
+
+void set_gamepad_vibration(float32 left, float32 right) {
+}
+void set_specific_gamepad_vibration(u64 gamepad_index, float32 left, float32 right) {
+}
+
+
+
+void os_update() {
+	has_os_update_been_called_at_all = true;
+
+	heap_decommit_free_pages(HEAP_DECOMMIT_BUDGET);
+
+#if ENABLE_PROFILING
+	profiler_mark_frame();
+#endif
+}
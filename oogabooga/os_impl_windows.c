@@ -123,6 +123,13 @@ bool win32_do_handle_raw_input = false;
 HANDLE win32_xinput = 0;
 bool has_os_update_been_called_at_all = false;
 
+// WaitOnAddress & friends, loaded in os_init so we don't need to link Synchronization.lib
+typedef BOOL (WINAPI *Win32_Wait_On_Address_Proc)(volatile VOID *address, PVOID compare_address, SIZE_T size, DWORD ms);
+typedef VOID (WINAPI *Win32_Wake_By_Address_Proc)(PVOID address);
+Win32_Wait_On_Address_Proc win32_wait_on_address = 0;
+Win32_Wake_By_Address_Proc win32_wake_by_address_single = 0;
+Win32_Wake_By_Address_Proc win32_wake_by_address_all = 0;
+
 // Used to save windowed state when in fullscreen mode.
 DWORD win32_windowed_style = 0;
 DWORD win32_windowed_style_ex = 0;
@@ -389,13 +396,22 @@ volatile bool win32_has_audio_thread_started = false;
 
 void os_init(u64 program_memory_capacity) {
 	
-    // #Volatile
-    // Any printing uses vsnprintf, and printing may happen in init,
-    // especially on errors, so this needs to happen first.
-    os.crt = os_load_dynamic_library(STR("msvcrt.dll"));
+#if RUN_TESTS
+	// Printing goes through our own formatter in string_format.c now, so the crt is only
+	// loaded for the tests, which check the formatter against vsnprintf & strtod.
+	os.crt = os_load_dynamic_library(STR("msvcrt.dll"));
 	assert(os.crt != 0, "Could not load win32 crt library. Might be compiled with non-msvc? #Incomplete #Portability");
 	os.crt_vsnprintf = (Crt_Vsnprintf_Proc)os_dynamic_library_load_symbol(os.crt, STR("vsnprintf"));
 	assert(os.crt_vsnprintf, "Missing vsnprintf in crt");
+#endif
+
+	// Windows 8+. Without it os_wait_on_address just yields.
+	Dynamic_Library_Handle synch = os_load_dynamic_library(STR("api-ms-win-core-synch-l1-2-0.dll"));
+	if (synch) {
+		win32_wait_on_address = (Win32_Wait_On_Address_Proc)os_dynamic_library_load_symbol(synch, STR("WaitOnAddress"));
+		win32_wake_by_address_single = (Win32_Wake_By_Address_Proc)os_dynamic_library_load_symbol(synch, STR("WakeByAddressSingle"));
+		win32_wake_by_address_all = (Win32_Wake_By_Address_Proc)os_dynamic_library_load_symbol(synch, STR("WakeByAddressAll"));
+	}
 
 #if CONFIGURATION == DEBUG
 	HANDLE process = GetCurrentProcess();
@@ -614,7 +630,8 @@ DWORD WINAPI win32_thread_invoker(LPVOID param) {
 	
 	t->proc(t);
 	
-	heap_dealloc(temporary_storage);
+	temporary_storage_deinit();
+	heap_release_thread_cache();
 	
 	return 0;
 }
@@ -738,6 +755,22 @@ void os_binary_semaphore_signal(Binary_Semaphore *sem) {
 	SetEvent(sem->os_event);
 }
 
+void os_wait_on_address(volatile u32 *address, u32 expected) {
+	if (win32_wait_on_address) {
+		win32_wait_on_address(address, &expected, sizeof(u32), INFINITE);
+	} else {
+		SwitchToThread();
+	}
+}
+
+void os_wake_one_on_address(volatile u32 *address) {
+	if (win32_wake_by_address_single) win32_wake_by_address_single((PVOID)address);
+}
+
+void os_wake_all_on_address(volatile u32 *address) {
+	if (win32_wake_by_address_all) win32_wake_by_address_all((PVOID)address);
+}
+
 
 void os_sleep(u32 ms) {
     Sleep(ms);
@@ -1326,6 +1359,44 @@ os_get_stack_trace(u64 *trace_count, Allocator allocator) {
 #endif // NOT DEBUG
 }
 
+u64
+os_capture_stack_frames(void **frames, u64 max_count, u64 skip_count) {
+	return (u64)RtlCaptureStackBackTrace((DWORD)(skip_count+1), (DWORD)min(max_count, WIN32_MAX_STACK_FRAMES), frames, 0);
+}
+
+string *
+os_get_stack_frame_names(void **frames, u64 count, Allocator allocator) {
+	string *names = (string *)alloc(allocator, count * sizeof(string));
+	for (u64 i = 0; i < count; i++) {
+#if CONFIGURATION == DEBUG
+		HANDLE process = GetCurrentProcess();
+		DWORD64 displacement = 0;
+		char buffer[sizeof(SYMBOL_INFO) + WIN32_MAX_SYMBOL_NAME_LENGTH * sizeof(TCHAR)];
+		PSYMBOL_INFO symbol = (PSYMBOL_INFO)buffer;
+		symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+		symbol->MaxNameLen = WIN32_MAX_SYMBOL_NAME_LENGTH;
+
+		if (SymFromAddr(process, (DWORD64)frames[i], &displacement, symbol)) {
+			IMAGEHLP_LINE64 line;
+			DWORD displacement_line;
+			line.SizeOfStruct = sizeof(IMAGEHLP_LINE64);
+
+			if (SymGetLineFromAddr64(process, (DWORD64)frames[i], &displacement_line, &line)) {
+				u64 length = (u64)(symbol->NameLen + strlen(line.FileName) + 50);
+				names[i].data = (u8 *)alloc(allocator, length);
+				names[i].count = format_string_to_buffer_va((char *)names[i].data, length, "%cs:%d: %cs", line.FileName, line.LineNumber, symbol->Name);
+			} else {
+				names[i] = string_copy(STR(symbol->Name), allocator);
+			}
+			continue;
+		}
+#endif
+		names[i].data = (u8 *)alloc(allocator, 32);
+		names[i].count = format_string_to_buffer_va((char *)names[i].data, 32, "0x%llx", (u64)frames[i]);
+	}
+	return names;
+}
+
 bool os_grow_program_memory(u64 new_size) {
 	os_lock_mutex(program_memory_mutex); // #Sync
 	if (program_memory_capacity >= new_size) {
@@ -1421,34 +1492,97 @@ os_reserve_next_memory_pages(u64 size) {
 
 void
 os_unlock_program_memory_pages(void *start, u64 size) {
-#if CONFIGURATION == DEBUG
 	assert((u64)start % os.page_size == 0, "When unlocking memory pages, the start address must be the start of a page");
 	assert(size       % os.page_size == 0, "When unlocking memory pages, the size must be aligned to page_size");
 	// This memory may be across multiple allocated regions so we need to do this one page at a time.
-	// Probably super slow but this shouldn't happen often at all + it's only in debug.
+	// Probably super slow but this only happens with HEAP_GUARD_FREED_PAGES.
 	// - Charlie M 28th July 2024
 	for (u8 *p = (u8*)start; p < (u8*)start+size; p += os.page_size) {
 		DWORD old_protect = PAGE_NOACCESS;
 		BOOL ok = VirtualProtect(p, os.page_size, PAGE_READWRITE, &old_protect);
 		assert(ok, "VirtualProtect Failed with error %d", GetLastError());
 	}
-#endif
 }
 
 void
 os_lock_program_memory_pages(void *start, u64 size) {
-#if CONFIGURATION == DEBUG
 	assert((u64)start % os.page_size == 0, "When unlocking memory pages, the start address must be the start of a page");
 	assert(size       % os.page_size == 0, "When unlocking memory pages, the size must be aligned to page_size");
 	// This memory may be across multiple allocated regions so we need to do this one page at a time.
-	// Probably super slow but this shouldn't happen often at all + it's only in debug.
+	// Probably super slow but this only happens with HEAP_GUARD_FREED_PAGES.
 	// - Charlie M 28th July 2024
 	for (u8 *p = (u8*)start; p < (u8*)start+size; p += os.page_size) {
 		DWORD old_protect = PAGE_READWRITE;
 		BOOL ok = VirtualProtect(p, os.page_size, PAGE_NOACCESS, &old_protect);
 		assert(ok, "VirtualProtect Failed with error %d", GetLastError());
 	}
-#endif
+}
+
+// Like VirtualProtect, VirtualAlloc & VirtualFree can't span regions so we go one region at a time
+void
+os_decommit_program_memory_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When decommitting memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When decommitting memory pages, the size must be aligned to page_size");
+	u8 *p = (u8*)start;
+	u8 *end = p + size;
+	while (p < end) {
+		MEMORY_BASIC_INFORMATION info;
+		SIZE_T ok = VirtualQuery(p, &info, sizeof(info));
+		assert(ok, "VirtualQuery Failed with error %d", GetLastError());
+		u64 n = min((u64)((u8*)info.BaseAddress + info.RegionSize - p), (u64)(end - p));
+		if (info.State == MEM_COMMIT) {
+			BOOL freed = VirtualFree(p, n, MEM_DECOMMIT);
+			assert(freed, "VirtualFree Failed with error %d", GetLastError());
+		}
+		p += n;
+	}
+}
+
+void
+os_commit_program_memory_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When committing memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When committing memory pages, the size must be aligned to page_size");
+	u8 *p = (u8*)start;
+	u8 *end = p + size;
+	while (p < end) {
+		MEMORY_BASIC_INFORMATION info;
+		SIZE_T ok = VirtualQuery(p, &info, sizeof(info));
+		assert(ok, "VirtualQuery Failed with error %d", GetLastError());
+		u64 n = min((u64)((u8*)info.BaseAddress + info.RegionSize - p), (u64)(end - p));
+		if (info.State != MEM_COMMIT) {
+			void *committed = VirtualAlloc(p, n, MEM_COMMIT, PAGE_READWRITE);
+			assert(committed, "VirtualAlloc Failed with error %d", GetLastError());
+		}
+		p += n;
+	}
+}
+
+void*
+os_reserve_memory(u64 size) {
+	size = align_next(size, os.page_size);
+	return VirtualAlloc(0, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+bool
+os_commit_memory(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When committing memory, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When committing memory, the size must be aligned to page_size");
+	return VirtualAlloc(start, size, MEM_COMMIT, PAGE_READWRITE) != 0;
+}
+
+void
+os_decommit_memory(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When decommitting memory, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When decommitting memory, the size must be aligned to page_size");
+	BOOL ok = VirtualFree(start, size, MEM_DECOMMIT);
+	assert(ok, "VirtualFree MEM_DECOMMIT failed with error %d", GetLastError());
+}
+
+void
+os_release_memory(void *start, u64 size) {
+	(void)size;
+	BOOL ok = VirtualFree(start, 0, MEM_RELEASE);
+	assert(ok, "VirtualFree MEM_RELEASE failed with error %d", GetLastError());
 }
 
 ///
@@ -1926,6 +2060,12 @@ void os_update() {
 	}
 
 	has_os_update_been_called_at_all = true;
+	
+	heap_decommit_free_pages(HEAP_DECOMMIT_BUDGET);
+
+#if ENABLE_PROFILING
+	profiler_mark_frame();
+#endif
 
 	win32_do_handle_raw_input = true;
 #ifndef OOGABOOGA_HEADLESS
@@ -9,14 +9,13 @@
 	
 #elif defined(__linux__)
     #ifndef OOGABOOGA_HEADLESS
-    #define "Linux is only supported for headless builds"
+    #error "Linux is only supported for headless builds (#define OOGABOOGA_HEADLESS 1)"
     #endif
-	typedef SOMETHING Mutex_Handle;
-	typedef SOMETHING Thread_Handle;
-	typedef SOMETHING Dynamic_Library_Handle;
-	typedef SOMETHING Window_Handle;
-	typedef SOMETHING File;
-	#error "Linux is not supported yet";
+	typedef void* Mutex_Handle; // pthread_mutex_t*
+	typedef u64   Thread_Handle; // pthread_t
+	typedef void* Dynamic_Library_Handle;
+	typedef void* Window_Handle; // Always 0, we have no windows on linux
+	typedef s32   File; // File descriptor
 #elif defined(__APPLE__) && defined(__MACH__)
 	typedef SOMETHING Mutex_Handle;
 	typedef SOMETHING Thread_Handle;
@@ -106,7 +105,9 @@ Os_Window window = ZERO(Os_Window);
 
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
+// The crt vsnprintf, only loaded with RUN_TESTS. Use format_string_to_buffer otherwise.
 inline int vsnprintf(char* buffer, size_t n, const char* fmt, va_list args) {
+	assert(os.crt_vsnprintf, "The crt vsnprintf is only loaded with RUN_TESTS, use format_string_to_buffer");
 	return os.crt_vsnprintf(buffer, n, fmt, args);
 }
 
@@ -188,6 +189,19 @@ os_binary_semaphore_wait(Binary_Semaphore *sem);
 void ogb_instance
 os_binary_semaphore_signal(Binary_Semaphore *sem);
 
+///
+// Wait on address (futex on linux, WaitOnAddress on windows)
+// Sleeps while *address == expected, until someone wakes the address. It can also wake up for no
+// reason, so always check the value again after.
+void ogb_instance
+os_wait_on_address(volatile u32 *address, u32 expected);
+
+void ogb_instance
+os_wake_one_on_address(volatile u32 *address);
+
+void ogb_instance
+os_wake_all_on_address(volatile u32 *address);
+
 ///
 // Threading utilities
 
@@ -442,6 +456,15 @@ os_get_number_of_logical_processors();
 ogb_instance string*
 os_get_stack_trace(u64 *trace_count, Allocator allocator);
 
+// Just the return addresses, cheap enough to do on every allocation.
+// skip_count is how many frames to leave out on top of this call itself.
+ogb_instance u64
+os_capture_stack_frames(void **frames, u64 max_count, u64 skip_count);
+
+// Names for frames from os_capture_stack_frames. Addresses only if we don't have symbols.
+ogb_instance string*
+os_get_stack_frame_names(void **frames, u64 count, Allocator allocator);
+
 inline void 
 dump_stack_trace() {
 	u64 count;
@@ -486,6 +509,25 @@ void ogb_instance
 os_unlock_program_memory_pages(void *start, u64 size);
 void ogb_instance
 os_lock_program_memory_pages(void *start, u64 size);
+// Gives the memory behind these pages back to the OS but keeps the address space.
+// Commit before touching them again, they read as zero.
+void ogb_instance
+os_decommit_program_memory_pages(void *start, u64 size);
+void ogb_instance
+os_commit_program_memory_pages(void *start, u64 size);
+
+///
+// Raw virtual memory, separate from program memory.
+// os_reserve_memory only takes address space, nothing is backed until you commit it.
+// Addresses & sizes must be aligned to os.page_size (os_reserve_memory aligns size for you).
+ogb_instance void*
+os_reserve_memory(u64 size); // 0 on failure
+bool ogb_instance
+os_commit_memory(void *start, u64 size);
+void ogb_instance
+os_decommit_memory(void *start, u64 size);
+void ogb_instance
+os_release_memory(void *start, u64 size); // size must be what was reserved
 
 ///
 ///
@@ -1,54 +1,681 @@
 
+/*
+
+	Every thread writes tm_scope's into its own buffer as small binary events (rdtsc ticks +
+	a name id), no locks and no formatting. The google trace json is only made in
+	dump_profile_result().
+
+	Names are interned by pointer, so tm_scope names have to be string literals (or at least
+	never change or go away).
+
+	Buffers are blocks of PROFILER_EVENTS_PER_BLOCK events. By default a thread keeps up to
+	PROFILER_MAX_BLOCKS_PER_THREAD of them, after that it starts over writing its oldest events.
+
+	To keep memory bounded, only keep the last N frames:
+
+		profiler_keep_last_frames(300, 100000); // ~300 frames, at most 100k events per thread
+
+	Frames are marked by os_update() (or call profiler_mark_frame() yourself). If a thread runs
+	out of events before N frames you get less than N frames for that thread.
+
+	Ticks are converted to time with the rdtsc rate measured against os_get_elapsed_seconds(),
+	so this assumes an invariant TSC (anything from the last 15 years).
+
+	Stats:
+
+	Each frame mark also rolls everything recorded since the last one into per-scope stats over
+	the last PROFILER_STATS_WINDOW_FRAMES frames: call count, total, min, max and p50/p95/p99
+	per call. For budgets in soak tests or your own debug ui:
+
+		Profiler_Scope_Stats physics;
+		if (profiler_get_scope_stats(STR("physics"), &physics)) {
+			assert(physics.p99_seconds < 0.004, "Physics over budget");
+		}
+
+		Profiler_Scope_Stats top[10];
+		u64 count = profiler_get_top_scopes(top, 10); // Most time per frame first
+
+		Profiler_Frame_Stats frames = profiler_get_frame_stats(); // Frame times + histogram
+
+	draw_profiler_overlay() in drawing.c draws all of it.
+
+*/
+
+#define PROFILER_EVENTS_PER_BLOCK 4096
+#define PROFILER_MAX_BLOCKS_PER_THREAD 4096
+#define PROFILER_MAX_NAMES 4096
+#define PROFILER_NAME_SLOTS (PROFILER_MAX_NAMES*2)
+#define PROFILER_MAX_KEPT_FRAMES 4096
+#define PROFILER_STATS_WINDOW_FRAMES 240
+#define PROFILER_STATS_MAX_SAMPLES 1024
+#define PROFILER_FRAME_HISTOGRAM_BUCKETS 50
+
+typedef struct Profiler_Event {
+	u64 start; // rdtsc
+	u64 end;
+	u32 name_id;
+} Profiler_Event;
+
+typedef struct Profiler_Event_Block {
+	// Readers copy the events and check that first_position didn't change while they did,
+	// if it did the block was reused under them.
+	volatile u64 first_position;
+	volatile u64 count;
+	Profiler_Event events[PROFILER_EVENTS_PER_BLOCK];
+} Profiler_Event_Block;
+
+typedef struct Profiler_Thread_Buffer {
+	// Only touched by the owning thread
+	Profiler_Event *next_event;
+	Profiler_Event *block_end;
+	Profiler_Event_Block *current_block;
+	u64 current_block_index;
+
+	u64 thread_id;
+	volatile u64 overwritten_events;
+	u64 aggregated_position; // Events before this are in the stats
+	Profiler_Event_Block * volatile blocks[PROFILER_MAX_BLOCKS_PER_THREAD];
+	struct Profiler_Thread_Buffer *next;
+} Profiler_Thread_Buffer;
+
+// Stats for one scope in one frame
+typedef struct Profiler_Scope_Frame {
+	u64 frame;
+	u64 count;
+	u64 total_ticks;
+	u64 min_ticks;
+	u64 max_ticks;
+} Profiler_Scope_Frame;
+
+typedef struct Profiler_Scope_History {
+	Profiler_Scope_Frame frames[PROFILER_STATS_WINDOW_FRAMES]; // Ring, by frame number
+	// Last calls for the percentiles, and which frame they were in
+	u64 sample_ticks[PROFILER_STATS_MAX_SAMPLES];
+	u64 sample_frames[PROFILER_STATS_MAX_SAMPLES];
+	u64 sample_count;
+} Profiler_Scope_History;
+
+typedef struct Profiler_Scope_Stats {
+	string name;
+	u64 frame_count;        // Frames in the window
+	u64 count;              // Calls in the window
+	f64 total_seconds;
+	f64 seconds_per_frame;  // total_seconds / frame_count
+	f64 last_frame_seconds; // Total time in the scope in the last finished frame
+	// Per call
+	f64 min_seconds;
+	f64 max_seconds;
+	f64 p50_seconds; // Over the last PROFILER_STATS_MAX_SAMPLES calls in the window
+	f64 p95_seconds;
+	f64 p99_seconds;
+} Profiler_Scope_Stats;
+
+typedef struct Profiler_Frame_Stats {
+	u64 frame_count; // Frames in the window
+	f64 last_seconds;
+	f64 average_seconds;
+	f64 min_seconds;
+	f64 max_seconds;
+	f64 p50_seconds;
+	f64 p95_seconds;
+	f64 p99_seconds;
+	u64 histogram[PROFILER_FRAME_HISTOGRAM_BUCKETS]; // [i] is frames that took i to i+1 ms, the last one is also everything slower
+} Profiler_Frame_Stats;
+
+typedef struct Profiler_Counter {
+	f64 time;
+	u64 thread_id;
+	string name;
+	string args;
+} Profiler_Counter;
 
 // #Global
-ogb_instance String_Builder _profile_output;
 ogb_instance bool profiler_initted;
-ogb_instance Spinlock _profiler_lock;
+ogb_instance Spinlock _profiler_lock; // For the cold stuff: new threads, new names, counters, dumping
+ogb_instance Profiler_Thread_Buffer *_profiler_thread_buffers;
+ogb_instance volatile u64 _profiler_block_limit;
+ogb_instance u64 _profiler_start_ticks;
+ogb_instance f64 _profiler_start_seconds;
+
+ogb_instance const char * volatile _profiler_name_keys[PROFILER_NAME_SLOTS];
+ogb_instance u32 _profiler_name_ids[PROFILER_NAME_SLOTS];
+ogb_instance string _profiler_names[PROFILER_MAX_NAMES];
+ogb_instance volatile u32 _profiler_name_count;
+
+ogb_instance u64 _profiler_frame_starts[PROFILER_MAX_KEPT_FRAMES]; // Ring, in ticks
+ogb_instance volatile u64 _profiler_frame_count;
+ogb_instance u64 _profiler_kept_frame_count; // 0 is keep everything
+
+ogb_instance Profiler_Counter *_profiler_counters;
+ogb_instance Profiler_Event *_profiler_scratch_events; // One block, for copying out under _profiler_lock
+ogb_instance Profiler_Scope_History *_profiler_scope_histories[PROFILER_MAX_NAMES];
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
-String_Builder _profile_output = {0};
 bool profiler_initted = false;
 Spinlock _profiler_lock;
+Profiler_Thread_Buffer *_profiler_thread_buffers = 0;
+volatile u64 _profiler_block_limit = PROFILER_MAX_BLOCKS_PER_THREAD;
+u64 _profiler_start_ticks = 0;
+f64 _profiler_start_seconds = 0;
+
+const char * volatile _profiler_name_keys[PROFILER_NAME_SLOTS] = {0};
+u32 _profiler_name_ids[PROFILER_NAME_SLOTS] = {0};
+string _profiler_names[PROFILER_MAX_NAMES] = {0};
+volatile u32 _profiler_name_count = 0;
+
+u64 _profiler_frame_starts[PROFILER_MAX_KEPT_FRAMES] = {0};
+volatile u64 _profiler_frame_count = 0;
+u64 _profiler_kept_frame_count = 0;
+
+Profiler_Counter *_profiler_counters = 0;
+Profiler_Event *_profiler_scratch_events = 0;
+Profiler_Scope_History *_profiler_scope_histories[PROFILER_MAX_NAMES] = {0};
 #endif
 
+thread_local Profiler_Thread_Buffer *_profiler_thread_buffer = 0;
+
+void _profiler_init() {
+	if (profiler_initted) return;
+
+	// Threads can get here at the same time, the first one to swap in 1 does the init
+	local_persist volatile u32 init_state = 0;
+	u32 expected = 0;
+	if (atomic_compare_exchange_32(&init_state, &expected, 1, MEMORY_ORDER_ACQ_REL)) {
+		spinlock_init(&_profiler_lock);
+		_profiler_start_ticks = rdtsc();
+		_profiler_start_seconds = os_get_elapsed_seconds();
+		growing_array_init((void**)&_profiler_counters, sizeof(Profiler_Counter), get_heap_allocator());
+		_profiler_scratch_events = (Profiler_Event*)alloc(get_heap_allocator(), sizeof(Profiler_Event)*PROFILER_EVENTS_PER_BLOCK);
+		_profiler_names[0] = STR("(too many profiler names)");
+		_profiler_name_count = 1;
+		atomic_store_32(&init_state, 2, MEMORY_ORDER_RELEASE);
+	} else {
+		while (atomic_load_32(&init_state, MEMORY_ORDER_ACQUIRE) != 2) os_yield_thread();
+	}
+	profiler_initted = true;
+}
+
+f64 profiler_get_ticks_per_second() {
+	_profiler_init();
+	// Needs some time between the two samples to be accurate
+	u64 ticks;
+	f64 seconds;
+	do {
+		ticks = rdtsc();
+		seconds = os_get_elapsed_seconds();
+	} while (seconds - _profiler_start_seconds < 0.01);
+	return (f64)(ticks - _profiler_start_ticks) / (seconds - _profiler_start_seconds);
+}
+// Same timeline as os_get_elapsed_seconds()
+inline f64 _profiler_ticks_to_seconds(u64 ticks, f64 ticks_per_second) {
+	return _profiler_start_seconds + (f64)(s64)(ticks - _profiler_start_ticks) / ticks_per_second;
+}
+
+u32 _profiler_get_name_id_slow(const char *name, u64 slot) {
+	_profiler_init();
+	spinlock_acquire_or_wait(&_profiler_lock);
+
+	u32 id = 0;
+	u64 mask = PROFILER_NAME_SLOTS-1;
+	while (true) {
+		const char *key = atomic_load_ptr((void* volatile*)&_profiler_name_keys[slot], MEMORY_ORDER_ACQUIRE);
+		if (key == name) { id = _profiler_name_ids[slot]; break; }
+		if (key) { slot = (slot + 1) & mask; continue; }
+
+		// Same name at another address (a literal from another translation unit) gets the same id
+		string s = STR(name);
+		for (u32 i = 1; i < _profiler_name_count; i++) {
+			if (strings_match(_profiler_names[i], s)) { id = i; break; }
+		}
+		if (!id && _profiler_name_count < PROFILER_MAX_NAMES) {
+			id = _profiler_name_count;
+			_profiler_names[id] = string_copy(s, get_heap_allocator());
+			atomic_store_32(&_profiler_name_count, id + 1, MEMORY_ORDER_RELEASE);
+		}
+		if (!id) break; // Out of names, don't fill up the slots either
+
+		_profiler_name_ids[slot] = id;
+		atomic_store_ptr((void* volatile*)&_profiler_name_keys[slot], (void*)name, MEMORY_ORDER_RELEASE);
+		break;
+	}
+
+	spinlock_release(&_profiler_lock);
+	return id;
+}
+inline u32 _profiler_get_name_id(const char *name) {
+	u64 mask = PROFILER_NAME_SLOTS-1;
+	u64 slot = (((u64)name >> 3) * 0x9E3779B97F4A7C15ull >> 32) & mask;
+	while (true) {
+		const char *key = atomic_load_ptr((void* volatile*)&_profiler_name_keys[slot], MEMORY_ORDER_ACQUIRE);
+		if (key == name) return _profiler_name_ids[slot];
+		if (!key) return _profiler_get_name_id_slow(name, slot);
+		slot = (slot + 1) & mask;
+	}
+}
+string profiler_get_name(u32 name_id) {
+	if (name_id >= atomic_load_32(&_profiler_name_count, MEMORY_ORDER_ACQUIRE)) return STR("");
+	return _profiler_names[name_id];
+}
+
+// Called when the current block is full (or the thread hasn't written anything yet)
+Profiler_Thread_Buffer *_profiler_next_block() {
+	Profiler_Thread_Buffer *b = _profiler_thread_buffer;
+	Allocator heap = get_heap_allocator();
+
+	if (!b) {
+		_profiler_init();
+		b = (Profiler_Thread_Buffer*)alloc(heap, sizeof(Profiler_Thread_Buffer));
+		memset(b, 0, sizeof(Profiler_Thread_Buffer));
+		b->thread_id = get_context().thread_id;
+
+		spinlock_acquire_or_wait(&_profiler_lock);
+		b->next = _profiler_thread_buffers;
+		_profiler_thread_buffers = b;
+		spinlock_release(&_profiler_lock);
+
+		_profiler_thread_buffer = b;
+	}
+
+	u64 first_position = 0;
+	u64 index = 0;
+	if (b->current_block) {
+		first_position = b->current_block->first_position + PROFILER_EVENTS_PER_BLOCK;
+		index = b->current_block_index + 1;
+	}
+	if (index >= atomic_load_64(&_profiler_block_limit, MEMORY_ORDER_RELAXED)) index = 0;
+
+	Profiler_Event_Block *block = b->blocks[index];
+	if (!block) {
+		block = (Profiler_Event_Block*)alloc(heap, sizeof(Profiler_Event_Block));
+		block->first_position = first_position;
+		block->count = 0;
+		atomic_store_ptr((void* volatile*)&b->blocks[index], block, MEMORY_ORDER_RELEASE);
+	} else {
+		atomic_store_64(&b->overwritten_events, b->overwritten_events + block->count, MEMORY_ORDER_RELAXED);
+		atomic_store_64(&block->count, 0, MEMORY_ORDER_RELAXED);
+		atomic_store_64(&block->first_position, first_position, MEMORY_ORDER_RELAXED);
+		// The new first_position has to be visible before we start writing over the old events
+		atomic_thread_fence(MEMORY_ORDER_RELEASE);
+	}
+
+	b->current_block = block;
+	b->current_block_index = index;
+	b->next_event = block->events;
+	b->block_end = block->events + PROFILER_EVENTS_PER_BLOCK;
+	return b;
+}
+
+inline void _profiler_report_scope(u32 name_id, u64 start, u64 end) {
+	Profiler_Thread_Buffer *b = _profiler_thread_buffer;
+	if (!b || b->next_event == b->block_end) b = _profiler_next_block();
+
+	Profiler_Event *e = b->next_event;
+	e->start = start;
+	e->end = end;
+	e->name_id = name_id;
+	b->next_event = e + 1;
+	atomic_store_64(&b->current_block->count, (u64)(b->next_event - b->current_block->events), MEMORY_ORDER_RELEASE);
+}
+
+// Throws away everything the calling thread has recorded and stops tracking it, for threads
+// that are done and that nobody wants to see in the profile.
+void _profiler_discard_thread_buffer() {
+	Profiler_Thread_Buffer *b = _profiler_thread_buffer;
+	if (!b) return;
+
+	spinlock_acquire_or_wait(&_profiler_lock);
+	Profiler_Thread_Buffer **link = &_profiler_thread_buffers;
+	while (*link != b) link = &(*link)->next;
+	*link = b->next;
+	spinlock_release(&_profiler_lock);
+
+	for (u64 i = 0; i < PROFILER_MAX_BLOCKS_PER_THREAD; i++) {
+		if (b->blocks[i]) dealloc(get_heap_allocator(), b->blocks[i]);
+	}
+	dealloc(get_heap_allocator(), b);
+	_profiler_thread_buffer = 0;
+}
+
+// Start of the oldest frame we keep, 0 if we keep everything
+u64 _profiler_get_cutoff_ticks() {
+	u64 keep = _profiler_kept_frame_count;
+	u64 frame_count = atomic_load_64(&_profiler_frame_count, MEMORY_ORDER_ACQUIRE);
+	if (!keep || frame_count < keep) return 0;
+	return _profiler_frame_starts[(frame_count - keep) % PROFILER_MAX_KEPT_FRAMES];
+}
+
+// Returns how many events were copied out, 0 if the block was reused while we copied.
+u64 _profiler_copy_block(Profiler_Event_Block *block, Profiler_Event *out, u64 *first_position) {
+	*first_position = atomic_load_64(&block->first_position, MEMORY_ORDER_ACQUIRE);
+	u64 count = atomic_load_64(&block->count, MEMORY_ORDER_ACQUIRE);
+	memcpy(out, block->events, count*sizeof(Profiler_Event));
+	atomic_thread_fence(MEMORY_ORDER_ACQUIRE);
+	if (atomic_load_64(&block->first_position, MEMORY_ORDER_RELAXED) != *first_position) return 0;
+	return count;
+}
+
+Profiler_Scope_History *_profiler_get_scope_history(u32 name_id) {
+	Profiler_Scope_History *h = _profiler_scope_histories[name_id];
+	if (!h) {
+		h = (Profiler_Scope_History*)alloc(get_heap_allocator(), sizeof(Profiler_Scope_History));
+		memset(h, 0, sizeof(Profiler_Scope_History));
+		for (u64 i = 0; i < PROFILER_STATS_WINDOW_FRAMES; i++) h->frames[i].frame = UINT64_MAX;
+		_profiler_scope_histories[name_id] = h;
+	}
+	return h;
+}
+
+// Everything recorded since last time goes into the stats for this frame. _profiler_lock is held.
+void _profiler_aggregate_frame(u64 frame) {
+	for (Profiler_Thread_Buffer *b = _profiler_thread_buffers; b; b = b->next) {
+		u64 newest = b->aggregated_position;
+		for (u64 i = 0; i < PROFILER_MAX_BLOCKS_PER_THREAD; i++) {
+			Profiler_Event_Block *block = atomic_load_ptr((void* volatile*)&b->blocks[i], MEMORY_ORDER_ACQUIRE);
+			if (!block) continue;
+			u64 end_position = atomic_load_64(&block->first_position, MEMORY_ORDER_RELAXED) + atomic_load_64(&block->count, MEMORY_ORDER_RELAXED);
+			if (end_position <= b->aggregated_position) continue;
+
+			u64 first_position;
+			u64 count = _profiler_copy_block(block, _profiler_scratch_events, &first_position);
+			for (u64 j = 0; j < count; j++) {
+				if (first_position + j < b->aggregated_position) continue;
+				Profiler_Event *e = &_profiler_scratch_events[j];
+				u64 ticks = e->end - e->start;
+
+				Profiler_Scope_History *h = _profiler_get_scope_history(e->name_id);
+				Profiler_Scope_Frame *f = &h->frames[frame % PROFILER_STATS_WINDOW_FRAMES];
+				if (f->frame != frame) {
+					*f = (Profiler_Scope_Frame){0};
+					f->frame = frame;
+					f->min_ticks = UINT64_MAX;
+				}
+				f->count += 1;
+				f->total_ticks += ticks;
+				f->min_ticks = min(f->min_ticks, ticks);
+				f->max_ticks = max(f->max_ticks, ticks);
+
+				u64 sample = h->sample_count % PROFILER_STATS_MAX_SAMPLES;
+				h->sample_ticks[sample] = ticks;
+				h->sample_frames[sample] = frame;
+				h->sample_count += 1;
+			}
+			if (count) newest = max(newest, first_position + count);
+		}
+		b->aggregated_position = newest;
+	}
+}
+
+void profiler_mark_frame() {
+	_profiler_init();
+	u64 now = rdtsc();
+
+	spinlock_acquire_or_wait(&_profiler_lock);
+
+	u64 frame_count = _profiler_frame_count;
+	if (frame_count) _profiler_aggregate_frame(frame_count - 1);
+	_profiler_frame_starts[frame_count % PROFILER_MAX_KEPT_FRAMES] = now;
+	atomic_store_64(&_profiler_frame_count, frame_count + 1, MEMORY_ORDER_RELEASE);
+
+	u64 cutoff = _profiler_get_cutoff_ticks();
+	if (cutoff && growing_array_get_valid_count(_profiler_counters)) {
+		// Drop counters from frames we don't keep
+		f64 cutoff_seconds = _profiler_ticks_to_seconds(cutoff, profiler_get_ticks_per_second());
+		u32 count = growing_array_get_valid_count(_profiler_counters);
+		u32 drop = 0;
+		while (drop < count && _profiler_counters[drop].time < cutoff_seconds) {
+			dealloc_string(get_heap_allocator(), _profiler_counters[drop].name);
+			dealloc_string(get_heap_allocator(), _profiler_counters[drop].args);
+			drop += 1;
+		}
+		if (drop) {
+			memmove(_profiler_counters, _profiler_counters + drop, (count - drop)*sizeof(Profiler_Counter));
+			growing_array_resize((void**)&_profiler_counters, count - drop);
+		}
+	}
+
+	spinlock_release(&_profiler_lock);
+}
+
+// frame_count 0 goes back to keeping everything. max_events_per_thread is how much memory each
+// thread gets (rounded up to whole blocks), make it enough for frame_count frames.
+void profiler_keep_last_frames(u64 frame_count, u64 max_events_per_thread) {
+	_profiler_init();
+	assert(frame_count <= PROFILER_MAX_KEPT_FRAMES, "Can keep at most %d frames", PROFILER_MAX_KEPT_FRAMES);
+
+	u64 block_limit = PROFILER_MAX_BLOCKS_PER_THREAD;
+	if (frame_count) {
+		block_limit = (max_events_per_thread + PROFILER_EVENTS_PER_BLOCK - 1) / PROFILER_EVENTS_PER_BLOCK;
+		// One block is always being written to, need at least one more to keep something
+		block_limit = clamp(block_limit + 1, 2, PROFILER_MAX_BLOCKS_PER_THREAD);
+	}
+	_profiler_kept_frame_count = frame_count;
+	atomic_store_64(&_profiler_block_limit, block_limit, MEMORY_ORDER_RELAXED);
+}
+
+///
+// Stats
+
+// Frames [first, last) that the stats are over. _profiler_lock is held.
+void _profiler_get_stats_window(u64 *first, u64 *last) {
+	*last = _profiler_frame_count ? _profiler_frame_count - 1 : 0; // The current frame isn't done
+	*first = *last > PROFILER_STATS_WINDOW_FRAMES ? *last - PROFILER_STATS_WINDOW_FRAMES : 0;
+}
+f64 _profiler_percentile(u64 *sorted, u64 count, f64 percentile) {
+	if (!count) return 0;
+	u64 i = (u64)(percentile*(f64)(count - 1) + 0.5);
+	return (f64)sorted[min(i, count - 1)];
+}
+// _profiler_lock is held
+void _profiler_get_scope_stats_locked(u32 name_id, Profiler_Scope_Stats *stats, f64 ticks_per_second) {
+	memset(stats, 0, sizeof(*stats));
+	stats->name = _profiler_names[name_id];
+
+	u64 first, last;
+	_profiler_get_stats_window(&first, &last);
+	stats->frame_count = last - first;
+
+	Profiler_Scope_History *h = _profiler_scope_histories[name_id];
+	if (!h || !stats->frame_count) return;
+
+	u64 min_ticks = UINT64_MAX;
+	u64 max_ticks = 0;
+	u64 total_ticks = 0;
+	for (u64 frame = first; frame < last; frame++) {
+		Profiler_Scope_Frame *f = &h->frames[frame % PROFILER_STATS_WINDOW_FRAMES];
+		if (f->frame != frame) continue;
+		stats->count += f->count;
+		total_ticks += f->total_ticks;
+		min_ticks = min(min_ticks, f->min_ticks);
+		max_ticks = max(max_ticks, f->max_ticks);
+		if (frame == last - 1) stats->last_frame_seconds = (f64)f->total_ticks/ticks_per_second;
+	}
+	if (!stats->count) return;
+
+	stats->total_seconds = (f64)total_ticks/ticks_per_second;
+	stats->min_seconds = (f64)min_ticks/ticks_per_second;
+	stats->max_seconds = (f64)max_ticks/ticks_per_second;
+	stats->seconds_per_frame = stats->total_seconds/(f64)stats->frame_count;
+
+	u64 sorted[PROFILER_STATS_MAX_SAMPLES];
+	u64 help[PROFILER_STATS_MAX_SAMPLES];
+	u64 sample_count = 0;
+	for (u64 i = 0; i < min(h->sample_count, PROFILER_STATS_MAX_SAMPLES); i++) {
+		if (h->sample_frames[i] >= first && h->sample_frames[i] < last) sorted[sample_count++] = h->sample_ticks[i];
+	}
+	radix_sort(sorted, help, sample_count, sizeof(u64), 0, 64);
+	stats->p50_seconds = _profiler_percentile(sorted, sample_count, 0.50)/ticks_per_second;
+	stats->p95_seconds = _profiler_percentile(sorted, sample_count, 0.95)/ticks_per_second;
+	stats->p99_seconds = _profiler_percentile(sorted, sample_count, 0.99)/ticks_per_second;
+}
+
+bool profiler_get_scope_stats(string name, Profiler_Scope_Stats *stats) {
+	_profiler_init();
+	f64 ticks_per_second = profiler_get_ticks_per_second();
+
+	u32 name_count = atomic_load_32(&_profiler_name_count, MEMORY_ORDER_ACQUIRE);
+	for (u32 i = 1; i < name_count; i++) {
+		if (!strings_match(_profiler_names[i], name)) continue;
+		spinlock_acquire_or_wait(&_profiler_lock);
+		_profiler_get_scope_stats_locked(i, stats, ticks_per_second);
+		spinlock_release(&_profiler_lock);
+		return stats->count > 0;
+	}
+	memset(stats, 0, sizeof(*stats));
+	return false;
+}
+
+int _profiler_compare_seconds_per_frame(const void *a, const void *b) {
+	f64 x = ((Profiler_Scope_Stats*)a)->seconds_per_frame;
+	f64 y = ((Profiler_Scope_Stats*)b)->seconds_per_frame;
+	return (x < y) - (x > y);
+}
+u64 profiler_get_top_scopes(Profiler_Scope_Stats *stats, u64 max_count) {
+	_profiler_init();
+	f64 ticks_per_second = profiler_get_ticks_per_second();
+	u32 name_count = atomic_load_32(&_profiler_name_count, MEMORY_ORDER_ACQUIRE);
+	if (!max_count || name_count <= 1) return 0;
+
+	Profiler_Scope_Stats *all = (Profiler_Scope_Stats*)alloc(get_temporary_allocator(), 2*name_count*sizeof(Profiler_Scope_Stats));
+	u64 count = 0;
+
+	spinlock_acquire_or_wait(&_profiler_lock);
+	for (u32 i = 1; i < name_count; i++) {
+		_profiler_get_scope_stats_locked(i, &all[count], ticks_per_second);
+		if (all[count].count) count += 1;
+	}
+	spinlock_release(&_profiler_lock);
+
+	merge_sort(all, all + name_count, count, sizeof(Profiler_Scope_Stats), _profiler_compare_seconds_per_frame);
+	count = min(count, max_count);
+	memcpy(stats, all, count*sizeof(Profiler_Scope_Stats));
+	return count;
+}
+
+Profiler_Frame_Stats profiler_get_frame_stats() {
+	_profiler_init();
+	f64 ticks_per_second = profiler_get_ticks_per_second();
+	Profiler_Frame_Stats stats = {0};
+
+	u64 sorted[PROFILER_STATS_WINDOW_FRAMES];
+	u64 help[PROFILER_STATS_WINDOW_FRAMES];
+
+	spinlock_acquire_or_wait(&_profiler_lock);
+	u64 first, last;
+	_profiler_get_stats_window(&first, &last);
+	for (u64 frame = first; frame < last; frame++) {
+		sorted[stats.frame_count++] = _profiler_frame_starts[(frame + 1) % PROFILER_MAX_KEPT_FRAMES] - _profiler_frame_starts[frame % PROFILER_MAX_KEPT_FRAMES];
+	}
+	spinlock_release(&_profiler_lock);
+
+	if (!stats.frame_count) return stats;
+
+	u64 total = 0;
+	for (u64 i = 0; i < stats.frame_count; i++) {
+		total += sorted[i];
+		f64 ms = (f64)sorted[i]/ticks_per_second*1000.0;
+		stats.histogram[min((u64)ms, PROFILER_FRAME_HISTOGRAM_BUCKETS - 1)] += 1;
+	}
+	stats.last_seconds = (f64)sorted[stats.frame_count - 1]/ticks_per_second;
+	radix_sort(sorted, help, stats.frame_count, sizeof(u64), 0, 64);
+
+	stats.average_seconds = (f64)total/(f64)stats.frame_count/ticks_per_second;
+	stats.min_seconds = (f64)sorted[0]/ticks_per_second;
+	stats.max_seconds = (f64)sorted[stats.frame_count - 1]/ticks_per_second;
+	stats.p50_seconds = _profiler_percentile(sorted, stats.frame_count, 0.50)/ticks_per_second;
+	stats.p95_seconds = _profiler_percentile(sorted, stats.frame_count, 0.95)/ticks_per_second;
+	stats.p99_seconds = _profiler_percentile(sorted, stats.frame_count, 0.99)/ticks_per_second;
+	return stats;
+}
+
+// Appends the events as google trace json objects, each one followed by a comma
+void profiler_write_trace(String_Builder *out) {
+	_profiler_init();
+	f64 ticks_per_second = profiler_get_ticks_per_second();
+
+	spinlock_acquire_or_wait(&_profiler_lock);
+
+	u64 cutoff = _profiler_get_cutoff_ticks();
+	f64 cutoff_seconds = cutoff ? _profiler_ticks_to_seconds(cutoff, ticks_per_second) : 0;
+
+	for (Profiler_Thread_Buffer *b = _profiler_thread_buffers; b; b = b->next) {
+		for (u64 i = 0; i < PROFILER_MAX_BLOCKS_PER_THREAD; i++) {
+			Profiler_Event_Block *block = atomic_load_ptr((void* volatile*)&b->blocks[i], MEMORY_ORDER_ACQUIRE);
+			if (!block) continue;
+
+			u64 first_position;
+			u64 count = _profiler_copy_block(block, _profiler_scratch_events, &first_position);
+			for (u64 j = 0; j < count; j++) {
+				Profiler_Event *e = &_profiler_scratch_events[j];
+				if (cutoff && (s64)(e->end - cutoff) < 0) continue;
+				string_builder_print(out,
+					STR("{\"cat\":\"function\",\"dur\":%.3f,\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%zu,\"ts\":%.3f},"),
+					(f64)(e->end - e->start) / ticks_per_second * 1000000,
+					profiler_get_name(e->name_id),
+					b->thread_id,
+					_profiler_ticks_to_seconds(e->start, ticks_per_second) * 1000000
+				);
+			}
+		}
+	}
+
+	u32 counter_count = growing_array_get_valid_count(_profiler_counters);
+	for (u32 i = 0; i < counter_count; i++) {
+		Profiler_Counter *c = &_profiler_counters[i];
+		if (c->time < cutoff_seconds) continue;
+		string_builder_print(out, STR("{\"cat\":\"counter\",\"name\":\"%s\",\"ph\":\"C\",\"pid\":0,\"tid\":%zu,\"ts\":%.3f,\"args\":{%s}},"),
+			c->name, c->thread_id, c->time * 1000000, c->args);
+	}
+
+	spinlock_release(&_profiler_lock);
+}
+
 void dump_profile_result() {
+	String_Builder trace;
+	string_builder_init_reserve(&trace, 1024*1000, get_heap_allocator());
+	profiler_write_trace(&trace);
+
 	File file = os_file_open("google_trace.json", O_CREATE | O_WRITE);
-	
+
 	os_file_write_string(file, STR("["));
-	os_file_write_string(file, _profile_output.result);
+	os_file_write_string(file, trace.result);
 	os_file_write_string(file, STR("{}]"));
-	
+
 	os_file_close(file);
-	
+
+	string_builder_deinit(&trace);
+
 	log_verbose("Wrote profiling result to google_trace.json");
 }
-void _profiler_report_time(string name, f64 count, f64 start) {
-	if (!profiler_initted) {
-		spinlock_init(&_profiler_lock);
-		profiler_initted = true;
-		
-		string_builder_init_reserve(&_profile_output, 1024*1000, get_heap_allocator());	
-		
-	}
-	
+// args is the inside of a json object, like "a":1,"b":2. Each key is a line in the counter graph.
+void _profiler_report_counters(string name, string args, f64 time) {
+	_profiler_init();
+
+	Profiler_Counter c;
+	c.time = time;
+	c.thread_id = get_context().thread_id;
+	c.name = string_copy(name, get_heap_allocator());
+	c.args = string_copy(args, get_heap_allocator());
+
 	spinlock_acquire_or_wait(&_profiler_lock);
-	
-	string fmt = STR("{\"cat\":\"function\",\"dur\":%.3f,\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%zu,\"ts\":%.3f},");
-    string_builder_print(
-        &_profile_output,
-        fmt,
-        (float64)(count * 1000000),  
-        name,                  
-        get_context().thread_id,
-        start * 1000000              
-    );
+	growing_array_add((void**)&_profiler_counters, &c);
 	spinlock_release(&_profiler_lock);
 }
+#if ENABLE_LOCK_STATS
+// One counter track per lock, call it every now and then (once a frame) to see contention over time
+void profiler_report_lock_stats(string name, Lock_Stats *stats) {
+	string args = tprint("\"acquisitions\":%llu,\"contended\":%llu,\"spins\":%llu,\"sleeps\":%llu",
+		stats->acquisitions, stats->contended, stats->spins, stats->sleeps);
+	_profiler_report_counters(name, args, os_get_elapsed_seconds());
+}
+#endif
+
+// Always there so the tests can measure it, use tm_scope
+#define _tm_scope(name) \
+    for (u64 _tm_name_id = _profiler_get_name_id(name), _tm_start = rdtsc(), _tm_done = 0; \
+         !_tm_done; \
+         _tm_done = 1, _profiler_report_scope((u32)_tm_name_id, _tm_start, rdtsc()))
 #if ENABLE_PROFILING
-#define tm_scope(name) \
-    for (f64 start_time = os_get_elapsed_seconds(), end_time = start_time, elapsed_time = 0; \
-         elapsed_time == 0; \
-         elapsed_time = (end_time = os_get_elapsed_seconds()) - start_time, _profiler_report_time(STR(name), elapsed_time, start_time))
+#define tm_scope(name) _tm_scope(name)
 #define tm_scope_var(name, var) \
     for (f64 start_time = os_get_elapsed_seconds(), end_time = start_time, elapsed_time = 0; \
          elapsed_time == 0; \
@@ -61,4 +688,4 @@ void _profiler_report_time(string name, f64 count, f64 start) {
 	#define tm_scope(...)
 	#define tm_scope_var(...)
 	#define tm_scope_accum(...)
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,407 @@
+
+///
+// The CPU side of rendering a Draw_Frame: turning Draw_Quad's into vertices.
+// This doesn't touch the gpu at all so the renderer (gfx_impl_xxx.c) just does:
+//
+//     quad_batcher_prepare(&batcher, &frame->quad_buffer, frame->enable_z_sorting, MAX_TEXTURES);
+//     (maybe fill in batch.uv_nudge)
+//     quad_batcher_expand(&batcher, staging_vertices, window.pixel_height);
+//     for each batch: upload batch.quad_count*4 vertices from batch.first_quad*4 and draw
+//
+// prepare:
+//     When z sorting we sort (z, index) pairs packed in a u64 instead of moving the 200+ byte
+//     Draw_Quad's around. Then it walks the quads in order and splits them into batches
+//     whenever we run out of texture slots.
+//     The quads are in a Bucket_Array (so draw_xxx can hand out stable Draw_Quad*'s), we read
+//     them bucket by bucket here and by index in expand.
+// expand:
+//     Writes 4 vertices per quad. Every quad knows where its vertices go so this is split in
+//     chunks with parallel_for (job_system.c).
+//
+// This isn't in the #ifndef OOGABOOGA_HEADLESS block so we can test & benchmark it without a gpu.
+// Images are only ever compared by pointer in here, never dereferenced.
+//
+
+typedef struct Gfx_Image Gfx_Image;
+
+typedef enum Gfx_Filter_Mode {
+	GFX_FILTER_MODE_NEAREST,
+	GFX_FILTER_MODE_LINEAR,
+} Gfx_Filter_Mode;
+
+#ifdef VERTEX_2D_USER_DATA_COUNT
+	#error VERTEX_2D_USER_DATA_COUNT has been renamed to VERTEX_USER_DATA_COUNT, please use that instead
+#endif
+#ifndef VERTEX_USER_DATA_COUNT
+	#define VERTEX_USER_DATA_COUNT 1
+#endif
+
+// We use radix sort so the exact bit count is of importance
+#define MAX_Z_BITS 21
+#define MAX_Z ((1 << MAX_Z_BITS)/2)
+
+typedef struct Draw_Quad {
+	// BEWARE !! These are in ndc
+	Vector2 bottom_left, top_left, top_right, bottom_right;
+	// r, g, b, a
+	Vector4 color;
+	Gfx_Image *image;
+	Gfx_Filter_Mode image_min_filter;
+	Gfx_Filter_Mode image_mag_filter;
+	s32 z;
+	u8 type;
+	bool has_scissor;
+	// x1, y1, x2, y2
+	Vector4 uv;
+	Vector4 scissor;
+
+	Vector4 userdata[VERTEX_USER_DATA_COUNT]; // #Volatile do NOT change this to a pointer
+
+} Draw_Quad;
+
+// #Volatile reflected in the renderer's vertex layout & 2D batch shader
+// #Cleanup #Memory why am I doing alignat(16)?
+typedef struct alignat(16) Quad_Vertex {
+
+	Vector4 color;
+	Vector4 position;
+	Vector2 uv;
+	Vector2 self_uv;
+	s8 texture_index;
+	u8 type;
+	u8 sampler;
+	u8 has_scissor;
+
+	Vector4 userdata[VERTEX_USER_DATA_COUNT];
+
+	Vector4 scissor;
+
+} Quad_Vertex;
+
+// Draw_Frame keeps its quads in buckets of this many so Draw_Quad*'s never move while drawing
+#define DRAW_FRAME_QUADS_PER_BUCKET 1024
+
+#define QUAD_BATCH_MAX_TEXTURES 32
+#define QUAD_EXPAND_MAX_THREADS 16
+// Below this many quads per thread it's faster to just do it on one thread
+#define QUAD_EXPAND_MIN_QUADS_PER_THREAD 2048
+#define QUAD_EXPAND_PREFETCH_DISTANCE 8
+
+typedef struct Quad_Batch {
+	u64 first_quad; // In sorted order, which is also where the vertices go (first_quad*4)
+	u64 quad_count;
+
+	u64 image_count;
+	Gfx_Image *images[QUAD_BATCH_MAX_TEXTURES]; // Quad_Vertex.texture_index indexes this
+
+	// Added to the uv of quads with images[i]. The renderer can fill this in between prepare
+	// and expand, zero by default.
+	Vector2 uv_nudge[QUAD_BATCH_MAX_TEXTURES];
+} Quad_Batch;
+
+typedef struct Quad_Batcher {
+	// 0 means one per job system worker + this thread (up to QUAD_EXPAND_MAX_THREADS)
+	u64 thread_count;
+
+	// Valid after quad_batcher_prepare
+	Bucket_Array *quads; // Draw_Quad's
+	u64 quad_count;
+	bool sorted;
+	u32 *order; // Sorted position -> index in quads, only valid if sorted
+	s8 *texture_indices; // Per sorted position
+	Quad_Batch *batches; // Growing array
+
+	// Reused between frames
+	u64 capacity;
+	u64 *keys;
+	u64 *keys_swap;
+	Gfx_Image **images; // Per quad in submission order, so batching doesn't jump around in the quads
+} Quad_Batcher;
+
+void ogb_instance
+quad_batcher_prepare(Quad_Batcher *b, Bucket_Array *quads, bool z_sort, u64 max_textures_per_batch);
+
+// out needs room for quad_count*4 vertices.
+// Scissors are given top-down, pass the render target height to flip them.
+void ogb_instance
+quad_batcher_expand(Quad_Batcher *b, Quad_Vertex *out, float32 scissor_flip_height);
+
+void ogb_instance
+quad_batcher_destroy(Quad_Batcher *b);
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+void quad_batcher_reserve(Quad_Batcher *b, u64 quad_count) {
+	if (quad_count <= b->capacity) return;
+
+	Allocator heap = get_tagged_heap_allocator(MEMORY_TAG_RENDERER);
+	if (b->capacity) {
+		dealloc(heap, b->keys);
+		dealloc(heap, b->keys_swap);
+		dealloc(heap, b->order);
+		dealloc(heap, b->texture_indices);
+		dealloc(heap, b->images);
+	}
+
+	b->capacity = get_next_power_of_two(quad_count);
+	b->keys            = alloc(heap, b->capacity*sizeof(u64));
+	b->keys_swap       = alloc(heap, b->capacity*sizeof(u64));
+	b->order           = alloc(heap, b->capacity*sizeof(u32));
+	b->texture_indices = alloc(heap, b->capacity*sizeof(s8));
+	b->images          = alloc(heap, b->capacity*sizeof(Gfx_Image*));
+}
+
+// Stable LSD radix sort of the z in the high 32 bits. The index in the low bits makes ties keep
+// their submission order. Passes where every key has the same digit are skipped, which is most
+// of them when a game only uses a handful of z layers.
+void quad_batcher_sort_keys(Quad_Batcher *b) {
+	u64 n = b->quad_count;
+	u64 *src = b->keys;
+	u64 *dst = b->keys_swap;
+
+	for (u64 shift = 32; shift < 32 + MAX_Z_BITS + 1; shift += 8) {
+		u64 count[256];
+		memset(count, 0, sizeof(count));
+		for (u64 i = 0; i < n; i++) count[(src[i] >> shift) & 0xff] += 1;
+
+		if (count[(src[0] >> shift) & 0xff] == n) continue;
+
+		u64 sum = 0;
+		for (u64 d = 0; d < 256; d++) {
+			u64 c = count[d];
+			count[d] = sum;
+			sum += c;
+		}
+		for (u64 i = 0; i < n; i++) {
+			u64 key = src[i];
+			dst[count[(key >> shift) & 0xff]++] = key;
+		}
+		swap(src, dst, u64*);
+	}
+
+	for (u64 i = 0; i < n; i++) b->order[i] = (u32)src[i];
+}
+
+void quad_batcher_prepare(Quad_Batcher *b, Bucket_Array *quads, bool z_sort, u64 max_textures_per_batch) {
+	assert(quads->block_size_in_bytes == sizeof(Draw_Quad), "Expected a bucket array of Draw_Quad's");
+	u64 quad_count = quads->count;
+	assert(quad_count < 0xFFFFFFFFull, "Too many quads");
+	assert(max_textures_per_batch > 0 && max_textures_per_batch <= QUAD_BATCH_MAX_TEXTURES, "Bad max_textures_per_batch");
+
+	if (!b->batches) growing_array_init_reserve((void**)&b->batches, sizeof(Quad_Batch), 16, get_tagged_heap_allocator(MEMORY_TAG_RENDERER));
+	growing_array_clear((void**)&b->batches);
+
+	b->quads = quads;
+	b->quad_count = quad_count;
+	b->sorted = false;
+	if (quad_count == 0) return;
+
+	quad_batcher_reserve(b, quad_count);
+
+	// One pass in submission order over the big quads, after this we only touch them again in expand
+	u64 i = 0;
+	u64 bucket_count = bucket_array_get_bucket_count(quads);
+	for (u64 bucket_index = 0; bucket_index < bucket_count; bucket_index++) {
+		u64 count;
+		Draw_Quad *bucket = (Draw_Quad*)bucket_array_get_bucket(quads, bucket_index, &count);
+		for (u64 j = 0; j < count; j++, i++) {
+			s32 z = bucket[j].z;
+			assert(z <= MAX_Z, "Z is too high. Z is %d, Max is %d.", z, MAX_Z);
+			assert(z >= (-MAX_Z+1), "Z is too low. Z is %d, Min is %d.", z, -MAX_Z+1);
+			b->keys[i] = ((u64)(z + MAX_Z) << 32) | i;
+			b->images[i] = bucket[j].image;
+		}
+	}
+
+	b->sorted = z_sort;
+	u32 *order = 0;
+	if (z_sort) {
+		quad_batcher_sort_keys(b);
+		order = b->order;
+	}
+
+	///
+	// Split into batches by texture slots
+	Quad_Batch *batch = growing_array_add_empty((void**)&b->batches);
+	memset(batch, 0, sizeof(Quad_Batch));
+
+	Gfx_Image *last_image = 0;
+	s8 last_texture_index = -1;
+	for (u64 p = 0; p < quad_count; p++) {
+		Gfx_Image *image = b->images[order ? order[p] : p];
+
+		s8 texture_index = -1;
+		if (image) {
+			if (image == last_image) {
+				texture_index = last_texture_index;
+			} else {
+				// First look if texture is already bound
+				for (u64 j = 0; j < batch->image_count; j++) {
+					if (batch->images[j] == image) {
+						texture_index = (s8)j;
+						break;
+					}
+				}
+				// Otherwise use a new slot
+				if (texture_index <= -1) {
+					if (batch->image_count >= max_textures_per_batch) {
+						// Out of slots, start a new batch
+						u64 next_first = batch->first_quad + batch->quad_count;
+						batch = growing_array_add_empty((void**)&b->batches);
+						memset(batch, 0, sizeof(Quad_Batch));
+						batch->first_quad = next_first;
+					}
+					texture_index = (s8)batch->image_count;
+					batch->images[batch->image_count] = image;
+					batch->image_count += 1;
+				}
+				last_image = image;
+				last_texture_index = texture_index;
+			}
+		}
+
+		b->texture_indices[p] = texture_index;
+		batch->quad_count += 1;
+	}
+}
+
+// bucket_array_get, but with a constant stride & no range check since this runs per quad per frame
+inline Draw_Quad *quad_batcher_get_quad(Quad_Batcher *b, u64 index) {
+	u64 shift = b->quads->bucket_shift;
+	return (Draw_Quad*)b->quads->buckets[index >> shift] + (index & ((1ull << shift) - 1));
+}
+
+void quad_batcher_expand_range(Quad_Batcher *b, Quad_Vertex *out, float32 scissor_flip_height, u64 first, u64 last) {
+	Quad_Batch *batches = b->batches;
+	u64 batch_count = growing_array_get_valid_count(b->batches);
+
+	// Find the batch that first is in
+	u64 lo = 0, hi = batch_count-1;
+	while (lo < hi) {
+		u64 mid = (lo + hi + 1) / 2;
+		if (batches[mid].first_quad <= first) lo = mid;
+		else hi = mid - 1;
+	}
+	Quad_Batch *batch = &batches[lo];
+	u64 batch_end = batch->first_quad + batch->quad_count;
+
+	for (u64 p = first; p < last; p++) {
+		if (p >= batch_end) {
+			batch += 1;
+			batch_end = batch->first_quad + batch->quad_count;
+		}
+
+		Draw_Quad *q = quad_batcher_get_quad(b, b->sorted ? b->order[p] : p);
+		s8 texture_index = b->texture_indices[p];
+
+		// Sorted quads are all over the place, so get the ones a bit ahead on the way
+		if (b->sorted && p + QUAD_EXPAND_PREFETCH_DISTANCE < last) {
+			u8 *ahead = (u8*)quad_batcher_get_quad(b, b->order[p + QUAD_EXPAND_PREFETCH_DISTANCE]);
+			for (u64 offset = 0; offset < sizeof(Draw_Quad); offset += 64) {
+				_mm_prefetch((const char*)(ahead + offset), _MM_HINT_T0);
+			}
+		}
+
+		// Fill in everything that's the same for all 4 corners once, then copy it
+		Quad_Vertex v;
+		memset(&v, 0, sizeof(v)); // (padding too, so output is deterministic)
+		v.color = q->color;
+		v.texture_index = texture_index;
+		v.type = q->type;
+		v.has_scissor = q->has_scissor;
+		v.scissor = v4(q->scissor.x1, scissor_flip_height - q->scissor.y2, q->scissor.x2, scissor_flip_height - q->scissor.y1);
+		// #Speed #Cleanup
+		// Many programs may not user userdata, which means a lot of redundant time spent on this.
+		memcpy(v.userdata, q->userdata, sizeof(q->userdata));
+
+		Vector4 uv = q->uv;
+		if (q->image) {
+			Vector2 nudge = batch->uv_nudge[texture_index];
+			uv.x1 += nudge.x; uv.x2 += nudge.x;
+			uv.y1 += nudge.y; uv.y2 += nudge.y;
+
+			if (q->image_min_filter == GFX_FILTER_MODE_NEAREST
+					&& q->image_mag_filter == GFX_FILTER_MODE_NEAREST)
+				v.sampler = 0;
+			if (q->image_min_filter == GFX_FILTER_MODE_LINEAR
+					&& q->image_mag_filter == GFX_FILTER_MODE_LINEAR)
+				v.sampler = 1;
+			if (q->image_min_filter == GFX_FILTER_MODE_LINEAR
+					&& q->image_mag_filter == GFX_FILTER_MODE_NEAREST)
+				v.sampler = 2;
+			if (q->image_min_filter == GFX_FILTER_MODE_NEAREST
+					&& q->image_mag_filter == GFX_FILTER_MODE_LINEAR)
+				v.sampler = 3;
+		}
+
+		Quad_Vertex *BL = out + p*4 + 0;
+		Quad_Vertex *TL = out + p*4 + 1;
+		Quad_Vertex *TR = out + p*4 + 2;
+		Quad_Vertex *BR = out + p*4 + 3;
+		*BL = *TL = *TR = *BR = v;
+
+		BL->position = v4(q->bottom_left.x,  q->bottom_left.y,  0, 1);
+		TL->position = v4(q->top_left.x,     q->top_left.y,     0, 1);
+		TR->position = v4(q->top_right.x,    q->top_right.y,    0, 1);
+		BR->position = v4(q->bottom_right.x, q->bottom_right.y, 0, 1);
+
+		BL->uv = v2(uv.x1, uv.y1);
+		TL->uv = v2(uv.x1, uv.y2);
+		TR->uv = v2(uv.x2, uv.y2);
+		BR->uv = v2(uv.x2, uv.y1);
+
+		BL->self_uv = v2(0, 0);
+		TL->self_uv = v2(0, 1);
+		TR->self_uv = v2(1, 1);
+		BR->self_uv = v2(1, 0);
+	}
+}
+
+///
+// Expand is split up in thread_count ranges with parallel_for on the job system
+
+typedef struct Quad_Expand_Args {
+	Quad_Batcher *batcher;
+	Quad_Vertex *out;
+	float32 scissor_flip_height;
+} Quad_Expand_Args;
+
+void quad_expand_range_proc(u64 first, u64 last, void *data) {
+	Quad_Expand_Args *args = (Quad_Expand_Args*)data;
+	quad_batcher_expand_range(args->batcher, args->out, args->scissor_flip_height, first, last);
+}
+
+void quad_batcher_expand(Quad_Batcher *b, Quad_Vertex *out, float32 scissor_flip_height) {
+	u64 n = b->quad_count;
+	if (n == 0) return;
+
+	u64 thread_count = b->thread_count;
+	if (thread_count == 0) thread_count = job_system_get_worker_count() + 1;
+	thread_count = clamp(thread_count, 1, QUAD_EXPAND_MAX_THREADS);
+	thread_count = min(thread_count, max(n / QUAD_EXPAND_MIN_QUADS_PER_THREAD, 1));
+
+	if (thread_count == 1) {
+		quad_batcher_expand_range(b, out, scissor_flip_height, 0, n);
+		return;
+	}
+
+	Quad_Expand_Args args;
+	args.batcher = b;
+	args.out = out;
+	args.scissor_flip_height = scissor_flip_height;
+	parallel_for(0, n, (n + thread_count - 1) / thread_count, quad_expand_range_proc, &args);
+}
+
+void quad_batcher_destroy(Quad_Batcher *b) {
+	Allocator heap = get_tagged_heap_allocator(MEMORY_TAG_RENDERER);
+	if (b->capacity) {
+		dealloc(heap, b->keys);
+		dealloc(heap, b->keys_swap);
+		dealloc(heap, b->order);
+		dealloc(heap, b->texture_indices);
+		dealloc(heap, b->images);
+	}
+	if (b->batches) growing_array_deinit((void**)&b->batches);
+	memset(b, 0, sizeof(Quad_Batcher));
+}
+#endif // !OOGABOOGA_LINK_EXTERNAL_INSTANCE
@@ -50,7 +50,9 @@ inline void basic_rsqrt_float32_512(float32 *a, float32 *result);
 #endif
 
 #include <immintrin.h>
-#include <intrin.h>
+#ifdef _WIN32
+	#include <intrin.h>
+#endif
 
 
 // SSE
@@ -627,8 +629,8 @@ inline void simd_rsqrt_float32_512_aligned(float32 *a, float32 *result) {
 
 #endif
 
-float64 __cdecl sqrt(_In_ float64 _X);
-float64 __cdecl rsqrt(_In_ float64 _X);
+float64 __cdecl sqrt(float64 _X);
+float64 __cdecl rsqrt(float64 _X);
 
 inline void basic_add_float32_64 (float32 *a, float32 *b, float32* result) {
 	result[0] = a[0] + b[0];
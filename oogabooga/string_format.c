@@ -23,9 +23,17 @@
 		%v2   : Vector2
 		%v3   : Vector3
 		%v4   : Vector4
+		%r    : Float32 or float64, the shortest digits that read back as the same float64
+		%cs   : char* (null terminated)
 		
-	Also includes all of the standard C printf-like format specifiers:
-	https://www.geeksforgeeks.org/format-specifiers-in-c/
+	Also includes all of the standard C printf-like format specifiers, flags, width, precision
+	and length modifiers: https://www.geeksforgeeks.org/format-specifiers-in-c/
+	These are all formatted here, we don't call the CRT.
+	
+	Directly, for when you just need the digits:
+		u64 format_u64_digits(char *out, u64 x, u32 base, bool upper);
+		u64 format_float64_shortest(char *out, float64 x);
+		u64 format_float32_shortest(char *out, float32 x);
 */
 
 ogb_instance void os_write_string_to_stdout(string s);
@@ -41,158 +49,972 @@ u64 format_string_to_buffer_vararg(char* buffer, u64 count, const char* fmt, ...
 	va_end(args);
 	return n;
 }
-typedef struct _8_Bytes {u8 _[8];} _8_Bytes;
-typedef struct _12_Bytes {u8 _[12];} _12_Bytes;
-typedef struct _16_Bytes {u8 _[16];} _16_Bytes;
+
+///
+// Number formatting
+//
+// Integers are written 2 digits at a time from a table.
+// Floats are exact: %f/%e/%g give the correctly rounded (half to even) digits of the actual
+// binary value like glibc does, using a small bignum only when the value has more than 64 bits
+// of integer or 60 bits of fraction. %r gives the shortest digits that parse back to the same
+// float (Burger & Dybvig's free-format algorithm, same bignum).
+//
+
+static const char fmt_digit_pairs[201] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+// Writes the digits of x to out, returns how many. out needs room for 64.
+u64 format_u64_digits(char *out, u64 x, u32 base, bool upper) {
+	char temp[64];
+	char *at = temp + sizeof(temp);
+	if (base == 10) {
+		while (x >= 100) {
+			u64 pair = (x % 100)*2;
+			x /= 100;
+			at -= 2;
+			at[0] = fmt_digit_pairs[pair];
+			at[1] = fmt_digit_pairs[pair+1];
+		}
+		if (x >= 10) {
+			at -= 2;
+			at[0] = fmt_digit_pairs[x*2];
+			at[1] = fmt_digit_pairs[x*2+1];
+		} else {
+			*--at = (char)('0' + x);
+		}
+	} else {
+		const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+		u32 shift = base == 16 ? 4 : (base == 8 ? 3 : 1);
+		do {
+			*--at = digits[x & (base-1)];
+			x >>= shift;
+		} while (x);
+	}
+	u64 n = temp + sizeof(temp) - at;
+	memcpy(out, at, n);
+	return n;
+}
+
+// Enough for 2^1130 or so, which is the biggest the float algorithms need
+#define FMT_BIG_LIMBS 40
+
+typedef struct Fmt_Big {
+	u32 count; // Limbs in use, the top one is never 0
+	u32 limbs[FMT_BIG_LIMBS];
+} Fmt_Big;
+
+void fmt_big_set_u64(Fmt_Big *b, u64 x) {
+	b->limbs[0] = (u32)x;
+	b->limbs[1] = (u32)(x >> 32);
+	b->count = x >> 32 ? 2 : (x ? 1 : 0);
+}
+void fmt_big_mul_small(Fmt_Big *b, u32 m) {
+	u64 carry = 0;
+	for (u32 i = 0; i < b->count; i++) {
+		u64 x = (u64)b->limbs[i]*m + carry;
+		b->limbs[i] = (u32)x;
+		carry = x >> 32;
+	}
+	if (carry) {
+		assert(b->count < FMT_BIG_LIMBS, "Fmt_Big overflow");
+		b->limbs[b->count++] = (u32)carry;
+	}
+}
+void fmt_big_mul_pow10(Fmt_Big *b, u32 n) {
+	for (; n >= 9; n -= 9) fmt_big_mul_small(b, 1000000000);
+	static const u32 small_pow10[9] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+	if (n) fmt_big_mul_small(b, small_pow10[n]);
+}
+void fmt_big_shift_left(Fmt_Big *b, u32 bits) {
+	if (!b->count) return;
+	u32 limb_shift = bits / 32;
+	u32 bit_shift = bits % 32;
+	assert(b->count + limb_shift + 1 <= FMT_BIG_LIMBS, "Fmt_Big overflow");
+	b->limbs[b->count + limb_shift] = 0;
+	for (s64 i = b->count-1; i >= 0; i--) {
+		u64 x = (u64)b->limbs[i] << bit_shift;
+		b->limbs[i + limb_shift + 1] |= (u32)(x >> 32);
+		b->limbs[i + limb_shift] = (u32)x;
+	}
+	for (u32 i = 0; i < limb_shift; i++) b->limbs[i] = 0;
+	b->count += limb_shift + 1;
+	while (b->count && !b->limbs[b->count-1]) b->count -= 1;
+}
+void fmt_big_pow2(Fmt_Big *b, u32 n) {
+	fmt_big_set_u64(b, 1);
+	fmt_big_shift_left(b, n);
+}
+int fmt_big_compare(Fmt_Big *a, Fmt_Big *b) {
+	if (a->count != b->count) return a->count < b->count ? -1 : 1;
+	for (s64 i = a->count-1; i >= 0; i--) {
+		if (a->limbs[i] != b->limbs[i]) return a->limbs[i] < b->limbs[i] ? -1 : 1;
+	}
+	return 0;
+}
+// r = a + b, r may be a or b
+void fmt_big_add(Fmt_Big *r, Fmt_Big *a, Fmt_Big *b) {
+	u32 n = max(a->count, b->count);
+	u64 carry = 0;
+	for (u32 i = 0; i < n; i++) {
+		u64 x = carry + (i < a->count ? a->limbs[i] : 0) + (i < b->count ? b->limbs[i] : 0);
+		r->limbs[i] = (u32)x;
+		carry = x >> 32;
+	}
+	r->count = n;
+	if (carry) {
+		assert(n < FMT_BIG_LIMBS, "Fmt_Big overflow");
+		r->limbs[r->count++] = (u32)carry;
+	}
+}
+// a -= b, a >= b
+void fmt_big_sub(Fmt_Big *a, Fmt_Big *b) {
+	s64 borrow = 0;
+	for (u32 i = 0; i < a->count; i++) {
+		s64 x = (s64)a->limbs[i] - (i < b->count ? b->limbs[i] : 0) - borrow;
+		borrow = x < 0;
+		a->limbs[i] = (u32)x;
+	}
+	while (a->count && !a->limbs[a->count-1]) a->count -= 1;
+}
+// b /= d, returns the remainder
+u32 fmt_big_divmod_small(Fmt_Big *b, u32 d) {
+	u64 rem = 0;
+	for (s64 i = b->count-1; i >= 0; i--) {
+		u64 x = (rem << 32) | b->limbs[i];
+		b->limbs[i] = (u32)(x / d);
+		rem = x % d;
+	}
+	while (b->count && !b->limbs[b->count-1]) b->count -= 1;
+	return (u32)rem;
+}
+// r /= s for a quotient under 10, r becomes the remainder
+u32 fmt_big_quotient_digit(Fmt_Big *r, Fmt_Big *s) {
+	u32 q = 0;
+	while (fmt_big_compare(r, s) >= 0) {
+		fmt_big_sub(r, s);
+		q += 1;
+	}
+	return q;
+}
+
+typedef struct Fmt_Float_Parts {
+	bool negative;
+	bool is_inf, is_nan, is_zero;
+	u64 mantissa; // With the hidden bit
+	s32 exponent; // value = mantissa * 2^exponent
+	bool lower_boundary_closer; // Next float down is closer than next float up (mantissa is a power of two)
+} Fmt_Float_Parts;
+
+Fmt_Float_Parts fmt_float_parts(u64 bits, u32 mantissa_bits, u32 exponent_bits) {
+	Fmt_Float_Parts parts = ZERO(Fmt_Float_Parts);
+	u64 mantissa_mask = (1ull << mantissa_bits) - 1;
+	u32 max_exponent = (1u << exponent_bits) - 1;
+	s32 bias = (s32)(max_exponent >> 1) + (s32)mantissa_bits;
+
+	parts.negative = (bits >> (mantissa_bits + exponent_bits)) & 1;
+	u64 m = bits & mantissa_mask;
+	u32 biased = (u32)((bits >> mantissa_bits) & max_exponent);
+
+	if (biased == max_exponent) {
+		parts.is_inf = m == 0;
+		parts.is_nan = m != 0;
+	} else if (biased == 0) {
+		parts.is_zero = m == 0;
+		parts.mantissa = m;
+		parts.exponent = 1 - bias;
+	} else {
+		parts.mantissa = m | (1ull << mantissa_bits);
+		parts.exponent = (s32)biased - bias;
+		parts.lower_boundary_closer = m == 0 && biased > 1;
+	}
+	return parts;
+}
+
+///
+// Exact digits, integer part first then the fraction, for %f %e %g
+
+#define FMT_MAX_INT_DIGITS 320
+
+typedef struct Fmt_Digits {
+	char int_digits[FMT_MAX_INT_DIGITS];
+	s32 int_count; // 0 when the integer part is 0
+	s32 int_at;
+	u32 k; // Bits of fraction
+	u64 frac; // When k <= 60
+	bool big;
+	Fmt_Big big_frac;
+} Fmt_Digits;
+
+void fmt_digits_init(Fmt_Digits *d, u64 mantissa, s32 exponent) {
+	d->int_count = 0;
+	d->int_at = 0;
+	d->k = 0;
+	d->frac = 0;
+	d->big = false;
+
+	if (exponent >= 0) {
+		if (exponent <= 11) {
+			u64 x = mantissa << exponent;
+			if (x) d->int_count = (s32)format_u64_digits(d->int_digits, x, 10, false);
+		} else {
+			// Big integer, 9 digits at a time from the bottom
+			Fmt_Big b;
+			fmt_big_set_u64(&b, mantissa);
+			fmt_big_shift_left(&b, (u32)exponent);
+			char temp[FMT_MAX_INT_DIGITS];
+			s32 n = 0;
+			while (b.count) {
+				u32 chunk = fmt_big_divmod_small(&b, 1000000000);
+				for (u32 i = 0; i < 9; i++) {
+					temp[n++] = (char)('0' + chunk % 10);
+					chunk /= 10;
+				}
+			}
+			while (n > 1 && temp[n-1] == '0') n -= 1;
+			for (s32 i = 0; i < n; i++) d->int_digits[i] = temp[n-1-i];
+			d->int_count = n;
+		}
+	} else {
+		d->k = (u32)-exponent;
+		if (d->k < 64) {
+			u64 x = mantissa >> d->k;
+			if (x) d->int_count = (s32)format_u64_digits(d->int_digits, x, 10, false);
+		}
+		if (d->k <= 60) {
+			d->frac = mantissa & ((1ull << d->k) - 1);
+		} else {
+			// Mantissa is under 2^53 so there's no integer part here
+			d->big = true;
+			fmt_big_set_u64(&d->big_frac, mantissa);
+		}
+	}
+}
+
+bool fmt_digits_fraction_is_zero(Fmt_Digits *d) {
+	return d->big ? d->big_frac.count == 0 : d->frac == 0;
+}
+
+u32 fmt_digits_next(Fmt_Digits *d) {
+	if (d->int_at < d->int_count) return (u32)(d->int_digits[d->int_at++] - '0');
+	if (!d->big) {
+		if (!d->frac) return 0;
+		d->frac *= 10;
+		u32 digit = (u32)(d->frac >> d->k);
+		d->frac &= (1ull << d->k) - 1;
+		return digit;
+	}
+
+	Fmt_Big *b = &d->big_frac;
+	if (!b->count) return 0;
+	fmt_big_mul_small(b, 10);
+	u32 limb = d->k / 32;
+	u32 bit = d->k % 32;
+	if (limb >= b->count) return 0;
+	// The digit is under 16, so it's in at most 2 limbs
+	u64 top = b->limbs[limb];
+	if (limb+1 < b->count) top |= (u64)b->limbs[limb+1] << 32;
+	u32 digit = (u32)(top >> bit);
+	b->limbs[limb] &= bit ? (u32)((1ull << bit) - 1) : 0;
+	b->count = limb+1;
+	while (b->count && !b->limbs[b->count-1]) b->count -= 1;
+	return digit;
+}
+
+// Anything non-zero left after what we've taken so far
+bool fmt_digits_rest_is_nonzero(Fmt_Digits *d) {
+	for (s32 i = d->int_at; i < d->int_count; i++) {
+		if (d->int_digits[i] != '0') return true;
+	}
+	return !fmt_digits_fraction_is_zero(d);
+}
+
+// Round the digit string up by one in the last place (half to even is decided by the caller).
+// Returns true if it carried out of the first digit, in which case digits are now 1000...
+bool fmt_round_up(char *digits, s64 count) {
+	for (s64 i = count-1; i >= 0; i--) {
+		if (digits[i] == '.') continue;
+		if (digits[i] != '9') {
+			digits[i] += 1;
+			return false;
+		}
+		digits[i] = '0';
+	}
+	return true;
+}
+
+bool fmt_should_round_up(Fmt_Digits *d, char last_digit) {
+	u32 next = fmt_digits_next(d);
+	if (next != 5) return next > 5;
+	if (fmt_digits_rest_is_nonzero(d)) return true;
+	return (last_digit - '0') & 1;
+}
+
+// Precision is clamped to this, the body of one number has to fit on the stack
+#define FMT_MAX_PRECISION 512
+#define FMT_FLOAT_BUFFER_SIZE (FMT_MAX_INT_DIGITS + FMT_MAX_PRECISION + 16)
+
+// %f without sign, returns length
+u64 fmt_float_fixed(char *out, u64 mantissa, s32 exponent, u32 precision, bool force_point) {
+	Fmt_Digits d;
+	fmt_digits_init(&d, mantissa, exponent);
+
+	// Leave one in front for a carry
+	char *start = out + 1;
+	char *at = start;
+	if (d.int_count) {
+		memcpy(at, d.int_digits, d.int_count);
+		at += d.int_count;
+		d.int_at = d.int_count;
+	} else {
+		*at++ = '0';
+	}
+	if (precision || force_point) *at++ = '.';
+	for (u32 i = 0; i < precision; i++) *at++ = (char)('0' + fmt_digits_next(&d));
+
+	char last = at[-1] == '.' ? at[-2] : at[-1];
+	if (fmt_should_round_up(&d, last) && fmt_round_up(start, at - start)) {
+		start -= 1;
+		*start = '1';
+	}
+	u64 n = at - start;
+	if (start != out) memmove(out, start, n);
+	return n;
+}
+
+// significant_count digits into out and the decimal exponent of the first one
+void fmt_float_significant_digits(char *out, u32 significant_count, u64 mantissa, s32 exponent, s32 *exponent10) {
+	Fmt_Digits d;
+	fmt_digits_init(&d, mantissa, exponent);
+
+	u32 first;
+	if (d.int_count) {
+		*exponent10 = d.int_count - 1;
+		first = fmt_digits_next(&d);
+	} else {
+		*exponent10 = -1;
+		first = fmt_digits_next(&d);
+		while (first == 0) {
+			*exponent10 -= 1;
+			first = fmt_digits_next(&d);
+		}
+	}
+
+	out[0] = (char)('0' + first);
+	for (u32 i = 1; i < significant_count; i++) out[i] = (char)('0' + fmt_digits_next(&d));
+
+	if (fmt_should_round_up(&d, out[significant_count-1]) && fmt_round_up(out, significant_count)) {
+		out[0] = '1';
+		*exponent10 += 1;
+	}
+}
+
+u64 fmt_write_exponent(char *out, char e, s32 exponent10) {
+	char *at = out;
+	*at++ = e;
+	*at++ = exponent10 < 0 ? '-' : '+';
+	u32 x = (u32)(exponent10 < 0 ? -exponent10 : exponent10);
+	if (x < 10) *at++ = '0';
+	at += format_u64_digits(at, x, 10, false);
+	return at - out;
+}
+
+// %e without sign
+u64 fmt_float_exponential(char *out, u64 mantissa, s32 exponent, u32 precision, bool force_point, bool upper) {
+	char digits[FMT_MAX_PRECISION+1];
+	s32 exponent10 = 0;
+	if (mantissa) {
+		fmt_float_significant_digits(digits, precision+1, mantissa, exponent, &exponent10);
+	} else {
+		memset(digits, '0', precision+1);
+	}
+
+	char *at = out;
+	*at++ = digits[0];
+	if (precision || force_point) *at++ = '.';
+	memcpy(at, digits+1, precision);
+	at += precision;
+	at += fmt_write_exponent(at, upper ? 'E' : 'e', exponent10);
+	return at - out;
+}
+
+// Digits with the decimal point placed at exponent10, plain if it's small enough otherwise scientific
+u64 fmt_place_digits(char *out, char *digits, u32 count, s32 exponent10, s32 min_plain_exponent, s32 max_plain_exponent, bool keep_zeros, bool upper) {
+	if (!keep_zeros) {
+		while (count > 1 && digits[count-1] == '0') count -= 1;
+	}
+
+	char *at = out;
+	if (exponent10 < min_plain_exponent || exponent10 > max_plain_exponent) {
+		*at++ = digits[0];
+		if (count > 1 || keep_zeros) *at++ = '.';
+		memcpy(at, digits+1, count-1);
+		at += count-1;
+		at += fmt_write_exponent(at, upper ? 'E' : 'e', exponent10);
+	} else if (exponent10 < 0) {
+		*at++ = '0';
+		*at++ = '.';
+		for (s32 i = 0; i < -exponent10-1; i++) *at++ = '0';
+		memcpy(at, digits, count);
+		at += count;
+	} else {
+		u32 int_count = (u32)exponent10 + 1;
+		for (u32 i = 0; i < int_count; i++) *at++ = i < count ? digits[i] : '0';
+		if (count > int_count || keep_zeros) *at++ = '.';
+		if (count > int_count) {
+			memcpy(at, digits + int_count, count - int_count);
+			at += count - int_count;
+		}
+	}
+	return at - out;
+}
+
+// %g without sign
+u64 fmt_float_general(char *out, u64 mantissa, s32 exponent, u32 precision, bool alternate, bool upper) {
+	u32 p = precision ? precision : 1;
+	char digits[FMT_MAX_PRECISION+1];
+	s32 exponent10 = 0;
+	if (mantissa) {
+		fmt_float_significant_digits(digits, p, mantissa, exponent, &exponent10);
+	} else {
+		memset(digits, '0', p);
+	}
+	return fmt_place_digits(out, digits, p, exponent10, -4, (s32)p-1, alternate, upper);
+}
+
+///
+// Shortest round trip, Burger & Dybvig free-format
+
+// Same as below but in u64's, which is enough for most numbers around 0.001 to 2^53.
+// Returns 0 if it doesn't fit.
+u32 fmt_shortest_digits_small(Fmt_Float_Parts parts, char *digits, s32 *exponent10, s32 k) {
+	u64 f = parts.mantissa;
+	s32 e = parts.exponent;
+	bool even = (f & 1) == 0;
+	if (e >= 0 || e < -62) return 0;
+
+	u64 closer = parts.lower_boundary_closer ? 1 : 0;
+	u64 r = f << (1 + closer);
+	u64 s = 1ull << (u32)(1 - e + (s32)closer);
+	u64 m_plus = 1 + closer;
+	u64 m_minus = 1;
+	if (-e + 1 + closer >= 63 || f >> 61) return 0;
+
+	const u64 limit = UINT64_MAX / 16; // s*11 and friends must fit
+	if (k >= 0) {
+		for (s32 i = 0; i < k; i++) {
+			if (s > limit / 10) return 0;
+			s *= 10;
+		}
+	} else {
+		for (s32 i = 0; i < -k; i++) {
+			if (r > limit / 10) return 0;
+			r *= 10;
+			m_plus *= 10;
+			m_minus *= 10;
+		}
+	}
+	if (even ? r + m_plus >= s : r + m_plus > s) {
+		if (s > limit / 10) return 0;
+		s *= 10;
+		k += 1;
+	}
+	if (s > limit) return 0;
+	*exponent10 = k - 1;
+
+	u32 count = 0;
+	while (true) {
+		r *= 10;
+		m_plus *= 10;
+		m_minus *= 10;
+		u32 digit = (u32)(r / s);
+		r %= s;
+
+		bool low = even ? r <= m_minus : r < m_minus;
+		bool high = even ? r + m_plus >= s : r + m_plus > s;
+		if (!low && !high) {
+			digits[count++] = (char)('0' + digit);
+			continue;
+		}
+		if (low && high) {
+			if (r*2 > s || (r*2 == s && (digit & 1))) digit += 1;
+		} else if (high) {
+			digit += 1;
+		}
+		digits[count++] = (char)('0' + digit);
+		return count;
+	}
+}
+
+// Returns the digit count, digits[0] is at exponent10
+u32 fmt_shortest_digits(Fmt_Float_Parts parts, char *digits, s32 *exponent10) {
+	// Estimate k = ceil(log10(value)), might be one too low which the fixup below takes care of
+	s32 bit_length = (s32)bit_scan_reverse_64(parts.mantissa) + 1;
+	s32 k = (s32)ceil((f64)(parts.exponent + bit_length - 1)*0.30102999566398114 - 1e-10);
+
+	u32 small_count = fmt_shortest_digits_small(parts, digits, exponent10, k);
+	if (small_count) return small_count;
+
+	Fmt_Big r, s, m_plus, m_minus;
+	u64 f = parts.mantissa;
+	s32 e = parts.exponent;
+	bool even = (f & 1) == 0;
+
+	// r/s is the value, m+ and m- are half the distance to the neighbour floats
+	if (e >= 0) {
+		fmt_big_set_u64(&r, f);
+		fmt_big_shift_left(&r, (u32)e + (parts.lower_boundary_closer ? 2 : 1));
+		fmt_big_set_u64(&s, parts.lower_boundary_closer ? 4 : 2);
+		fmt_big_pow2(&m_plus, (u32)e + (parts.lower_boundary_closer ? 1 : 0));
+		fmt_big_pow2(&m_minus, (u32)e);
+	} else {
+		fmt_big_set_u64(&r, f << (parts.lower_boundary_closer ? 2 : 1));
+		fmt_big_pow2(&s, (u32)(-e) + (parts.lower_boundary_closer ? 2 : 1));
+		fmt_big_set_u64(&m_plus, parts.lower_boundary_closer ? 2 : 1);
+		fmt_big_set_u64(&m_minus, 1);
+	}
+
+	if (k >= 0) {
+		fmt_big_mul_pow10(&s, (u32)k);
+	} else {
+		fmt_big_mul_pow10(&r, (u32)-k);
+		fmt_big_mul_pow10(&m_plus, (u32)-k);
+		fmt_big_mul_pow10(&m_minus, (u32)-k);
+	}
+
+	Fmt_Big high;
+	fmt_big_add(&high, &r, &m_plus);
+	int c = fmt_big_compare(&high, &s);
+	if (even ? c >= 0 : c > 0) {
+		fmt_big_mul_small(&s, 10);
+		k += 1;
+	}
+	*exponent10 = k - 1;
+
+	u32 count = 0;
+	while (true) {
+		fmt_big_mul_small(&r, 10);
+		fmt_big_mul_small(&m_plus, 10);
+		fmt_big_mul_small(&m_minus, 10);
+		u32 digit = fmt_big_quotient_digit(&r, &s);
+
+		c = fmt_big_compare(&r, &m_minus);
+		bool low = even ? c <= 0 : c < 0;
+		fmt_big_add(&high, &r, &m_plus);
+		c = fmt_big_compare(&high, &s);
+		bool high_ok = even ? c >= 0 : c > 0;
+
+		if (!low && !high_ok) {
+			digits[count++] = (char)('0' + digit);
+			continue;
+		}
+		if (low && high_ok) {
+			// Both work, take the closer one (half to even)
+			Fmt_Big twice_r = r;
+			fmt_big_mul_small(&twice_r, 2);
+			c = fmt_big_compare(&twice_r, &s);
+			if (c > 0 || (c == 0 && (digit & 1))) digit += 1;
+		} else if (high_ok) {
+			digit += 1;
+		}
+		digits[count++] = (char)('0' + digit);
+		break;
+	}
+	return count;
+}
+
+// Shortest string that reads back as the same float. out needs room for 32.
+u64 fmt_shortest(char *out, Fmt_Float_Parts parts) {
+	char *at = out;
+	if (parts.negative && !parts.is_nan) *at++ = '-';
+	if (parts.is_nan)  { memcpy(at, "nan", 3); return at - out + 3; }
+	if (parts.is_inf)  { memcpy(at, "inf", 3); return at - out + 3; }
+	if (parts.is_zero) { *at++ = '0'; return at - out; }
+
+	char digits[32];
+	s32 exponent10;
+	u32 count = fmt_shortest_digits(parts, digits, &exponent10);
+	at += fmt_place_digits(at, digits, count, exponent10, -5, 16, false, false);
+	return at - out;
+}
+u64 format_float64_shortest(char *out, float64 x) {
+	u64 bits;
+	memcpy(&bits, &x, sizeof(bits));
+	return fmt_shortest(out, fmt_float_parts(bits, 52, 11));
+}
+u64 format_float32_shortest(char *out, float32 x) {
+	u32 bits;
+	memcpy(&bits, &x, sizeof(bits));
+	return fmt_shortest(out, fmt_float_parts(bits, 23, 8));
+}
+
+///
+// Spec parsing & padding
+
+#define FMT_FLAG_LEFT      (1 << 0)
+#define FMT_FLAG_PLUS      (1 << 1)
+#define FMT_FLAG_SPACE     (1 << 2)
+#define FMT_FLAG_ALTERNATE (1 << 3)
+#define FMT_FLAG_ZERO      (1 << 4)
+
+typedef enum Fmt_Length {
+	FMT_LENGTH_NONE, FMT_LENGTH_HH, FMT_LENGTH_H, FMT_LENGTH_L, FMT_LENGTH_LL,
+	FMT_LENGTH_J, FMT_LENGTH_Z, FMT_LENGTH_T, FMT_LENGTH_BIG_L,
+} Fmt_Length;
+
+typedef struct Fmt_Spec {
+	u32 flags;
+	s64 width;
+	s64 precision; // -1 for none
+	Fmt_Length length;
+} Fmt_Spec;
+
+typedef struct Fmt_Out {
+	char *buffer;
+	char *at;
+	u64 count;
+} Fmt_Out;
+
+inline u64 fmt_room(Fmt_Out *o) {
+	u64 used = o->at - o->buffer;
+	return used < o->count-1 ? o->count-1 - used : 0;
+}
+void fmt_put_bytes(Fmt_Out *o, const char *p, u64 n) {
+	n = min(n, fmt_room(o));
+	if (o->buffer && n) memcpy(o->at, p, n);
+	o->at += n;
+}
+void fmt_put_repeat(Fmt_Out *o, char c, s64 n) {
+	if (n <= 0) return;
+	u64 m = min((u64)n, fmt_room(o));
+	if (o->buffer) memset(o->at, c, m);
+	o->at += m;
+}
+
+// [spaces][prefix][zeros][body][spaces]
+void fmt_put_padded(Fmt_Out *o, Fmt_Spec *spec, const char *prefix, u64 prefix_count, const char *body, u64 body_count, bool zero_pad) {
+	s64 pad = spec->width - (s64)(prefix_count + body_count);
+	bool left = spec->flags & FMT_FLAG_LEFT;
+	if (!left && !zero_pad) fmt_put_repeat(o, ' ', pad);
+	fmt_put_bytes(o, prefix, prefix_count);
+	if (!left && zero_pad) fmt_put_repeat(o, '0', pad);
+	fmt_put_bytes(o, body, body_count);
+	if (left) fmt_put_repeat(o, ' ', pad);
+}
+
+void fmt_put_integer(Fmt_Out *o, Fmt_Spec *spec, u64 magnitude, bool negative, u32 base, bool upper) {
+	char prefix[4];
+	u64 prefix_count = 0;
+	if (negative)                         prefix[prefix_count++] = '-';
+	else if (spec->flags & FMT_FLAG_PLUS)  prefix[prefix_count++] = '+';
+	else if (spec->flags & FMT_FLAG_SPACE) prefix[prefix_count++] = ' ';
+
+	char digits[64+64];
+	u64 digit_count = 0;
+	if (magnitude || spec->precision != 0) digit_count = format_u64_digits(digits + 64, magnitude, base, upper);
+
+	if (spec->flags & FMT_FLAG_ALTERNATE && magnitude) {
+		if (base == 16) {
+			prefix[prefix_count++] = '0';
+			prefix[prefix_count++] = upper ? 'X' : 'x';
+		} else if (base == 8 && spec->precision <= (s64)digit_count) {
+			prefix[prefix_count++] = '0';
+		}
+	}
+
+	// Precision is the minimum digit count for integers
+	char *body = digits + 64;
+	if (spec->precision > (s64)digit_count) {
+		u64 zeros = min((u64)spec->precision - digit_count, 64);
+		body -= zeros;
+		memset(body, '0', zeros);
+		digit_count += zeros;
+	}
+
+	bool zero_pad = (spec->flags & FMT_FLAG_ZERO) && spec->precision < 0;
+	fmt_put_padded(o, spec, prefix, prefix_count, body, digit_count, zero_pad);
+}
+
+void fmt_put_float(Fmt_Out *o, Fmt_Spec *spec, float64 x, char conversion) {
+	u64 bits;
+	memcpy(&bits, &x, sizeof(bits));
+	Fmt_Float_Parts parts = fmt_float_parts(bits, 52, 11);
+	bool upper = conversion >= 'A' && conversion <= 'Z';
+
+	char prefix[1];
+	u64 prefix_count = 0;
+	if (parts.negative)                    prefix[prefix_count++] = '-';
+	else if (spec->flags & FMT_FLAG_PLUS)  prefix[prefix_count++] = '+';
+	else if (spec->flags & FMT_FLAG_SPACE) prefix[prefix_count++] = ' ';
+
+	if (parts.is_nan || parts.is_inf) {
+		const char *body = parts.is_nan ? (upper ? "NAN" : "nan") : (upper ? "INF" : "inf");
+		fmt_put_padded(o, spec, prefix, prefix_count, body, 3, false);
+		return;
+	}
+
+	u32 precision = spec->precision < 0 ? 6 : (u32)min(spec->precision, FMT_MAX_PRECISION);
+	bool alternate = spec->flags & FMT_FLAG_ALTERNATE;
+
+	char body[FMT_FLOAT_BUFFER_SIZE];
+	u64 n = 0;
+	switch (conversion) {
+		case 'f': case 'F': n = fmt_float_fixed(body, parts.mantissa, parts.exponent, precision, alternate); break;
+		case 'e': case 'E': n = fmt_float_exponential(body, parts.mantissa, parts.exponent, precision, alternate, upper); break;
+		case 'g': case 'G': n = fmt_float_general(body, parts.mantissa, parts.exponent, precision, alternate, upper); break;
+		case 'a': case 'A': {
+			// Hex float, 0x1.8p+1. Subnormals are written as 0x0.xxxp-1022 like glibc
+			char *at = body;
+			*at++ = '0';
+			*at++ = upper ? 'X' : 'x';
+			u64 m = parts.mantissa & ((1ull << 52) - 1);
+			s32 e = parts.is_zero ? 0 : parts.exponent + 52;
+			u32 lead = parts.is_zero ? 0 : (u32)(parts.mantissa >> 52);
+			if (!lead && !parts.is_zero) e = -1022;
+
+			u32 hex_count = 13;
+			if (spec->precision < 0) {
+				while (hex_count && !((m >> (4*(13-hex_count))) & 0xf)) hex_count -= 1;
+			} else if (precision < 13) {
+				// Round half to even at the hex digit
+				u32 drop = 4*(13 - precision);
+				u64 rest = m & ((1ull << drop) - 1);
+				u64 half = 1ull << (drop-1);
+				m >>= drop;
+				bool odd = precision ? (m & 1) : (lead & 1);
+				if (rest > half || (rest == half && odd)) m += 1;
+				if (m >> (4*precision)) { lead += 1; m &= (1ull << (4*precision)) - 1; }
+				m <<= drop;
+				hex_count = precision;
+			}
+			*at++ = (char)('0' + lead);
+			if (hex_count || alternate || (spec->precision > 0)) *at++ = '.';
+			const char *hex = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+			for (u32 i = 0; i < hex_count; i++) *at++ = hex[(m >> (48 - 4*i)) & 0xf];
+			for (u32 i = hex_count; i < precision && spec->precision >= 0; i++) *at++ = '0';
+			*at++ = upper ? 'P' : 'p';
+			*at++ = e < 0 ? '-' : '+';
+			at += format_u64_digits(at, (u64)(e < 0 ? -e : e), 10, false);
+			n = at - body;
+			break;
+		}
+		case 'r': n = fmt_shortest(body, parts) - (parts.negative ? 1 : 0); memmove(body, body + (parts.negative ? 1 : 0), n); break;
+	}
+
+	fmt_put_padded(o, spec, prefix, prefix_count, body, n, spec->flags & FMT_FLAG_ZERO);
+}
+
+void fmt_put_cstring(Fmt_Out *o, Fmt_Spec *spec, const char *s) {
+	u64 len = 0;
+	u64 max_len = spec->precision < 0 ? UINT64_MAX : (u64)spec->precision;
+	while (len < max_len && s[len] != '\0') {
+		len += 1;
+		assert(len < (1024ULL*1024ULL*1024ULL*1ULL), "The argument passed to %%cs is either way too big, missing null-termination or simply not a char*.");
+	}
+	fmt_put_padded(o, spec, 0, 0, s, len, false);
+}
+
+// f32 members so these are passed the same way as Vector2/3/4 in all calling conventions
+typedef struct _8_Bytes {f32 _[2];} _8_Bytes;
+typedef struct _12_Bytes {f32 _[3];} _12_Bytes;
+typedef struct _16_Bytes {f32 _[4];} _16_Bytes;
+
+void fmt_put_vector(Fmt_Out *o, Fmt_Spec *spec, f32 *v, u64 n) {
+	const char *names[] = { "{ X: ", ", Y: ", ", Z: ", ", W: " };
+	Fmt_Spec element = *spec;
+	element.width = 0;
+	for (u64 i = 0; i < n; i++) {
+		fmt_put_bytes(o, names[i], strlen(names[i]));
+		fmt_put_float(o, &element, v[i], 'f');
+	}
+	fmt_put_bytes(o, " }", 2);
+}
+
 u64 format_string_to_buffer(char* buffer, u64 count, const char* fmt, va_list args) {
 	if (!buffer) count = UINT64_MAX;
+	if (count == 0) return 0;
+
+	Fmt_Out out = { buffer, buffer, count };
+	Fmt_Out *o = &out;
     const char* p = fmt;
-    char* bufp = buffer;
-    while (*p != '\0' && (bufp - buffer) < count - 1) {
-        if (*p == '%') {
+    while (*p != '\0' && fmt_room(o)) {
+        if (*p != '%') {
+            // Copy everything up to the next %
+            const char *literal = p;
+            while (*p != '\0' && *p != '%') p += 1;
+            fmt_put_bytes(o, literal, p - literal);
+            continue;
+        }
+        const char *spec_start = p;
+        p += 1;
+
+        Fmt_Spec spec = { 0, 0, -1, FMT_LENGTH_NONE };
+        while (true) {
+            if      (*p == '-') spec.flags |= FMT_FLAG_LEFT;
+            else if (*p == '+') spec.flags |= FMT_FLAG_PLUS;
+            else if (*p == ' ') spec.flags |= FMT_FLAG_SPACE;
+            else if (*p == '#') spec.flags |= FMT_FLAG_ALTERNATE;
+            else if (*p == '0') spec.flags |= FMT_FLAG_ZERO;
+            else break;
             p += 1;
-            if (*p == 's') {
-            	p += 1;
-            	// We replace %s formatting with our fixed length string (if it is a valid such, otherwise treat as char*)
-				va_list args2; // C varargs are so good
-				va_copy(args2, args);
-                string s = va_arg(args2, string);
-                va_end(args2);
-            	// Ooga booga moment
-            	bool is_valid_fixed_length_string = s.count < 1024ULL*1024ULL*1024ULL*256ULL && is_pointer_valid(s.data);
-            	if (is_valid_fixed_length_string) {
-            		va_arg(args, string);
-	                for (u64 i = 0; i < s.count && (bufp - buffer) < count - 1; i++) {
-	                	if (buffer) *bufp = s.data[i];
-	                    bufp += 1;
-	                }
-                } else {
-	            	// #Copypaste
-	            	// We extend the standard formatting and add %cs so we can format c strings if we need to
-	                char* s = va_arg(args, char*);
-	                u64 len = 0;
-	                while (*s != '\0' && (bufp - buffer) < count - 1) {
-	                	assert(len < (1024ULL*1024ULL*1024ULL*1ULL), "The argument passed to %%cs is either way too big, missing null-termination or simply not a char*.");
-	                	if (buffer) {
-	                		*bufp = *s;
-	                	}
-	                	s += 1;
-	                    bufp += 1;
-	                    len += 1;
-	                    assert(len < (1024ULL*1024ULL*1024ULL*1ULL), "The argument passed to %%cs is either way too big, missing null-termination or simply not a char*.");
-                    }
-                }
-            } else if (*p == 'c' && *(p+1) == 's') {
-            	// #Copypaste
-            	// We extend the standard formatting and add %cs so we can format c strings if we need to
-                p += 2;
-                char* s = va_arg(args, char*);
-                u64 len = 0;
-                while (*s != '\0' && (bufp - buffer) < count - 1) {
-                	assert(len < (1024ULL*1024ULL*1024ULL*1ULL), "The argument passed to %%cs is either way too big, missing null-termination or simply not a char*.");
-                	if (buffer) {
-                		*bufp = *s;
-                	}
-                	s += 1;
-                    bufp += 1;
-                    len += 1;
-                    assert(len < (1024ULL*1024ULL*1024ULL*1ULL), "The argument passed to %%cs is either way too big, missing null-termination or simply not a char*.");
-                }
-            } else if (*p == 'b') {
-            	p += 1;
-            	int data = va_arg(args, int);
-            	bool val = !(data == 0);
-            	
-            	char *result = (val ? "true" : "false");
-            	
-            	if (buffer) {
-            		memcpy(bufp, result, strlen(result));
-            	}
-        		bufp += strlen(result);
-            	
-            } else if (*p == 'v' && *(p+1) == '2') {
-            	p += 2;
-            	
-            	_8_Bytes data = va_arg(args, _8_Bytes);
-            	
-            	f32 x = *(((f32*)(&data))+0);
-            	f32 y = *(((f32*)(&data))+1);
-            	
-                u64 n = format_string_to_buffer_vararg(buffer ? bufp : 0, 128, "{ X: %f, Y: %f }", x, y);
-                
-                bufp += n;
-            } else if (*p == 'v' && *(p+1) == '3') {
-            	p += 2;
-            	
-            	_12_Bytes data = va_arg(args, _12_Bytes);
-            	
-            	f32 x = *(((f32*)(&data))+0);
-            	f32 y = *(((f32*)(&data))+1);
-            	f32 z = *(((f32*)(&data))+2);
-            	
-                u64 n = format_string_to_buffer_vararg(buffer ? bufp : 0, 196, "{ X: %f, Y: %f, Z: %f }", x, y, z);
-                
-                bufp += n;
-            } else if (*p == 'v' && *(p+1) == '4') {
-            	p += 2;
-            	
-            	_16_Bytes data = va_arg(args, _16_Bytes);
-            	
-            	f32 x = *(((f32*)(&data))+0);
-            	f32 y = *(((f32*)(&data))+1);
-            	f32 z = *(((f32*)(&data))+2);
-            	f32 w = *(((f32*)(&data))+3);
-            	
-                u64 n = format_string_to_buffer_vararg(buffer ? bufp : 0, 256, "{ X: %f, Y: %f, Z: %f, W: %f }", x, y, z, w);
-                
-                bufp += n;
+        }
+        if (*p == '*') {
+            p += 1;
+            int width = va_arg(args, int);
+            if (width < 0) { spec.flags |= FMT_FLAG_LEFT; width = -width; }
+            spec.width = width;
+        } else {
+            while (*p >= '0' && *p <= '9') spec.width = spec.width*10 + (*p++ - '0');
+        }
+        if (*p == '.') {
+            p += 1;
+            if (*p == '*') {
+                p += 1;
+                int precision = va_arg(args, int);
+                spec.precision = precision < 0 ? -1 : precision;
             } else {
-                // Fallback to standard vsnprintf
-                char temp_buffer[512];
-                char format_specifier[64];
-                int specifier_len = 0;
-                format_specifier[specifier_len++] = '%';
-
-                while (*p != '\0' && strchr("diuoxXfFeEgGaAcCpn%", *p) == NULL) {
-                    format_specifier[specifier_len++] = *p++;
+                spec.precision = 0;
+                while (*p >= '0' && *p <= '9') spec.precision = spec.precision*10 + (*p++ - '0');
+            }
+        }
+        if      (p[0] == 'h' && p[1] == 'h') { spec.length = FMT_LENGTH_HH; p += 2; }
+        else if (p[0] == 'l' && p[1] == 'l') { spec.length = FMT_LENGTH_LL; p += 2; }
+        else if (p[0] == 'h') { spec.length = FMT_LENGTH_H;     p += 1; }
+        else if (p[0] == 'l') { spec.length = FMT_LENGTH_L;     p += 1; }
+        else if (p[0] == 'j') { spec.length = FMT_LENGTH_J;     p += 1; }
+        else if (p[0] == 'z') { spec.length = FMT_LENGTH_Z;     p += 1; }
+        else if (p[0] == 't') { spec.length = FMT_LENGTH_T;     p += 1; }
+        else if (p[0] == 'L') { spec.length = FMT_LENGTH_BIG_L; p += 1; }
+        else if (p[0] == 'q') { spec.length = FMT_LENGTH_LL;    p += 1; }
+
+        char conversion = *p;
+        if (conversion == '\0') {
+            // Dangling %, write it as is
+            fmt_put_bytes(o, spec_start, p - spec_start);
+            break;
+        }
+        p += 1;
+
+        switch (conversion) {
+            case 'd': case 'i': {
+                s64 x;
+                switch (spec.length) {
+                    case FMT_LENGTH_HH: x = (s8)va_arg(args, int); break;
+                    case FMT_LENGTH_H:  x = (s16)va_arg(args, int); break;
+                    case FMT_LENGTH_L:  x = va_arg(args, long); break;
+                    case FMT_LENGTH_LL: case FMT_LENGTH_J: case FMT_LENGTH_BIG_L: x = va_arg(args, long long); break;
+                    case FMT_LENGTH_Z:  x = (s64)va_arg(args, size_t); break;
+                    case FMT_LENGTH_T:  x = va_arg(args, ptrdiff_t); break;
+                    default:            x = va_arg(args, int); break;
                 }
-                if (*p != '\0') {
-                    format_specifier[specifier_len++] = *p++;
+                u64 magnitude = x < 0 ? 0ull - (u64)x : (u64)x;
+                fmt_put_integer(o, &spec, magnitude, x < 0, 10, false);
+                break;
+            }
+            case 'u': case 'x': case 'X': case 'o': {
+                u64 x;
+                switch (spec.length) {
+                    case FMT_LENGTH_HH: x = (u8)va_arg(args, unsigned int); break;
+                    case FMT_LENGTH_H:  x = (u16)va_arg(args, unsigned int); break;
+                    case FMT_LENGTH_L:  x = va_arg(args, unsigned long); break;
+                    case FMT_LENGTH_LL: case FMT_LENGTH_J: case FMT_LENGTH_BIG_L: x = va_arg(args, unsigned long long); break;
+                    case FMT_LENGTH_Z:  x = va_arg(args, size_t); break;
+                    case FMT_LENGTH_T:  x = (u64)va_arg(args, ptrdiff_t); break;
+                    default:            x = va_arg(args, unsigned int); break;
                 }
-                format_specifier[specifier_len] = '\0';
-
-                int temp_len = vsnprintf(temp_buffer, sizeof(temp_buffer), format_specifier, args);
-                switch (format_specifier[specifier_len - 1]) {
-                    case 'd': case 'i': va_arg(args, int); break;
-                    case 'u': case 'x': case 'X': case 'o': va_arg(args, unsigned int); break;
-                    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': va_arg(args, double); break;
-                    case 'c': va_arg(args, int); break;
-                    case 's': va_arg(args, char*); break;
-                    case 'p': va_arg(args, void*); break;
-                    case 'n': va_arg(args, int*); break;
-                    default: break;
+                u32 base = conversion == 'u' ? 10 : (conversion == 'o' ? 8 : 16);
+                Fmt_Spec unsigned_spec = spec;
+                unsigned_spec.flags &= ~(FMT_FLAG_PLUS | FMT_FLAG_SPACE);
+                fmt_put_integer(o, &unsigned_spec, x, false, base, conversion == 'X');
+                break;
+            }
+            case 'p': {
+                void *x = va_arg(args, void*);
+                Fmt_Spec pointer_spec = spec;
+                pointer_spec.flags |= FMT_FLAG_ALTERNATE;
+                if (x) {
+                    fmt_put_integer(o, &pointer_spec, (u64)x, false, 16, false);
+                } else {
+                    fmt_put_padded(o, &spec, 0, 0, "0x0", 3, false);
                 }
-                
-                if (temp_len < 0) {
-                    return -1; // Error in formatting
+                break;
+            }
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': case 'r': {
+                float64 x = spec.length == FMT_LENGTH_BIG_L ? (float64)va_arg(args, long double) : va_arg(args, float64);
+                fmt_put_float(o, &spec, x, conversion);
+                break;
+            }
+            case 'c': {
+                if (*p == 's') {
+                    // We extend the standard formatting and add %cs so we can format c strings if we need to
+                    p += 1;
+                    fmt_put_cstring(o, &spec, va_arg(args, char*));
+                } else {
+                    char c = (char)va_arg(args, int);
+                    fmt_put_padded(o, &spec, 0, 0, &c, 1, false);
                 }
-
-                for (int i = 0; i < temp_len && (bufp - buffer) < count - 1; i++) {
-                    if (buffer) *bufp = temp_buffer[i];
-                    bufp += 1;
+                break;
+            }
+            case 's': {
+                // We replace %s formatting with our fixed length string (if it is a valid such, otherwise treat as char*)
+                va_list args2; // C varargs are so good
+                va_copy(args2, args);
+                string s = va_arg(args2, string);
+                va_end(args2);
+                // Ooga booga moment
+                bool is_valid_fixed_length_string = s.count < 1024ULL*1024ULL*1024ULL*256ULL && is_pointer_valid(s.data);
+                if (is_valid_fixed_length_string) {
+                    va_arg(args, string);
+                    u64 len = spec.precision < 0 ? s.count : min(s.count, (u64)spec.precision);
+                    fmt_put_padded(o, &spec, 0, 0, (char*)s.data, len, false);
+                } else {
+                    fmt_put_cstring(o, &spec, va_arg(args, char*));
                 }
+                break;
             }
-        } else {
-            if (buffer) {
-                *bufp = *p;
+            case 'b': {
+                bool val = va_arg(args, int) != 0;
+                fmt_put_padded(o, &spec, 0, 0, val ? "true" : "false", val ? 4 : 5, false);
+                break;
+            }
+            case 'v': {
+                if (*p == '2') {
+                    p += 1;
+                    _8_Bytes data = va_arg(args, _8_Bytes);
+                    fmt_put_vector(o, &spec, data._, 2);
+                } else if (*p == '3') {
+                    p += 1;
+                    _12_Bytes data = va_arg(args, _12_Bytes);
+                    fmt_put_vector(o, &spec, data._, 3);
+                } else if (*p == '4') {
+                    p += 1;
+                    _16_Bytes data = va_arg(args, _16_Bytes);
+                    fmt_put_vector(o, &spec, data._, 4);
+                } else {
+                    fmt_put_bytes(o, spec_start, p - spec_start);
+                }
+                break;
+            }
+            case 'n': {
+                int *n = va_arg(args, int*);
+                if (n) *n = (int)(o->at - o->buffer);
+                break;
+            }
+            case '%': {
+                fmt_put_bytes(o, "%", 1);
+                break;
+            }
+            default: {
+                // Not a conversion we know, write it as is
+                fmt_put_bytes(o, spec_start, p - spec_start);
+                break;
             }
-            bufp += 1;
-            p += 1;
         }
     }
-    if (buffer)  *bufp = '\0';
-    
-    return bufp - buffer;
+    if (buffer) *o->at = '\0';
+
+    return o->at - buffer;
 }
 u64 format_string_to_buffer_va(char* buffer, u64 count, const char* fmt, ...) {
 	va_list args;
@@ -224,7 +1046,12 @@ string sprint_va_list_to_buffer(const string fmt, va_list args, void* buffer, u6
 string sprint_va_list(Allocator allocator, const string fmt, va_list args) {
 
     char* fmt_cstring = temp_convert_to_null_terminated_string(fmt);
-    u64 count = format_string_to_buffer(NULL, 0, fmt_cstring, args) + 1; 
+    
+    // args is consumed when passed along on some abi's (sysv), so we need a copy for the second pass
+    va_list args_copy;
+    va_copy(args_copy, args);
+    u64 count = format_string_to_buffer(NULL, 0, fmt_cstring, args_copy) + 1; 
+    va_end(args_copy);
 
     char* buffer = NULL;
 
@@ -235,7 +1062,7 @@ string sprint_va_list(Allocator allocator, const string fmt, va_list args) {
 
 
 string sprints(Allocator allocator, const string fmt, ...) {
-	va_list args = 0;
+	va_list args;
 	va_start(args, fmt);
 	string s = sprint_va_list(allocator, fmt, args);
 	va_end(args);
@@ -244,7 +1071,7 @@ string sprints(Allocator allocator, const string fmt, ...) {
 
 // temp allocator
 string tprints(const string fmt, ...) {
-	va_list args = 0;
+	va_list args;
 	va_start(args, fmt);
 	string s = sprint_va_list(get_temporary_allocator(), fmt, args);
 	va_end(args);
@@ -347,9 +1174,9 @@ typedef void(*Logger_Proc)(Log_Level level, string s);
 void string_builder_prints(String_Builder *b, string fmt, ...) {
 	assert(b->allocator.proc, "String_Builder is missing allocator");
 	
-	va_list args1 = 0;
+	va_list args1;
 	va_start(args1, fmt);
-	va_list args2 = 0;
+	va_list args2;
 	va_copy(args2, args1);
 	
 	u64 formatted_count = format_string_to_buffer(0, 0, temp_convert_to_null_terminated_string(fmt), args1);
@@ -366,9 +1193,9 @@ void string_builder_prints(String_Builder *b, string fmt, ...) {
 void string_builder_printf(String_Builder *b, const char *fmt, ...) {
 	assert(b->allocator.proc, "String_Builder is missing allocator");
 	
-	va_list args1 = 0;
+	va_list args1;
 	va_start(args1, fmt);
-	va_list args2 = 0;
+	va_list args2;
 	va_copy(args2, args1);
 	
 	u64 formatted_count = format_string_to_buffer(0, 0, fmt, args1);
@@ -12,19 +12,22 @@ void log_heap() {
 	
 	while (block != 0) {
 		
-		print("\tBLOCK @ 0x%I64x, %llu bytes\n", (u64)block, block->size);
+		print("\tBLOCK @ 0x%llx, %llu bytes\n", (u64)block, block->size);
 		
-		Heap_Free_Node *node = block->free_head;
+		Heap_Allocation_Metadata *end = heap_block_end_chunk(block);
+		Heap_Allocation_Metadata *chunk = (Heap_Allocation_Metadata*)block->start;
 
 		u64 total_free = 0;
 		
-		while (node != 0) {
+		while (chunk != end) {
 		
-			print("\t\tFREE NODE @ 0x%I64x, %llu bytes\n", (u64)node, node->size);
-			
-			total_free += node->size;
+			if (chunk->size & HEAP_CHUNK_FREE) {
+				print("\t\tFREE NODE @ 0x%llx, %llu bytes\n", (u64)chunk, heap_chunk_size(chunk));
+				
+				total_free += heap_chunk_size(chunk);
+			}
 		
-			node = node->next;
+			chunk = heap_chunk_next(chunk);
 		}
 		
 		print("\t TOTAL FREE: %llu\n\n", total_free);
@@ -258,6 +261,1206 @@ void test_allocator_threaded(Thread *t) {
     }
 }
 
+void test_allocator_performance() {
+
+	// Fixed seed so numbers are comparable between runs
+	u64 seed_before = seed_for_random;
+	seed_for_random = 69;
+
+	Allocator heap = get_heap_allocator();
+
+	const u64 live_count = 20000;
+	const u64 churn_count = 100000;
+
+	void **ptrs  = (void**)alloc(heap, live_count*sizeof(void*));
+	u64  *order  = (u64*)  alloc(heap, live_count*sizeof(u64));
+
+	// Shuffled free order
+	for (u64 i = 0; i < live_count; i += 1) order[i] = i;
+	for (u64 i = live_count-1; i > 0; i -= 1) {
+		u64 j = (get_random() >> 16) % (i+1);
+		swap(order[i], order[j], u64);
+	}
+
+	///
+	// Burst: lots of small allocations, then free them all in random order
+	f64 start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < live_count; i += 1) {
+		ptrs[i] = alloc_uninitialized(heap, 16 + (get_random() >> 16) % 497);
+	}
+	f64 alloc_seconds = os_get_elapsed_seconds()-start;
+
+	start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < live_count; i += 1) {
+		dealloc(heap, ptrs[order[i]]);
+	}
+	f64 free_seconds = os_get_elapsed_seconds()-start;
+
+	print("\n\tBurst  %llu x 16-512b:  alloc %.1f ns/op, free %.1f ns/op\n", live_count, (alloc_seconds*1e9)/(f64)live_count, (free_seconds*1e9)/(f64)live_count);
+
+	///
+	// Churn: keep a lot of mixed size allocations alive and randomly replace them.
+	// This is where fragmentation & free list lengths start to matter.
+	for (u64 i = 0; i < live_count; i += 1) {
+		ptrs[i] = alloc_uninitialized(heap, 16 + (get_random() >> 16) % 4081);
+	}
+	start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < churn_count; i += 1) {
+		u64 index = (get_random() >> 16) % live_count;
+		dealloc(heap, ptrs[index]);
+		u64 size = 16 + (get_random() >> 16) % 4081;
+		// Every now and then something big
+		if (i % 1000 == 0) size = KB(64) + (get_random() >> 16) % KB(256);
+		ptrs[index] = alloc_uninitialized(heap, size);
+	}
+	f64 churn_seconds = os_get_elapsed_seconds()-start;
+
+	Heap_Stats stats = heap_get_stats();
+	f64 external_fragmentation = stats.free_bytes ? 1.0-(f64)stats.largest_free_chunk/(f64)stats.free_bytes : 0;
+
+	print("\tChurn  %llu live, %llu free+alloc pairs: %.1f ns/pair\n", live_count, churn_count, (churn_seconds*1e9)/(f64)churn_count);
+	print("\tFragmentation: %llu kb in use, %llu kb reserved, %llu free chunks, largest free chunk %llu kb (%.1f%% external fragmentation)\n",
+		stats.allocated_bytes/1024, stats.reserved_bytes/1024, stats.free_chunk_count, stats.largest_free_chunk/1024, external_fragmentation*100.0);
+
+	for (u64 i = 0; i < live_count; i += 1) {
+		dealloc(heap, ptrs[i]);
+	}
+
+	dealloc(heap, ptrs);
+	dealloc(heap, order);
+
+	seed_for_random = seed_before;
+}
+
+#define ALLOCATOR_STRESS_OPS_PER_THREAD 100000
+#define ALLOCATOR_STRESS_SHARED_SLOTS 1024
+typedef struct Allocator_Stress_Data {
+	volatile u64 *shared_slots;
+	u64 seed;
+} Allocator_Stress_Data;
+
+void allocator_stress_thread_proc(Thread *t) {
+	Allocator_Stress_Data *data = (Allocator_Stress_Data*)t->data;
+	Allocator heap = get_heap_allocator();
+
+	test_allocator_threaded(t);
+
+	seed_for_random = data->seed;
+
+	void *local[64] = {0};
+	for (u64 i = 0; i < ALLOCATOR_STRESS_OPS_PER_THREAD; i += 1) {
+		u64 size = 8 + (get_random() >> 16) % 1017;
+		void *p = alloc_uninitialized(heap, size);
+		*(u64*)p = i;
+
+		if (i % 2 == 0) {
+			// Keep it for a while and free it ourselves
+			u64 index = (get_random() >> 16) % 64;
+			if (local[index]) dealloc(heap, local[index]);
+			local[index] = p;
+		} else {
+			// Hand it over, whatever was in the slot was probably allocated by another thread
+			volatile u64 *slot = &data->shared_slots[(get_random() >> 16) % ALLOCATOR_STRESS_SHARED_SLOTS];
+			u64 old;
+			do {
+				old = *slot;
+			} while (!compare_and_swap_64(slot, (u64)p, old));
+			if (old) dealloc(heap, (void*)old);
+		}
+	}
+	for (u64 i = 0; i < 64; i += 1) {
+		if (local[i]) dealloc(heap, local[i]);
+	}
+}
+
+void test_allocator_threaded_performance() {
+	Allocator heap = get_heap_allocator();
+
+	u64 processor_count = os_get_number_of_logical_processors();
+	// At least 2 threads so we always exercise cross-thread frees
+	u64 max_thread_count = max(processor_count, 2);
+
+	volatile u64 *shared_slots = (volatile u64*)alloc(heap, ALLOCATOR_STRESS_SHARED_SLOTS*sizeof(u64));
+	Thread *threads = (Thread*)alloc(heap, max_thread_count*sizeof(Thread));
+	Allocator_Stress_Data *datas = (Allocator_Stress_Data*)alloc(heap, max_thread_count*sizeof(Allocator_Stress_Data));
+
+	print("\n");
+	for (u64 thread_count = 1; thread_count <= max_thread_count; thread_count += 1) {
+		f64 start = os_get_elapsed_seconds();
+
+		for (u64 i = 0; i < thread_count; i += 1) {
+			datas[i].shared_slots = shared_slots;
+			datas[i].seed = 1337 + i;
+			os_thread_init(&threads[i], allocator_stress_thread_proc);
+			threads[i].data = &datas[i];
+			os_thread_start(&threads[i]);
+		}
+		for (u64 i = 0; i < thread_count; i += 1) {
+			os_thread_join(&threads[i]);
+			os_thread_destroy(&threads[i]);
+		}
+
+		f64 seconds = os_get_elapsed_seconds()-start;
+		// alloc + free per iteration
+		f64 ops = (f64)(thread_count*ALLOCATOR_STRESS_OPS_PER_THREAD*2);
+		print("\t%llu thread(s): %.2f million ops/sec\n", thread_count, (ops/seconds)/1000000.0);
+
+		// Free whatever is left in the shared slots. These were allocated by threads that have exited.
+		for (u64 i = 0; i < ALLOCATOR_STRESS_SHARED_SLOTS; i += 1) {
+			if (shared_slots[i]) dealloc(heap, (void*)shared_slots[i]);
+			shared_slots[i] = 0;
+		}
+	}
+
+	dealloc(heap, (void*)shared_slots);
+	dealloc(heap, threads);
+	dealloc(heap, datas);
+}
+
+void test_heap_realloc() {
+	Allocator heap = get_heap_allocator();
+	Heap_Stats before = heap_get_stats();
+
+	// Shrinking never moves, and growing back into the tail we just gave back can't move either
+	u8 *a = (u8*)alloc(heap, KB(128));
+	for (u64 i = 0; i < KB(128); i += 1) a[i] = (u8)(i*7);
+	u8 *b = (u8*)reallocate(heap, a, KB(128), KB(32));
+	assert(a == b, "Shrinking realloc moved the allocation");
+	b = (u8*)reallocate(heap, b, KB(32), KB(128));
+	assert(a == b, "Growing realloc into a free neighbour moved the allocation");
+	for (u64 i = 0; i < KB(32); i += 1) assert(b[i] == (u8)(i*7), "Realloc lost data");
+#if DO_ZERO_INITIALIZATION
+	for (u64 i = KB(32); i < KB(128); i += 1) assert(b[i] == 0, "Grown memory was not zeroed");
+#endif
+
+	// Something right after us means we have to move
+	u8 *c = (u8*)alloc(heap, KB(64));
+	for (u64 i = 0; i < KB(64); i += 1) c[i] = (u8)(i*3);
+	u8 *blocker = (u8*)alloc(heap, KB(64));
+	u8 *d = (u8*)reallocate(heap, c, KB(64), KB(512));
+	for (u64 i = 0; i < KB(64); i += 1) assert(d[i] == (u8)(i*3), "Realloc lost data");
+
+	// Small ones from the thread cache
+	u8 *s = (u8*)alloc(heap, 24);
+	for (u64 i = 0; i < 24; i += 1) s[i] = (u8)i;
+	s = (u8*)reallocate(heap, s, 24, 16);
+	s = (u8*)reallocate(heap, s, 16, 3000);
+	for (u64 i = 0; i < 16; i += 1) assert(s[i] == (u8)i, "Realloc lost data");
+
+	Heap_Stats after = heap_get_stats();
+	assert(after.realloc_count - before.realloc_count == 5, "Heap realloc count is wrong");
+	assert(after.realloc_in_place_count - before.realloc_in_place_count >= 3, "Heap realloc in place count is wrong");
+
+	dealloc(heap, b);
+	dealloc(heap, d);
+	dealloc(heap, blocker);
+	dealloc(heap, s);
+
+	// Allocators that can't reallocate still work through reallocate()
+	u8 *t = (u8*)alloc(get_temporary_allocator(), 100);
+	for (u64 i = 0; i < 100; i += 1) t[i] = (u8)i;
+	t = (u8*)reallocate(get_temporary_allocator(), t, 100, 1000);
+	for (u64 i = 0; i < 100; i += 1) assert(t[i] == (u8)i, "Temporary allocator reallocate lost data");
+
+	// Arena grows in place when it's the last thing pushed
+	Arena arena = make_arena(MB(16));
+	Allocator arena_allocator = make_arena_allocator_from_arena(&arena);
+	u8 *r = (u8*)alloc(arena_allocator, 100);
+	for (u64 i = 0; i < 100; i += 1) r[i] = (u8)i;
+	u8 *r2 = (u8*)reallocate(arena_allocator, r, 100, KB(64));
+	assert(r == r2, "Arena realloc of the last allocation moved it");
+	for (u64 i = 0; i < 100; i += 1) assert(r2[i] == (u8)i, "Arena realloc lost data");
+	arena_destroy(&arena);
+
+	// Heap was exactly as it was before
+	Heap_Stats end = heap_get_stats();
+	assert(end.allocated_bytes == before.allocated_bytes, "Heap realloc leaked bytes");
+	assert(end.allocation_count == before.allocation_count, "Heap realloc leaked allocations");
+}
+
+void test_heap_large_allocations() {
+	Allocator heap = get_heap_allocator();
+	Heap_Stats before = heap_get_stats();
+
+	// Way past what fits in a heap block. Uninitialized so we don't touch 600mb of pages.
+	u8 *huge = (u8*)alloc_uninitialized(heap, MB(600));
+	huge[0] = 1;
+	huge[MB(600)-1] = 2;
+	assert(is_pointer_valid(huge+MB(300)), "Large allocation is not a valid pointer");
+
+	Heap_Stats stats = heap_get_stats();
+	assert(stats.large_allocation_count == before.large_allocation_count+1, "Large allocation is not in heap stats");
+	assert(stats.large_committed_bytes >= before.large_committed_bytes+MB(600), "Large allocation is not in heap stats");
+	assert(stats.allocated_bytes == before.allocated_bytes, "Large allocation went in a heap block");
+	assert(stats.block_count == before.block_count, "Large allocation made a heap block");
+
+	dealloc(heap, huge);
+	stats = heap_get_stats();
+	assert(stats.large_allocation_count == before.large_allocation_count, "Large allocation was not released");
+	assert(stats.large_committed_bytes == before.large_committed_bytes, "Large allocation was not released");
+	assert(stats.large_reserved_bytes == before.large_reserved_bytes, "Large allocation was not released");
+
+	// Big buffers coming and going between small allocations don't leave holes in the heap
+	void *smalls[16];
+	void *bigs[16];
+	for (u64 i = 0; i < 16; i += 1) {
+		smalls[i] = alloc(heap, 64 + i*100);
+		bigs[i] = alloc_uninitialized(heap, HEAP_LARGE_ALLOCATION_SIZE*2 + i*KB(300));
+	}
+	for (u64 i = 0; i < 16; i += 1) dealloc(heap, bigs[i]);
+	stats = heap_get_stats();
+	assert(stats.allocated_bytes - before.allocated_bytes < KB(64), "Large allocations went in heap blocks");
+	for (u64 i = 0; i < 16; i += 1) dealloc(heap, smalls[i]);
+
+	// Realloc grows in the reserved address space, moves if it has to, and goes back to the heap when small
+	const u64 large = HEAP_LARGE_ALLOCATION_SIZE;
+	u8 *p = (u8*)alloc(heap, large*2);
+	for (u64 i = 0; i < large*2; i += 4096) p[i] = (u8)(i/4096);
+	u8 *q = (u8*)reallocate(heap, p, large*2, large*6);
+	assert(p == q, "Large realloc did not grow in place");
+	q[large*6-1] = 3;
+	q = (u8*)reallocate(heap, q, large*6, large*20);
+	for (u64 i = 0; i < large*2; i += 4096) assert(q[i] == (u8)(i/4096), "Large realloc lost data");
+	assert(q[large*6-1] == 3, "Large realloc lost data");
+	q = (u8*)reallocate(heap, q, large*20, 256);
+	assert(is_pointer_in_program_memory(q), "Shrunk large allocation did not go back to the heap");
+	assert(q[0] == 0 && q[255] == 0, "Large realloc lost data");
+	dealloc(heap, q);
+
+	// Strings in large allocations still format as strings
+	string s;
+	s.count = 5;
+	s.data = (u8*)alloc(heap, HEAP_LARGE_ALLOCATION_SIZE*4);
+	memcpy(s.data, "hello", 5);
+	string formatted = tprint("%s", s);
+	assert(strings_match(formatted, STR("hello")), "Formatting a string in a large allocation failed");
+	dealloc(heap, s.data);
+
+	stats = heap_get_stats();
+	assert(stats.large_allocation_count == before.large_allocation_count, "Large allocations leaked");
+	assert(stats.allocated_bytes == before.allocated_bytes, "Heap leaked");
+}
+
+void test_heap_freed_pages() {
+	Allocator heap = get_heap_allocator();
+	bool guard_before = heap_guard_freed_pages;
+	heap_set_guard_freed_pages(false);
+
+	u64 size = HEAP_DECOMMIT_MIN_SIZE*2;
+	if (size >= HEAP_LARGE_ALLOCATION_SIZE) size = HEAP_LARGE_ALLOCATION_SIZE-KB(64);
+	u8 *big = (u8*)alloc_uninitialized(heap, size);
+	memset(big, 0xAB, size);
+	dealloc(heap, big);
+
+	// Nothing happens until the free chunks have sat there for a while
+	Heap_Stats before = heap_get_stats();
+	for (u64 i = 0; i < HEAP_DECOMMIT_DELAY_PASSES-1; i += 1) {
+		heap_decommit_free_pages(GB(256));
+	}
+	Heap_Stats stats = heap_get_stats();
+	assert(stats.page_decommit_calls == before.page_decommit_calls, "Decommitted before the delay was up");
+
+	u64 decommitted = heap_decommit_free_pages(GB(256));
+	stats = heap_get_stats();
+	assert(decommitted >= size - os.page_size*2, "Big free chunk was not decommitted");
+	assert(stats.decommitted_bytes == before.decommitted_bytes+decommitted, "Bad decommitted_bytes");
+
+	// Only once while nothing changes
+	assert(heap_decommit_free_pages(GB(256)) == 0, "Decommitted the same chunks twice");
+
+	// Taking the memory again gives working pages
+	big = (u8*)alloc_uninitialized(heap, size);
+	for (u64 i = 0; i < size; i += os.page_size) big[i] = (u8)i;
+	for (u64 i = 0; i < size; i += os.page_size) assert(big[i] == (u8)i, "Recommitted page doesn't hold data");
+	u8 *zeroed = (u8*)alloc(heap, size);
+	for (u64 i = 0; i < size; i += 1) assert(zeroed[i] == 0, "Allocation from decommitted pages isn't zeroed");
+	stats = heap_get_stats();
+	assert(stats.page_protect_calls == before.page_protect_calls, "Page protection changed without guarding");
+	dealloc(heap, big);
+	dealloc(heap, zeroed);
+
+	// Guarding locks on free & unlocks on alloc
+	heap_set_guard_freed_pages(true);
+	assert(heap_decommit_free_pages(GB(256)) == 0, "Decommitted while guarding");
+	before = heap_get_stats();
+	u8 *guarded = (u8*)alloc(heap, KB(64));
+	guarded[KB(64)-1] = 1;
+	dealloc(heap, guarded);
+	stats = heap_get_stats();
+	assert(stats.page_protect_calls > before.page_protect_calls, "Guarding didn't protect anything");
+	heap_set_guard_freed_pages(false);
+
+	// And everything free is usable again after turning it off
+	u8 *after = (u8*)alloc_uninitialized(heap, size);
+	memset(after, 1, size);
+	dealloc(heap, after);
+
+	heap_set_guard_freed_pages(guard_before);
+}
+
+void test_heap_freed_pages_performance() {
+	u64 seed_before = seed_for_random;
+	bool guard_before = heap_guard_freed_pages;
+
+	Allocator heap = get_heap_allocator();
+	const u64 pair_count = 10000;
+	const u64 live_count = 64;
+	const u64 pairs_per_frame = 100;
+
+	// Sizes past the thread caches so everything goes through the heap, some big enough to decommit
+	u64 *sizes = (u64*)alloc(heap, pair_count*sizeof(u64));
+	u64 *slots = (u64*)alloc(heap, pair_count*sizeof(u64));
+	seed_for_random = 69;
+	for (u64 i = 0; i < pair_count; i += 1) {
+		sizes[i] = KB(8) + (get_random() >> 16) % KB(120);
+		if (i % 50 == 0) sizes[i] = HEAP_DECOMMIT_MIN_SIZE + KB(64);
+		if (sizes[i] >= HEAP_LARGE_ALLOCATION_SIZE) sizes[i] = HEAP_LARGE_ALLOCATION_SIZE/2;
+		slots[i] = (get_random() >> 16) % live_count;
+	}
+
+	print("\n\t%llu alloc/free pairs, %llu live, a decommit pass every %llu pairs:\n", pair_count, live_count, pairs_per_frame);
+	for (u64 guard = 0; guard <= 1; guard += 1) {
+		heap_set_guard_freed_pages(guard);
+		void *live[64];
+		for (u64 i = 0; i < live_count; i += 1) live[i] = alloc_uninitialized(heap, KB(8));
+
+		Heap_Stats before = heap_get_stats();
+		f64 start = os_get_elapsed_seconds();
+		for (u64 i = 0; i < pair_count; i += 1) {
+			u64 j = slots[i];
+			dealloc(heap, live[j]);
+			live[j] = alloc_uninitialized(heap, sizes[i]);
+			*(u8*)live[j] = (u8)i;
+			if (i % pairs_per_frame == pairs_per_frame-1) heap_decommit_free_pages(HEAP_DECOMMIT_BUDGET);
+		}
+		f64 seconds = os_get_elapsed_seconds()-start;
+		Heap_Stats stats = heap_get_stats();
+
+		for (u64 i = 0; i < live_count; i += 1) dealloc(heap, live[i]);
+
+		u64 protect  = stats.page_protect_calls-before.page_protect_calls;
+		u64 commit   = stats.page_commit_calls-before.page_commit_calls;
+		u64 decommit = stats.page_decommit_calls-before.page_decommit_calls;
+		print("\t%s %6llu protect, %4llu commit, %4llu decommit calls (%llu per 10k pairs), %.2f ms\n",
+			guard ? "guard pages:   " : "lazy decommit: ",
+			protect, commit, decommit, ((protect+commit+decommit)*10000)/pair_count, seconds*1000.0);
+	}
+
+	heap_set_guard_freed_pages(guard_before);
+	dealloc(heap, sizes);
+	dealloc(heap, slots);
+	seed_for_random = seed_before;
+}
+
+void test_memory_tracking() {
+	// Compiled out this should all still compile and just do nothing
+	Allocator audio = get_tagged_heap_allocator(MEMORY_TAG_AUDIO);
+#if ENABLE_MEMORY_TRACKING
+	Memory_Tag_Stats audio_before = get_memory_tag_stats(MEMORY_TAG_AUDIO);
+	Memory_Tag_Stats world_before = get_memory_tag_stats(MEMORY_TAG_WORLD);
+#endif
+
+	u8 *a = (u8*)alloc(audio, 1000);
+	u8 *w = 0;
+	memory_tag_scope(MEMORY_TAG_WORLD) {
+		w = (u8*)alloc(get_heap_allocator(), 3000);
+	}
+	assert(a && w, "Tagged allocation failed");
+
+#if ENABLE_MEMORY_TRACKING
+	Memory_Tag_Stats audio_stats = get_memory_tag_stats(MEMORY_TAG_AUDIO);
+	Memory_Tag_Stats world_stats = get_memory_tag_stats(MEMORY_TAG_WORLD);
+	assert(audio_stats.live_bytes == audio_before.live_bytes+1000, "Tagged allocation was not tracked");
+	assert(audio_stats.alloc_count == audio_before.alloc_count+1, "Tagged allocation was not tracked");
+	assert(world_stats.live_bytes == world_before.live_bytes+3000, "memory_tag_scope allocation was not tracked");
+	assert(memory_tag_current == MEMORY_TAG_UNTAGGED, "memory_tag_scope did not restore the tag");
+
+	// Realloc keeps the tag no matter which heap allocator it goes through
+	a = (u8*)reallocate(get_heap_allocator(), a, 1000, KB(100));
+	audio_stats = get_memory_tag_stats(MEMORY_TAG_AUDIO);
+	assert(audio_stats.live_bytes == audio_before.live_bytes+KB(100), "Realloc lost the tag");
+	assert(audio_stats.peak_bytes >= audio_stats.live_bytes, "Bad peak");
+
+	// Call sites
+	memory_tracking_capture_call_sites = true;
+	u8 *c = (u8*)alloc(audio, 64);
+	memory_tracking_capture_call_sites = false;
+	Heap_Allocation_Metadata *chunk = (Heap_Allocation_Metadata*)(c-sizeof(Heap_Allocation_Metadata));
+	assert(chunk->track.frame_count > 0, "No call site captured");
+	string *names = os_get_stack_frame_names(chunk->track.frames, chunk->track.frame_count, get_temporary_allocator());
+	assert(names[0].count > 0, "No call site name");
+	dealloc(get_heap_allocator(), c);
+
+	memory_tracking_update();
+#else
+	Memory_Tag_Stats audio_stats = get_memory_tag_stats(MEMORY_TAG_AUDIO);
+	assert(audio_stats.live_bytes == 0 && audio_stats.alloc_count == 0, "Memory tracking is compiled out but has stats");
+	assert(audio.proc == get_heap_allocator().proc && audio.data == 0, "Tagged allocator is not just the heap allocator");
+#endif
+
+	dealloc(get_heap_allocator(), a);
+	dealloc(audio, w);
+
+#if ENABLE_MEMORY_TRACKING
+	audio_stats = get_memory_tag_stats(MEMORY_TAG_AUDIO);
+	world_stats = get_memory_tag_stats(MEMORY_TAG_WORLD);
+	assert(audio_stats.live_bytes == audio_before.live_bytes && audio_stats.live_count == audio_before.live_count, "Tagged free was not tracked");
+	assert(world_stats.live_bytes == world_before.live_bytes && world_stats.live_count == world_before.live_count, "Tagged free was not tracked");
+#endif
+}
+
+// The old growing array/string builder path: always alloc a new one, copy, free the old one
+void *realloc_by_copy(Allocator allocator, void *p, u64 old_size, u64 new_size) {
+	void *new = alloc_uninitialized(allocator, new_size);
+	if (p) {
+		memcpy(new, p, min(old_size, new_size));
+		dealloc(allocator, p);
+	}
+	return new;
+}
+
+void test_heap_realloc_performance() {
+	Allocator heap = get_heap_allocator();
+	const u64 element_count = 1000000;
+	const u64 array_count = 4;
+
+	for (u64 copy_path = 0; copy_path <= 1; copy_path += 1) {
+		// One array on its own, then a few growing at the same time so they get in each others way
+		for (u64 interleaved = 0; interleaved <= 1; interleaved += 1) {
+			u64 n = interleaved ? array_count : 1;
+			u64 *arrays[array_count];
+			u64 capacities[array_count];
+			for (u64 j = 0; j < n; j += 1) {
+				arrays[j] = 0;
+				capacities[j] = 0;
+			}
+
+			Heap_Stats before = heap_get_stats();
+			u64 grow_count = 0;
+			f64 start = os_get_elapsed_seconds();
+			for (u64 i = 0; i < element_count; i += 1) {
+				for (u64 j = 0; j < n; j += 1) {
+					if (i >= capacities[j]) {
+						u64 new_capacity = max(capacities[j]*2, 16);
+						if (copy_path) {
+							arrays[j] = (u64*)realloc_by_copy(heap, arrays[j], capacities[j]*sizeof(u64), new_capacity*sizeof(u64));
+						} else {
+							arrays[j] = (u64*)reallocate(heap, arrays[j], capacities[j]*sizeof(u64), new_capacity*sizeof(u64));
+						}
+						capacities[j] = new_capacity;
+						grow_count += 1;
+					}
+					arrays[j][i] = i;
+				}
+			}
+			f64 seconds = os_get_elapsed_seconds()-start;
+			Heap_Stats after = heap_get_stats();
+
+			for (u64 j = 0; j < n; j += 1) {
+				assert(arrays[j][element_count-1] == element_count-1 && arrays[j][element_count/2] == element_count/2, "Grown array is wrong");
+				dealloc(heap, arrays[j]);
+			}
+
+			u64 realloc_count = after.realloc_count-before.realloc_count;
+			u64 in_place_count = after.realloc_in_place_count-before.realloc_in_place_count;
+			print("\n\t%s, %llu array(s) to %llu elements: %.2f ms, %llu grows",
+				copy_path ? "alloc+copy+free" : "realloc        ", n, element_count, seconds*1000.0, grow_count);
+			if (!copy_path) {
+				print(", %llu%% in place, %llu kb copied", realloc_count ? (in_place_count*100)/realloc_count : 0,
+					(after.realloc_copied_bytes-before.realloc_copied_bytes)/1024);
+			}
+		}
+	}
+
+	// And through the growing array itself
+	u64 *things = 0;
+	growing_array_init_reserve((void**)&things, sizeof(u64), 1, heap);
+	f64 start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < element_count; i += 1) {
+		growing_array_add((void**)&things, &i);
+	}
+	f64 seconds = os_get_elapsed_seconds()-start;
+	assert(things[element_count-1] == element_count-1, "Growing array is wrong");
+	growing_array_deinit((void**)&things);
+	print("\n\tgrowing_array_add x %llu: %.2f ms\n", element_count, seconds*1000.0);
+}
+
+void test_arena() {
+	Arena arena = make_arena(GB(1));
+	assert(arena.committed == 0, "Arena should not commit anything up front");
+
+	// Alignment
+	u8 *a = arena_push_aligned(&arena, 3, 1);
+	u8 *b = arena_push_aligned(&arena, 16, 64);
+	u64 *c = arena_push_struct(&arena, u64);
+	assert((u64)b % 64 == 0, "Arena push not aligned to 64");
+	assert((u64)c % 8 == 0, "arena_push_struct not aligned");
+	assert(b >= a+3, "Arena pushes overlap");
+	memset(a, 1, 3);
+	memset(b, 2, 16);
+	*c = 0xDEADBEEF;
+
+	// Marks
+	Arena_Mark mark = arena_mark(&arena);
+	u64 used_at_mark = arena_used(&arena);
+	for (int i = 0; i < 1000; i++) {
+		u32 *nums = arena_push_array(&arena, u32, 100);
+		nums[99] = i;
+	}
+	assert(arena.committed >= arena_used(&arena), "Arena used memory that isn't committed");
+	{
+		Arena_Mark inner = arena_mark(&arena);
+		arena_push(&arena, KB(100));
+		arena_pop_to_mark(&arena, inner);
+		assert(arena_mark(&arena).used == inner.used, "Inner mark not restored");
+	}
+	arena_pop_to_mark(&arena, mark);
+	assert(arena_used(&arena) == used_at_mark, "Arena mark not restored");
+	assert(*c == 0xDEADBEEF && b[15] == 2 && a[2] == 1, "Arena pop to mark corrupted earlier pushes");
+	assert(arena.peak >= used_at_mark + 1000*400, "Arena peak is wrong");
+
+	// Commit on demand, decommit on reset
+	arena.decommit_on_reset = true;
+	u8 *big = arena_push(&arena, MB(8));
+	memset(big, 0xAB, MB(8));
+	assert(arena.committed >= MB(8) && arena.committed <= MB(8) + ARENA_COMMIT_SIZE*2, "Arena committed too much or too little");
+	arena_reset(&arena);
+	assert(arena_used(&arena) == 0, "Arena not reset");
+	assert(arena.committed <= ARENA_COMMIT_SIZE, "Arena didn't decommit on reset");
+	// Decommitted pages come back zeroed
+	big = arena_push(&arena, MB(8));
+	assert(big[MB(4)] == 0, "Recommitted page was not zero");
+
+	// Overflow
+	assert(arena_try_push_aligned(&arena, GB(2), 8) == 0, "Arena overflow not detected");
+	assert(arena_try_push_aligned(&arena, 0xFFFFFFFFFFFFFFF0ull, 8) == 0, "Arena overflow with wrapping size not detected");
+
+	arena_destroy(&arena);
+
+	// Fixed memory
+	u8 buffer[256];
+	Arena fixed = make_arena_with_memory(sizeof(buffer), buffer);
+	assert(arena_try_push_aligned(&fixed, 200, 1) == buffer, "Fixed arena push wrong");
+	assert(arena_try_push_aligned(&fixed, 100, 1) == 0, "Fixed arena overflow not detected");
+
+	// Allocator interface
+	Allocator allocator = make_arena_allocator(MB(64));
+	Arena *arena_of_allocator = (Arena*)allocator.data;
+	int *ints = alloc(allocator, 10*sizeof(int));
+	for (int i = 0; i < 10; i++) ints[i] = i;
+	int *grown = allocator.proc(1000*sizeof(int), ints, ALLOCATOR_REALLOCATE, allocator.data);
+	assert(grown == ints, "Reallocating the last push should grow in place");
+	alloc(allocator, 8);
+	int *moved = allocator.proc(2000*sizeof(int), grown, ALLOCATOR_REALLOCATE, allocator.data);
+	assert(moved != grown, "Should not grow in place when something was pushed after");
+	for (int i = 0; i < 10; i++) assert(moved[i] == i, "Reallocate lost data");
+	dealloc(allocator, moved);
+	assert(arena_of_allocator->peak > 3000*sizeof(int), "Arena allocator peak is wrong");
+	arena_allocator_destroy(allocator);
+}
+
+void temporary_storage_small_thread_proc(Thread *t) {
+	// Way more than the thread's KB(10), used to silently run past the end of it
+	u8 *first = talloc(KB(8));
+	memset(first, 0xAA, KB(8));
+	for (int i = 0; i < 100; i++) {
+		u8 *p = talloc(KB(1));
+		memset(p, i, KB(1));
+	}
+	assert(first[0] == 0xAA && first[KB(8)-1] == 0xAA, "Thread temporary storage was overwritten when it ran out");
+	Temporary_Storage_Stats stats = get_temporary_storage_stats();
+	assert(stats.grow_count > 0 && stats.used >= KB(108), "Thread temporary storage stats are wrong");
+}
+
+// On its own thread so the main thread's temporary storage doesn't stay grown after the test
+void temporary_storage_test_thread_proc(Thread *t) {
+	reset_temporary_storage();
+	Temporary_Storage_Stats before = get_temporary_storage_stats();
+	assert(before.used == 0 && before.block_count == 1 && before.capacity == KB(64), "Temporary storage not initialized");
+
+	// Allocating more than we have moves on to a new block instead of wrapping
+	u64 *first = talloc(sizeof(u64));
+	*first = 0x1234;
+	u64 chunk_size = KB(16);
+	u64 chunk_count = 20;
+	for (u64 i = 0; i < chunk_count; i++) {
+		u8 *p = talloc(chunk_size);
+		memset(p, (u8)i, chunk_size);
+	}
+	assert(*first == 0x1234, "Temporary storage wrapped and overwrote memory still in use");
+	Temporary_Storage_Stats grown = get_temporary_storage_stats();
+	assert(grown.block_count > 1, "Temporary storage should have grown a block");
+	assert(grown.used == chunk_count*chunk_size + 8, "Temporary storage used is wrong");
+	assert(grown.frame_peak == grown.used, "Frame peak is wrong");
+
+	// Reset merges into one block big enough for last frame
+	reset_temporary_storage();
+	Temporary_Storage_Stats merged = get_temporary_storage_stats();
+	assert(merged.block_count == 1, "Temporary storage blocks were not merged");
+	assert(merged.capacity >= grown.used, "Merged block too small");
+	assert(merged.last_frame_peak == grown.frame_peak && merged.frame_peak == 0, "Frame peak not rolled over");
+	talloc(grown.used);
+	assert(get_temporary_storage_stats().grow_count == merged.grow_count, "Merged block should fit a frame like the last one");
+
+	// Nested scopes
+	reset_temporary_storage();
+	u8 *outer = talloc(16);
+	temp_scope() {
+		u8 *a = talloc(100);
+		u64 used_in_outer_scope = get_temporary_storage_stats().used;
+		temp_scope() {
+			talloc(merged.capacity); // Needs a new block
+			talloc(16);
+		}
+		assert(get_temporary_storage_stats().used == used_in_outer_scope, "Inner temp scope not restored");
+		u8 *b = talloc(100);
+		assert(b == a + 104, "Allocation after inner scope should continue where it left off");
+	}
+	u8 *after = talloc(16);
+	assert(after == outer + 16, "Outer temp scope not restored");
+	assert(get_temporary_storage_stats().frame_peak >= merged.capacity + 16, "Frame peak should include popped scopes");
+}
+
+void test_temporary_storage() {
+	Thread t;
+	os_thread_init(&t, temporary_storage_test_thread_proc);
+	t.temporary_storage_size = KB(64);
+	os_thread_start(&t);
+	os_thread_join(&t);
+	os_thread_destroy(&t);
+
+	// Default thread storage is tiny
+	os_thread_init(&t, temporary_storage_small_thread_proc);
+	os_thread_start(&t);
+	os_thread_join(&t);
+	os_thread_destroy(&t);
+
+	// Main thread still works like before
+	reset_temporary_storage();
+	void *a = talloc(72);
+	reset_temporary_storage();
+	assert(talloc(72) == a, "Temporary storage reset goof");
+}
+
+void test_arena_performance() {
+	u64 seed_before = seed_for_random;
+	seed_for_random = 69;
+
+	Allocator heap = get_heap_allocator();
+
+	// Something like a frame of scratch work: lots of small things, a few medium arrays
+	const u64 frame_count = 200;
+	const u64 allocations_per_frame = 2000;
+	u64 *sizes = (u64*)alloc(heap, allocations_per_frame*sizeof(u64));
+	void **ptrs = (void**)alloc(heap, allocations_per_frame*sizeof(void*));
+	for (u64 i = 0; i < allocations_per_frame; i += 1) {
+		sizes[i] = 16 + (get_random() >> 16) % 497;
+		if (i % 100 == 0) sizes[i] = KB(4) + (get_random() >> 16) % KB(60);
+	}
+
+	// Heap: alloc everything, free everything
+	f64 start = os_get_elapsed_seconds();
+	for (u64 f = 0; f < frame_count; f += 1) {
+		for (u64 i = 0; i < allocations_per_frame; i += 1) {
+			ptrs[i] = alloc_uninitialized(heap, sizes[i]);
+			*(u8*)ptrs[i] = (u8)i;
+		}
+		for (u64 i = 0; i < allocations_per_frame; i += 1) {
+			dealloc(heap, ptrs[i]);
+		}
+	}
+	f64 heap_seconds = os_get_elapsed_seconds()-start;
+
+	// Arena: push everything, pop to mark
+	Arena arena = make_arena(GB(1));
+	start = os_get_elapsed_seconds();
+	for (u64 f = 0; f < frame_count; f += 1) {
+		Arena_Mark mark = arena_mark(&arena);
+		for (u64 i = 0; i < allocations_per_frame; i += 1) {
+			ptrs[i] = arena_push(&arena, sizes[i]);
+			*(u8*)ptrs[i] = (u8)i;
+		}
+		arena_pop_to_mark(&arena, mark);
+	}
+	f64 arena_seconds = os_get_elapsed_seconds()-start;
+
+	// Same but giving the memory back every frame, the worst case for commit/decommit
+	arena.decommit_on_reset = true;
+	start = os_get_elapsed_seconds();
+	for (u64 f = 0; f < frame_count; f += 1) {
+		for (u64 i = 0; i < allocations_per_frame; i += 1) {
+			ptrs[i] = arena_push(&arena, sizes[i]);
+			*(u8*)ptrs[i] = (u8)i;
+		}
+		arena_reset(&arena);
+	}
+	f64 decommit_seconds = os_get_elapsed_seconds()-start;
+
+	u64 op_count = frame_count*allocations_per_frame;
+	print("\n\tPer frame scratch, %llu frames x %llu allocations (%llu kb peak):\n", frame_count, allocations_per_frame, arena.peak/1024);
+	print("\theap alloc+free:         %.1f ns/allocation\n", (heap_seconds*1e9)/(f64)op_count);
+	print("\tarena push+pop to mark:  %.1f ns/allocation\n", (arena_seconds*1e9)/(f64)op_count);
+	print("\tarena push+decommit:     %.1f ns/allocation\n", (decommit_seconds*1e9)/(f64)op_count);
+
+	arena_destroy(&arena);
+	dealloc(heap, sizes);
+	dealloc(heap, ptrs);
+
+	seed_for_random = seed_before;
+}
+
+typedef struct Pool_Test_Thing {
+	u64 id;
+	bool allocated; // Only for the scanning version in test_pool_performance
+	u8 payload[48];
+} Pool_Test_Thing;
+
+void test_pool() {
+	Allocator heap = get_heap_allocator();
+	Pool pool = make_typed_pool(Pool_Test_Thing, 8, heap);
+	assert(pool.chunk_count == 0, "Pool should not allocate up front");
+
+	// Enough to need a few chunks
+	const u64 count = 100;
+	Pool_Test_Thing *things[100];
+	Pool_Handle handles[100];
+	for (u64 i = 0; i < count; i += 1) {
+		things[i] = (Pool_Test_Thing*)pool_alloc(&pool);
+		assert((u64)things[i] % _Alignof(Pool_Test_Thing) == 0, "Pool object is misaligned");
+		things[i]->id = i;
+		memset(things[i]->payload, (u8)i, sizeof(things[i]->payload));
+		handles[i] = pool_get_handle(&pool, things[i]);
+	}
+	assert(pool.count == count, "Bad pool count");
+	assert(pool.chunk_count == count/8 + 1, "Unexpected chunk count");
+	for (u64 i = 0; i < count; i += 1) {
+		assert(pool_get(&pool, handles[i]) == things[i], "Handle does not resolve to its object");
+		assert(things[i]->id == i && things[i]->payload[47] == (u8)i, "Pool objects overlap");
+	}
+
+	// Free every other one, handles go stale, pointers to the rest stay put
+	for (u64 i = 0; i < count; i += 2) {
+		pool_free(&pool, things[i]);
+	}
+	assert(pool.count == count/2, "Bad pool count after free");
+	for (u64 i = 0; i < count; i += 1) {
+		if (i % 2 == 0) {
+			assert(pool_get(&pool, handles[i]) == 0, "Stale handle still resolves");
+		} else {
+			assert(pool_get(&pool, handles[i]) == things[i] && things[i]->id == i, "Live object moved or got clobbered");
+		}
+	}
+	assert(!pool_free_handle(&pool, handles[0]), "Freed a stale handle");
+
+	// Dense iteration only sees live objects, each once
+	u64 seen = 0;
+	for (u64 i = 0; i < pool.count; i += 1) {
+		Pool_Test_Thing *t = (Pool_Test_Thing*)pool_get_live(&pool, i);
+		assert(t->id % 2 == 1, "Dense list has a freed object");
+		seen += t->id;
+	}
+	assert(seen == (count/2)*(count/2), "Dense iteration missed something");
+
+	// Freed slots get reused before we make new chunks, and old handles stay stale
+	u64 chunks_before = pool.chunk_count;
+	for (u64 i = 0; i < count; i += 2) {
+		things[i] = (Pool_Test_Thing*)pool_alloc(&pool);
+		things[i]->id = i;
+		assert(pool_get(&pool, handles[i]) == 0, "Handle to a reused slot resolves to the new object");
+		handles[i] = pool_get_handle(&pool, things[i]);
+	}
+	assert(pool.chunk_count == chunks_before, "Pool grew even though it had free slots");
+
+	// Freeing while iterating backwards
+	for (u64 i = pool.count; i-- > 0;) {
+		Pool_Test_Thing *t = (Pool_Test_Thing*)pool_get_live(&pool, i);
+		if (t->id % 3 == 0) pool_free(&pool, t);
+	}
+	for (u64 i = 0; i < count; i += 1) {
+		bool alive = pool_get(&pool, handles[i]) != 0;
+		assert(alive == (i % 3 != 0), "Freeing while iterating went wrong");
+	}
+
+	Pool_Handle zero = ZERO(Pool_Handle);
+	assert(pool_get(&pool, zero) == 0, "Zero handle should never be valid");
+
+	pool_clear(&pool);
+	assert(pool.count == 0, "pool_clear left live objects");
+	for (u64 i = 0; i < count; i += 1) {
+		assert(pool_get(&pool, handles[i]) == 0, "Handle survived pool_clear");
+	}
+
+	// Tiny objects still fit the free list
+	Pool bytes = make_pool(1, 1, 4, heap);
+	u8 *b0 = (u8*)pool_alloc(&bytes);
+	u8 *b1 = (u8*)pool_alloc(&bytes);
+	*b0 = 1; *b1 = 2;
+	pool_free(&bytes, b0);
+	assert(pool_alloc(&bytes) == b0 && *b1 == 2, "Small object pool is broken");
+	pool_destroy(&bytes);
+
+	pool_destroy(&pool);
+	assert(pool.chunks == 0 && pool.count == 0, "pool_destroy didn't reset the pool");
+}
+
+// What Audio_Player_Block did: blocks of things with an allocated flag, scan for a free one
+#define POOL_TEST_SLOTS_PER_BLOCK 128
+typedef struct Pool_Test_Block {
+	Pool_Test_Thing things[POOL_TEST_SLOTS_PER_BLOCK];
+	struct Pool_Test_Block *next;
+} Pool_Test_Block;
+
+Pool_Test_Thing *pool_test_scan_alloc(Pool_Test_Block *first) {
+	Pool_Test_Block *block = first;
+	Pool_Test_Block *last = 0;
+	while (block) {
+		for (u64 i = 0; i < POOL_TEST_SLOTS_PER_BLOCK; i += 1) {
+			if (!block->things[i].allocated) {
+				block->things[i].allocated = true;
+				return &block->things[i];
+			}
+		}
+		last = block;
+		block = block->next;
+	}
+	Pool_Test_Block *new_block = (Pool_Test_Block*)alloc(get_heap_allocator(), sizeof(Pool_Test_Block));
+	memset(new_block, 0, sizeof(*new_block));
+	last->next = new_block;
+	new_block->things[0].allocated = true;
+	return &new_block->things[0];
+}
+
+void test_pool_performance() {
+	u64 seed_before = seed_for_random;
+	seed_for_random = 69;
+
+	Allocator heap = get_heap_allocator();
+	const u64 live_counts[] = { 128, 1024, 8192 };
+	const u64 churn_count = 200000;
+
+	print("\n\tChurn: free a random live object & make a new one, %llu times\n", churn_count);
+	for (u64 l = 0; l < sizeof(live_counts)/sizeof(live_counts[0]); l += 1) {
+		u64 live_count = live_counts[l];
+		Pool_Test_Thing **live = (Pool_Test_Thing**)alloc(heap, live_count*sizeof(void*));
+		u64 *picks = (u64*)alloc(heap, churn_count*sizeof(u64));
+		for (u64 i = 0; i < churn_count; i += 1) picks[i] = (get_random() >> 16) % live_count;
+
+		// Scan for a free slot
+		Pool_Test_Block *blocks = (Pool_Test_Block*)alloc(heap, sizeof(Pool_Test_Block));
+		memset(blocks, 0, sizeof(*blocks));
+		for (u64 i = 0; i < live_count; i += 1) live[i] = pool_test_scan_alloc(blocks);
+		f64 start = os_get_elapsed_seconds();
+		for (u64 i = 0; i < churn_count; i += 1) {
+			u64 j = picks[i];
+			live[j]->allocated = false;
+			live[j] = pool_test_scan_alloc(blocks);
+			live[j]->id = i;
+		}
+		f64 scan_seconds = os_get_elapsed_seconds()-start;
+
+		// Iterate everything that's alive, at 25% occupancy
+		for (u64 i = 0; i < live_count; i += 1) {
+			if (i % 4) live[i]->allocated = false;
+		}
+		u64 scan_sum = 0;
+		start = os_get_elapsed_seconds();
+		for (u64 r = 0; r < 100; r += 1) {
+			for (Pool_Test_Block *block = blocks; block; block = block->next) {
+				for (u64 i = 0; i < POOL_TEST_SLOTS_PER_BLOCK; i += 1) {
+					if (block->things[i].allocated) scan_sum += block->things[i].id;
+				}
+			}
+		}
+		f64 scan_iterate_seconds = os_get_elapsed_seconds()-start;
+
+		while (blocks) {
+			Pool_Test_Block *next = blocks->next;
+			dealloc(heap, blocks);
+			blocks = next;
+		}
+
+		// Pool
+		Pool pool = make_typed_pool(Pool_Test_Thing, POOL_TEST_SLOTS_PER_BLOCK, heap);
+		for (u64 i = 0; i < live_count; i += 1) live[i] = (Pool_Test_Thing*)pool_alloc(&pool);
+		start = os_get_elapsed_seconds();
+		for (u64 i = 0; i < churn_count; i += 1) {
+			u64 j = picks[i];
+			pool_free(&pool, live[j]);
+			live[j] = (Pool_Test_Thing*)pool_alloc(&pool);
+			live[j]->id = i;
+		}
+		f64 pool_seconds = os_get_elapsed_seconds()-start;
+
+		for (u64 i = 0; i < live_count; i += 1) {
+			if (i % 4) pool_free(&pool, live[i]);
+		}
+		u64 pool_sum = 0;
+		start = os_get_elapsed_seconds();
+		for (u64 r = 0; r < 100; r += 1) {
+			for (u64 i = 0; i < pool.count; i += 1) {
+				pool_sum += ((Pool_Test_Thing*)pool_get_live(&pool, i))->id;
+			}
+		}
+		f64 pool_iterate_seconds = os_get_elapsed_seconds()-start;
+		assert(scan_sum == pool_sum, "Pool and scan disagree on what's alive");
+
+		pool_destroy(&pool);
+		dealloc(heap, live);
+		dealloc(heap, picks);
+
+		print("\t%5llu live: scan for free slot %7.1f ns, pool %5.1f ns per free+alloc. Iterate 25%% live: scan %7.1f us, pool %6.1f us\n",
+			live_count,
+			(scan_seconds*1e9)/(f64)churn_count, (pool_seconds*1e9)/(f64)churn_count,
+			(scan_iterate_seconds*1e6)/100.0, (pool_iterate_seconds*1e6)/100.0);
+	}
+
+	seed_for_random = seed_before;
+}
+
+void test_format_expect(const char *expected, const char *fmt, ...) {
+	char buffer[1024];
+	va_list args;
+	va_start(args, fmt);
+	format_string_to_buffer(buffer, sizeof(buffer), fmt, args);
+	va_end(args);
+	assert(strcmp(buffer, expected) == 0, "Format '%cs' gave '%cs', expected '%cs'", fmt, buffer, expected);
+}
+
+#if TARGET_OS == LINUX
+typedef double (*Test_Strtod_Proc)(const char *s, char **end);
+
+// Ours and the CRT's must agree exactly. Only on linux, msvcrt has its own ideas about %e and %a.
+void test_format_against_crt(const char *fmt, ...) {
+	char ours[1024];
+	char crt[1024];
+	va_list args;
+	va_start(args, fmt);
+	va_list args_copy;
+	va_copy(args_copy, args);
+	format_string_to_buffer(ours, sizeof(ours), fmt, args);
+	vsnprintf(crt, sizeof(crt), fmt, args_copy);
+	va_end(args_copy);
+	va_end(args);
+	assert(strcmp(ours, crt) == 0, "Format '%cs': we gave '%cs', crt gave '%cs'", fmt, ours, crt);
+}
+#endif
+
+float64 test_random_float64() {
+	// Random bits, so all exponents, subnormals and the odd inf/nan
+	u64 bits = get_random();
+	float64 x;
+	memcpy(&x, &bits, sizeof(x));
+	return x;
+}
+
+void test_string_format() {
+	u64 seed_before = seed_for_random;
+	seed_for_random = 69;
+
+	///
+	// Integers
+	test_format_expect("0 1 -1 2147483647 -2147483648", "%d %d %d %d %d", 0, 1, -1, 2147483647, (int)0x80000000);
+	test_format_expect("18446744073709551615 -9223372036854775808", "%llu %lld", 0xFFFFFFFFFFFFFFFFull, (s64)0x8000000000000000ull);
+	test_format_expect("[   42] [42   ] [00042] [+42] [ 42] [-0042]", "[%5d] [%-5d] [%05d] [%+d] [% d] [%05d]", 42, 42, 42, 42, 42, -42);
+	test_format_expect("[  007] []", "[%5.3d] [%.0d]", 7, 0);
+	test_format_expect("ff FF 0xff 0XFF 777 0777 0", "%x %X %#x %#X %o %#o %#x", 255, 255, 255, 255, 511, 511, 0);
+	test_format_expect("deadbeefcafebabe", "%llx", 0xdeadbeefcafebabeull);
+	test_format_expect("-1 255 -1 65535", "%hhd %hhu %hd %hu", 255, 255, 65535, 65535);
+	test_format_expect("[  12] [12  ]", "[%*d] [%*d]", 4, 12, -4, 12);
+	test_format_expect("123 4567", "%zu %llu", (size_t)123, (u64)4567);
+	test_format_expect("0x1234", "%p", (void*)0x1234);
+
+	///
+	// Floats
+	test_format_expect("3.141593 3.14 3 3. 0.000000 -0.000000", "%f %.2f %.0f %#.0f %f %f", 3.14159265, 3.14159265, 3.14159265, 3.0, 0.0, -0.0);
+	test_format_expect("0 2 2 4 0.1 0.2", "%.0f %.0f %.0f %.0f %.1f %.1f", 0.5, 1.5, 2.5, 3.5, 0.05, 0.25);
+	test_format_expect("0.1000000000000000055511151231257827", "%.34f", 0.1);
+	test_format_expect("1e+300 = 1000000000000000052504760255204420248704468581108159154915854115511802457988908195786371375080447864043704443832883878176942523235360430575644792184786706982848387200926575803737830233794788090059368953234970799945081119038967640880074652742780142494579258788820056842838115669472196386865459400540160.000000", "1e+300 = %f", 1e300);
+	test_format_expect("1.000000e+00 1.234568e+05 -1.5E-10 0.000000e+00", "%e %e %.1E %e", 1.0, 123456.789, -1.5e-10, 0.0);
+	test_format_expect("100000 1e+06 0.0001 1e-05 1.5 123457 1.00000", "%g %g %g %g %g %g %#g", 100000.0, 1000000.0, 0.0001, 0.00001, 1.5, 123456.789, 1.0);
+	{
+		u64 nan_bits = 0x7ff8000000000000ull;
+		float64 nan;
+		memcpy(&nan, &nan_bits, sizeof(nan));
+		test_format_expect("inf -inf nan -NAN INF", "%f %f %f %F %F", 1.0/0.0, -1.0/0.0, nan, -nan, 1.0/0.0);
+	}
+	test_format_expect("[    3.14] [3.14    ] [00003.14] [-0003.14] [+3.14]", "[%8.2f] [%-8.2f] [%08.2f] [%08.2f] [%+.2f]", 3.14159, 3.14159, 3.14159, -3.14159, 3.14159);
+	test_format_expect("0x1.8p+1 0x0.0000000000001p-1022 0x0p+0 0x1.000p+0 0x2p+0", "%a %a %a %.3a %.0a", 3.0, 4.9406564584124654e-324, 0.0, 1.0, 1.5);
+	test_format_expect("4.9406564584124654e-324", "%.17g", 4.9406564584124654e-324);
+	test_format_expect("1.7976931348623157e+308", "%.17g", 1.7976931348623157e308);
+
+	///
+	// Shortest round trip
+	test_format_expect("0.1 0.3 1 -2.5 100 1e+21 1.5e-07 0 -0 5e-324 1.7976931348623157e+308",
+		"%r %r %r %r %r %r %r %r %r %r %r", 0.1, 0.3, 1.0, -2.5, 100.0, 1e21, 1.5e-7, 0.0, -0.0, 4.9406564584124654e-324, 1.7976931348623157e308);
+	test_format_expect("0.30000000000000004 1.2345678901234568e+17 0.00001", "%r %r %r", 0.1+0.2, 123456789012345678.0, 0.00001);
+	{
+		char out[32];
+		u64 n = format_float32_shortest(out, 0.1f);
+		assert(n == 3 && memcmp(out, "0.1", 3) == 0, "Failed: format_float32_shortest");
+		n = format_float32_shortest(out, 16777216.0f);
+		assert(n == 8 && memcmp(out, "16777216", 8) == 0, "Failed: format_float32_shortest");
+	}
+
+	///
+	// Our own stuff
+	test_format_expect("true false [ true]", "%b %b [%5b]", 1, 0, 1);
+	test_format_expect("abc [  abc] [abc  ] [ab]", "%s [%5s] [%-5s] [%.2s]", STR("abc"), STR("abc"), STR("abc"), STR("abc"));
+	test_format_expect("xyz [x]", "%cs [%c]", "xyz", 'x');
+	test_format_expect("{ X: 1.000000, Y: 2.500000 } { X: 1.0, Y: 2.0, Z: 3.0 }", "%v2 %.1v3", v2(1, 2.5), v3(1, 2, 3));
+	test_format_expect("100% done, %y is not a thing", "100%% done, %y is not a thing");
+
+	// Truncation & measuring
+	{
+		char small[8];
+		u64 n = format_string_to_buffer_vararg(small, sizeof(small), "%d %s", 123456, STR("abcdef"));
+		assert(n == 7 && strcmp(small, "123456 ") == 0, "Failed: truncated format");
+		n = format_string_to_buffer_vararg(0, 0, "%d %s %.3f", 123456, STR("abcdef"), 1.0);
+		assert(n == 19, "Failed: measuring format");
+		string s = tprint("%.20f|%-30e|%r", 1.0/3.0, 2.0/3.0, 1.0/7.0);
+		assert(strings_match(s, STR("0.33333333333333331483|6.666667e-01                  |0.14285714285714285")), "Failed: sprint sized the buffer wrong");
+	}
+
+#if TARGET_OS == LINUX
+	///
+	// Everything against glibc, which is exact too
+	const char *float_formats[] = {
+		"%f", "%.0f", "%.1f", "%.2f", "%.3f", "%.10f", "%.20f", "%#.0f", "%12.4f", "%-12.4f|", "%+012.3f",
+		"%e", "%.0e", "%.3E", "%.16e", "%#.0e", "%+14.5e",
+		"%g", "%.0g", "%.1g", "%.3G", "%.10g", "%.17g", "%#g", "%#.3g", "%-10g|", "%010g",
+		"%a", "%.0a", "%.3A", "%.13a", "%#.0a",
+	};
+	for (u64 i = 0; i < 4000; i++) {
+		float64 x;
+		switch (i % 4) {
+			case 0: x = test_random_float64(); break;
+			case 1: x = (f64)(s64)(get_random() >> 20) / (f64)(1 << (get_random() % 30)); break; // Game-ish numbers
+			case 2: x = get_random_float64_in_range(-1000.0, 1000.0); break;
+			default: x = (f64)((s64)(get_random() % 20001) - 10000) / 1000.0; break; // Lots of ties
+		}
+		for (u64 f = 0; f < sizeof(float_formats)/sizeof(float_formats[0]); f++) {
+			if (fabs(x) > 1e200 && float_formats[f][1] != 'e' && strchr(float_formats[f], 'f')) continue; // Just long
+			test_format_against_crt(float_formats[f], x);
+		}
+	}
+
+	const char *int_formats[] = { "%lld", "%llu", "%llx", "%#llX", "%llo", "%#llo", "%20lld|", "%-20lld|", "%020lld", "%+lld", "% lld", "%.25lld", "%.0lld" };
+	for (u64 i = 0; i < 4000; i++) {
+		s64 x = (s64)(get_random() >> (get_random() % 64));
+		if (i % 2) x = -x;
+		if (i % 97 == 0) x = 0;
+		for (u64 f = 0; f < sizeof(int_formats)/sizeof(int_formats[0]); f++) {
+			test_format_against_crt(int_formats[f], x);
+		}
+	}
+
+	// Shortest reads back the same and one digit less wouldn't
+	Test_Strtod_Proc strtod_proc = (Test_Strtod_Proc)os_dynamic_library_load_symbol(os.crt, STR("strtod"));
+	assert(strtod_proc, "Missing strtod in crt");
+	for (u64 i = 0; i < 20000; i++) {
+		float64 x = i % 2 ? test_random_float64() : get_random_float64_in_range(-100.0, 100.0);
+		if (x != x || x - x != 0) continue;
+		char shortest[33];
+		u64 n = format_float64_shortest(shortest, x);
+		shortest[n] = 0;
+		float64 back = strtod_proc(shortest, 0);
+		assert(back == x && signbit(back) == signbit(x), "%cs doesn't read back as %.17g", shortest, x);
+
+		// Significant digits, without the zeros on either end
+		char digits[33];
+		s32 digit_count = 0;
+		for (u64 c = 0; c < n && shortest[c] != 'e'; c++) {
+			if (shortest[c] >= '0' && shortest[c] <= '9' && (digit_count || shortest[c] != '0')) digits[digit_count++] = shortest[c];
+		}
+		while (digit_count > 1 && digits[digit_count-1] == '0') digit_count -= 1;
+		if (digit_count > 1) {
+			char fewer[64];
+			format_string_to_buffer_vararg(fewer, sizeof(fewer), "%.*e", digit_count-2, x);
+			assert(strtod_proc(fewer, 0) != x, "%cs isn't the shortest for %.17g, %cs works too", shortest, x, fewer);
+		}
+	}
+#endif
+
+	seed_for_random = seed_before;
+}
+
+u64 test_format_ours(char *buffer, u64 count, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	u64 n = format_string_to_buffer(buffer, count, fmt, args);
+	va_end(args);
+	return n;
+}
+u64 test_format_crt(char *buffer, u64 count, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int n = vsnprintf(buffer, count, fmt, args);
+	va_end(args);
+	return (u64)n;
+}
+
+void test_string_format_performance() {
+	u64 seed_before = seed_for_random;
+	seed_for_random = 69;
+
+	const u64 n = 200000;
+	s64 *ints = (s64*)alloc(get_heap_allocator(), n*sizeof(s64));
+	f64 *floats = (f64*)alloc(get_heap_allocator(), n*sizeof(f64));
+	for (u64 i = 0; i < n; i++) {
+		ints[i] = (s64)(get_random() >> (get_random() % 64));
+		floats[i] = get_random_float64_in_range(-10000.0, 10000.0);
+	}
+
+	typedef enum { PERF_INT, PERF_FLOAT, PERF_MIXED } Perf_Kind;
+	struct { const char *fmt; Perf_Kind kind; } cases[] = {
+		{ "%d", PERF_INT },
+		{ "%llu", PERF_INT },
+		{ "%8llx", PERF_INT },
+		{ "%.2f", PERF_FLOAT },
+		{ "%f", PERF_FLOAT },
+		{ "%e", PERF_FLOAT },
+		{ "%g", PERF_FLOAT },
+		{ "%.17g", PERF_FLOAT },
+		{ "Entity %llu at %.2f, %.2f (%d hp)", PERF_MIXED },
+	};
+
+	print("\n");
+	char buffer[256];
+	for (u64 c = 0; c < sizeof(cases)/sizeof(cases[0]); c++) {
+		u64 sink = 0;
+		f64 seconds[2];
+		for (u64 which = 0; which < 2; which++) {
+			u64 (*proc)(char*, u64, const char*, ...) = which == 0 ? test_format_ours : test_format_crt;
+			f64 start = os_get_elapsed_seconds();
+			for (u64 i = 0; i < n; i++) {
+				switch (cases[c].kind) {
+					case PERF_INT:   sink += proc(buffer, sizeof(buffer), cases[c].fmt, ints[i]); break;
+					case PERF_FLOAT: sink += proc(buffer, sizeof(buffer), cases[c].fmt, floats[i]); break;
+					case PERF_MIXED: sink += proc(buffer, sizeof(buffer), cases[c].fmt, ints[i], floats[i], floats[n-1-i], (int)i); break;
+				}
+			}
+			seconds[which] = os_get_elapsed_seconds() - start;
+		}
+		assert(sink, "");
+		print("\t%-36cs ours %6.1f ns, crt vsnprintf %6.1f ns\n", cases[c].fmt, seconds[0]*1e9/n, seconds[1]*1e9/n);
+	}
+
+	// Shortest vs %.17g, which is what you'd otherwise use to get a float back exactly
+	{
+		char out[32];
+		u64 sink = 0;
+		f64 start = os_get_elapsed_seconds();
+		for (u64 i = 0; i < n; i++) sink += format_float64_shortest(out, floats[i]);
+		f64 seconds = os_get_elapsed_seconds() - start;
+		assert(sink, "");
+		print("\t%-36cs ours %6.1f ns\n", "shortest round trip (%r)", seconds*1e9/n);
+	}
+
+	dealloc(get_heap_allocator(), ints);
+	dealloc(get_heap_allocator(), floats);
+	seed_for_random = seed_before;
+}
+
 void test_strings() {
 	Allocator heap = get_heap_allocator();
 	{
@@ -487,7 +1690,7 @@ void test_file_io() {
     assert(file != OS_INVALID_FILE, "Failed: os_file_open (read)");
     string hello_world_read = talloc_string(hello_world_write.count);
     bool read_result = os_file_read(file, hello_world_read.data, hello_world_read.count, &hello_world_read.count);
-    assert(read_result, "Failed: os_file_read %d", GetLastError());
+    assert(read_result, "Failed: os_file_read");
     assert(strings_match(hello_world_read, hello_world_write), "Failed: os_file_read write/read mismatch");
     os_file_close(file);
 
@@ -1307,6 +2510,220 @@ void test_intmath() {
     assert(v4i_result.x == 1 && v4i_result.y == 2 && v4i_result.z == 3 && v4i_result.w == 4, "v4i_divi incorrect");
 }
 
+void test_hash() {
+	u64 seed_before = seed_for_random;
+	seed_for_random = 69;
+	Allocator heap = get_heap_allocator();
+
+	const u64 size = 20000;
+	u8 *data = (u8*)alloc(heap, size + 64);
+	for (u64 i = 0; i < size + 64; i++) data[i] = (u8)(get_random() >> 16);
+
+	// Only the bytes in range matter. Short strings used to read whatever came before them.
+	u8 *a = (u8*)alloc(heap, 128);
+	u8 *b = (u8*)alloc(heap, 128);
+	for (u64 n = 0; n <= 80; n++) {
+		memset(a, 0xAA, 128);
+		memset(b, 0x55, 128);
+		memcpy(a + 40, data, n);
+		memcpy(b + 40, data, n);
+		assert(bytes_get_hash(a + 40, n) == bytes_get_hash(b + 40, n), "Hash of %llu bytes depends on bytes outside the range", n);
+		assert(string_get_hash((string){n, a + 40}) == bytes_get_hash(data, n), "string_get_hash doesn't match bytes_get_hash");
+	}
+	dealloc(heap, a);
+	dealloc(heap, b);
+
+	// Every length, and every length's hash is different
+	u64 *hashes = (u64*)alloc(heap, 1200*sizeof(u64));
+	for (u64 n = 0; n < 1200; n++) {
+		hashes[n] = bytes_get_hash(data, n);
+		for (u64 m = 0; m < n; m++) {
+			assert(hashes[m] != hashes[n], "Prefixes of length %llu and %llu collide", m, n);
+		}
+	}
+	dealloc(heap, hashes);
+
+	// Seed
+	assert(bytes_get_hash_seeded(data, 10, 1) != bytes_get_hash_seeded(data, 10, 2), "Seed doesn't change short hash");
+	assert(bytes_get_hash_seeded(data, 1000, 1) != bytes_get_hash_seeded(data, 1000, 2), "Seed doesn't change long hash");
+	assert(bytes_get_hash_seeded(data, 1000, HASH_DEFAULT_SEED) == bytes_get_hash(data, 1000), "Default seed mismatch");
+
+	// Streaming in any size pieces gives the same thing as all at once
+	const u64 lengths[] = { 0, 1, 3, 4, 8, 16, 17, 48, 49, 255, 256, 257, 320, 1023, 1024, 1025, 1088, 5000, size };
+	const u64 pieces[] = { 1, 7, 64, 100, 1000, size };
+	for (u64 l = 0; l < sizeof(lengths)/sizeof(lengths[0]); l++) {
+		u64 n = lengths[l];
+		u64 expected = bytes_get_hash_seeded(data, n, 1234);
+		for (u64 p = 0; p < sizeof(pieces)/sizeof(pieces[0]); p++) {
+			Hash_State h;
+			hash_state_init(&h, 1234);
+			for (u64 i = 0; i < n; i += pieces[p]) {
+				hash_state_add(&h, data + i, min(pieces[p], n - i));
+			}
+			assert(hash_state_get(&h) == expected, "Streaming hash of %llu bytes in pieces of %llu doesn't match", n, pieces[p]);
+			assert(hash_state_get(&h) == expected, "hash_state_get changed the state");
+		}
+	}
+
+#if COMPILER_CAN_DO_SSE2
+	// SSE2 and scalar long hash must agree, hashes could end up on disk
+	{
+		alignat(16) u64 acc_sse2[8];
+		alignat(16) u64 acc_scalar[8];
+		for (u64 i = 0; i < 8; i++) acc_sse2[i] = acc_scalar[i] = get_random();
+		for (u64 s = 0; s < 200; s++) {
+			const u8 *secret = (const u8*)hash_secret + (s % (HASH_STRIPES_PER_BLOCK+1))*8;
+			hash_accumulate_stripe_sse2(acc_sse2, data + s*64, secret);
+			hash_accumulate_stripe_scalar(acc_scalar, data + s*64, secret);
+			if (s % 16 == 15) {
+				hash_scramble_sse2(acc_sse2, secret);
+				hash_scramble_scalar(acc_scalar, secret);
+			}
+		}
+		assert(memcmp(acc_sse2, acc_scalar, sizeof(acc_sse2)) == 0, "SSE2 and scalar hash don't agree");
+	}
+#endif
+
+	// get_hash for vectors, so they can be hash table keys
+	{
+		assert(get_hash(v2i(1, 2)) == get_hash(v2i(1, 2)), "Failed: get_hash(Vector2i)");
+		assert(get_hash(v2i(1, 2)) != get_hash(v2i(2, 1)), "Failed: get_hash(Vector2i)");
+		assert(get_hash(v2i(-1, 0)) != get_hash(v2i(0, -1)), "Failed: get_hash(Vector2i)");
+		assert(get_hash(v3i(1, 2, 3)) != get_hash(v3i(1, 2, 4)), "Failed: get_hash(Vector3i)");
+		assert(get_hash(v2(1, 2)) != get_hash(v2(2, 1)), "Failed: get_hash(Vector2)");
+
+		Hash_Table table = make_hash_table(Vector2i, int, heap);
+		for (s32 y = -20; y < 20; y++) {
+			for (s32 x = -20; x < 20; x++) {
+				Vector2i tile = v2i(x, y);
+				int value = x*1000 + y;
+				hash_table_add(&table, tile, value);
+			}
+		}
+		assert(table.count == 1600, "Vector2i keys collided in hash table");
+		Vector2i tile = v2i(-7, 13);
+		int *found = hash_table_find(&table, tile);
+		assert(found && *found == -7*1000 + 13, "Failed: Vector2i hash table lookup");
+		hash_table_destroy(&table);
+	}
+
+	dealloc(heap, data);
+	seed_for_random = seed_before;
+}
+
+// What string_get_hash used to do for long strings, for comparison
+u64 test_djb2_hash(const u8 *p, u64 n) {
+	u64 hash = 5381;
+	for (u64 i = 0; i < n; i++) hash = ((hash << 5) + hash) + p[i];
+	return hash;
+}
+
+void test_hash_performance() {
+	u64 seed_before = seed_for_random;
+	seed_for_random = 69;
+	Allocator heap = get_heap_allocator();
+
+	const u64 max_size = MB(1);
+	u8 *data = (u8*)alloc(heap, max_size);
+	for (u64 i = 0; i < max_size; i++) data[i] = (u8)(get_random() >> 16);
+
+	///
+	// Throughput
+	print("\n");
+	const u64 sizes[] = { 4, 8, 16, 32, 64, 256, KB(1), KB(64), MB(1) };
+	for (u64 s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+		u64 n = sizes[s];
+		u64 iterations = max(MB(64) / n, 1);
+		iterations = min(iterations, 2000000);
+		u64 offset_mask = max_size - n; // n is a power of two, so this walks around a bit in data
+
+		u64 sink = 0;
+		f64 start = os_get_elapsed_seconds();
+		for (u64 i = 0; i < iterations; i++) sink += bytes_get_hash(data + ((i*64) & offset_mask), n);
+		f64 hash_seconds = os_get_elapsed_seconds()-start;
+
+		start = os_get_elapsed_seconds();
+		for (u64 i = 0; i < iterations; i++) sink += test_djb2_hash(data + ((i*64) & offset_mask), n);
+		f64 djb2_seconds = os_get_elapsed_seconds()-start;
+
+		Hash_State h;
+		u64 stream_iterations = max(iterations/8, 1);
+		start = os_get_elapsed_seconds();
+		for (u64 i = 0; i < stream_iterations; i++) {
+			hash_state_init(&h, 0);
+			hash_state_add(&h, data + ((i*64) & offset_mask), n);
+			sink += hash_state_get(&h);
+		}
+		f64 stream_seconds = os_get_elapsed_seconds()-start;
+		assert(sink != 0, "");
+
+		f64 bytes = (f64)(n*iterations);
+		print("\t%8llu bytes: bytes_get_hash %6.2f gb/s (%5.1f ns), streaming %6.2f gb/s, djb2 %5.2f gb/s\n",
+			n, bytes/hash_seconds/1e9, hash_seconds*1e9/iterations,
+			(f64)(n*stream_iterations)/stream_seconds/1e9, bytes/djb2_seconds/1e9);
+	}
+
+	///
+	// Quality
+	// Avalanche: flipping any one input bit should flip each output bit half the time
+	const u64 avalanche_sizes[] = { 4, 8, 24, 100, 300, 2000 };
+	for (u64 s = 0; s < sizeof(avalanche_sizes)/sizeof(avalanche_sizes[0]); s++) {
+		u64 n = avalanche_sizes[s];
+		u8 *key = (u8*)alloc(heap, n);
+		u64 flips[64];
+		memset(flips, 0, sizeof(flips));
+		u64 trials = 0;
+		for (u64 k = 0; k < 40; k++) {
+			for (u64 i = 0; i < n; i++) key[i] = (u8)(get_random() >> 16);
+			u64 h0 = bytes_get_hash(key, n);
+			u64 bit_step = max(n*8/256, 1);
+			for (u64 bit = 0; bit < n*8; bit += bit_step) {
+				key[bit/8] ^= (u8)(1 << (bit%8));
+				u64 diff = h0 ^ bytes_get_hash(key, n);
+				key[bit/8] ^= (u8)(1 << (bit%8));
+				for (u64 o = 0; o < 64; o++) flips[o] += (diff >> o) & 1;
+				trials += 1;
+			}
+		}
+		f64 worst = 0;
+		for (u64 o = 0; o < 64; o++) worst = max(worst, fabs((f64)flips[o]/(f64)trials - 0.5));
+		print("\t%4llu byte keys: worst output bit flip bias %.3f over %llu single bit flips\n", n, worst, trials);
+		assert(worst < 0.05, "Bad avalanche for %llu byte keys", n);
+		dealloc(heap, key);
+	}
+
+	// Sequential keys, like tile coordinates & "thing_%d", into power of two buckets by the low bits
+	{
+		const u64 bucket_count = 1024;
+		const u64 key_count = bucket_count*64;
+		u64 *tile_buckets = (u64*)alloc(heap, bucket_count*sizeof(u64));
+		u64 *string_buckets = (u64*)alloc(heap, bucket_count*sizeof(u64));
+		memset(tile_buckets, 0, bucket_count*sizeof(u64));
+		memset(string_buckets, 0, bucket_count*sizeof(u64));
+		for (u64 i = 0; i < key_count; i++) {
+			Vector2i tile = v2i((s32)(i % 256) - 128, (s32)(i / 256) - 128);
+			tile_buckets[get_hash(tile) & (bucket_count-1)] += 1;
+			string name = tprint("thing_%llu", i);
+			string_buckets[get_hash(name) & (bucket_count-1)] += 1;
+		}
+		// Chi-squared, for uniform buckets it's close to bucket_count-1 give or take ~sqrt(2*bucket_count)
+		f64 expected = (f64)key_count/(f64)bucket_count;
+		f64 tile_chi = 0, string_chi = 0;
+		for (u64 i = 0; i < bucket_count; i++) {
+			tile_chi   += (tile_buckets[i]-expected)*(tile_buckets[i]-expected)/expected;
+			string_chi += (string_buckets[i]-expected)*(string_buckets[i]-expected)/expected;
+		}
+		print("\tChi-squared over %llu buckets (uniform ~%llu): Vector2i tiles %.0f, \"thing_N\" strings %.0f\n",
+			bucket_count, bucket_count-1, tile_chi, string_chi);
+		assert(tile_chi < bucket_count*1.3 && string_chi < bucket_count*1.3, "Hash distribution is too uneven");
+		dealloc(heap, tile_buckets);
+		dealloc(heap, string_buckets);
+	}
+
+	dealloc(heap, data);
+	seed_for_random = seed_before;
+}
+
 void test_hash_table() {
     Hash_Table table = make_hash_table(string, int, get_heap_allocator());
     
@@ -1342,11 +2759,194 @@ void test_hash_table() {
     assert(table.entries == NULL, "Failed: Hash table entries should be NULL after destroy");
     assert(table.count == 0, "Failed: Hash table count should be 0 after destroy");
     assert(table.capacity_count == 0, "Failed: Hash table capacity count should be 0 after destroy");
-}
-
-#define NUM_BINS 100
-#define NUM_SAMPLES 100000000
-
+    
+    // Keys with the same hash must not alias
+    table = make_hash_table(u64, u64, get_heap_allocator());
+    u64 k1 = 1, k2 = 2, v1 = 111, v2 = 222;
+    assert(hash_table_set_raw(&table, 1234, &k1, &v1, sizeof(u64), sizeof(u64)), "Failed: k1 should be newly added");
+    assert(hash_table_set_raw(&table, 1234, &k2, &v2, sizeof(u64), sizeof(u64)), "Failed: k2 has the same hash but should still be newly added");
+    assert(*(u64*)hash_table_find_raw(&table, 1234, &k1, sizeof(u64)) == 111, "Failed: colliding keys alias");
+    assert(*(u64*)hash_table_find_raw(&table, 1234, &k2, sizeof(u64)) == 222, "Failed: colliding keys alias");
+    hash_table_destroy(&table);
+    
+    // Grow, remove half, check the rest survived the shuffling
+    table = make_hash_table(u64, u64, get_heap_allocator());
+    const u64 n = 10000;
+    for (u64 i = 0; i < n; i++) {
+        u64 value = i*3;
+        assert(hash_table_set(&table, i, value), "Failed: key %llu should be newly added", i);
+    }
+    assert(table.count == n, "Failed: count should be %llu, was %llu", n, table.count);
+    for (u64 i = 0; i < n; i += 2) {
+        assert(hash_table_remove(&table, i), "Failed: key %llu should have been removed", i);
+        assert(!hash_table_remove(&table, i), "Failed: key %llu was removed twice", i);
+    }
+    assert(table.count == n/2, "Failed: count should be %llu after removing, was %llu", n/2, table.count);
+    for (u64 i = 0; i < n; i++) {
+        u64 *value = hash_table_find(&table, i);
+        if (i % 2 == 0) {
+            assert(value == 0, "Failed: removed key %llu is still in the table", i);
+        } else {
+            assert(value && *value == i*3, "Failed: key %llu has the wrong value after removals", i);
+        }
+    }
+    u64 sum = 0;
+    for (u64 i = 0; i < table.count; i++) sum += *(u64*)hash_table_get_nth_value(&table, i);
+    assert(sum == 3*(n/2)*(n/2), "Failed: iterating values after removals gave the wrong sum");
+    hash_table_destroy(&table);
+    
+    // String keys are copied, so a key we throw away after adding must still be found
+    table = make_hash_table(string, int, get_heap_allocator());
+    string temp_key = string_copy(STR("Temporary key"), get_heap_allocator());
+    int temp_value = 5;
+    hash_table_add(&table, temp_key, temp_value);
+    memset(temp_key.data, 'x', temp_key.count);
+    dealloc_string(get_heap_allocator(), temp_key);
+    string same_key = STR("Temporary key");
+    found_value = hash_table_find(&table, same_key);
+    assert(found_value && *found_value == 5, "Failed: string key should be owned by the table");
+    assert(hash_table_remove(&table, same_key), "Failed: string key should have been removed");
+    hash_table_destroy(&table);
+}
+
+void test_hash_table_performance() {
+	u64 seed_before = seed_for_random;
+	seed_for_random = 69;
+
+	u64 sizes[] = {10, 10000, 1000000};
+	const u64 lookup_count = 1000000;
+	
+	u64 *keys = (u64*)alloc(get_heap_allocator(), sizes[2]*sizeof(u64));
+	
+	for (u64 s = 0; s < sizeof(sizes)/sizeof(u64); s++) {
+		u64 n = sizes[s];
+		
+		Hash_Table table = make_hash_table(u64, u64, get_heap_allocator());
+		for (u64 i = 0; i < n; i++) {
+			keys[i] = get_random() & ~(1ull << 63);
+			hash_table_set(&table, keys[i], i);
+		}
+		
+		// Random order so big tables don't get the cache for free
+		u64 checksum = 0;
+		f64 start = os_get_elapsed_seconds();
+		for (u64 i = 0; i < lookup_count; i++) {
+			u64 key = keys[(get_random() >> 16) % n];
+			checksum += *(u64*)hash_table_find(&table, key);
+		}
+		f64 hit_seconds = os_get_elapsed_seconds()-start;
+		
+		u64 miss_count = 0;
+		start = os_get_elapsed_seconds();
+		for (u64 i = 0; i < lookup_count; i++) {
+			u64 key = get_random() | 1ull << 63; // Ours have the top bit clear
+			if (!hash_table_contains(&table, key)) miss_count += 1;
+		}
+		f64 miss_seconds = os_get_elapsed_seconds()-start;
+		assert(checksum != 0 && miss_count == lookup_count, "Failed: hash table benchmark got wrong results");
+		
+		print("\n\t%llu entries: hits %.1f ns/lookup (%.1f million/sec), misses %.1f ns/lookup",
+			n, hit_seconds*1e9/lookup_count, lookup_count/hit_seconds/1e6, miss_seconds*1e9/lookup_count);
+		
+		hash_table_destroy(&table);
+	}
+	print("\n");
+	
+	dealloc(get_heap_allocator(), keys);
+	seed_for_random = seed_before;
+}
+
+bool lz_round_trip(u8 *data, u64 size) {
+	u64 bound = lz_compress_bound(size);
+	u8 *compressed = alloc(get_heap_allocator(), bound);
+	u8 *decompressed = alloc(get_heap_allocator(), size+1);
+	
+	u64 compressed_size = lz_compress(data, size, compressed, bound);
+	bool ok = compressed_size > 0 && compressed_size <= bound;
+	ok = ok && lz_decompress(compressed, compressed_size, decompressed, size);
+	ok = ok && (size == 0 || memcmp(data, decompressed, size) == 0);
+	
+	// Wrong sizes & truncated input must be rejected, not read/written out of bounds
+	if (ok && size > 0) {
+		ok = !lz_decompress(compressed, compressed_size, decompressed, size-1);
+		ok = ok && !lz_decompress(compressed, compressed_size, decompressed, size+1);
+		ok = ok && !lz_decompress(compressed, compressed_size-1, decompressed, size);
+	}
+	
+	dealloc(get_heap_allocator(), compressed);
+	dealloc(get_heap_allocator(), decompressed);
+	return ok;
+}
+
+void test_compression() {
+	u64 seed_before = seed_for_random;
+	seed_for_random = 69;
+	
+	const u64 size = 1024*1024*4;
+	u8 *data = alloc(get_heap_allocator(), size);
+	
+	// Tiny inputs, all under the minimum match length + last literals
+	for (u64 n = 0; n < 32; n++) {
+		for (u64 i = 0; i < n; i++) data[i] = (u8)(i % 3);
+		assert(lz_round_trip(data, n), "lz round trip failed for %llu bytes", n);
+	}
+	
+	// Zeroes, long runs
+	memset(data, 0, size);
+	assert(lz_round_trip(data, size), "lz round trip failed for zeroes");
+	
+	// Incompressible
+	for (u64 i = 0; i < size; i++) data[i] = (u8)(get_random() >> 16);
+	assert(lz_round_trip(data, size), "lz round trip failed for random bytes");
+	
+	// Repeated structs with a few fields changing, like a save file
+	for (u64 i = 0; i < size; i++) {
+		u64 field = i % 256;
+		data[i] = field < 16 ? (u8)(get_random() >> 16) : (field < 64 ? (u8)field : 0);
+	}
+	assert(lz_round_trip(data, size), "lz round trip failed for structs");
+	
+	// Random offsets & lengths into a small alphabet, lots of short overlapping matches
+	for (u64 i = 0; i < size; i++) data[i] = "ooga booga "[(get_random() >> 16) % 11];
+	assert(lz_round_trip(data, 100000), "lz round trip failed for text");
+	
+	// Garbage in must not crash
+	u8 *garbage_out = alloc(get_heap_allocator(), 4096);
+	for (u64 i = 0; i < 10000; i++) {
+		u64 n = (get_random() >> 16) % 64;
+		for (u64 j = 0; j < n; j++) data[j] = (u8)(get_random() >> 16);
+		lz_decompress(data, n, garbage_out, (get_random() >> 16) % 4096);
+	}
+	dealloc(get_heap_allocator(), garbage_out);
+	
+	// Throughput on the struct-like data
+	for (u64 i = 0; i < size; i++) {
+		u64 field = i % 256;
+		data[i] = field < 16 ? (u8)(get_random() >> 16) : (field < 64 ? (u8)field : 0);
+	}
+	u64 bound = lz_compress_bound(size);
+	u8 *compressed = alloc(get_heap_allocator(), bound);
+	
+	f64 start = os_get_elapsed_seconds();
+	u64 compressed_size = lz_compress(data, size, compressed, bound);
+	f64 compress_seconds = os_get_elapsed_seconds()-start;
+	
+	start = os_get_elapsed_seconds();
+	bool ok = lz_decompress(compressed, compressed_size, data, size);
+	f64 decompress_seconds = os_get_elapsed_seconds()-start;
+	assert(ok, "lz decompress failed");
+	
+	print("\n\t%llu kb -> %llu kb, compress %.0f mb/s, decompress %.0f mb/s\n",
+		size/1024, compressed_size/1024, size/compress_seconds/(1024*1024), size/decompress_seconds/(1024*1024));
+	
+	dealloc(get_heap_allocator(), compressed);
+	dealloc(get_heap_allocator(), data);
+	seed_for_random = seed_before;
+}
+
+#define NUM_BINS 100
+#define NUM_SAMPLES 100000000
+
 void test_random_distribution() {
     int bins[NUM_BINS] = {0};
     seed_for_random = rdtsc();
@@ -1390,19 +2990,36 @@ void test_mutex() {
     
     // Test initialization
     mutex_init(&m);
-    assert(m.spin_time_microseconds == MUTEX_DEFAULT_SPIN_TIME_MICROSECONDS, "Failed: Default spin time incorrect");
-    assert(!m.spinlock_acquired, "Failed: Spinlock should not be acquired after initialization");
+    assert(m.spin_count == MUTEX_DEFAULT_SPIN_COUNT, "Failed: Default spin count incorrect");
+    assert(m.state == MUTEX_UNLOCKED, "Failed: Mutex should not be acquired after initialization");
 
     // Test acquire and release without contention
     mutex_acquire_or_wait(&m);
-    assert(m.spinlock_acquired, "Failed: Mutex should be acquired after mutex_acquire_or_wait");
+    assert(m.state == MUTEX_LOCKED, "Failed: Mutex should be acquired after mutex_acquire_or_wait");
+    assert(!mutex_try_acquire(&m), "Failed: try_acquire got a mutex that was already acquired");
     
     mutex_release(&m);
-    assert(!m.spinlock_acquired, "Failed: Spinlock should not be acquired after mutex_release");
+    assert(m.state == MUTEX_UNLOCKED, "Failed: Mutex should not be acquired after mutex_release");
+    assert(mutex_try_acquire(&m), "Failed: try_acquire didn't get a free mutex");
+    mutex_release(&m);
 
     // Clean up
     mutex_destroy(&m);
     
+    // Zero initialized works too
+    Mutex zeroed = {0};
+    mutex_acquire_or_wait(&zeroed);
+    mutex_release(&zeroed);
+    
+    Spinlock l;
+    spinlock_init(&l);
+    assert(spinlock_try_acquire(&l), "Failed: try_acquire didn't get a free spinlock");
+    assert(!spinlock_try_acquire(&l), "Failed: try_acquire got a spinlock that was already acquired");
+    assert(!spinlock_acquire_or_wait_timeout(&l, 0.001), "Failed: Spinlock timeout acquired a locked spinlock");
+    spinlock_release(&l);
+    assert(spinlock_acquire_or_wait_timeout(&l, 0.001), "Failed: Spinlock timeout didn't get a free spinlock");
+    spinlock_release(&l);
+    
     Mutex_Test_Shared_Data data;
     data.counter = 0;
     data.any_active_thread = false;
@@ -1429,6 +3046,683 @@ void test_mutex() {
     mutex_destroy(&data.mutex);
 }
 
+#define ATOMICS_TEST_INCREMENTS 100000
+typedef struct Atomics_Test_Data {
+	volatile u64 add_counter;
+	volatile u32 cas_counter;
+	volatile u64 bits;
+	volatile u32 ticket;
+	volatile u32 now_serving;
+	u64 plain_counter; // Only touched while holding the ticket lock
+	volatile u64 next_thread_index;
+} Atomics_Test_Data;
+void atomics_test_proc(Thread *t) {
+	Atomics_Test_Data *d = (Atomics_Test_Data*)t->data;
+	for (u64 i = 0; i < ATOMICS_TEST_INCREMENTS; i++) {
+		atomic_fetch_add_64(&d->add_counter, 1, MEMORY_ORDER_RELAXED);
+
+		u32 expected = atomic_load_32(&d->cas_counter, MEMORY_ORDER_RELAXED);
+		while (!atomic_compare_exchange_32(&d->cas_counter, &expected, expected + 1, MEMORY_ORDER_ACQ_REL)) {}
+
+		// Ticket lock out of fetch_add + acquire/release, checks that the plain counter doesn't lose increments
+		u32 ticket = atomic_fetch_add_32(&d->ticket, 1, MEMORY_ORDER_RELAXED);
+		while (atomic_load_32(&d->now_serving, MEMORY_ORDER_ACQUIRE) != ticket) os_yield_thread();
+		d->plain_counter += 1;
+		atomic_store_32(&d->now_serving, ticket + 1, MEMORY_ORDER_RELEASE);
+	}
+	u64 index = atomic_fetch_add_64(&d->next_thread_index, 1, MEMORY_ORDER_RELAXED);
+	atomic_fetch_or_64(&d->bits, 1ull << index, MEMORY_ORDER_RELAXED);
+}
+void test_atomics() {
+	volatile u32 a32 = 5;
+	volatile u64 a64 = 5;
+	assert(atomic_load_32(&a32, MEMORY_ORDER_ACQUIRE) == 5, "load_32");
+	atomic_store_32(&a32, 7, MEMORY_ORDER_RELEASE);
+	assert(a32 == 7, "store_32");
+	assert(atomic_exchange_32(&a32, 9, MEMORY_ORDER_ACQ_REL) == 7 && a32 == 9, "exchange_32");
+	assert(atomic_fetch_add_32(&a32, -10, MEMORY_ORDER_SEQ_CST) == 9 && a32 == 0xFFFFFFFF, "fetch_add_32 negative");
+	assert(atomic_fetch_and_32(&a32, 0xF0, MEMORY_ORDER_RELAXED) == 0xFFFFFFFF && a32 == 0xF0, "fetch_and_32");
+	assert(atomic_fetch_or_32(&a32, 0x0F, MEMORY_ORDER_RELAXED) == 0xF0 && a32 == 0xFF, "fetch_or_32");
+
+	u32 expected32 = 1;
+	assert(!atomic_compare_exchange_32(&a32, &expected32, 2, MEMORY_ORDER_SEQ_CST), "compare_exchange_32 should fail");
+	assert(expected32 == 0xFF && a32 == 0xFF, "compare_exchange_32 should give back the current value");
+	assert(atomic_compare_exchange_32(&a32, &expected32, 2, MEMORY_ORDER_SEQ_CST) && a32 == 2, "compare_exchange_32 should succeed");
+
+	atomic_store_64(&a64, 0x100000000ull, MEMORY_ORDER_SEQ_CST);
+	assert(atomic_load_64(&a64, MEMORY_ORDER_RELAXED) == 0x100000000ull, "store_64 / load_64");
+	assert(atomic_fetch_add_64(&a64, 0x100000000ull, MEMORY_ORDER_ACQ_REL) == 0x100000000ull && a64 == 0x200000000ull, "fetch_add_64");
+	assert(atomic_exchange_64(&a64, 3, MEMORY_ORDER_SEQ_CST) == 0x200000000ull && a64 == 3, "exchange_64");
+	u64 expected64 = 3;
+	assert(atomic_compare_exchange_64(&a64, &expected64, 0xFFFFFFFFFFull, MEMORY_ORDER_RELEASE) && a64 == 0xFFFFFFFFFFull, "compare_exchange_64");
+
+	int x, y;
+	void * volatile p = &x;
+	void *expected_p = &y;
+	assert(!atomic_compare_exchange_ptr(&p, &expected_p, &y, MEMORY_ORDER_SEQ_CST) && expected_p == &x, "compare_exchange_ptr should fail");
+	assert(atomic_compare_exchange_ptr(&p, &expected_p, &y, MEMORY_ORDER_SEQ_CST) && p == &y, "compare_exchange_ptr");
+	assert(atomic_exchange_ptr(&p, 0, MEMORY_ORDER_ACQ_REL) == &y && atomic_load_ptr(&p, MEMORY_ORDER_ACQUIRE) == 0, "exchange_ptr");
+	atomic_thread_fence(MEMORY_ORDER_SEQ_CST);
+
+	const u64 thread_count = 8;
+	Atomics_Test_Data d = {0};
+	Thread threads[8];
+	for (u64 i = 0; i < thread_count; i++) {
+		os_thread_init(&threads[i], atomics_test_proc);
+		threads[i].data = &d;
+		os_thread_start(&threads[i]);
+	}
+	for (u64 i = 0; i < thread_count; i++) {
+		os_thread_join(&threads[i]);
+		os_thread_destroy(&threads[i]);
+	}
+	assert(d.add_counter == thread_count*ATOMICS_TEST_INCREMENTS, "fetch_add lost increments");
+	assert(d.cas_counter == thread_count*ATOMICS_TEST_INCREMENTS, "compare_exchange lost increments");
+	assert(d.plain_counter == thread_count*ATOMICS_TEST_INCREMENTS, "Ticket lock let two threads in");
+	assert(d.bits == (1ull << thread_count) - 1, "fetch_or lost bits");
+}
+
+typedef struct Queue_Test_Item {
+	u64 producer;
+	u64 sequence;
+	u64 check; // Some function of the other two so torn copies show up
+} Queue_Test_Item;
+
+#define QUEUE_TEST_CHECK(p, s) (((p) * 0x9E3779B97F4A7C15ull) ^ ((s) * 0xC2B2AE3D27D4EB4Full))
+#define QUEUE_TEST_MAX_BATCH 37
+
+typedef struct Spsc_Test_Data {
+	Spsc_Queue queue;
+	u64 item_count;
+	u64 bad_items;
+} Spsc_Test_Data;
+void spsc_test_producer(Thread *t) {
+	Spsc_Test_Data *d = (Spsc_Test_Data*)t->data;
+	Queue_Test_Item batch[QUEUE_TEST_MAX_BATCH];
+	u64 seed = 1234;
+	u64 next = 0;
+	while (next < d->item_count) {
+		seed = seed*6364136223846793005ull + 1442695040888963407ull;
+		u64 n = min((seed >> 33) % QUEUE_TEST_MAX_BATCH + 1, d->item_count - next);
+		for (u64 i = 0; i < n; i++) batch[i] = (Queue_Test_Item){0, next + i, QUEUE_TEST_CHECK(0, next + i)};
+		u64 pushed = 0;
+		while (pushed < n) {
+			u64 count = n == 1 ? spsc_queue_push(&d->queue, batch) : spsc_queue_push_batch(&d->queue, batch + pushed, n - pushed);
+			if (!count) os_yield_thread();
+			pushed += count;
+		}
+		next += n;
+	}
+}
+void spsc_test_consumer(Thread *t) {
+	Spsc_Test_Data *d = (Spsc_Test_Data*)t->data;
+	Queue_Test_Item batch[QUEUE_TEST_MAX_BATCH];
+	u64 seed = 5678;
+	u64 next = 0;
+	while (next < d->item_count) {
+		seed = seed*6364136223846793005ull + 1442695040888963407ull;
+		u64 want = (seed >> 33) % QUEUE_TEST_MAX_BATCH + 1;
+		u64 count = want == 1 ? spsc_queue_pop(&d->queue, batch) : spsc_queue_pop_batch(&d->queue, batch, want);
+		if (!count) os_yield_thread();
+		for (u64 i = 0; i < count; i++) {
+			if (batch[i].sequence != next || batch[i].check != QUEUE_TEST_CHECK(0, next)) d->bad_items += 1;
+			next += 1;
+		}
+	}
+}
+
+typedef struct Mpmc_Test_Data {
+	Mpmc_Queue queue;
+	u64 items_per_producer;
+	u64 producer_count;
+	volatile u64 popped;
+	volatile u64 bad_items;
+	volatile u64 next_producer;
+	volatile u64 next_consumer;
+	u8 *seen; // producer*items_per_producer + sequence
+} Mpmc_Test_Data;
+void mpmc_test_producer(Thread *t) {
+	Mpmc_Test_Data *d = (Mpmc_Test_Data*)t->data;
+	u64 producer = atomic_fetch_add_64(&d->next_producer, 1, MEMORY_ORDER_RELAXED);
+	Queue_Test_Item batch[QUEUE_TEST_MAX_BATCH];
+	u64 seed = producer + 1;
+	u64 next = 0;
+	while (next < d->items_per_producer) {
+		seed = seed*6364136223846793005ull + 1442695040888963407ull;
+		u64 n = min((seed >> 33) % QUEUE_TEST_MAX_BATCH + 1, d->items_per_producer - next);
+		for (u64 i = 0; i < n; i++) batch[i] = (Queue_Test_Item){producer, next + i, QUEUE_TEST_CHECK(producer, next + i)};
+		u64 pushed = 0;
+		while (pushed < n) {
+			u64 count = n == 1 ? mpmc_queue_push(&d->queue, batch) : mpmc_queue_push_batch(&d->queue, batch + pushed, n - pushed);
+			if (!count) os_yield_thread();
+			pushed += count;
+		}
+		next += n;
+	}
+}
+void mpmc_test_consumer(Thread *t) {
+	Mpmc_Test_Data *d = (Mpmc_Test_Data*)t->data;
+	u64 total = d->items_per_producer*d->producer_count;
+	Queue_Test_Item batch[QUEUE_TEST_MAX_BATCH];
+	u64 last_sequence[16]; // Items from one producer come out in the order they went in
+	for (u64 i = 0; i < 16; i++) last_sequence[i] = UINT64_MAX;
+	u64 seed = atomic_fetch_add_64(&d->next_consumer, 1, MEMORY_ORDER_RELAXED) + 100;
+	while (atomic_load_64(&d->popped, MEMORY_ORDER_RELAXED) < total) {
+		seed = seed*6364136223846793005ull + 1442695040888963407ull;
+		u64 want = (seed >> 33) % QUEUE_TEST_MAX_BATCH + 1;
+		u64 count = want == 1 ? mpmc_queue_pop(&d->queue, batch) : mpmc_queue_pop_batch(&d->queue, batch, want);
+		if (!count) { os_yield_thread(); continue; }
+		for (u64 i = 0; i < count; i++) {
+			Queue_Test_Item *item = &batch[i];
+			bool ok = item->producer < d->producer_count
+				&& item->sequence < d->items_per_producer
+				&& item->check == QUEUE_TEST_CHECK(item->producer, item->sequence)
+				&& (last_sequence[item->producer] == UINT64_MAX || item->sequence > last_sequence[item->producer]);
+			if (!ok) {
+				atomic_fetch_add_64(&d->bad_items, 1, MEMORY_ORDER_RELAXED);
+				continue;
+			}
+			last_sequence[item->producer] = item->sequence;
+			d->seen[item->producer*d->items_per_producer + item->sequence] += 1;
+		}
+		atomic_fetch_add_64(&d->popped, count, MEMORY_ORDER_RELAXED);
+	}
+}
+
+void test_concurrent_queues() {
+	Allocator heap = get_heap_allocator();
+
+	{
+		// Single threaded basics
+		Spsc_Queue q;
+		spsc_queue_init(&q, sizeof(u64), 6, heap);
+		assert(q.capacity == 8, "Capacity should be rounded up to a power of two");
+		u64 items[16];
+		for (u64 i = 0; i < 16; i++) items[i] = i;
+		assert(spsc_queue_push_batch(&q, items, 5) == 5, "Expected 5 pushed");
+		assert(spsc_queue_push_batch(&q, items + 5, 5) == 3, "Expected only 3 to fit");
+		assert(!spsc_queue_push(&q, items), "Push to a full queue");
+		assert(spsc_queue_get_count(&q) == 8, "Expected 8");
+		u64 out[16];
+		assert(spsc_queue_pop_batch(&q, out, 3) == 3 && out[0] == 0 && out[2] == 2, "Bad pop");
+		assert(spsc_queue_push_batch(&q, items + 8, 3) == 3, "Expected 3 pushed (wrapping)");
+		assert(spsc_queue_pop_batch(&q, out, 16) == 8, "Expected 8 popped");
+		for (u64 i = 0; i < 8; i++) assert(out[i] == i + 3, "Wrong order after wrapping");
+		assert(!spsc_queue_pop(&q, out), "Pop from an empty queue");
+		spsc_queue_deinit(&q);
+
+		Mpmc_Queue m;
+		mpmc_queue_init(&m, sizeof(u64), 8, heap);
+		assert(mpmc_queue_push_batch(&m, items, 6) == 6, "Expected 6 pushed");
+		assert(mpmc_queue_push_batch(&m, items + 6, 6) == 2, "Expected only 2 to fit");
+		assert(!mpmc_queue_push(&m, items), "Push to a full queue");
+		assert(mpmc_queue_get_count(&m) == 8, "Expected 8");
+		assert(mpmc_queue_pop_batch(&m, out, 5) == 5 && out[4] == 4, "Bad pop");
+		assert(mpmc_queue_push_batch(&m, items + 8, 8) == 5, "Expected 5 pushed (wrapping)");
+		assert(mpmc_queue_pop_batch(&m, out, 16) == 8, "Expected 8 popped");
+		for (u64 i = 0; i < 8; i++) assert(out[i] == i + 5, "Wrong order after wrapping");
+		assert(!mpmc_queue_pop(&m, out), "Pop from an empty queue");
+		mpmc_queue_deinit(&m);
+	}
+
+	{
+		// One producer, one consumer, random batch sizes through a small queue so it wraps a lot
+		Spsc_Test_Data d = {0};
+		spsc_queue_init(&d.queue, sizeof(Queue_Test_Item), 64, heap);
+		d.item_count = 500000;
+		Thread producer, consumer;
+		os_thread_init(&producer, spsc_test_producer);
+		os_thread_init(&consumer, spsc_test_consumer);
+		producer.data = &d;
+		consumer.data = &d;
+		os_thread_start(&consumer);
+		os_thread_start(&producer);
+		os_thread_join(&producer);
+		os_thread_join(&consumer);
+		assert(d.bad_items == 0, "Spsc consumer got %llu items out of order or torn", d.bad_items);
+		assert(spsc_queue_get_count(&d.queue) == 0, "Spsc queue should be empty");
+		spsc_queue_deinit(&d.queue);
+	}
+
+	{
+		// Many producers and consumers, every item must come out exactly once
+		const u64 producer_count = 4;
+		const u64 consumer_count = 4;
+		Mpmc_Test_Data d = {0};
+		mpmc_queue_init(&d.queue, sizeof(Queue_Test_Item), 128, heap);
+		d.items_per_producer = 100000;
+		d.producer_count = producer_count;
+		d.seen = (u8*)alloc(heap, producer_count*d.items_per_producer);
+		memset(d.seen, 0, producer_count*d.items_per_producer);
+
+		Thread threads[8];
+		for (u64 i = 0; i < producer_count + consumer_count; i++) {
+			bool is_producer = i < producer_count;
+			os_thread_init(&threads[i], is_producer ? mpmc_test_producer : mpmc_test_consumer);
+			threads[i].data = &d;
+			os_thread_start(&threads[i]);
+		}
+		for (u64 i = 0; i < producer_count + consumer_count; i++) {
+			os_thread_join(&threads[i]);
+			os_thread_destroy(&threads[i]);
+		}
+
+		assert(d.bad_items == 0, "Mpmc consumers got %llu bad items", d.bad_items);
+		assert(d.popped == producer_count*d.items_per_producer, "Popped %llu items", d.popped);
+		for (u64 i = 0; i < producer_count*d.items_per_producer; i++) {
+			assert(d.seen[i] == 1, "Item %llu came out %d times", i, (int)d.seen[i]);
+		}
+		dealloc(heap, d.seen);
+		mpmc_queue_deinit(&d.queue);
+	}
+
+	{
+		// Uncontended cost per item, compared to a spinlock around the same ring
+		const u64 rounds = 20000;
+		const u64 batch = 32;
+		u64 items[32] = {0};
+		Spsc_Queue s;
+		Mpmc_Queue m;
+		Spinlock lock;
+		spsc_queue_init(&s, sizeof(u64), 256, heap);
+		mpmc_queue_init(&m, sizeof(u64), 256, heap);
+		spinlock_init(&lock);
+
+		print("\n\tns per item push+pop, one thread:   single    batch of 32\n");
+		for (u64 kind = 0; kind < 3; kind++) {
+			string names[] = {STR("spsc"), STR("mpmc"), STR("spinlock+spsc")};
+			f64 ns[2];
+			for (u64 batched = 0; batched < 2; batched++) {
+				f64 start = os_get_elapsed_seconds();
+				for (u64 r = 0; r < rounds; r++) {
+					for (u64 i = 0; i < batch; i += (batched ? batch : 1)) {
+						u64 n = batched ? batch : 1;
+						if (kind == 0) spsc_queue_push_batch(&s, items, n);
+						if (kind == 1) mpmc_queue_push_batch(&m, items, n);
+						if (kind == 2) { spinlock_acquire_or_wait(&lock); spsc_queue_push_batch(&s, items, n); spinlock_release(&lock); }
+					}
+					for (u64 i = 0; i < batch; i += (batched ? batch : 1)) {
+						u64 n = batched ? batch : 1;
+						if (kind == 0) spsc_queue_pop_batch(&s, items, n);
+						if (kind == 1) mpmc_queue_pop_batch(&m, items, n);
+						if (kind == 2) { spinlock_acquire_or_wait(&lock); spsc_queue_pop_batch(&s, items, n); spinlock_release(&lock); }
+					}
+				}
+				ns[batched] = (os_get_elapsed_seconds() - start)*1e9/(f64)(rounds*batch);
+			}
+			print("\t%-35s %6.1f %12.1f\n", names[kind], ns[0], ns[1]);
+		}
+		assert(spsc_queue_get_count(&s) == 0 && mpmc_queue_get_count(&m) == 0, "Benchmark queues should be empty");
+		spsc_queue_deinit(&s);
+		mpmc_queue_deinit(&m);
+	}
+}
+
+#define RW_LOCK_TEST_ROUNDS 2000
+typedef struct RW_Lock_Test_Data {
+	RW_Lock lock;
+	volatile u64 readers_inside;
+	volatile u64 writers_inside;
+	u64 values[16]; // Writers keep these all equal
+	u64 write_count;
+	u64 bad_reads;
+} RW_Lock_Test_Data;
+void rw_lock_test_proc(Thread *t) {
+	RW_Lock_Test_Data *d = (RW_Lock_Test_Data*)t->data;
+	u64 seed = (u64)t;
+	for (u64 i = 0; i < RW_LOCK_TEST_ROUNDS; i++) {
+		seed = seed*6364136223846793005ull + 1442695040888963407ull;
+		if ((seed >> 60) < 3) {
+			rw_lock_acquire_write(&d->lock);
+			assert(d->writers_inside == 0 && d->readers_inside == 0, "Writer got in with someone else inside");
+			d->writers_inside += 1;
+			for (u64 j = 0; j < 16; j++) d->values[j] += 1;
+			d->write_count += 1;
+			d->writers_inside -= 1;
+			rw_lock_release_write(&d->lock);
+		} else {
+			rw_lock_acquire_read(&d->lock);
+			atomic_fetch_add_64(&d->readers_inside, 1, MEMORY_ORDER_RELAXED);
+			assert(d->writers_inside == 0, "Reader got in with a writer inside");
+			for (u64 j = 1; j < 16; j++) {
+				if (d->values[j] != d->values[0]) atomic_fetch_add_64(&d->bad_reads, 1, MEMORY_ORDER_RELAXED);
+			}
+			atomic_fetch_add_64(&d->readers_inside, -1, MEMORY_ORDER_RELAXED);
+			rw_lock_release_read(&d->lock);
+		}
+	}
+}
+void test_rw_lock() {
+	RW_Lock_Test_Data d = {0};
+	rw_lock_init(&d.lock);
+
+	// Many readers at once is fine
+	rw_lock_acquire_read(&d.lock);
+	rw_lock_acquire_read(&d.lock);
+	assert((d.lock.state & RW_LOCK_READER_MASK) == 2, "Expected 2 readers");
+	rw_lock_release_read(&d.lock);
+	rw_lock_release_read(&d.lock);
+	rw_lock_acquire_write(&d.lock);
+	assert(d.lock.state == RW_LOCK_WRITER, "Expected a writer");
+	rw_lock_release_write(&d.lock);
+	assert(d.lock.state == 0, "Expected nobody");
+
+	const u64 thread_count = 32;
+	Thread threads[32];
+	for (u64 i = 0; i < thread_count; i++) {
+		os_thread_init(&threads[i], rw_lock_test_proc);
+		threads[i].data = &d;
+		os_thread_start(&threads[i]);
+	}
+	for (u64 i = 0; i < thread_count; i++) {
+		os_thread_join(&threads[i]);
+		os_thread_destroy(&threads[i]);
+	}
+
+	assert(d.bad_reads == 0, "Readers saw %llu half written values", d.bad_reads);
+	assert(d.values[0] == d.write_count, "Lost writes");
+	assert(d.lock.state == 0, "Lock still held after all threads are done");
+}
+
+typedef enum Lock_Bench_Kind {
+	LOCK_BENCH_SPINLOCK,
+	LOCK_BENCH_MUTEX,
+	LOCK_BENCH_OS_MUTEX,
+	LOCK_BENCH_RW_WRITE,
+	LOCK_BENCH_RW_READ,
+	LOCK_BENCH_KIND_COUNT,
+} Lock_Bench_Kind;
+const char *lock_bench_names[LOCK_BENCH_KIND_COUNT] = {"Spinlock", "Mutex", "os mutex", "RW_Lock write", "RW_Lock read"};
+
+typedef struct Lock_Bench_Data {
+	Lock_Bench_Kind kind;
+	Spinlock spinlock;
+	Mutex mutex;
+	Mutex_Handle os_mutex;
+	RW_Lock rw_lock;
+	u64 ops_per_thread;
+	volatile u64 counter;
+	volatile bool go;
+} Lock_Bench_Data;
+
+void lock_bench_proc(Thread *t) {
+	Lock_Bench_Data *d = (Lock_Bench_Data*)t->data;
+	while (!d->go) os_yield_thread();
+	for (u64 i = 0; i < d->ops_per_thread; i++) {
+		switch (d->kind) {
+			case LOCK_BENCH_SPINLOCK:
+				spinlock_acquire_or_wait(&d->spinlock);
+				d->counter += 1;
+				spinlock_release(&d->spinlock);
+				break;
+			case LOCK_BENCH_MUTEX:
+				mutex_acquire_or_wait(&d->mutex);
+				d->counter += 1;
+				mutex_release(&d->mutex);
+				break;
+			case LOCK_BENCH_OS_MUTEX:
+				os_lock_mutex(d->os_mutex);
+				d->counter += 1;
+				os_unlock_mutex(d->os_mutex);
+				break;
+			case LOCK_BENCH_RW_WRITE:
+				rw_lock_acquire_write(&d->rw_lock);
+				d->counter += 1;
+				rw_lock_release_write(&d->rw_lock);
+				break;
+			case LOCK_BENCH_RW_READ:
+				rw_lock_acquire_read(&d->rw_lock);
+				(void)d->counter;
+				rw_lock_release_read(&d->rw_lock);
+				break;
+			default: break;
+		}
+	}
+}
+
+void test_lock_performance() {
+	Allocator heap = get_heap_allocator();
+	u64 max_thread_count = max(os_get_number_of_logical_processors(), 4);
+	Thread *threads = (Thread*)alloc(heap, max_thread_count*sizeof(Thread));
+
+	print("\n\tns per acquire+release, all threads hammering one lock:\n\t%-14s", "threads");
+	for (u64 thread_count = 1; thread_count <= max_thread_count; thread_count *= 2) print("%9llu", thread_count);
+	print("\n");
+
+	for (u64 kind = 0; kind < LOCK_BENCH_KIND_COUNT; kind++) {
+		print("\t%-14s", lock_bench_names[kind]);
+		for (u64 thread_count = 1; thread_count <= max_thread_count; thread_count *= 2) {
+			Lock_Bench_Data d = {0};
+			d.kind = (Lock_Bench_Kind)kind;
+			spinlock_init(&d.spinlock);
+			mutex_init(&d.mutex);
+			d.os_mutex = os_make_mutex();
+			rw_lock_init(&d.rw_lock);
+			d.ops_per_thread = 400000 / thread_count;
+
+			for (u64 i = 0; i < thread_count; i++) {
+				os_thread_init(&threads[i], lock_bench_proc);
+				threads[i].data = &d;
+				os_thread_start(&threads[i]);
+			}
+			f64 start = os_get_elapsed_seconds();
+			d.go = true;
+			for (u64 i = 0; i < thread_count; i++) {
+				os_thread_join(&threads[i]);
+				os_thread_destroy(&threads[i]);
+			}
+			f64 seconds = os_get_elapsed_seconds() - start;
+
+			u64 ops = d.ops_per_thread*thread_count;
+			if (kind != LOCK_BENCH_RW_READ) assert(d.counter == ops, "Lock didn't protect the counter");
+			print("%9.1f", seconds*1e9/(f64)ops);
+
+#if ENABLE_LOCK_STATS
+			if (thread_count*2 > max_thread_count) {
+				Lock_Stats *stats = 0;
+				if (kind == LOCK_BENCH_SPINLOCK) stats = &d.spinlock.stats;
+				if (kind == LOCK_BENCH_MUTEX) stats = &d.mutex.stats;
+				if (kind == LOCK_BENCH_RW_WRITE || kind == LOCK_BENCH_RW_READ) stats = &d.rw_lock.stats;
+				if (stats) {
+					print("   (%llu acquisitions, %llu contended, %llu spins, %llu sleeps)",
+						stats->acquisitions, stats->contended, stats->spins, stats->sleeps);
+					assert(stats->acquisitions == ops, "Lock stats missed acquisitions");
+				}
+			}
+#endif
+			os_destroy_mutex(d.os_mutex);
+		}
+		print("\n");
+	}
+
+	dealloc(heap, threads);
+}
+
+#define PROFILER_TEST_FRAMES 10
+#define PROFILER_TEST_SCOPES_PER_FRAME 1000
+typedef struct Profiler_Test_Data {
+	u64 outer_count; // How many outer scopes made it into the trace
+	u64 inner_count;
+	u64 allocated_blocks;
+	u64 overwritten_events;
+} Profiler_Test_Data;
+u64 profiler_test_count_in_trace(string trace, string needle) {
+	u64 count = 0;
+	while (true) {
+		s64 i = string_find_from_left(trace, needle);
+		if (i < 0) break;
+		count += 1;
+		trace = string_view(trace, i + needle.count, trace.count - i - needle.count);
+	}
+	return count;
+}
+void profiler_test_proc(Thread *t) {
+	Profiler_Test_Data *d = (Profiler_Test_Data*)t->data;
+	volatile u64 sink = 0;
+	for (u64 frame = 0; frame < PROFILER_TEST_FRAMES; frame++) {
+		profiler_mark_frame();
+		for (u64 i = 0; i < PROFILER_TEST_SCOPES_PER_FRAME; i++) {
+			_tm_scope("profiler test outer") {
+				_tm_scope("profiler test inner") sink += i;
+			}
+		}
+	}
+
+	String_Builder trace;
+	string_builder_init(&trace, get_heap_allocator());
+	profiler_write_trace(&trace);
+	d->outer_count = profiler_test_count_in_trace(trace.result, STR("\"name\":\"profiler test outer\""));
+	d->inner_count = profiler_test_count_in_trace(trace.result, STR("\"name\":\"profiler test inner\""));
+	string_builder_deinit(&trace);
+
+	Profiler_Thread_Buffer *b = _profiler_thread_buffer;
+	for (u64 i = 0; i < PROFILER_MAX_BLOCKS_PER_THREAD; i++) d->allocated_blocks += b->blocks[i] != 0;
+	d->overwritten_events = b->overwritten_events;
+
+	_profiler_discard_thread_buffer();
+}
+void profiler_bench_proc(Thread *t) {
+	const u64 scope_count = 500000;
+	volatile u64 sink = 0;
+
+	f64 start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < scope_count; i++) sink += i;
+	f64 baseline = os_get_elapsed_seconds() - start;
+
+	start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < scope_count; i++) _tm_scope("profiler bench") sink += i;
+	f64 binary = os_get_elapsed_seconds() - start - baseline;
+
+	// What tm_scope used to do: format json into a shared builder under a lock
+	String_Builder json;
+	string_builder_init_reserve(&json, 1024*1000, get_heap_allocator());
+	Spinlock lock;
+	spinlock_init(&lock);
+	start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < scope_count; i++) {
+		f64 scope_start = os_get_elapsed_seconds();
+		sink += i;
+		f64 elapsed = os_get_elapsed_seconds() - scope_start;
+		spinlock_acquire_or_wait(&lock);
+		string_builder_print(&json, STR("{\"cat\":\"function\",\"dur\":%.3f,\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%zu,\"ts\":%.3f},"),
+			elapsed*1000000, STR("profiler bench"), get_context().thread_id, scope_start*1000000);
+		spinlock_release(&lock);
+	}
+	f64 json_seconds = os_get_elapsed_seconds() - start - baseline;
+	string_builder_deinit(&json);
+
+	print("\n\tns per scope: binary %.1f, old json %.1f (%.1fx)\n",
+		binary*1e9/(f64)scope_count, json_seconds*1e9/(f64)scope_count, json_seconds/binary);
+
+	_profiler_discard_thread_buffer();
+}
+void test_profiler() {
+	// Interned by pointer, but the same text at another address gets the same id
+	char copy[] = "profiler test outer";
+	u32 id = _profiler_get_name_id("profiler test outer");
+	assert(id != 0, "Expected a name id");
+	assert(_profiler_get_name_id("profiler test outer") == id, "Name ids should be stable");
+	assert(_profiler_get_name_id(copy) == id, "Same name at another address should get the same id");
+	assert(_profiler_get_name_id("profiler test inner") != id, "Different names should get different ids");
+	assert(strings_match(profiler_get_name(id), STR("profiler test outer")), "Bad name for id");
+
+	Thread t;
+	u64 total_scopes = PROFILER_TEST_FRAMES*PROFILER_TEST_SCOPES_PER_FRAME;
+
+	// Keeps everything
+	Profiler_Test_Data d = {0};
+	os_thread_init(&t, profiler_test_proc);
+	t.data = &d;
+	os_thread_start(&t);
+	os_thread_join(&t);
+	os_thread_destroy(&t);
+	assert(d.outer_count == total_scopes && d.inner_count == total_scopes, "Expected %llu scopes, got %llu outer & %llu inner", total_scopes, d.outer_count, d.inner_count);
+	assert(d.overwritten_events == 0, "Nothing should be overwritten");
+
+	// Only the last 3 frames, and not more than about 8k events of memory
+	profiler_keep_last_frames(3, 8192);
+	Profiler_Test_Data bounded = {0};
+	os_thread_init(&t, profiler_test_proc);
+	t.data = &bounded;
+	os_thread_start(&t);
+	os_thread_join(&t);
+	os_thread_destroy(&t);
+	profiler_keep_last_frames(0, 0);
+	u64 kept_scopes = 3*PROFILER_TEST_SCOPES_PER_FRAME;
+	assert(bounded.outer_count == kept_scopes && bounded.inner_count == kept_scopes, "Expected %llu scopes, got %llu outer & %llu inner", kept_scopes, bounded.outer_count, bounded.inner_count);
+	assert(bounded.allocated_blocks == 3, "Expected 3 blocks, got %llu", bounded.allocated_blocks);
+	assert(bounded.overwritten_events > 0, "Expected old events to be overwritten");
+
+	os_thread_init(&t, profiler_bench_proc);
+	os_thread_start(&t);
+	os_thread_join(&t);
+	os_thread_destroy(&t);
+}
+
+#define PROFILER_STATS_TEST_FRAMES 100
+#define PROFILER_STATS_TEST_CALLS 10
+void profiler_stats_test_proc(Thread *t) {
+	// Made up durations so we know what the stats should be: 1000, 2000, ... 1000000 ticks
+	u32 name_id = _profiler_get_name_id("profiler stats test");
+	for (u64 frame = 0; frame < PROFILER_STATS_TEST_FRAMES; frame++) {
+		profiler_mark_frame();
+		for (u64 i = 0; i < PROFILER_STATS_TEST_CALLS; i++) {
+			u64 ticks = (frame*PROFILER_STATS_TEST_CALLS + i + 1)*1000;
+			_profiler_report_scope(name_id, 1000, 1000 + ticks);
+		}
+	}
+	profiler_mark_frame(); // The last frame only counts once it's done
+	_profiler_discard_thread_buffer();
+}
+void test_profiler_stats() {
+	Thread t;
+	os_thread_init(&t, profiler_stats_test_proc);
+	os_thread_start(&t);
+	os_thread_join(&t);
+	os_thread_destroy(&t);
+
+	f64 ticks_per_second = profiler_get_ticks_per_second();
+	u64 calls = PROFILER_STATS_TEST_FRAMES*PROFILER_STATS_TEST_CALLS;
+
+	Profiler_Scope_Stats stats;
+	assert(!profiler_get_scope_stats(STR("profiler stats test that never ran"), &stats), "Unknown scope should have no stats");
+	assert(profiler_get_scope_stats(STR("profiler stats test"), &stats), "Expected stats");
+	assert(stats.count == calls, "Expected %llu calls, got %llu", calls, stats.count);
+	assert(stats.frame_count >= PROFILER_STATS_TEST_FRAMES, "Expected at least %d frames, got %llu", PROFILER_STATS_TEST_FRAMES, stats.frame_count);
+
+	// The tick rate is measured again every call so it moves a tiny bit
+	#define ticks_match(seconds, ticks) (fabs((seconds)*ticks_per_second - (f64)(ticks)) <= (f64)(ticks)*1e-4)
+	assert(ticks_match(stats.min_seconds, 1000), "Bad min %f", stats.min_seconds*ticks_per_second);
+	assert(ticks_match(stats.max_seconds, calls*1000), "Bad max %f", stats.max_seconds*ticks_per_second);
+	assert(ticks_match(stats.total_seconds, calls*(calls + 1)/2*1000), "Bad total %f", stats.total_seconds*ticks_per_second);
+	assert(ticks_match(stats.p50_seconds, 501000), "Bad p50 %f", stats.p50_seconds*ticks_per_second);
+	assert(ticks_match(stats.p95_seconds, 950000), "Bad p95 %f", stats.p95_seconds*ticks_per_second);
+	assert(ticks_match(stats.p99_seconds, 990000), "Bad p99 %f", stats.p99_seconds*ticks_per_second);
+	u64 last_frame_ticks = 0;
+	for (u64 i = calls - PROFILER_STATS_TEST_CALLS; i < calls; i++) last_frame_ticks += (i + 1)*1000;
+	assert(ticks_match(stats.last_frame_seconds, last_frame_ticks), "Bad last frame %f", stats.last_frame_seconds*ticks_per_second);
+	assert(fabs(stats.seconds_per_frame - stats.total_seconds/stats.frame_count) < 1e-12, "Bad seconds per frame");
+	#undef ticks_match
+
+	Profiler_Scope_Stats top[8];
+	u64 top_count = profiler_get_top_scopes(top, 8);
+	bool found = false;
+	for (u64 i = 0; i < top_count; i++) {
+		if (strings_match(top[i].name, STR("profiler stats test"))) found = true;
+		if (i) assert(top[i].seconds_per_frame <= top[i-1].seconds_per_frame, "Top scopes should be sorted");
+	}
+	assert(found, "Expected the test scope in the top scopes");
+
+	Profiler_Frame_Stats frames = profiler_get_frame_stats();
+	assert(frames.frame_count >= PROFILER_STATS_TEST_FRAMES, "Expected at least %d frames, got %llu", PROFILER_STATS_TEST_FRAMES, frames.frame_count);
+	u64 histogram_total = 0;
+	for (u64 i = 0; i < PROFILER_FRAME_HISTOGRAM_BUCKETS; i++) histogram_total += frames.histogram[i];
+	assert(histogram_total == frames.frame_count, "Histogram should have every frame");
+	assert(frames.min_seconds <= frames.p50_seconds && frames.p50_seconds <= frames.p95_seconds
+		&& frames.p95_seconds <= frames.p99_seconds && frames.p99_seconds <= frames.max_seconds, "Frame percentiles out of order");
+	assert(frames.min_seconds <= frames.average_seconds && frames.average_seconds <= frames.max_seconds, "Bad frame average");
+}
+
 #ifndef OOGABOOGA_HEADLESS
 int compare_draw_quads(const void *a, const void *b) {
     return ((Draw_Quad*)a)->z-((Draw_Quad*)b)->z;
@@ -1501,6 +3795,175 @@ void test_sort() {
 }
 #endif /* OOGABOOGA_HEADLESS */
 
+void quad_batch_test_fill(Bucket_Array *quads, u64 count, Gfx_Image **images, u64 image_count, s32 z_range) {
+	bucket_array_clear(quads);
+	for (u64 i = 0; i < count; i++) {
+		Draw_Quad *q = (Draw_Quad*)bucket_array_add_empty(quads);
+		memset(q, 0, sizeof(Draw_Quad));
+		float32 x = (float32)(i % 1000) / 500.0 - 1.0;
+		float32 y = (float32)(i / 1000) / 500.0 - 1.0;
+		q->bottom_left  = v2(x, y);
+		q->top_left     = v2(x, y + 0.01);
+		q->top_right    = v2(x + 0.01, y + 0.01);
+		q->bottom_right = v2(x + 0.01, y);
+		q->color = v4(1, 0.5, 0.25, 1);
+		q->z = (s32)get_random_int_in_range(-z_range, z_range);
+		q->type = (u8)(i % 3);
+		u64 r = get_random() >> 16;
+		// Mostly runs of the same image, like a game drawing a tilemap then some sprites
+		if (r % 4 != 0) q->image = images[(i / 64) % image_count];
+		q->image_min_filter = (Gfx_Filter_Mode)(r % 2);
+		q->image_mag_filter = (Gfx_Filter_Mode)((r >> 1) % 2);
+		q->uv = v4(0, 0, 1, 1);
+		q->has_scissor = (r >> 2) % 2;
+		q->scissor = v4(10, 20, 110, 220);
+		q->userdata[0] = v4((float32)i, 0, 0, 0);
+	}
+}
+
+void test_quad_batcher() {
+	// Images are only compared by pointer in quad_batch.c so fake ones are fine
+	const u64 image_count = 40;
+	Gfx_Image *images[40];
+	for (u64 i = 0; i < image_count; i++) images[i] = (Gfx_Image*)((i+1)*64);
+
+	///
+	// Correctness
+	{
+		const u64 n = 50000;
+		Bucket_Array quads;
+		bucket_array_init(&quads, sizeof(Draw_Quad), 1000, get_heap_allocator());
+		quad_batch_test_fill(&quads, n, images, image_count, 100);
+
+		Quad_Vertex *a = alloc(get_heap_allocator(), n*4*sizeof(Quad_Vertex));
+		Quad_Vertex *b = alloc(get_heap_allocator(), n*4*sizeof(Quad_Vertex));
+
+		Quad_Batcher batcher = ZERO(Quad_Batcher);
+		quad_batcher_prepare(&batcher, &quads, true, QUAD_BATCH_MAX_TEXTURES);
+
+		// Stable sort by z
+		for (u64 p = 1; p < n; p++) {
+			Draw_Quad *prev = (Draw_Quad*)bucket_array_get(&quads, batcher.order[p-1]);
+			Draw_Quad *q = (Draw_Quad*)bucket_array_get(&quads, batcher.order[p]);
+			assert(prev->z <= q->z, "Quads not sorted by z");
+			if (prev->z == q->z) {
+				assert(batcher.order[p-1] < batcher.order[p], "Sort is not stable");
+			}
+		}
+
+		// Batches cover every quad and texture indices point to the right image
+		u64 batch_count = growing_array_get_valid_count(batcher.batches);
+		assert(batch_count > 1, "40 images should need more than one batch of 32");
+		u64 next_first = 0;
+		for (u64 i = 0; i < batch_count; i++) {
+			Quad_Batch *batch = &batcher.batches[i];
+			assert(batch->first_quad == next_first, "Batches have gaps");
+			assert(batch->image_count <= QUAD_BATCH_MAX_TEXTURES, "Too many images in batch");
+			for (u64 p = batch->first_quad; p < batch->first_quad + batch->quad_count; p++) {
+				Draw_Quad *q = (Draw_Quad*)bucket_array_get(&quads, batcher.order[p]);
+				s8 ti = batcher.texture_indices[p];
+				if (q->image) {
+					assert(ti >= 0 && batch->images[ti] == q->image, "Wrong texture index");
+				} else {
+					assert(ti == -1, "Quad without image got a texture index");
+				}
+			}
+			next_first += batch->quad_count;
+		}
+		assert(next_first == n, "Batches don't cover all quads");
+
+		// One thread and many threads must write the exact same thing
+		batcher.thread_count = 1;
+		quad_batcher_expand(&batcher, a, 600);
+		batcher.thread_count = 7;
+		quad_batcher_expand(&batcher, b, 600);
+		assert(memcmp(a, b, n*4*sizeof(Quad_Vertex)) == 0, "Threaded expand is different from single threaded");
+
+		for (u64 p = 0; p < n; p += 997) {
+			Draw_Quad *q = (Draw_Quad*)bucket_array_get(&quads, batcher.order[p]);
+			Quad_Vertex *v = a + p*4;
+			assert(v[0].position.x == q->bottom_left.x && v[0].position.y == q->bottom_left.y, "Bad BL");
+			assert(v[2].position.x == q->top_right.x && v[2].position.y == q->top_right.y, "Bad TR");
+			assert(v[1].uv.x == q->uv.x1 && v[1].uv.y == q->uv.y2, "Bad TL uv");
+			assert(v[3].userdata[0].x == q->userdata[0].x, "Bad userdata");
+			assert(v[3].type == q->type && v[3].has_scissor == q->has_scissor, "Bad flags");
+			assert(v[0].scissor.y1 == 600-220 && v[0].scissor.y2 == 600-20, "Scissor not flipped");
+		}
+
+		// Not sorting keeps submission order
+		quad_batcher_prepare(&batcher, &quads, false, QUAD_BATCH_MAX_TEXTURES);
+		quad_batcher_expand(&batcher, a, 600);
+		for (u64 p = 0; p < n; p += 991) {
+			assert(a[p*4].userdata[0].x == (float32)p, "Unsorted expand changed the order");
+		}
+
+		// Empty frame
+		bucket_array_clear(&quads);
+		quad_batcher_prepare(&batcher, &quads, true, QUAD_BATCH_MAX_TEXTURES);
+		quad_batcher_expand(&batcher, a, 600);
+		assert(growing_array_get_valid_count(batcher.batches) == 0, "Empty frame has batches");
+
+		quad_batcher_destroy(&batcher);
+		bucket_array_deinit(&quads);
+		dealloc(get_heap_allocator(), a);
+		dealloc(get_heap_allocator(), b);
+	}
+
+	///
+	// Quads per second
+	{
+		const u64 n = 200000;
+		const u64 iterations = 20;
+		Bucket_Array quads;
+		bucket_array_init(&quads, sizeof(Draw_Quad), DRAW_FRAME_QUADS_PER_BUCKET, get_heap_allocator());
+		Draw_Quad *flat_quads = alloc(get_heap_allocator(), n*sizeof(Draw_Quad));
+		Draw_Quad *sort_buffer = alloc(get_heap_allocator(), n*sizeof(Draw_Quad));
+		Quad_Vertex *out = alloc(get_heap_allocator(), n*4*sizeof(Quad_Vertex));
+		quad_batch_test_fill(&quads, n, images, image_count, 1000);
+		for (u64 i = 0; i < n; i++) flat_quads[i] = *(Draw_Quad*)bucket_array_get(&quads, i);
+
+		// What we used to do, sort the quads themselves
+		f64 start = os_get_elapsed_seconds();
+		for (u64 i = 0; i < iterations; i++) {
+			radix_sort(flat_quads, sort_buffer, n, sizeof(Draw_Quad), offsetof(Draw_Quad, z), MAX_Z_BITS);
+		}
+		f64 quad_sort_ms = (os_get_elapsed_seconds() - start)*1000.0/iterations;
+
+		Quad_Batcher batcher = ZERO(Quad_Batcher);
+		u64 thread_counts[] = {1, 0};
+		for (u64 t = 0; t < sizeof(thread_counts)/sizeof(u64); t++) {
+			batcher.thread_count = thread_counts[t];
+
+			// Warm up, first expand faults in the output pages & starts the workers
+			quad_batcher_prepare(&batcher, &quads, true, QUAD_BATCH_MAX_TEXTURES);
+			quad_batcher_expand(&batcher, out, 600);
+
+			f64 prepare_seconds = 0;
+			f64 expand_seconds = 0;
+			for (u64 i = 0; i < iterations; i++) {
+				start = os_get_elapsed_seconds();
+				quad_batcher_prepare(&batcher, &quads, true, QUAD_BATCH_MAX_TEXTURES);
+				f64 mid = os_get_elapsed_seconds();
+				quad_batcher_expand(&batcher, out, 600);
+				prepare_seconds += mid - start;
+				expand_seconds += os_get_elapsed_seconds() - mid;
+			}
+
+			u64 threads = thread_counts[t] ? thread_counts[t] : min(job_system_get_worker_count() + 1, QUAD_EXPAND_MAX_THREADS);
+			f64 quads_per_second = (f64)(n*iterations) / (prepare_seconds + expand_seconds);
+			print("\n    %llu quads, %llu thread(s): sort+batch %.2fms, expand %.2fms, %.1fm quads/s",
+				n, threads, prepare_seconds*1000.0/iterations, expand_seconds*1000.0/iterations, quads_per_second/1000000.0);
+		}
+		print("\n    (radix sorting the Draw_Quad's themselves took %.2fms)\n", quad_sort_ms);
+
+		quad_batcher_destroy(&batcher);
+		bucket_array_deinit(&quads);
+		dealloc(get_heap_allocator(), flat_quads);
+		dealloc(get_heap_allocator(), sort_buffer);
+		dealloc(get_heap_allocator(), out);
+	}
+}
+
 typedef struct Test_Thing {
     int foo;
     float bar;
@@ -1567,10 +4030,175 @@ void test_growing_array() {
     assert(growing_array_get_valid_count(things) == 99, "Failed: growing_array_get_valid_count");
 }
 
+void test_bucket_array() {
+	Bucket_Array things;
+	bucket_array_init(&things, sizeof(Test_Thing), 10, get_heap_allocator());
+	assert(things.bucket_shift == 4, "Items per bucket should round up to a power of two");
+	assert(bucket_array_get_bucket_count(&things) == 0, "Failed: bucket_array_get_bucket_count");
+
+	Test_Thing new_thing;
+	new_thing.foo = 5;
+	new_thing.bar = 420.69;
+	Test_Thing *first = (Test_Thing*)bucket_array_add(&things, &new_thing);
+	assert(things.count == 1, "Failed: bucket_array_add");
+	assert(first->foo == 5 && floats_roughly_match(first->bar, 420.69), "Failed: bucket_array_add");
+
+	// Pointers don't move no matter how much we add
+	Test_Thing *pointers[1000];
+	pointers[0] = first;
+	for (u32 i = 1; i < 1000; i += 1) {
+		new_thing.foo = i;
+		new_thing.bar = i * 4.0;
+		pointers[i] = (Test_Thing*)bucket_array_add(&things, &new_thing);
+	}
+	assert(things.count == 1000, "Failed: bucket_array_add");
+	assert(bucket_array_get_bucket_count(&things) == 63, "Failed: bucket_array_get_bucket_count");
+	assert(first->foo == 5, "First item moved or got overwritten");
+	for (u32 i = 1; i < 1000; i += 1) {
+		Test_Thing *thing = (Test_Thing*)bucket_array_get(&things, i);
+		assert(thing == pointers[i], "Item moved");
+		assert(thing->foo == (int)i && floats_roughly_match(thing->bar, i * 4.0), "Failed: bucket_array_get");
+	}
+
+	// Bucket by bucket sees every item once, in order
+	u64 seen = 0;
+	for (u64 b = 0; b < bucket_array_get_bucket_count(&things); b += 1) {
+		u64 count;
+		Test_Thing *bucket = (Test_Thing*)bucket_array_get_bucket(&things, b, &count);
+		assert(count == (b == 62 ? 1000 - 62*16 : 16), "Wrong bucket item count");
+		for (u64 i = 0; i < count; i += 1) {
+			assert(&bucket[i] == pointers[seen], "Bucket iteration out of order");
+			seen += 1;
+		}
+	}
+	assert(seen == 1000, "Bucket iteration missed items");
+
+	bucket_array_pop(&things);
+	assert(things.count == 999, "Failed: bucket_array_pop");
+
+	// Clear keeps the buckets, so adding again reuses the same memory
+	u64 bucket_count = things.bucket_count;
+	bucket_array_clear(&things);
+	assert(things.count == 0, "Failed: bucket_array_clear");
+	for (u32 i = 0; i < 1000; i += 1) {
+		Test_Thing *thing = (Test_Thing*)bucket_array_add_empty(&things);
+		assert(thing == pointers[i], "Clear didn't reuse the buckets");
+	}
+	assert(things.bucket_count == bucket_count, "Clear didn't keep the buckets");
+
+	bucket_array_deinit(&things);
+	assert(things.buckets == 0 && things.count == 0, "Failed: bucket_array_deinit");
+
+	bucket_array_init_reserve(&things, sizeof(Test_Thing), 64, 100, get_heap_allocator());
+	assert(things.bucket_count == 2 && things.count == 0, "Failed: bucket_array_init_reserve");
+	bucket_array_deinit(&things);
+}
+
+void test_bucket_array_performance() {
+	// Draw_Quad's, since that's what Draw_Frame keeps in one
+	Allocator heap = get_heap_allocator();
+	const u64 counts[] = { 1000, 50000, 200000 };
+	const u64 rounds = 10;
+
+	Draw_Quad quad = ZERO(Draw_Quad);
+	quad.color = v4(1, 1, 1, 1);
+
+	print("\n");
+	for (u64 c = 0; c < sizeof(counts)/sizeof(counts[0]); c += 1) {
+		u64 n = counts[c];
+
+		// Fresh: starting from nothing every round, so growing array copies on every grow
+		f64 growing_fresh = 0;
+		f64 bucket_fresh = 0;
+		for (u64 r = 0; r < rounds; r += 1) {
+			Draw_Quad *quads;
+			growing_array_init((void**)&quads, sizeof(Draw_Quad), heap);
+			f64 start = os_get_elapsed_seconds();
+			for (u64 i = 0; i < n; i += 1) {
+				quad.z = (s32)i;
+				growing_array_add((void**)&quads, &quad);
+			}
+			growing_fresh += os_get_elapsed_seconds()-start;
+			growing_array_deinit((void**)&quads);
+
+			Bucket_Array bucket_quads;
+			bucket_array_init(&bucket_quads, sizeof(Draw_Quad), DRAW_FRAME_QUADS_PER_BUCKET, heap);
+			start = os_get_elapsed_seconds();
+			for (u64 i = 0; i < n; i += 1) {
+				quad.z = (s32)i;
+				bucket_array_add(&bucket_quads, &quad);
+			}
+			bucket_fresh += os_get_elapsed_seconds()-start;
+			bucket_array_deinit(&bucket_quads);
+		}
+
+		// Reused: cleared and filled again, like a draw frame after the first frame
+		Draw_Quad *quads;
+		growing_array_init((void**)&quads, sizeof(Draw_Quad), heap);
+		Bucket_Array bucket_quads;
+		bucket_array_init(&bucket_quads, sizeof(Draw_Quad), DRAW_FRAME_QUADS_PER_BUCKET, heap);
+		f64 growing_reused = 0;
+		f64 bucket_reused = 0;
+		for (u64 r = 0; r < rounds+1; r += 1) {
+			growing_array_clear((void**)&quads);
+			f64 start = os_get_elapsed_seconds();
+			for (u64 i = 0; i < n; i += 1) {
+				quad.z = (s32)i;
+				growing_array_add((void**)&quads, &quad);
+			}
+			if (r) growing_reused += os_get_elapsed_seconds()-start;
+
+			bucket_array_clear(&bucket_quads);
+			start = os_get_elapsed_seconds();
+			for (u64 i = 0; i < n; i += 1) {
+				quad.z = (s32)i;
+				bucket_array_add(&bucket_quads, &quad);
+			}
+			if (r) bucket_reused += os_get_elapsed_seconds()-start;
+		}
+
+		// Iterate
+		s64 growing_sum = 0;
+		f64 start = os_get_elapsed_seconds();
+		for (u64 r = 0; r < rounds; r += 1) {
+			for (u64 i = 0; i < n; i += 1) growing_sum += quads[i].z;
+		}
+		f64 growing_iterate = os_get_elapsed_seconds()-start;
+
+		s64 bucket_sum = 0;
+		start = os_get_elapsed_seconds();
+		for (u64 r = 0; r < rounds; r += 1) {
+			for (u64 b = 0; b < bucket_array_get_bucket_count(&bucket_quads); b += 1) {
+				u64 count;
+				Draw_Quad *bucket = (Draw_Quad*)bucket_array_get_bucket(&bucket_quads, b, &count);
+				for (u64 i = 0; i < count; i += 1) bucket_sum += bucket[i].z;
+			}
+		}
+		f64 bucket_iterate = os_get_elapsed_seconds()-start;
+
+		s64 index_sum = 0;
+		start = os_get_elapsed_seconds();
+		for (u64 r = 0; r < rounds; r += 1) {
+			for (u64 i = 0; i < bucket_quads.count; i += 1) index_sum += ((Draw_Quad*)bucket_array_get(&bucket_quads, i))->z;
+		}
+		f64 index_iterate = os_get_elapsed_seconds()-start;
+
+		assert(growing_sum == bucket_sum && bucket_sum == index_sum, "Bucket array and growing array disagree");
+
+		growing_array_deinit((void**)&quads);
+		bucket_array_deinit(&bucket_quads);
+
+		f64 to_ns = 1e9/(f64)(n*rounds);
+		print("\t%6llu quads, ns per quad. Add fresh: growing %5.1f, bucket %5.1f. Add reused: growing %5.1f, bucket %5.1f. Iterate: growing %4.2f, by bucket %4.2f, by index %4.2f\n",
+			n, growing_fresh*to_ns, bucket_fresh*to_ns, growing_reused*to_ns, bucket_reused*to_ns,
+			growing_iterate*to_ns, bucket_iterate*to_ns, index_iterate*to_ns);
+	}
+}
+
 
 typedef struct {
     Binary_Semaphore *sem;
-    volatile LONG *counter;
+    volatile u64 *counter;
     int increments;
 } Test_Args;
 
@@ -1578,7 +4206,8 @@ void increment_thread_proc(Thread *t) {
     Test_Args *test_args = (Test_Args *)t->data;
     for (int i = 0; i < test_args->increments; i++) {
         os_binary_semaphore_wait(test_args->sem);
-        InterlockedIncrement(test_args->counter);
+        u64 old;
+        do { old = *test_args->counter; } while (!compare_and_swap_64(test_args->counter, old+1, old));
         os_binary_semaphore_signal(test_args->sem);
     }
 }
@@ -1591,7 +4220,7 @@ void test_os_binary_semaphore() {
         Binary_Semaphore sem;
         os_binary_semaphore_init(&sem, true);
 
-        LONG counter = 0;
+        u64 counter = 0;
         Thread threads[num_threads];
         Test_Args args = { &sem, &counter, increments_per_thread };
 
@@ -1616,7 +4245,7 @@ void test_os_binary_semaphore() {
         Binary_Semaphore sem;
         os_binary_semaphore_init(&sem, false);
 
-        LONG counter = 0;
+        u64 counter = 0;
 
         Thread thread;
         Test_Args args = { &sem, &counter, 1 };
@@ -1625,7 +4254,7 @@ void test_os_binary_semaphore() {
         os_thread_start(&thread);
 
         // Signal the semaphore after a delay
-        Sleep(100);
+        os_sleep(100);
         os_binary_semaphore_signal(&sem);
 
         os_thread_join(&thread);
@@ -1644,7 +4273,7 @@ void test_os_binary_semaphore() {
         Binary_Semaphore sem;
         os_binary_semaphore_init(&sem, true);
 
-        LONG counter = 0;
+        u64 counter = 0;
         Thread threads[num_threads];
         Test_Args args = { &sem, &counter, increments_per_thread };
 
@@ -1669,7 +4298,7 @@ void test_os_binary_semaphore() {
         Binary_Semaphore sem;
         os_binary_semaphore_init(&sem, false);
 
-        LONG counter = 0;
+        u64 counter = 0;
 
         Thread thread1, thread2;
         Test_Args args1 = { &sem, &counter, 1 };
@@ -1698,16 +4327,306 @@ void test_os_binary_semaphore() {
 
 }
 
+typedef struct Job_Test_Data {
+	volatile u64 *hits;
+	u64 count;
+	volatile u64 sum;
+} Job_Test_Data;
+
+void job_test_hit(void *data) {
+	u64 *slot = (u64*)data;
+	*slot += 1;
+}
+void job_test_hit_range(u64 first, u64 last, void *data) {
+	Job_Test_Data *d = (Job_Test_Data*)data;
+	u64 sum = 0;
+	for (u64 i = first; i < last; i++) {
+		d->hits[i] += 1;
+		sum += i;
+	}
+	u64 old;
+	do { old = d->sum; } while (!compare_and_swap_64(&d->sum, old+sum, old));
+}
+void job_test_nested(void *data) {
+	// Jobs that wait for their own jobs, the waiting worker has to help out or this deadlocks
+	Job_Test_Data *d = (Job_Test_Data*)data;
+	parallel_for(0, d->count, 16, job_test_hit_range, d);
+}
+void job_test_talloc(void *data) {
+	for (u64 i = 0; i < 64; i++) {
+		u8 *p = (u8*)talloc(KB(16));
+		memset(p, 0xAB, KB(16));
+	}
+	job_test_hit(data);
+}
+void job_test_outside_thread_proc(Thread *t) {
+	Job_Test_Data *d = (Job_Test_Data*)t->data;
+	parallel_for(0, d->count, 100, job_test_hit_range, d);
+}
+
+typedef struct Job_Test_Lazy_Init {
+	Job_Test_Data data[4];
+	volatile u64 starters;
+	volatile u64 done;
+} Job_Test_Lazy_Init;
+Job_Test_Lazy_Init job_test_lazy_init;
+void job_test_lazy_init_thread_proc(Thread *t) {
+	Job_Test_Data *d = (Job_Test_Data*)t->data;
+	parallel_for(0, d->count, 10, job_test_hit_range, d);
+
+	// The thread that started it is queue 0 and has to shut it down, after everyone is done with it
+	if (job_thread_index == 0) atomic_fetch_add_64(&job_test_lazy_init.starters, 1, MEMORY_ORDER_RELAXED);
+	atomic_fetch_add_64(&job_test_lazy_init.done, 1, MEMORY_ORDER_RELEASE);
+	if (job_thread_index == 0) {
+		while (atomic_load_64(&job_test_lazy_init.done, MEMORY_ORDER_ACQUIRE) < 4) os_yield_thread();
+		job_system_shutdown();
+	}
+}
+
+void test_job_system() {
+	Allocator heap = get_heap_allocator();
+
+	// Several threads running their first job at once, only one of them may start the job system
+	{
+		u64 *lazy_hits = (u64*)alloc(heap, 4*1000*sizeof(u64));
+		memset(lazy_hits, 0, 4*1000*sizeof(u64));
+		memset(&job_test_lazy_init, 0, sizeof(job_test_lazy_init));
+		Thread threads[4];
+		for (u64 i = 0; i < 4; i++) {
+			job_test_lazy_init.data[i] = (Job_Test_Data){lazy_hits + i*1000, 1000, 0};
+			os_thread_init(&threads[i], job_test_lazy_init_thread_proc);
+			threads[i].data = &job_test_lazy_init.data[i];
+		}
+		for (u64 i = 0; i < 4; i++) os_thread_start(&threads[i]);
+		for (u64 i = 0; i < 4; i++) os_thread_join(&threads[i]);
+		for (u64 i = 0; i < 4; i++) os_thread_destroy(&threads[i]);
+
+		assert(job_test_lazy_init.starters == 1, "%llu threads started the job system", job_test_lazy_init.starters);
+		assert(!job_system_is_ready(), "Job system wasn't shut down");
+		for (u64 i = 0; i < 4*1000; i++) assert(lazy_hits[i] == 1, "Lazy init parallel_for missed index %llu", i);
+		dealloc(heap, lazy_hits);
+	}
+
+	u64 count = 100000;
+	u64 *hits = (u64*)alloc(heap, count*sizeof(u64));
+
+	// 0 is one per logical processor - 1, which is 0 on a single core machine
+	u64 worker_counts[] = {0, 1, 3, 7};
+	for (u64 w = 0; w < sizeof(worker_counts)/sizeof(worker_counts[0]); w++) {
+		job_system_init(worker_counts[w]);
+		if (worker_counts[w]) assert(job_system_get_worker_count() == worker_counts[w], "Wrong worker count");
+
+		// Plain jobs
+		memset(hits, 0, count*sizeof(u64));
+		Job_Counter counter = {0};
+		for (u64 i = 0; i < 5000; i++) {
+			job_run(job_test_hit, &hits[i], &counter);
+		}
+		job_counter_wait(&counter);
+		assert(job_counter_is_done(&counter), "Counter not done after waiting");
+		for (u64 i = 0; i < 5000; i++) assert(hits[i] == 1, "Job %llu ran %llu times", i, hits[i]);
+
+		// More jobs than fit in a queue, the rest run right away
+		memset(hits, 0, count*sizeof(u64));
+		for (u64 i = 0; i < JOB_QUEUE_CAPACITY*3; i++) {
+			job_run(job_test_hit, &hits[i], &counter);
+		}
+		job_counter_wait(&counter);
+		for (u64 i = 0; i < JOB_QUEUE_CAPACITY*3; i++) assert(hits[i] == 1, "Job %llu ran %llu times", i, hits[i]);
+
+		// parallel_for must hit every index exactly once, whatever the grain size
+		u64 grains[] = {1, 7, 1000, count, count*2};
+		for (u64 g = 0; g < sizeof(grains)/sizeof(grains[0]); g++) {
+			memset(hits, 0, count*sizeof(u64));
+			Job_Test_Data d = {hits, count, 0};
+			parallel_for(0, count, grains[g], job_test_hit_range, &d);
+			for (u64 i = 0; i < count; i++) assert(hits[i] == 1, "Index %llu hit %llu times with grain %llu", i, hits[i], grains[g]);
+			assert(d.sum == count*(count-1)/2, "Bad parallel_for sum");
+		}
+
+		// Empty and offset ranges
+		memset(hits, 0, count*sizeof(u64));
+		Job_Test_Data d = {hits, count, 0};
+		parallel_for(10, 10, 1, job_test_hit_range, &d);
+		parallel_for(500, 1500, 3, job_test_hit_range, &d);
+		for (u64 i = 0; i < 2000; i++) assert(hits[i] == (i >= 500 && i < 1500), "Offset range hit wrong index");
+
+		// Nested waiting
+		u64 nested_count = 8;
+		Job_Test_Data nested[8];
+		u64 *nested_hits = (u64*)alloc(heap, nested_count*1000*sizeof(u64));
+		memset(nested_hits, 0, nested_count*1000*sizeof(u64));
+		for (u64 i = 0; i < nested_count; i++) {
+			nested[i] = (Job_Test_Data){nested_hits + i*1000, 1000, 0};
+			job_run(job_test_nested, &nested[i], &counter);
+		}
+		job_counter_wait(&counter);
+		for (u64 i = 0; i < nested_count*1000; i++) assert(nested_hits[i] == 1, "Nested parallel_for missed index %llu", i);
+		for (u64 i = 0; i < nested_count; i++) assert(nested[i].sum == 1000*999/2, "Bad nested sum");
+		dealloc(heap, nested_hits);
+
+		// Threads outside of the job system go through the shared queue
+		memset(hits, 0, count*sizeof(u64));
+		Job_Test_Data outside = {hits, count, 0};
+		Thread t;
+		os_thread_init(&t, job_test_outside_thread_proc);
+		t.data = &outside;
+		os_thread_start(&t);
+		os_thread_join(&t);
+		os_thread_destroy(&t);
+		for (u64 i = 0; i < count; i++) assert(hits[i] == 1, "Outside thread parallel_for missed index %llu", i);
+
+		// talloc in a job is given back when the job returns, also when we run it ourselves
+		memset(hits, 0, count*sizeof(u64));
+		u64 temp_used = get_temporary_storage_stats().used;
+		for (u64 i = 0; i < 100; i++) {
+			job_run(job_test_talloc, &hits[i], &counter);
+		}
+		job_counter_wait(&counter);
+		for (u64 i = 0; i < 100; i++) assert(hits[i] == 1, "talloc job didn't run");
+		assert(get_temporary_storage_stats().used == temp_used, "Jobs leaked temporary storage on this thread");
+
+		job_system_shutdown();
+	}
+
+	// Jobs without a counter still run, at the latest when we shut down
+	job_system_init(2);
+	memset(hits, 0, count*sizeof(u64));
+	for (u64 i = 0; i < 1000; i++) job_run(job_test_hit, &hits[i], 0);
+	job_system_shutdown();
+	for (u64 i = 0; i < 1000; i++) assert(hits[i] == 1, "Fire and forget job %llu ran %llu times", i, hits[i]);
+
+	dealloc(heap, hits);
+}
+
+typedef struct Job_Bench_Data {
+	f32 *values;
+} Job_Bench_Data;
+
+void job_bench_range(u64 first, u64 last, void *data) {
+	Job_Bench_Data *d = (Job_Bench_Data*)data;
+	for (u64 i = first; i < last; i++) {
+		f32 x = d->values[i];
+		for (u64 j = 0; j < 16; j++) x = sqrtf(x*x + 1.0f) * 0.5f;
+		d->values[i] = x;
+	}
+}
+void job_bench_empty(void *data) {}
+
+void test_job_system_performance() {
+	Allocator heap = get_heap_allocator();
+
+	u64 count = 1 << 20;
+	Job_Bench_Data d;
+	d.values = (f32*)alloc(heap, count*sizeof(f32));
+	for (u64 i = 0; i < count; i++) d.values[i] = (f32)i;
+
+	const u64 rounds = 8;
+
+	// Baseline, no job system at all
+	f64 start = os_get_elapsed_seconds();
+	for (u64 r = 0; r < rounds; r++) job_bench_range(0, count, &d);
+	f64 single_ms = (os_get_elapsed_seconds() - start)*1000.0/rounds;
+	print("\n\t%llu items, no job system: %.2fms\n", count, single_ms);
+
+	u64 processor_count = os_get_number_of_logical_processors();
+	u64 max_workers = max(processor_count, 2);
+	for (u64 workers = 1; workers <= max_workers; workers++) {
+		job_system_init(workers);
+
+		// Warm up, wakes everyone up
+		parallel_for(0, count, 4096, job_bench_range, &d);
+
+		start = os_get_elapsed_seconds();
+		for (u64 r = 0; r < rounds; r++) parallel_for(0, count, 4096, job_bench_range, &d);
+		f64 ms = (os_get_elapsed_seconds() - start)*1000.0/rounds;
+
+		const u64 job_count = 100000;
+		Job_Counter counter = {0};
+		start = os_get_elapsed_seconds();
+		for (u64 i = 0; i < job_count; i++) job_run(job_bench_empty, 0, &counter);
+		job_counter_wait(&counter);
+		f64 ns_per_job = (os_get_elapsed_seconds() - start)*1e9/job_count;
+
+		print("\t%llu worker(s) + this thread: parallel_for %.2fms (%.2fx), %.0fns per empty job\n",
+			workers, ms, single_ms/ms, ns_per_job);
+
+		job_system_shutdown();
+	}
+
+	dealloc(heap, d.values);
+}
+
 void oogabooga_run_tests() {
 	
 	print("Testing growing array... ");
 	test_growing_array();
 	print("OK!\n");
+	
+	print("Testing bucket array... ");
+	test_bucket_array();
+	print("OK!\n");
+	
+	print("Testing bucket array performance... ");
+	test_bucket_array_performance();
+	print("OK!\n");
     
 	print("Testing allocator... ");
 	test_allocator(true);
 	print("OK!\n");
 	
+	print("Testing allocator performance... ");
+	test_allocator_performance();
+	print("OK!\n");
+	
+	print("Testing threaded allocator performance... ");
+	test_allocator_threaded_performance();
+	print("OK!\n");
+	
+	print("Testing heap realloc... ");
+	test_heap_realloc();
+	print("OK!\n");
+	
+	print("Testing heap large allocations... ");
+	test_heap_large_allocations();
+	print("OK!\n");
+	
+	print("Testing heap freed pages... ");
+	test_heap_freed_pages();
+	print("OK!\n");
+	
+	print("Testing heap freed pages performance... ");
+	test_heap_freed_pages_performance();
+	print("OK!\n");
+	
+	print("Testing memory tracking... ");
+	test_memory_tracking();
+	print("OK!\n");
+	
+	print("Testing heap realloc performance... ");
+	test_heap_realloc_performance();
+	print("OK!\n");
+	
+	print("Testing arena... ");
+	test_arena();
+	print("OK!\n");
+	
+	print("Testing temporary storage... ");
+	test_temporary_storage();
+	print("OK!\n");
+	
+	print("Testing arena performance... ");
+	test_arena_performance();
+	print("OK!\n");
+	
+	print("Testing pool... ");
+	test_pool();
+	print("OK!\n");
+	
+	print("Testing pool performance... ");
+	test_pool_performance();
+	print("OK!\n");
+	
 	print("Testing threads... ");
 	test_threads();
 	print("OK!\n");
@@ -1716,6 +4635,14 @@ void oogabooga_run_tests() {
 	test_strings();
 	print("OK!\n");
 	
+	print("Testing string format... ");
+	test_string_format();
+	print("OK!\n");
+	
+	print("Testing string format performance... ");
+	test_string_format_performance();
+	print("OK!\n");
+	
 	print("Testing file IO... ");
 	test_file_io();
 	print("OK!\n");
@@ -1732,10 +4659,26 @@ void oogabooga_run_tests() {
 	test_simd();
 	print("OK!\n");
 	
+	print("Testing hash... ");
+	test_hash();
+	print("OK!\n");
+	
+	print("Testing hash performance... ");
+	test_hash_performance();
+	print("OK!\n");
+	
 	print("Testing hash table... ");
 	test_hash_table();
 	print("OK!\n");
 	
+	print("Testing hash table performance... ");
+	test_hash_table_performance();
+	print("OK!\n");
+	
+	print("Testing compression... ");
+	test_compression();
+	print("OK!\n");
+	
 	print("Testing random distribution... ");
 	test_random_distribution();
 	print("OK!\n");
@@ -1744,9 +4687,41 @@ void oogabooga_run_tests() {
 	test_mutex();
 	print("OK!\n");
 	
+	print("Testing rw lock... ");
+	test_rw_lock();
+	print("OK!\n");
+	
+	print("Testing lock performance... ");
+	test_lock_performance();
+	print("OK!\n");
+	
+	print("Testing atomics... ");
+	test_atomics();
+	print("OK!\n");
+	
+	print("Testing concurrent queues... ");
+	test_concurrent_queues();
+	print("OK!\n");
+	
+	print("Testing profiler... ");
+	test_profiler();
+	print("OK!\n");
+	
+	print("Testing profiler stats... ");
+	test_profiler_stats();
+	print("OK!\n");
+	
 	print("Testing binary semaphore... ");
 	test_os_binary_semaphore();
 	print("OK!\n");
+	
+	print("Testing job system... ");
+	test_job_system();
+	print("OK!\n");
+	
+	print("Testing job system performance... ");
+	test_job_system_performance();
+	print("OK!\n");
 
 #ifndef OOGABOOGA_HEADLESS
 	print("Testing radix sort... ");
@@ -1754,6 +4729,10 @@ void oogabooga_run_tests() {
 	print("OK!\n");
 #endif
 
+	print("Testing quad batcher... ");
+	test_quad_batcher();
+	print("OK!\n");
+
 	
 	
 	print("All tests ok!\n");
@@ -229,6 +229,7 @@ Gfx_Font* font;
 u32 font_height_beeg = 128;
 u32 font_height = 48;
 u32 font_height_body = 36;
+bool show_profiler_overlay = false;
 
 typedef struct AppFrame {
 	bool connected_to_tether;
@@ -480,7 +481,6 @@ typedef enum GameError {
 
 typedef struct Entity Entity; // needs forward declare
 typedef struct EntityFrame {
-	Entity** connected_to_tethers;
 	bool is_powered;
 	Vector2 input_axis;
 	SpriteID functional_sprite_id;
@@ -638,7 +638,6 @@ typedef struct Entity {
 	EntityFrame frame;
 	EntityFrame last_frame;
 } Entity;
-#define MAX_ENTITY_COUNT 1024
 
 //
 // NOTE about the entity structure
@@ -663,22 +662,23 @@ typedef struct Entity {
 //
 
 Entity entity_archetype_data[ARCH_MAX] = {0};
-Entity get_archetype_data(ArchetypeID id) {
-	return entity_archetype_data[id];
+// returns a pointer, the struct is big enough that copying it around actually shows up
+Entity* get_archetype_data(ArchetypeID id) {
+	return &entity_archetype_data[id];
 }
 string get_archetype_pretty_name(ArchetypeID id) {
-	return get_archetype_data(id).pretty_name;
+	return get_archetype_data(id)->pretty_name;
 }
 
 SpriteID get_icon_from_arch_id(ArchetypeID id) {
-	Entity data = get_archetype_data(id);
-	return data.icon ? data.icon : data.sprite_id;
+	Entity* data = get_archetype_data(id);
+	return data->icon ? data->icon : data->sprite_id;
 }
 SpriteID get_sprite_id_from_item(ArchetypeID id) {
 	return get_icon_from_arch_id(id);
 }
 
-Entity get_item_data(ArchetypeID id) {
+Entity* get_item_data(ArchetypeID id) {
 	return get_archetype_data(id);
 }
 SpriteID get_sprite_id_from_item_instance(ItemInstanceData item) {
@@ -894,7 +894,6 @@ typedef struct World {
 	u64 day_count;
 	float64 cycle_end_time;
 	float64 time_elapsed;
-	Entity entities[MAX_ENTITY_COUNT];
 	ItemInstanceData inventory_items[INV_COUNT];
 	UXState ux_state;
 	float inventory_alpha;
@@ -938,8 +937,323 @@ typedef struct WorldFrame {
 } WorldFrame;
 WorldFrame world_frame;
 
+// :power graph
+// Which entities the oxygenerator powers only changes when tethers, wall seals or whatever sits next
+// to them on the tile grid get placed or destroyed, so it's worked out once then and kept around,
+// instead of flooding every frame.
+// The flood assumes the oxygenerator has oxygen, that's checked when applying it.
+typedef struct PowerGraphNode {
+	EntityHandle en;
+	EntityHandle powered_from; // who we got it from, for drawing the tether line. nil for wall seals
+} PowerGraphNode;
+typedef struct PowerGraphMover {
+	EntityHandle en;
+	Vector2 pos;
+	Dimension dim;
+} PowerGraphMover;
+typedef struct PowerGraph {
+	bool dirty;
+	PowerGraphNode* nodes; // in the order they got powered
+	PowerGraphMover* movers; // tethers with physics (dropped tether items), rebuild if they move
+	// by entity index, sized to the pool at the last rebuild
+	int reachable_capacity;
+	bool* reachable;
+	int* reachable_id; // so a new entity in the same slot doesn't count
+} PowerGraph;
+PowerGraph power_graph = { .dirty = true };
+
+void power_graph_mark_dirty() {
+	power_graph.dirty = true;
+}
+
+// Tethers and seals are in the graph, and anything else sitting on a tile can change what
+// entity_at_tile finds next to a wall seal. Items & physics bodies move around, they're not tile occupants.
+bool entity_affects_power_graph(Entity* en) {
+	return en->is_oxygen_tether || en->wall_seal || (!en->is_item && !en->has_physics);
+}
+
+// :entity pool
+// Entities live in pages that never move, so an Entity* stays good for as long as the entity does.
+// Each page is double the last one, page p starts at index ENTITY_PAGE_FIRST_SIZE * (2^p - 1).
+// Slot 0 is the nil entity.
+//
+// Destroyed slots go on a pending list and only get reused after entity_pool_flush() at the start
+// of the frame. That way a loop that destroys stuff half way through never sees a slot twice, and
+// the dense live list only gets compacted once per frame.
+//
+// Handles check the entity id, which is never reused, so it doubles as the slot generation.
+#define ENTITY_PAGE_FIRST_SIZE 1024
+#define ENTITY_PAGE_MAX 20
+
+typedef struct EntityPool {
+	Entity* pages[ENTITY_PAGE_MAX];
+	int page_count;
+	int capacity;
+	int high_water; // every slot below this has been handed out at some point
+	u32* free_slots;
+	u32* pending_free; // destroyed this frame
+	u32* live; // dense list of live indices, can have dead ones in it until the next flush
+} EntityPool;
+EntityPool entity_pool;
+
+inline Entity* entity_at(int index) {
+	u64 page = bit_scan_reverse_64((u64)index / ENTITY_PAGE_FIRST_SIZE + 1);
+	u64 page_start = ENTITY_PAGE_FIRST_SIZE * ((1ull << page) - 1);
+	return &entity_pool.pages[page][index - page_start];
+}
+
+// -1 if it's not in the pool, like archetype data
+int entity_index(Entity* en) {
+	u64 page_start = 0;
+	for (int page = 0; page < entity_pool.page_count; page++) {
+		u64 page_size = (u64)ENTITY_PAGE_FIRST_SIZE << page;
+		Entity* first = entity_pool.pages[page];
+		if (en >= first && en < first + page_size) {
+			return (int)(page_start + (en - first));
+		}
+		page_start += page_size;
+	}
+	return -1;
+}
+
+// :entity hot
+// Packed copies of the few fields almost every loop over the entities tests first.
+// Scanning these instead of the megastruct means empty slots and non-matching entities
+// never pull their ~2kb Entity through the cache.
+//
+// The Entity is still the source of truth. After changing any of these fields outside of the
+// setup functions, call entity_hot_sync(). In debug we check they match every frame.
+typedef enum EntityHotFlag {
+	ENTITY_HOT_has_physics,
+	ENTITY_HOT_has_collision,
+	ENTITY_HOT_is_oxygen_tether,
+	ENTITY_HOT_wall_seal,
+	ENTITY_HOT_is_enemy,
+	ENTITY_HOT_enemy_target,
+	ENTITY_HOT_has_anti_meteor_radius,
+	ENTITY_HOT_o2_consume,
+	ENTITY_HOT_destroyable_by_explosion,
+	ENTITY_HOT_MAX,
+} EntityHotFlag;
+
+// one bit per entity slot, so a filtered loop only ever visits the entities that match.
+// grows along with the pool.
+typedef struct EntityHotStore {
+	int word_count;
+	u64* valid;
+	u64* flag_bits[ENTITY_HOT_MAX];
+	ArchetypeID* arch;
+	Dimension* dim;
+} EntityHotStore;
+EntityHotStore entity_hot;
+
+void* entity_hot_grow_array(void* old, u64 old_size, u64 new_size) {
+	u8* result = alloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), new_size);
+	if (old) {
+		memcpy(result, old, old_size);
+		dealloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), old);
+	}
+	memset(result + old_size, 0, new_size - old_size);
+	return result;
+}
+
+void entity_hot_grow(int capacity) {
+	int old_words = entity_hot.word_count;
+	int new_words = capacity / 64;
+	int old_capacity = old_words * 64;
+	entity_hot.valid = entity_hot_grow_array(entity_hot.valid, old_words * sizeof(u64), new_words * sizeof(u64));
+	for (EntityHotFlag flag = 0; flag < ENTITY_HOT_MAX; flag++) {
+		entity_hot.flag_bits[flag] = entity_hot_grow_array(entity_hot.flag_bits[flag], old_words * sizeof(u64), new_words * sizeof(u64));
+	}
+	entity_hot.arch = entity_hot_grow_array(entity_hot.arch, old_capacity * sizeof(ArchetypeID), capacity * sizeof(ArchetypeID));
+	entity_hot.dim = entity_hot_grow_array(entity_hot.dim, old_capacity * sizeof(Dimension), capacity * sizeof(Dimension));
+	entity_hot.word_count = new_words;
+}
+
+bool entity_hot_flag_from_entity(Entity* en, EntityHotFlag flag) {
+	switch (flag) {
+		case ENTITY_HOT_has_physics:              return en->has_physics;
+		case ENTITY_HOT_has_collision:            return en->has_collision;
+		case ENTITY_HOT_is_oxygen_tether:         return en->is_oxygen_tether;
+		case ENTITY_HOT_wall_seal:                return en->wall_seal;
+		case ENTITY_HOT_is_enemy:                 return en->is_enemy;
+		case ENTITY_HOT_enemy_target:             return en->enemy_target;
+		case ENTITY_HOT_has_anti_meteor_radius:   return en->has_anti_meteor_radius;
+		case ENTITY_HOT_o2_consume:               return en->o2_consume;
+		case ENTITY_HOT_destroyable_by_explosion: return en->destroyable_by_explosion;
+		default: return false;
+	}
+}
+
+inline void entity_hot_set_bit(u64* words, int index, bool value) {
+	u64 bit = 1ull << (index % 64);
+	if (value) {
+		words[index / 64] |= bit;
+	} else {
+		words[index / 64] &= ~bit;
+	}
+}
+
+void entity_hot_sync_index(int index) {
+	Entity* en = entity_at(index);
+	entity_hot_set_bit(entity_hot.valid, index, en->is_valid);
+	for (EntityHotFlag flag = 0; flag < ENTITY_HOT_MAX; flag++) {
+		entity_hot_set_bit(entity_hot.flag_bits[flag], index, entity_hot_flag_from_entity(en, flag));
+	}
+	entity_hot.arch[index] = en->arch;
+	entity_hot.dim[index] = en->dim;
+}
+
+void entity_hot_sync(Entity* en) {
+	int index = entity_index(en);
+	// archetype data & other loose entities aren't in the store
+	if (index == -1) {
+		return;
+	}
+	entity_hot_sync_index(index);
+}
+
+inline bool entity_hot_is_valid(int index) {
+	return (entity_hot.valid[index / 64] >> (index % 64)) & 1;
+}
+
+inline bool entity_hot_has(int index, EntityHotFlag flag) {
+	return (entity_hot.flag_bits[flag][index / 64] >> (index % 64)) & 1;
+}
+
+#if CONFIGURATION == DEBUG
+void entity_hot_validate() {
+	for (int i = 0; i < entity_pool.capacity; i++) {
+		Entity* en = entity_at(i);
+		assert(entity_hot_is_valid(i) == en->is_valid, "entity_hot out of sync for entity %d (is_valid), missing entity_hot_sync()?", i);
+		if (!en->is_valid) continue;
+		assert(entity_hot.arch[i] == en->arch && entity_hot.dim[i] == en->dim, "entity_hot out of sync for entity %d, missing entity_hot_sync()?", i);
+		for (EntityHotFlag flag = 0; flag < ENTITY_HOT_MAX; flag++) {
+			assert(entity_hot_has(i, flag) == entity_hot_flag_from_entity(en, flag), "entity_hot flag %d out of sync for entity %d, missing entity_hot_sync()?", flag, i);
+		}
+	}
+}
+#endif
+
+// first valid entity index >= start with the flag, or -1
+inline int entity_hot_next(int start, EntityHotFlag flag) {
+	for (int word = start / 64; word < entity_hot.word_count; word++) {
+		u64 bits = entity_hot.valid[word] & entity_hot.flag_bits[flag][word];
+		if (word == start / 64) bits &= ~0ull << (start % 64);
+		if (bits) {
+			return word * 64 + (int)bit_scan_forward_64(bits);
+		}
+	}
+	return -1;
+}
+
+// next live index from the dense list, or -1
+inline int entity_live_next(int* cursor) {
+	int count = growing_array_get_valid_count(entity_pool.live);
+	while (*cursor < count) {
+		int index = entity_pool.live[*cursor];
+		*cursor += 1;
+		if (entity_hot_is_valid(index)) {
+			return index;
+		}
+	}
+	return -1;
+}
+
+// These check validity live, so creating/destroying mid loop is fine.
+// Entities created during the loop get visited too.
+#define for_each_entity(i) for (int i##_cursor = 0, i = entity_live_next(&i##_cursor); i != -1; i = entity_live_next(&i##_cursor))
+#define for_each_entity_with(i, flag) for (int i = entity_hot_next(0, flag); i != -1; i = entity_hot_next(i + 1, flag))
+
+void entity_pool_add_page() {
+	assert(entity_pool.page_count < ENTITY_PAGE_MAX, "Entity pool is out of pages");
+	u64 page_size = (u64)ENTITY_PAGE_FIRST_SIZE << entity_pool.page_count;
+	Entity* page = alloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), page_size * sizeof(Entity));
+	memset(page, 0, page_size * sizeof(Entity));
+	entity_pool.pages[entity_pool.page_count] = page;
+	entity_pool.page_count += 1;
+	entity_pool.capacity += page_size;
+	entity_hot_grow(entity_pool.capacity);
+}
+
+void entity_pool_reserve(int count) {
+	while (entity_pool.capacity < count) {
+		entity_pool_add_page();
+	}
+}
+
+void entity_pool_init() {
+	growing_array_init_reserve((void**)&entity_pool.free_slots, sizeof(u32), 256, get_tagged_heap_allocator(MEMORY_TAG_WORLD));
+	growing_array_init_reserve((void**)&entity_pool.pending_free, sizeof(u32), 256, get_tagged_heap_allocator(MEMORY_TAG_WORLD));
+	growing_array_init_reserve((void**)&entity_pool.live, sizeof(u32), ENTITY_PAGE_FIRST_SIZE, get_tagged_heap_allocator(MEMORY_TAG_WORLD));
+	entity_pool_add_page();
+	entity_pool.high_water = 1;
+}
+
+// derive the free/live lists & hot store from whatever is in the pages, for after loading or poking at entities directly
+void entity_pool_rebuild() {
+	growing_array_clear((void**)&entity_pool.free_slots);
+	growing_array_clear((void**)&entity_pool.pending_free);
+	growing_array_clear((void**)&entity_pool.live);
+
+	entity_pool.high_water = 1;
+	for (int i = 1; i < entity_pool.capacity; i++) {
+		Entity* en = entity_at(i);
+		if (en->is_valid) {
+			u32 index = i;
+			growing_array_add((void**)&entity_pool.live, &index);
+			entity_pool.high_water = i + 1;
+		}
+	}
+	// backwards so the lowest slots get handed out first
+	for (int i = entity_pool.high_water - 1; i >= 1; i--) {
+		if (!entity_at(i)->is_valid) {
+			u32 index = i;
+			growing_array_add((void**)&entity_pool.free_slots, &index);
+		}
+	}
+
+	for (int i = 0; i < entity_pool.capacity; i++) {
+		entity_hot_sync_index(i);
+	}
+}
+
+void entity_pool_clear() {
+	for (int page = 0; page < entity_pool.page_count; page++) {
+		memset(entity_pool.pages[page], 0, ((u64)ENTITY_PAGE_FIRST_SIZE << page) * sizeof(Entity));
+	}
+	entity_pool_rebuild();
+}
+
+// once a frame, makes the slots destroyed since the last flush reusable and compacts the live list
+void entity_pool_flush() {
+	int pending_count = growing_array_get_valid_count(entity_pool.pending_free);
+	if (pending_count == 0) {
+		return;
+	}
+	for (int i = pending_count - 1; i >= 0; i--) {
+		growing_array_add((void**)&entity_pool.free_slots, &entity_pool.pending_free[i]);
+	}
+	growing_array_clear((void**)&entity_pool.pending_free);
+
+	int live_count = growing_array_get_valid_count(entity_pool.live);
+	int kept = 0;
+	for (int i = 0; i < live_count; i++) {
+		u32 index = entity_pool.live[i];
+		if (entity_hot_is_valid(index)) {
+			entity_pool.live[kept] = index;
+			kept += 1;
+		}
+	}
+	growing_array_resize((void**)&entity_pool.live, kept);
+}
+
+int entity_live_count() {
+	return growing_array_get_valid_count(entity_pool.live) - growing_array_get_valid_count(entity_pool.pending_free);
+}
+
 inline Entity* get_nil_entity() {
-	return &world->entities[0];
+	return entity_at(0);
 }
 bool is_nil(Entity* en) {
 	return en == get_nil_entity();
@@ -949,11 +1263,17 @@ bool is_valid(Entity* en) {
 }
 
 EntityHandle handle_from_entity(Entity* en) {
-	s64 index = en - world->entities;
+	int index = entity_index(en);
+	if (index == -1) {
+		return (EntityHandle){0};
+	}
 	return (EntityHandle){ en->id, index };
 }
 Entity* entity_from_handle(EntityHandle handle) {
-	Entity* en = &world->entities[handle.index];
+	if (handle.index <= 0 || handle.index >= entity_pool.capacity) {
+		return get_nil_entity();
+	}
+	Entity* en = entity_at(handle.index);
 	if (en->id == handle.id) {
 		return en;
 	} else {
@@ -990,15 +1310,21 @@ void entity_apply_defaults(Entity* en) {
 }
 
 Entity* entity_create(Dimension dim) {
-	Entity* entity_found = 0;
-	for (int i = 1; i < MAX_ENTITY_COUNT; i++) {
-		Entity* existing_entity = &world->entities[i];
-		if (!existing_entity->is_valid) {
-			entity_found = existing_entity;
-			break;
+	u32 index;
+	int free_count = growing_array_get_valid_count(entity_pool.free_slots);
+	if (free_count > 0) {
+		index = entity_pool.free_slots[free_count - 1];
+		growing_array_pop((void**)&entity_pool.free_slots);
+	} else {
+		if (entity_pool.high_water == entity_pool.capacity) {
+			entity_pool_add_page();
 		}
+		index = entity_pool.high_water;
+		entity_pool.high_water += 1;
 	}
-	assert(entity_found, "No more free entities!");
+	growing_array_add((void**)&entity_pool.live, &index);
+
+	Entity* entity_found = entity_at(index);
 	entity_found->is_valid = true;
 	entity_apply_defaults(entity_found);
 
@@ -1007,15 +1333,29 @@ Entity* entity_create(Dimension dim) {
 	entity_found->frame.is_creation = true;
 	entity_found->dim = dim;
 	entity_found->random_seed = get_random();
+	entity_hot_sync_index(index);
 
 	return entity_found;
 }
 
 void entity_zero_immediately(Entity* en) {
+	if (entity_affects_power_graph(en)) {
+		power_graph_mark_dirty();
+	}
 	if (en->render_target_image) {
 		delete_image(en->render_target_image);
 	}
+	bool was_valid = en->is_valid;
 	memset(en, 0, sizeof(Entity));
+
+	int index = entity_index(en);
+	if (index > 0) {
+		entity_hot_sync_index(index);
+		if (was_valid) {
+			u32 slot = index;
+			growing_array_add((void**)&entity_pool.pending_free, &slot);
+		}
+	}
 }
 
 void entity_max_health_setter(Entity* en, int new_max_health) {
@@ -1643,8 +1983,8 @@ void setup_furnace(Entity* en) {
 		StorageSlot* slot = &en->storage_slots[1];
 		slot->desired_item_count = 0;
 		for (ArchetypeID i = 0; i < ARCH_MAX; i++) {
-			Entity item_data = get_item_data(i);
-			if (item_data.furnace_transform_into) {
+			Entity* item_data = get_item_data(i);
+			if (item_data->furnace_transform_into) {
 				assert(slot->desired_item_count < ARRAY_COUNT(slot->desired_items));
 				slot->desired_items[slot->desired_item_count] = i;
 				slot->desired_item_count += 1;
@@ -1789,6 +2129,11 @@ void entity_setup(Entity* en, ArchetypeID id) {
 	}
 
 	assert(en->arch, "Archetype not setup in function.");
+
+	if (entity_affects_power_graph(en)) {
+		power_graph_mark_dirty();
+	}
+	entity_hot_sync(en);
 }
 
 void setup_item_with_instance(Entity* en, ItemInstanceData item) {
@@ -1796,6 +2141,7 @@ void setup_item_with_instance(Entity* en, ItemInstanceData item) {
 	en->is_item = true;
 	en->item = item;
 	en->has_collision = false;
+	entity_hot_sync(en);
 }
 void setup_item(Entity* en, ArchetypeID id) {
 	entity_setup(en, id);
@@ -1805,6 +2151,7 @@ void setup_item(Entity* en, ArchetypeID id) {
 		en->item.amount = 1;
 	}
 	en->has_collision = false;
+	entity_hot_sync(en);
 }
 
 void setup_entity_archetype_data_cache() {
@@ -1962,17 +2309,17 @@ bool has_reached_end_time(float64 end_time) {
 }
 
 Tile* get_tile_list_at_pos_based_on_arch(Vector2 pos, ArchetypeID id) {
-	Entity en_data = get_archetype_data(id);
+	Entity* en_data = get_archetype_data(id);
 
 	Tile* tiles;
 	growing_array_init_reserve((void**)&tiles, sizeof(Tile), 4, get_temporary_allocator());
 
 	Tile start_tile = v2_world_pos_to_tile_pos(pos);
 
-	int half_width = en_data.tile_size.x / 2;
-	int half_height = en_data.tile_size.y / 2;
-	for (int y = -half_height; y < half_height + en_data.tile_size.y % 2; y++)
-	for (int x = -half_width; x < half_width + en_data.tile_size.x % 2; x++) {
+	int half_width = en_data->tile_size.x / 2;
+	int half_height = en_data->tile_size.y / 2;
+	for (int y = -half_height; y < half_height + en_data->tile_size.y % 2; y++)
+	for (int x = -half_width; x < half_width + en_data->tile_size.x % 2; x++) {
 		Tile tile = {start_tile.x + x, start_tile.y + y};
 		growing_array_add((void**)&tiles, &tile);
 	}
@@ -1982,8 +2329,8 @@ Tile* get_tile_list_at_pos_based_on_arch(Vector2 pos, ArchetypeID id) {
 
 Vector2 v2_tile_pos_to_entity_world_pos(Vector2i tile_pos, ArchetypeID id) {
 	Vector2 pos = v2_tile_pos_to_world_pos(tile_pos);
-	pos.x += get_archetype_data(id).tile_size.x * tile_width * 0.5;
-	pos.y += get_archetype_data(id).tile_size.y * tile_width * 0.5;
+	pos.x += get_archetype_data(id)->tile_size.x * tile_width * 0.5;
+	pos.y += get_archetype_data(id)->tile_size.y * tile_width * 0.5;
 	return pos;
 }
 
@@ -1997,7 +2344,7 @@ typedef struct TileEntityCache {
 	int tile_count;
 } TileEntityCache;
 
-void add_new_entity_to_tile_cache(Entity* en, Dimension dim) {
+void tile_cache_store_entity(Entity* en, Dimension dim) {
 	TileEntityCache* cache = world_frame.tile_entity_caches[dim];
 
 	Tile* tiles = get_tile_list_at_pos_based_on_arch(en->pos, en->arch);
@@ -2011,6 +2358,13 @@ void add_new_entity_to_tile_cache(Entity* en, Dimension dim) {
 	}
 }
 
+// for entities that show up after the cache was built this frame
+void add_new_entity_to_tile_cache(Entity* en, Dimension dim) {
+	tile_cache_store_entity(en, dim);
+	// changes what entity_at_tile finds, so the wall seal flood has to rerun
+	power_graph_mark_dirty();
+}
+
 void create_tile_entity_pair_cache() {
 	for (Dimension dim = 0; dim < DIM_MAX; dim++) {
 		if (world_frame.tile_entity_caches[dim] != 0) {
@@ -2035,9 +2389,9 @@ void create_tile_entity_pair_cache() {
 		}
 
 		tm_scope("add enttiy to tile cache")
-		for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-			Entity* en = &world->entities[i];
-			add_new_entity_to_tile_cache(en, dim);
+		for_each_entity(i) {
+			Entity* en = entity_at(i);
+			tile_cache_store_entity(en, dim);
 		}
 	}
 }
@@ -2064,6 +2418,168 @@ Entity* entity_at_tile(Tile tile, Dimension dim) {
 	}
 }
 
+void power_graph_add_node(Entity* en, Entity* powered_from) {
+	PowerGraphNode node = { handle_from_entity(en), handle_from_entity(powered_from) };
+	growing_array_add((void**)&power_graph.nodes, &node);
+
+	int index = entity_index(en);
+	power_graph.reachable[index] = true;
+	power_graph.reachable_id[index] = en->id;
+}
+
+// same floods the old per-frame code did, in the same order, just done once
+void power_graph_rebuild(Entity* oxygenerator) {
+	if (power_graph.nodes) {
+		growing_array_clear((void**)&power_graph.nodes);
+		growing_array_clear((void**)&power_graph.movers);
+	} else {
+		growing_array_init_reserve((void**)&power_graph.nodes, sizeof(PowerGraphNode), 64, get_tagged_heap_allocator(MEMORY_TAG_WORLD));
+		growing_array_init_reserve((void**)&power_graph.movers, sizeof(PowerGraphMover), 8, get_tagged_heap_allocator(MEMORY_TAG_WORLD));
+	}
+	if (power_graph.reachable_capacity != entity_pool.capacity) {
+		if (power_graph.reachable) {
+			dealloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), power_graph.reachable);
+			dealloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), power_graph.reachable_id);
+		}
+		power_graph.reachable_capacity = entity_pool.capacity;
+		power_graph.reachable = alloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), sizeof(bool) * entity_pool.capacity);
+		power_graph.reachable_id = alloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), sizeof(int) * entity_pool.capacity);
+	}
+	memset(power_graph.reachable, 0, sizeof(bool) * power_graph.reachable_capacity);
+	memset(power_graph.reachable_id, 0, sizeof(int) * power_graph.reachable_capacity);
+
+	// for each tether, find all nearby tethers
+	Entity** tethers;
+	growing_array_init_reserve((void**)&tethers, sizeof(Entity*), 64, get_temporary_allocator());
+	for_each_entity_with(i, ENTITY_HOT_is_oxygen_tether) {
+		Entity* en = entity_at(i);
+		growing_array_add((void**)&tethers, &en);
+		if (entity_hot_has(i, ENTITY_HOT_has_physics)) {
+			PowerGraphMover mover = { handle_from_entity(en), en->pos, en->dim };
+			growing_array_add((void**)&power_graph.movers, &mover);
+		}
+	}
+	int tether_count = growing_array_get_valid_count(tethers);
+
+	Entity*** connected_to_tethers = alloc(get_temporary_allocator(), sizeof(Entity**) * entity_pool.capacity);
+	memset(connected_to_tethers, 0, sizeof(Entity**) * entity_pool.capacity);
+	for (int i = 0; i < tether_count; i++) {
+		Entity* self_tether = tethers[i];
+		Entity** nearby_tethers;
+		growing_array_init_reserve((void**)&nearby_tethers, sizeof(Entity*), 1, get_temporary_allocator());
+		for (int j = 0; j < tether_count; j++) {
+			Entity* nearby_tether = tethers[j];
+			if (nearby_tether != self_tether && nearby_tether->dim == self_tether->dim && v2_dist(nearby_tether->pos, self_tether->pos) < tether_connection_radius) {
+				growing_array_add((void**)&nearby_tethers, &nearby_tether);
+			}
+		}
+		connected_to_tethers[entity_index(self_tether)] = nearby_tethers;
+	}
+
+	// run through connections recursively, starting at the core tether
+	{
+		Entity** connection_stack;
+		growing_array_init_reserve((void**)&connection_stack, sizeof(Entity*), 1, get_temporary_allocator());
+		growing_array_add((void**)&connection_stack, &oxygenerator);
+
+		while (growing_array_get_valid_count(connection_stack)) {
+			Entity* current = connection_stack[growing_array_get_valid_count(connection_stack)-1];
+			growing_array_pop((void**)&connection_stack);
+
+			Entity** connected = connected_to_tethers[entity_index(current)];
+			if (!connected) continue;
+			for (int i = 0; i < growing_array_get_valid_count(connected); i ++) {
+				Entity* connected_tether = connected[i];
+				if (!power_graph.reachable[entity_index(connected_tether)]) {
+					growing_array_add((void**)&connection_stack, &connected_tether);
+					power_graph_add_node(connected_tether, current);
+				}
+			}
+		}
+	}
+
+	// for each o2 emitter, run through neighboring wall seals
+	for_each_entity(i) {
+		Entity* en = entity_at(i);
+		if (entity_hot.arch[i] == ARCH_o2_emitter && power_graph.reachable[i]) {
+
+			Entity** stack;
+			growing_array_init_reserve((void**)&stack, sizeof(Entity*), 1, get_temporary_allocator());
+			growing_array_add((void**)&stack, &en);
+
+			while (growing_array_get_valid_count(stack)) {
+				Entity* current = stack[growing_array_get_valid_count(stack)-1];
+				growing_array_pop((void**)&stack);
+
+				if (!power_graph.reachable[entity_index(current)]) {
+					power_graph_add_node(current, get_nil_entity());
+				}
+				Tile current_tile = v2_world_pos_to_tile_pos(current->pos);
+
+				Vector2i offsets[4] = { v2i(-1, 0), v2i(1, 0), v2i(0, 1), v2i(0, -1) };
+				for (int k = 0; k < 4; k++) {
+					Entity* next = entity_at_tile(v2i_add(offsets[k], current_tile), DIM_first);
+					if (next && next->wall_seal && !power_graph.reachable[entity_index(next)]) {
+						growing_array_add((void**)&stack, &next);
+					}
+				}
+			}
+		}
+	}
+
+	power_graph.dirty = false;
+}
+
+bool power_graph_movers_moved() {
+	for (int i = 0; i < growing_array_get_valid_count(power_graph.movers); i++) {
+		PowerGraphMover mover = power_graph.movers[i];
+		Entity* en = entity_from_handle(mover.en);
+		if (!is_valid(en) || en->pos.x != mover.pos.x || en->pos.y != mover.pos.y || en->dim != mover.dim) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// O(1), doesn't need the frame flags to be set yet
+bool is_powered(Entity* en) {
+	int index = entity_index(en);
+	if (index < 0 || index >= power_graph.reachable_capacity) {
+		return false;
+	}
+	if (!power_graph.reachable[index] || power_graph.reachable_id[index] != en->id) {
+		return false;
+	}
+	return entity_from_handle(world->oxygenerator)->oxygen > 0;
+}
+
+// rebuilds if something changed, then sets frame.is_powered and draws the tether lines
+void power_graph_update() {
+	Entity* oxygenerator = entity_from_handle(world->oxygenerator);
+
+	if (power_graph.dirty || !power_graph.nodes || power_graph_movers_moved()) {
+		power_graph_rebuild(oxygenerator);
+	}
+
+	if (oxygenerator->oxygen <= 0) {
+		return;
+	}
+
+	for (int i = 0; i < growing_array_get_valid_count(power_graph.nodes); i++) {
+		PowerGraphNode node = power_graph.nodes[i];
+		Entity* en = entity_from_handle(node.en);
+		if (!is_valid(en)) {
+			continue;
+		}
+		en->frame.is_powered = true;
+
+		Entity* from = entity_from_handle(node.powered_from);
+		if (is_valid(from)) {
+			draw_line(v2_add(en->pos, en->tether_connection_offset), v2_add(from->pos, from->tether_connection_offset), 1.0f, col_tether);
+		}
+	}
+}
+
 Gfx_Text_Metrics draw_text_with_pivot(Gfx_Font *font, string text, u32 raster_height, Vector2 position, Vector2 scale, Vector4 color, Pivot pivot) {
 	Gfx_Text_Metrics metrics = measure_text(font, text, raster_height, scale);
 	position = v2_sub(position, metrics.visual_pos_min);
@@ -2080,14 +2596,14 @@ Dimension get_player_dim() {
 }
 
 bool move_item_instance_to_inv(ItemInstanceData* item) {
-	Entity item_data = get_item_data(item->id);
+	Entity* item_data = get_item_data(item->id);
 
 	// First pass: Try to stack into existing items
 	for (int i = 0; i < ARRAY_COUNT(world->inventory_items); i++) {
 		ItemInstanceData* inv_item = &world->inventory_items[i];
 
 		if (inv_item->id == item->id) {
-			int space_left = item_data.stack_size - inv_item->amount;
+			int space_left = item_data->stack_size - inv_item->amount;
 			if (space_left > 0) {
 				int amount_to_add = (item->amount < space_left) ? item->amount : space_left;
 				inv_item->amount += amount_to_add;
@@ -2105,7 +2621,7 @@ bool move_item_instance_to_inv(ItemInstanceData* item) {
 	for (int i = 0; i < ARRAY_COUNT(world->inventory_items); i++) {
 		ItemInstanceData* inv_item = &world->inventory_items[i];
 		if (inv_item->id == 0) {
-			int amount_to_add = (item->amount < item_data.stack_size) ? item->amount : item_data.stack_size;
+			int amount_to_add = (item->amount < item_data->stack_size) ? item->amount : item_data->stack_size;
 			*inv_item = *item;
 			inv_item->amount = amount_to_add;
 			item->amount -= amount_to_add;
@@ -2125,7 +2641,7 @@ bool move_item_instance_to_inv(ItemInstanceData* item) {
 
 // copied and modified from the one below.
 bool can_add_item_to_inv(ItemInstanceData item) {
-	Entity item_data = get_item_data(item.id);
+	Entity* item_data = get_item_data(item.id);
 
 	int amount_left = item.amount;
 
@@ -2134,7 +2650,7 @@ bool can_add_item_to_inv(ItemInstanceData item) {
 		ItemInstanceData* inv_item = &world->inventory_items[i];
 
 		if (inv_item->id == item.id) {
-			int space_left = item_data.stack_size - inv_item->amount;
+			int space_left = item_data->stack_size - inv_item->amount;
 			if (space_left > 0) {
 				int amount_to_add = (amount_left < space_left) ? amount_left : space_left;
 				amount_left -= amount_to_add;
@@ -2150,7 +2666,7 @@ bool can_add_item_to_inv(ItemInstanceData item) {
 	for (int i = 0; i < ARRAY_COUNT(world->inventory_items); i++) {
 		ItemInstanceData* inv_item = &world->inventory_items[i];
 		if (inv_item->id == 0) {
-			int amount_to_add = (amount_left < item_data.stack_size) ? amount_left : item_data.stack_size;
+			int amount_to_add = (amount_left < item_data->stack_size) ? amount_left : item_data->stack_size;
 			amount_left -= amount_to_add;
 
 			if (amount_left == 0) {
@@ -2164,7 +2680,7 @@ bool can_add_item_to_inv(ItemInstanceData item) {
 }
 
 bool attempt_add_item_to_inv(ItemInstanceData item) {
-	Entity item_data = get_item_data(item.id);
+	Entity* item_data = get_item_data(item.id);
 
 	int amount_left = item.amount;
 
@@ -2173,7 +2689,7 @@ bool attempt_add_item_to_inv(ItemInstanceData item) {
 		ItemInstanceData* inv_item = &world->inventory_items[i];
 
 		if (inv_item->id == item.id) {
-			int space_left = item_data.stack_size - inv_item->amount;
+			int space_left = item_data->stack_size - inv_item->amount;
 			if (space_left > 0) {
 				int amount_to_add = (amount_left < space_left) ? amount_left : space_left;
 				inv_item->amount += amount_to_add;
@@ -2190,7 +2706,7 @@ bool attempt_add_item_to_inv(ItemInstanceData item) {
 	for (int i = 0; i < ARRAY_COUNT(world->inventory_items); i++) {
 		ItemInstanceData* inv_item = &world->inventory_items[i];
 		if (inv_item->id == 0) {
-			int amount_to_add = (amount_left < item_data.stack_size) ? amount_left : item_data.stack_size;
+			int amount_to_add = (amount_left < item_data->stack_size) ? amount_left : item_data->stack_size;
 			inv_item->id = item.id;
 			inv_item->amount = amount_to_add;
 			amount_left -= amount_to_add;
@@ -2309,8 +2825,8 @@ void do_resource_respawning() {
 
 				// is it close to any entities?
 				bool too_close = false;
-				for (int j = 0; j < MAX_ENTITY_COUNT; j++) {
-					Entity* en = &world->entities[j];
+				for_each_entity(j) {
+					Entity* en = entity_at(j);
 					if (en->is_valid && en->arch == data.arch_id && !en->isnt_a_tile) {
 						int tile_radius = data.dist_from_self;
 						if (v2_dist(spawn_pos, en->pos) < tile_width * tile_radius) {
@@ -2354,7 +2870,7 @@ void do_resource_respawning() {
 bool has_enough_for_recipe(ItemInstanceData* recipe, int count) {
 	for (int i = 0; i < count; i++) {
 		ItemInstanceData ing = recipe[i];
-		Entity ing_data = get_item_data(ing.id);
+		Entity* ing_data = get_item_data(ing.id);
 
 		int total_count = 0;
 
@@ -2376,7 +2892,7 @@ bool has_enough_for_recipe(ItemInstanceData* recipe, int count) {
 void consume_recipe(ItemInstanceData* recipe, int count) {
 	for (int i = 0; i < count; i++) {
 		ItemInstanceData ing = recipe[i];
-		Entity ing_data = get_item_data(ing.id);
+		Entity* ing_data = get_item_data(ing.id);
 
 		int remaining_amount = ing.amount;
 
@@ -2514,7 +3030,7 @@ Range2f get_entity_collision_bounds(Entity* en) {
 }
 
 Vector2 snap_position_to_nearest_tile_based_on_arch(Vector2 pos, ArchetypeID id) {
-	Vector2i tile_size = get_archetype_data(id).tile_size;
+	Vector2i tile_size = get_archetype_data(id)->tile_size;
 
 	if (tile_size.x % 2 == 0) {
 		pos.x = roundf(pos.x / (float)tile_width) * tile_width;
@@ -2534,22 +3050,22 @@ Vector2 snap_position_to_nearest_tile_based_on_arch(Vector2 pos, ArchetypeID id)
 }
 
 Vector2 get_offset_for_rendering(ArchetypeID id) {
-	Entity en = get_archetype_data(id);
+	Entity* en = get_archetype_data(id);
 
-	Sprite* sprite = get_sprite(en.sprite_id);
+	Sprite* sprite = get_sprite(en->sprite_id);
 
 	Vector2 sprite_size = get_sprite_size(sprite );
 
 	Vector2 offset = {0};
 	offset.x -= sprite_size.x * 0.5;
 
-	if (en.offset_based_on_tile_height) {
-		offset.y -= en.tile_size.y * tile_width * 0.5;
+	if (en->offset_based_on_tile_height) {
+		offset.y -= en->tile_size.y * tile_width * 0.5;
 	} else {
 		offset.y -= sprite_size.y * 0.5;
 	}
 
-	if (en.arch == ARCH_burner_drill) {
+	if (en->arch == ARCH_burner_drill) {
 		offset.x = tile_width * -0.5;
 	}
 
@@ -2572,6 +3088,7 @@ void do_entity_exp_drops(Entity* en) {
 		orb->is_item = true;
 		orb->pos = en->pos;
 		orb->has_physics = true;
+		entity_hot_sync(orb);
 		orb->friction = 20.f;
 		orb->velocity = v2_normalize(v2(get_random_float32_in_range(-1, 1), get_random_float32_in_range(-1, 1)));
 		orb->velocity = v2_mulf(orb->velocity, get_random_float32_in_range(100, 200));
@@ -2605,11 +3122,11 @@ void do_entity_drops(Entity* en) {
 	if (en->right_click_remove) {
 
 		// drop building stuff
-		Entity item_data = get_item_data(en->arch);
+		Entity* item_data = get_item_data(en->arch);
 		growing_array_add((void**)&drops, &en->arch);
 		// not dropping the raw materials anymore, so it's more clear that the item got destroyed.
-		// for (int i = 0; i < item_data.ingredients_count; i++) {
-		// 	ItemInstanceData drop = item_data.ingredients[i];
+		// for (int i = 0; i < item_data->ingredients_count; i++) {
+		// 	ItemInstanceData drop = item_data->ingredients[i];
 		// 	for (int j = 0; j < drop.amount; j++) {
 		// 		growing_array_add((void**)&drops, &drop.id);
 		// 	}
@@ -2652,7 +3169,7 @@ void item_tooltip(ItemInstanceData item) {
 	push_z_layer_in_frame(layer_tooltip, current_draw_frame);
 
 	Vector2 text_scale = v2(0.1, 0.1);
-	Entity item_data = get_item_data(item.id);
+	Entity* item_data = get_item_data(item.id);
 
 	Vector2 size = v2(40, 20);
 	Vector2 pos = get_mouse_pos_in_current_space();
@@ -2665,12 +3182,12 @@ void item_tooltip(ItemInstanceData item) {
 	y0 = pos.y + size.y;
 	y0 -= 2.f; // arbitrary padding
 
-	Gfx_Text_Metrics met = draw_text_with_pivot(font, item_data.pretty_name, font_height, v2(x0, y0), text_scale, COLOR_WHITE, PIVOT_top_center);
+	Gfx_Text_Metrics met = draw_text_with_pivot(font, item_data->pretty_name, font_height, v2(x0, y0), text_scale, COLOR_WHITE, PIVOT_top_center);
 	y0 -= met.visual_size.y;
 	y0 -= 2.f;
 
-	if (item_data.description.count) {
-		string txt = item_data.description;
+	if (item_data->description.count) {
+		string txt = item_data->description;
 		Gfx_Text_Metrics met = draw_text_with_pivot(font, txt, font_height_body, v2(x0, y0), text_scale, COLOR_WHITE, PIVOT_top_center);
 		y0 -= met.visual_size.y;
 		y0 -= 2.f;
@@ -2766,8 +3283,8 @@ void spawn_world_resources() {
 
 				// is it close to any entities?
 				bool too_close = false;
-				for (int j = 0; j < MAX_ENTITY_COUNT; j++) {
-					Entity* en = &world->entities[j];
+				for_each_entity(j) {
+					Entity* en = entity_at(j);
 					if (en->is_valid && en->arch == data.arch_id && !en->isnt_a_tile) {
 						int tile_radius = data.dist_from_self;
 						if (v2_dist(spawn_pos, en->pos) < tile_width * tile_radius) {
@@ -2890,30 +3407,25 @@ typedef struct Particle {
 	float light_intensity;
 	float light_radius;
 } Particle;
-Particle particles[2048] = {0};
-int particle_cursor = 0;
+// used to be a ring of 2048 that overwrote live particles when it wrapped, the pool just grows
+Pool particles = {0};
 
 Particle* particle_new() {
-	Particle* p = &particles[particle_cursor];
-	particle_cursor += 1;
-	if (particle_cursor >= ARRAY_COUNT(particles)) {
-		particle_cursor = 0;
-	}
-	if (p->flags & PARTICLE_FLAGS_valid) {
-		log_warning("too many particles, overwriting existing");
+	if (!particles.stride) {
+		particles = make_typed_pool(Particle, 2048, get_heap_allocator());
 	}
+	Particle* p = pool_alloc(&particles);
+	memset(p, 0, sizeof(Particle));
 	p->flags |= PARTICLE_FLAGS_valid;
 	return p;
 }
 void particle_clear(Particle* p) {
-	memset(p, 0, sizeof(Particle));
+	pool_free(&particles, p);
 }
 void particle_update() {
-	for (int i = 0; i < ARRAY_COUNT(particles); i++) {
-		Particle* p = &particles[i];
-		if (!(p->flags & PARTICLE_FLAGS_valid)) {
-			continue;
-		}
+	// backwards so particle_clear doesn't skip any
+	for (u64 i = particles.count; i-- > 0;) {
+		Particle* p = pool_get_live(&particles, i);
 
 		// set end time on first update frame of particle
 		if (p->lifetime_length && p->lifetime_end_time == 0) {
@@ -2928,6 +3440,7 @@ void particle_update() {
 		if (p->flags & PARTICLE_FLAGS_fade_out_with_velocity
 		&& v2_length(p->velocity) < 0.01) {
 			particle_clear(p);
+			continue;
 		}
 
 		if (p->flags & PARTICLE_FLAGS_physics) {
@@ -2942,11 +3455,8 @@ void particle_update() {
 	}
 }
 void particle_render() {
-	for (int i = 0; i < ARRAY_COUNT(particles); i++) {
-		Particle* p = &particles[i];
-		if (!(p->flags & PARTICLE_FLAGS_valid)) {
-			continue;
-		}
+	for (u64 i = 0; i < particles.count; i++) {
+		Particle* p = pool_get_live(&particles, i);
 
 		Vector4 col = p->col;
 		if (p->flags & PARTICLE_FLAGS_fade_out_with_velocity) {
@@ -3012,18 +3522,727 @@ void particle_emit(Vector2 pos, ParticleKind kind) {
 	}
 }
 
-// caveman :serialisation™️
-bool world_save_to_disk() {
-	return os_write_entire_file_s(STR("world"), (string){sizeof(World), (u8*)world});
+// caveman :serialisation™️ (now slightly less caveman)
+//
+// File is a WorldSaveHeader, then the body which might be lz compressed. The body is chunks of
+//     [u32 tag][u64 size][payload]
+// and we skip any chunk we don't know about.
+//
+// World and Entity get written field by field. Before each we write a schema chunk with every field's
+// name & size, and on load we match those up by name against the current tables. So adding, removing
+// or reordering fields doesn't break old saves: gone fields get dropped and new ones keep their defaults.
+// Arrays keep whatever overlaps if their count changes. Anything that changed size gets dropped, but only
+// sizes are stored so a type change that keeps the size (s32 -> f32) isn't caught, rename the field for those.
+//
+// Only live entities are written, each with its slot index so handles stored in the world still work.
+// An entity pool chunk before them has the highest index + 1. Loading rejects indices past that or past
+// SAVE_ENTITY_INDEX_SLACK times the entity count, and duplicates, so a bad file can't make us allocate
+// pages up to the max pool size. Counts and arch ids that index into arrays get checked too.
+//
+// Saving takes a snapshot on the main thread (a memcpy of World + the live entities), then the packing,
+// compression and the write happen on a background thread so autosaves don't hitch.
+//
+// New fields on World or Entity need adding to the tables below to get saved. #Sync
+#define WORLD_SAVE_MAGIC 0x444c5257 // "WRLD"
+#define WORLD_SAVE_VERSION 2
+#define WORLD_SAVE_FLAG_lz 1
+
+#define SAVE_TAG(a, b, c, d) ((u32)(a) | ((u32)(b) << 8) | ((u32)(c) << 16) | ((u32)(d) << 24))
+#define SAVE_CHUNK_world_schema  SAVE_TAG('W', 'S', 'C', 'H')
+#define SAVE_CHUNK_world         SAVE_TAG('W', 'R', 'L', 'D')
+#define SAVE_CHUNK_entity_schema SAVE_TAG('E', 'S', 'C', 'H')
+#define SAVE_CHUNK_entities      SAVE_TAG('E', 'N', 'T', 'S')
+#define SAVE_CHUNK_entity_pool   SAVE_TAG('E', 'P', 'O', 'L')
+
+// indices have to fit in this many times the entity count, so the pool we reserve on load stays
+// proportional to what's actually in the file
+#define SAVE_ENTITY_INDEX_SLACK 4
+#define SAVE_ENTITY_INDEX_MAX ((u64)ENTITY_PAGE_FIRST_SIZE * ((1ull << ENTITY_PAGE_MAX) - 1))
+
+typedef struct WorldSaveHeader {
+	u32 magic;
+	u32 version;
+	u32 flags;
+	u32 reserved;
+	u64 body_size; // uncompressed
+	u64 stored_size;
+} WorldSaveHeader;
+
+typedef struct SaveField {
+	const char* name;
+	u32 offset;
+	u32 size;
+	u32 elem_size; // same as size unless it's an array
+} SaveField;
+#define SAVE_FIELD(type, field) { #field, offsetof(type, field), sizeof(((type*)0)->field), sizeof(((type*)0)->field) }
+#define SAVE_ARRAY(type, field) { #field, offsetof(type, field), sizeof(((type*)0)->field), sizeof(((type*)0)->field[0]) }
+
+SaveField world_save_fields[] = {
+	SAVE_FIELD(World, id_count),
+	SAVE_FIELD(World, tick_count),
+	SAVE_FIELD(World, day_count),
+	SAVE_FIELD(World, cycle_end_time),
+	SAVE_FIELD(World, time_elapsed),
+	SAVE_ARRAY(World, inventory_items),
+	SAVE_FIELD(World, ux_state),
+	SAVE_FIELD(World, inventory_alpha),
+	SAVE_FIELD(World, inventory_alpha_target),
+	SAVE_FIELD(World, building_alpha),
+	SAVE_FIELD(World, building_alpha_target),
+	SAVE_FIELD(World, placing_building),
+	SAVE_FIELD(World, interacting_with_entity),
+	SAVE_FIELD(World, selected_research_thing),
+	SAVE_ARRAY(World, item_unlocks),
+	SAVE_ARRAY(World, resource_next_spawn_end_time),
+	SAVE_FIELD(World, oxygenerator),
+	SAVE_FIELD(World, mouse_cursor_item),
+	SAVE_FIELD(World, night_alpha),
+	SAVE_FIELD(World, night_alpha_target),
+	SAVE_FIELD(World, next_close_meteor_spawn_end_time),
+	SAVE_FIELD(World, next_far_meteor_spawn_end_time),
+	SAVE_FIELD(World, cursor_rotate_dir),
+};
+
+// pointers, strings and per frame state get skipped, the setup functions fill in the constant stuff on load
+SaveField entity_save_fields[] = {
+	SAVE_FIELD(Entity, is_valid),
+	SAVE_FIELD(Entity, id),
+	SAVE_FIELD(Entity, arch),
+	SAVE_FIELD(Entity, item),
+	SAVE_FIELD(Entity, pos),
+	SAVE_FIELD(Entity, render_sprite),
+	SAVE_FIELD(Entity, sprite_id),
+	SAVE_FIELD(Entity, health),
+	SAVE_FIELD(Entity, max_health),
+	SAVE_FIELD(Entity, destroyable_world_item),
+	SAVE_FIELD(Entity, current_crafting_amount),
+	SAVE_FIELD(Entity, crafting_end_time),
+	SAVE_ARRAY(Entity, drops),
+	SAVE_FIELD(Entity, drops_count),
+	SAVE_FIELD(Entity, dmg_type),
+	SAVE_FIELD(Entity, selected_crafting_item),
+	SAVE_FIELD(Entity, oxygen),
+	SAVE_FIELD(Entity, oxygen_max),
+	SAVE_FIELD(Entity, oxygen_deplete_end_time),
+	SAVE_FIELD(Entity, oxygen_regen_end_time),
+	SAVE_FIELD(Entity, is_oxygen_tether),
+	SAVE_FIELD(Entity, tether_connection_offset),
+	SAVE_FIELD(Entity, isnt_a_tile),
+	SAVE_FIELD(Entity, right_click_remove),
+	SAVE_FIELD(Entity, health_bar_current_alpha),
+	SAVE_FIELD(Entity, has_physics),
+	SAVE_FIELD(Entity, velocity),
+	SAVE_FIELD(Entity, acceleration),
+	SAVE_FIELD(Entity, friction),
+	SAVE_FIELD(Entity, disable_friction),
+	SAVE_FIELD(Entity, pick_up_cooldown_end_time),
+	SAVE_FIELD(Entity, white_flash_current_alpha),
+	SAVE_FIELD(Entity, exp_amount),
+	SAVE_ARRAY(Entity, storage_slots),
+	SAVE_FIELD(Entity, storage_slot_count),
+	SAVE_FIELD(Entity, input0),
+	SAVE_FIELD(Entity, input1),
+	SAVE_FIELD(Entity, output0),
+	SAVE_FIELD(Entity, anim_index),
+	SAVE_FIELD(Entity, time_til_next_frame),
+	SAVE_FIELD(Entity, last_move_dir),
+	SAVE_FIELD(Entity, next_hit_end_time),
+	SAVE_FIELD(Entity, radius),
+	SAVE_FIELD(Entity, interactable_entity),
+	SAVE_FIELD(Entity, last_fuel_max),
+	SAVE_FIELD(Entity, current_fuel),
+	SAVE_FIELD(Entity, offset_based_on_tile_height),
+	SAVE_FIELD(Entity, current_crafting_item),
+	SAVE_FIELD(Entity, progress_on_crafting),
+	SAVE_FIELD(Entity, progress),
+	SAVE_FIELD(Entity, progress_max),
+	SAVE_FIELD(Entity, next_crafting_progress_tick_end_time),
+	SAVE_FIELD(Entity, has_collision),
+	SAVE_FIELD(Entity, collision_bounds),
+	SAVE_FIELD(Entity, ignore_collision),
+	SAVE_FIELD(Entity, wall_seal),
+	SAVE_FIELD(Entity, move_based_on_input_axis),
+	SAVE_FIELD(Entity, move_speed),
+	SAVE_FIELD(Entity, is_being_knocked_back),
+	SAVE_FIELD(Entity, movement_cooldown_end_time),
+	SAVE_FIELD(Entity, is_agro),
+	SAVE_FIELD(Entity, is_enemy),
+	SAVE_FIELD(Entity, last_shoot_dir),
+	SAVE_FIELD(Entity, rotation_current),
+	SAVE_FIELD(Entity, rotation_target),
+	SAVE_FIELD(Entity, enemy_target),
+	SAVE_FIELD(Entity, destroyable_by_explosion),
+	SAVE_FIELD(Entity, meteor_destroy_without_drops),
+	SAVE_FIELD(Entity, spawned_from),
+	SAVE_FIELD(Entity, big_resource_drop),
+	SAVE_FIELD(Entity, z_layer),
+	SAVE_FIELD(Entity, has_input_storage),
+	SAVE_FIELD(Entity, dir),
+	SAVE_FIELD(Entity, next_update_end_time),
+	SAVE_FIELD(Entity, o2_consume),
+	SAVE_FIELD(Entity, o2_consume_amount),
+	SAVE_FIELD(Entity, o2_consume_rate),
+	SAVE_FIELD(Entity, next_consume_end_time),
+	SAVE_FIELD(Entity, has_anti_meteor_radius),
+	SAVE_FIELD(Entity, portal_view_pos),
+	SAVE_FIELD(Entity, teleported_at_time),
+	SAVE_FIELD(Entity, is_item),
+	SAVE_FIELD(Entity, can_be_placed),
+	SAVE_FIELD(Entity, dim),
+	SAVE_FIELD(Entity, dimension_target),
+	SAVE_FIELD(Entity, random_seed),
+	SAVE_FIELD(Entity, flip_sprite),
+	SAVE_FIELD(Entity, tile_size),
+	SAVE_FIELD(Entity, icon),
+	SAVE_FIELD(Entity, extra_axe_dmg),
+	SAVE_FIELD(Entity, extra_pickaxe_dmg),
+	SAVE_FIELD(Entity, extra_sickle_dmg),
+	SAVE_FIELD(Entity, for_structure),
+	SAVE_FIELD(Entity, craft_length),
+	SAVE_FIELD(Entity, furnace_transform_into),
+	SAVE_FIELD(Entity, disabled),
+	SAVE_FIELD(Entity, used_in_turret),
+	SAVE_FIELD(Entity, exp_cost),
+	SAVE_ARRAY(Entity, ingredients),
+	SAVE_FIELD(Entity, ingredients_count),
+	SAVE_ARRAY(Entity, research_ingredients),
+	SAVE_FIELD(Entity, research_ingredients_count),
+	SAVE_FIELD(Entity, stack_size),
+};
+
+// what we write to disk, or what we read from it before it gets applied to the world
+typedef struct WorldSnapshot {
+	World world;
+	u64 entity_count;
+	u32 index_end; // highest index + 1
+	u32* indices;
+	Entity* entities;
+} WorldSnapshot;
+
+void world_snapshot_destroy(WorldSnapshot* snapshot) {
+	if (snapshot->indices) dealloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), snapshot->indices);
+	if (snapshot->entities) dealloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), snapshot->entities);
+	*snapshot = (WorldSnapshot){0};
+}
+
+// main thread, just memcpys
+void world_snapshot_take(WorldSnapshot* snapshot) {
+	*snapshot = (WorldSnapshot){0};
+	snapshot->world = *world;
+	snapshot->entity_count = entity_live_count();
+	u64 alloc_count = max(snapshot->entity_count, 1);
+	snapshot->indices = alloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), alloc_count * sizeof(u32));
+	snapshot->entities = alloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), alloc_count * sizeof(Entity));
+	u64 n = 0;
+	snapshot->index_end = 1;
+	for_each_entity(i) {
+		snapshot->indices[n] = i;
+		snapshot->index_end = max(snapshot->index_end, (u32)i + 1);
+		memcpy(&snapshot->entities[n], entity_at(i), sizeof(Entity));
+		n += 1;
+	}
+	assert(n == snapshot->entity_count, "Live entity count is off");
+}
+
+u64 save_record_size(SaveField* fields, int field_count) {
+	u64 size = 0;
+	for (int i = 0; i < field_count; i++) {
+		size += fields[i].size;
+	}
+	return size;
+}
+
+u64 save_schema_size(SaveField* fields, int field_count) {
+	u64 size = sizeof(u32);
+	for (int i = 0; i < field_count; i++) {
+		size += sizeof(u32) + strlen(fields[i].name) + sizeof(u32) * 2;
+	}
+	return size;
+}
+
+inline u8* save_put(u8* at, const void* data, u64 size) {
+	memcpy(at, data, size);
+	return at + size;
+}
+
+u8* save_put_chunk_header(u8* at, u32 tag, u64 size) {
+	at = save_put(at, &tag, sizeof(u32));
+	return save_put(at, &size, sizeof(u64));
+}
+
+u8* save_put_schema(u8* at, u32 tag, SaveField* fields, int field_count) {
+	at = save_put_chunk_header(at, tag, save_schema_size(fields, field_count));
+	u32 count = field_count;
+	at = save_put(at, &count, sizeof(u32));
+	for (int i = 0; i < field_count; i++) {
+		u32 name_length = strlen(fields[i].name);
+		at = save_put(at, &name_length, sizeof(u32));
+		at = save_put(at, fields[i].name, name_length);
+		at = save_put(at, &fields[i].size, sizeof(u32));
+		at = save_put(at, &fields[i].elem_size, sizeof(u32));
+	}
+	return at;
+}
+
+u8* save_put_record(u8* at, const void* base, SaveField* fields, int field_count) {
+	for (int i = 0; i < field_count; i++) {
+		at = save_put(at, (u8*)base + fields[i].offset, fields[i].size);
+	}
+	return at;
+}
+
+// packs (and maybe compresses) a snapshot into the bytes that go on disk. safe to call from any thread.
+string world_snapshot_encode(WorldSnapshot* snapshot, bool compress) {
+	int world_field_count = ARRAY_COUNT(world_save_fields);
+	int entity_field_count = ARRAY_COUNT(entity_save_fields);
+	u64 chunk_header_size = sizeof(u32) + sizeof(u64);
+	u64 entity_record_size = save_record_size(entity_save_fields, entity_field_count);
+
+	u64 entities_size = sizeof(u64) + snapshot->entity_count * (sizeof(u32) + entity_record_size);
+	u64 body_size = chunk_header_size * 5
+		+ save_schema_size(world_save_fields, world_field_count)
+		+ save_record_size(world_save_fields, world_field_count)
+		+ save_schema_size(entity_save_fields, entity_field_count)
+		+ sizeof(u32)
+		+ entities_size;
+
+	u8* file = alloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), sizeof(WorldSaveHeader) + body_size);
+	u8* body = file + sizeof(WorldSaveHeader);
+	u8* at = body;
+	at = save_put_schema(at, SAVE_CHUNK_world_schema, world_save_fields, world_field_count);
+	at = save_put_chunk_header(at, SAVE_CHUNK_world, save_record_size(world_save_fields, world_field_count));
+	at = save_put_record(at, &snapshot->world, world_save_fields, world_field_count);
+	at = save_put_schema(at, SAVE_CHUNK_entity_schema, entity_save_fields, entity_field_count);
+	at = save_put_chunk_header(at, SAVE_CHUNK_entity_pool, sizeof(u32));
+	at = save_put(at, &snapshot->index_end, sizeof(u32));
+	at = save_put_chunk_header(at, SAVE_CHUNK_entities, entities_size);
+	at = save_put(at, &snapshot->entity_count, sizeof(u64));
+	for (u64 i = 0; i < snapshot->entity_count; i++) {
+		at = save_put(at, &snapshot->indices[i], sizeof(u32));
+		at = save_put_record(at, &snapshot->entities[i], entity_save_fields, entity_field_count);
+	}
+	assert(at == body + body_size, "World save size mismatch");
+
+	WorldSaveHeader header = {0};
+	header.magic = WORLD_SAVE_MAGIC;
+	header.version = WORLD_SAVE_VERSION;
+	header.body_size = body_size;
+	header.stored_size = body_size;
+
+	if (compress) {
+		u64 bound = lz_compress_bound(body_size);
+		u8* compressed = alloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), sizeof(WorldSaveHeader) + bound);
+		u64 compressed_size = lz_compress(body, body_size, compressed + sizeof(WorldSaveHeader), bound);
+		if (compressed_size > 0 && compressed_size < body_size) {
+			dealloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), file);
+			file = compressed;
+			header.flags |= WORLD_SAVE_FLAG_lz;
+			header.stored_size = compressed_size;
+		} else {
+			dealloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), compressed);
+		}
+	}
+	memcpy(file, &header, sizeof(WorldSaveHeader));
+
+	return (string){ sizeof(WorldSaveHeader) + header.stored_size, file };
 }
-bool world_attempt_load_from_disk() {
-	string result = {0};
-	bool succ = os_read_entire_file_s(STR("world"), &result, temp_allocator);
+
+// where each field from the file goes in the current struct
+typedef struct SaveFieldMap {
+	u32 file_offset; // in the record
+	u32 offset; // in the struct
+	u32 copy_size; // 0 if it's getting dropped
+} SaveFieldMap;
+
+typedef struct SaveSchema {
+	SaveFieldMap* fields; // growing array
+	u64 record_size;
+} SaveSchema;
+
+typedef struct SaveReader {
+	u8* at;
+	u8* end;
+	bool failed;
+} SaveReader;
+
+void save_read(SaveReader* r, void* out, u64 size) {
+	if (r->failed || (u64)(r->end - r->at) < size) {
+		r->failed = true;
+		memset(out, 0, size);
+		return;
+	}
+	memcpy(out, r->at, size);
+	r->at += size;
+}
+
+bool save_read_schema(SaveReader* r, SaveSchema* schema, SaveField* fields, int field_count) {
+	growing_array_init_reserve((void**)&schema->fields, sizeof(SaveFieldMap), field_count, get_tagged_heap_allocator(MEMORY_TAG_WORLD));
+	schema->record_size = 0;
+
+	u32 count;
+	save_read(r, &count, sizeof(u32));
+	for (u32 i = 0; i < count && !r->failed; i++) {
+		u32 name_length, size, elem_size;
+		save_read(r, &name_length, sizeof(u32));
+		if (r->failed || name_length > (u64)(r->end - r->at)) {
+			r->failed = true;
+			break;
+		}
+		string name = { name_length, r->at };
+		r->at += name_length;
+		save_read(r, &size, sizeof(u32));
+		save_read(r, &elem_size, sizeof(u32));
+
+		SaveFieldMap map = { schema->record_size, 0, 0 };
+		for (int j = 0; j < field_count; j++) {
+			if (!strings_match(name, STR(fields[j].name))) continue;
+			if (size == fields[j].size) {
+				map.copy_size = size;
+			} else if (elem_size == fields[j].elem_size && fields[j].elem_size != fields[j].size) {
+				map.copy_size = min(size, fields[j].size) / elem_size * elem_size;
+			} else {
+				log_warning("Save field '%s' changed size (%u -> %u), dropping it.", fields[j].name, size, fields[j].size);
+			}
+			map.offset = fields[j].offset;
+			break;
+		}
+		growing_array_add((void**)&schema->fields, &map);
+		schema->record_size += size;
+	}
+	return !r->failed;
+}
+
+void save_read_record(SaveSchema* schema, u8* record, void* base) {
+	int count = growing_array_get_valid_count(schema->fields);
+	for (int i = 0; i < count; i++) {
+		SaveFieldMap* map = &schema->fields[i];
+		if (map->copy_size) {
+			memcpy((u8*)base + map->offset, record + map->file_offset, map->copy_size);
+		}
+	}
+}
+
+bool save_arch_is_sane(ArchetypeID arch) {
+	return (u32)arch < ARCH_MAX;
+}
+bool save_items_are_sane(ItemInstanceData* items, u64 count) {
+	for (u64 i = 0; i < count; i++) {
+		if (!save_arch_is_sane(items[i].id)) return false;
+	}
+	return true;
+}
+
+// the counts and arch ids in here index straight into arrays, so a corrupt file could have us read & write past them
+bool save_entity_is_sane(Entity* en) {
+	if (!save_arch_is_sane(en->arch) || (u32)en->dim >= DIM_MAX || (u32)en->dimension_target >= DIM_MAX) return false;
+
+	if ((u32)en->drops_count > ARRAY_COUNT(en->drops)
+		|| (u32)en->storage_slot_count > ARRAY_COUNT(en->storage_slots)
+		|| (u32)en->ingredients_count > ARRAY_COUNT(en->ingredients)
+		|| (u32)en->research_ingredients_count > ARRAY_COUNT(en->research_ingredients)) {
+		return false;
+	}
+
+	if (!save_items_are_sane(en->drops, ARRAY_COUNT(en->drops))
+		|| !save_items_are_sane(en->ingredients, ARRAY_COUNT(en->ingredients))
+		|| !save_items_are_sane(en->research_ingredients, ARRAY_COUNT(en->research_ingredients))
+		|| !save_items_are_sane(&en->item, 1)
+		|| !save_items_are_sane(&en->input0, 1)
+		|| !save_items_are_sane(&en->input1, 1)
+		|| !save_items_are_sane(&en->output0, 1)) {
+		return false;
+	}
+	for (int i = 0; i < ARRAY_COUNT(en->storage_slots); i++) {
+		StorageSlot* slot = &en->storage_slots[i];
+		if (!save_items_are_sane(&slot->item, 1) || (u32)slot->desired_item_count > ARRAY_COUNT(slot->desired_items)) return false;
+		for (int j = 0; j < ARRAY_COUNT(slot->desired_items); j++) {
+			if (!save_arch_is_sane(slot->desired_items[j])) return false;
+		}
+	}
+
+	return save_arch_is_sane(en->selected_crafting_item)
+		&& save_arch_is_sane(en->current_crafting_item)
+		&& save_arch_is_sane(en->big_resource_drop)
+		&& save_arch_is_sane(en->for_structure)
+		&& save_arch_is_sane(en->furnace_transform_into);
+}
+
+bool save_indices_are_unique(u32* indices, u64 count) {
+	if (count < 2) return true;
+	u64* sorted = alloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), count * sizeof(u64) * 2);
+	for (u64 i = 0; i < count; i++) {
+		sorted[i] = indices[i];
+	}
+	// indices are < 2^30 so 32 bits is plenty
+	radix_sort(sorted, sorted + count, count, sizeof(u64), 0, 32);
+	bool unique = true;
+	for (u64 i = 1; i < count && unique; i++) {
+		unique = sorted[i] != sorted[i - 1];
+	}
+	dealloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), sorted);
+	return unique;
+}
+
+// the reverse of world_snapshot_encode, doesn't touch the world so it's safe to call from any thread
+bool world_snapshot_decode(string file, WorldSnapshot* snapshot) {
+	*snapshot = (WorldSnapshot){0};
+
+	WorldSaveHeader header = {0};
+	if (file.count >= sizeof(WorldSaveHeader)) {
+		memcpy(&header, file.data, sizeof(WorldSaveHeader));
+	}
+	if (header.magic != WORLD_SAVE_MAGIC) {
+		log_error("World file isn't a world save (or it's from before the save format got versioned).");
+		return false;
+	}
+	if (header.version != WORLD_SAVE_VERSION) {
+		log_error("World file is version %u, we only know version %u.", header.version, WORLD_SAVE_VERSION);
+		return false;
+	}
+	if (header.stored_size != file.count - sizeof(WorldSaveHeader)) {
+		log_error("World file is truncated.");
+		return false;
+	}
+
+	u8* body = file.data + sizeof(WorldSaveHeader);
+	u8* decompressed = 0;
+	if (header.flags & WORLD_SAVE_FLAG_lz) {
+		decompressed = alloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), max(header.body_size, 1));
+		if (!lz_decompress(body, header.stored_size, decompressed, header.body_size)) {
+			log_error("World file is corrupt, failed decompressing it.");
+			dealloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), decompressed);
+			return false;
+		}
+		body = decompressed;
+	} else if (header.body_size != header.stored_size) {
+		log_error("World file is corrupt.");
+		return false;
+	}
+
+	SaveSchema world_schema = {0};
+	SaveSchema entity_schema = {0};
+	bool has_world = false;
+	u32 index_end = 0; // 0 until we've seen the entity pool chunk
+
+	SaveReader r = { body, body + header.body_size, false };
+	while (r.at < r.end && !r.failed) {
+		u32 tag;
+		u64 size;
+		save_read(&r, &tag, sizeof(u32));
+		save_read(&r, &size, sizeof(u64));
+		if (r.failed || size > (u64)(r.end - r.at)) {
+			r.failed = true;
+			break;
+		}
+		SaveReader chunk = { r.at, r.at + size, false };
+		r.at += size;
+
+		switch (tag) {
+			case SAVE_CHUNK_world_schema: {
+				chunk.failed = !save_read_schema(&chunk, &world_schema, world_save_fields, ARRAY_COUNT(world_save_fields));
+			} break;
+			case SAVE_CHUNK_entity_schema: {
+				chunk.failed = !save_read_schema(&chunk, &entity_schema, entity_save_fields, ARRAY_COUNT(entity_save_fields));
+			} break;
+			case SAVE_CHUNK_entity_pool: {
+				save_read(&chunk, &index_end, sizeof(u32));
+				if (index_end == 0 || index_end > SAVE_ENTITY_INDEX_MAX) {
+					chunk.failed = true;
+				}
+			} break;
+			case SAVE_CHUNK_world: {
+				if (!world_schema.fields || size != world_schema.record_size) {
+					chunk.failed = true;
+					break;
+				}
+				save_read_record(&world_schema, chunk.at, &snapshot->world);
+				has_world = true;
+			} break;
+			case SAVE_CHUNK_entities: {
+				u64 count;
+				save_read(&chunk, &count, sizeof(u64));
+				u64 stride = sizeof(u32) + entity_schema.record_size;
+				if (chunk.failed || !entity_schema.fields || snapshot->entities || (size - sizeof(u64)) % stride != 0 || count != (size - sizeof(u64)) / stride) {
+					chunk.failed = true;
+					break;
+				}
+				// the stored index_end comes from the file too, so it only ever tightens the count based bound
+				u64 max_index_end = min(max((count + 1) * SAVE_ENTITY_INDEX_SLACK, ENTITY_PAGE_FIRST_SIZE), SAVE_ENTITY_INDEX_MAX);
+				if (index_end > max_index_end) {
+					chunk.failed = true;
+					break;
+				}
+				if (index_end) max_index_end = index_end;
+				snapshot->entity_count = count;
+				snapshot->indices = alloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), max(count, 1) * sizeof(u32));
+				snapshot->entities = alloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), max(count, 1) * sizeof(Entity));
+				memset(snapshot->entities, 0, max(count, 1) * sizeof(Entity));
+				for (u64 i = 0; i < count; i++) {
+					u8* record = chunk.at + i * stride;
+					u32 index;
+					memcpy(&index, record, sizeof(u32));
+					if (index == 0 || index >= max_index_end) {
+						chunk.failed = true;
+						break;
+					}
+					snapshot->indices[i] = index;
+					snapshot->index_end = max(snapshot->index_end, index + 1);
+					Entity* en = &snapshot->entities[i];
+					entity_apply_defaults(en);
+					save_read_record(&entity_schema, record + sizeof(u32), en);
+					if (!save_entity_is_sane(en)) {
+						chunk.failed = true;
+						break;
+					}
+				}
+				// two records in one slot would just overwrite each other
+				if (!chunk.failed && !save_indices_are_unique(snapshot->indices, count)) {
+					chunk.failed = true;
+				}
+			} break;
+			default: break; // from the future, skip it
+		}
+		if (chunk.failed) {
+			r.failed = true;
+		}
+	}
+
+	if (world_schema.fields) growing_array_deinit((void**)&world_schema.fields);
+	if (entity_schema.fields) growing_array_deinit((void**)&entity_schema.fields);
+	if (decompressed) dealloc(get_tagged_heap_allocator(MEMORY_TAG_WORLD), decompressed);
+
+	if (r.failed || !has_world) {
+		log_error("World file is corrupt.");
+		world_snapshot_destroy(snapshot);
+		return false;
+	}
+	return true;
+}
+
+// main thread, replaces the current world
+void world_snapshot_apply(WorldSnapshot* snapshot) {
+	*world = snapshot->world;
+	entity_pool_clear();
+	// decode already bounded index_end, so reserve all the pages up front
+	entity_pool_reserve(snapshot->index_end);
+	for (u64 i = 0; i < snapshot->entity_count; i++) {
+		u32 index = snapshot->indices[i];
+		Entity* en = entity_at(index);
+		memcpy(en, &snapshot->entities[i], sizeof(Entity));
+		en->is_valid = true;
+	}
+	entity_pool_rebuild();
+
+	// re-setup to override the static data
+	for_each_entity(i) {
+		Entity* en = entity_at(i);
+		entity_setup(en, en->arch);
+	}
+	power_graph_mark_dirty();
+}
+
+bool world_write_to_disk(WorldSnapshot* snapshot, bool compress) {
+	string file = world_snapshot_encode(snapshot, compress);
+	bool succ = os_write_entire_file_s(STR("world"), file);
+	dealloc_string(get_tagged_heap_allocator(MEMORY_TAG_WORLD), file);
 	if (!succ) {
+		log_error("Failed to save world.");
+	}
+	return succ;
+}
+
+bool world_read_from_disk(WorldSnapshot* snapshot) {
+	string file = {0};
+	if (!os_read_entire_file_s(STR("world"), &file, get_tagged_heap_allocator(MEMORY_TAG_WORLD))) {
 		log_error("Failed to load world.");
 		return false;
 	}
+	bool succ = world_snapshot_decode(file, snapshot);
+	dealloc_string(get_tagged_heap_allocator(MEMORY_TAG_WORLD), file);
+	return succ;
+}
+
+// :world io
+// one background save or load at a time
+typedef struct WorldIoJob {
+	Thread thread;
+	bool running; // started & not joined yet
+	volatile bool done;
+	bool is_load;
+	bool result;
+	WorldSnapshot snapshot;
+} WorldIoJob;
+WorldIoJob world_io;
+
+bool world_save_compress = true;
+
+void world_io_thread_proc(Thread* t) {
+	WorldIoJob* job = t->data;
+	if (job->is_load) {
+		job->result = world_read_from_disk(&job->snapshot);
+	} else {
+		job->result = world_write_to_disk(&job->snapshot, world_save_compress);
+		world_snapshot_destroy(&job->snapshot);
+	}
+	MEMORY_BARRIER;
+	job->done = true;
+}
+
+void world_io_start(bool is_load) {
+	world_io.is_load = is_load;
+	world_io.done = false;
+	world_io.result = false;
+	world_io.running = true;
+	os_thread_init(&world_io.thread, world_io_thread_proc);
+	world_io.thread.data = &world_io;
+	os_thread_start(&world_io.thread);
+}
 
+// blocks until the in flight save/load is done. a finished load gets applied here.
+bool world_io_wait() {
+	if (!world_io.running) {
+		return true;
+	}
+	os_thread_join(&world_io.thread);
+	os_thread_destroy(&world_io.thread);
+	world_io.running = false;
+
+	bool result = world_io.result;
+	if (world_io.is_load) {
+		if (result) {
+			world_snapshot_apply(&world_io.snapshot);
+			log("loaded");
+		}
+		world_snapshot_destroy(&world_io.snapshot);
+	}
+	return result;
+}
+
+// call once a frame, finishes up a background save/load if it's done
+void world_io_update() {
+	if (world_io.running && world_io.done) {
+		world_io_wait();
+	}
+}
+
+// the main thread only pays for the snapshot
+void world_save_to_disk_async() {
+	world_io_wait();
+	world_snapshot_take(&world_io.snapshot);
+	world_io_start(false);
+}
+
+void world_load_from_disk_async() {
+	world_io_wait();
+	world_io_start(true);
+}
+
+bool world_save_to_disk() {
+	world_save_to_disk_async();
+	return world_io_wait();
+}
+
+bool world_attempt_load_from_disk() {
 	// NOTE, for errors I used to do stuff like this assert:
 	// assert(result.count == sizeof(World), "world size has changed!");
 	//
@@ -3031,21 +4250,13 @@ bool world_attempt_load_from_disk() {
 	// That's why this function returns a bool. We handle that at the callsite.
 	// Maybe we want to just start up a new world, throw a user friendly error, or whatever as a fallback. Not just crash the game lol.
 
-	if (result.count != sizeof(World)) {
-		log_error("world size different to one on disk.");
+	world_io_wait();
+	WorldSnapshot snapshot;
+	if (!world_read_from_disk(&snapshot)) {
 		return false;
 	}
-
-	memcpy(world, result.data, result.count);
-
-	// re-setup to override the static data
-	for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-		Entity* en = &world->entities[i];
-		if (en->is_valid) {
-			entity_setup(en, en->arch);
-		}
-	}
-
+	world_snapshot_apply(&snapshot);
+	world_snapshot_destroy(&snapshot);
 	return true;
 }
 
@@ -3455,8 +4666,8 @@ void do_world_entity_interaction_ui_stuff() {
 			ArchetypeID* desired_items;
 			growing_array_init_reserve((void**)&desired_items, sizeof(ArchetypeID), 1, get_temporary_allocator());
 			for (ArchetypeID i = 0; i < ARCH_MAX; i++) {
-				Entity item_data = get_item_data(i);
-				if (item_data.used_in_turret) {
+				Entity* item_data = get_item_data(i);
+				if (item_data->used_in_turret) {
 					growing_array_add((void**)&desired_items, &i);
 				}
 			}
@@ -3801,7 +5012,7 @@ void do_ui_stuff() {
 			int slot_index = 0;
 			ItemInstanceData* hovered_item_slot = 0;
 			for (int i = 0; i < ARRAY_COUNT(world->inventory_items); i++) {
-				Entity item_data = get_item_data(i);
+				Entity* item_data = get_item_data(i);
 				ItemInstanceData* item = &world->inventory_items[i];
 				if (item->amount > 0) {
 
@@ -3872,7 +5083,7 @@ void do_ui_stuff() {
 		{
 			y0 -= 2.f;
 			x0 = x_middle;
-			string txt = get_archetype_data(ARCH_workbench).pretty_name;
+			string txt = get_archetype_data(ARCH_workbench)->pretty_name;
 			Gfx_Text_Metrics met = draw_text_with_pivot(font, txt, font_height, v2(x0, y0), text_scale, COLOR_WHITE, PIVOT_top_center);
 			y0 -= met.visual_size.y + 2.f;
 		}
@@ -3884,9 +5095,9 @@ void do_ui_stuff() {
 		ArchetypeID selected = 0;
 		int count = 0;
 		for (ArchetypeID i = 1; i < ARCH_MAX; i++) {
-			Entity item_data  = get_item_data(i);
+			Entity* item_data  = get_item_data(i);
 			bool unlocked = is_fully_unlocked(world->item_unlocks[i]);
-			if (item_data.ingredients_count == 0 || item_data.disabled) {
+			if (item_data->ingredients_count == 0 || item_data->disabled) {
 				continue;
 			}
 
@@ -3927,7 +5138,7 @@ void do_ui_stuff() {
 		if (selected)
 		defer_scope(push_z_layer_in_frame(layer_tooltip, current_draw_frame), pop_z_layer_in_frame(current_draw_frame)) {
 			UnlockState unlock_state = world->item_unlocks[selected];
-			Entity item_data = get_item_data(selected);
+			Entity* item_data = get_item_data(selected);
 
 			if (is_fully_unlocked(unlock_state)) {
 
@@ -3935,15 +5146,15 @@ void do_ui_stuff() {
 				if (is_key_just_pressed(MOUSE_BUTTON_LEFT)) {
 					consume_key_just_pressed(MOUSE_BUTTON_LEFT);
 
-					if (has_enough_for_recipe(item_data.ingredients, item_data.ingredients_count)) {
+					if (has_enough_for_recipe(item_data->ingredients, item_data->ingredients_count)) {
 						// insta craft straight into cursor
 						// #future, we'll wanna make this craft queue so we can lean into automated crafting
 
 						if (!world->mouse_cursor_item.id
-						|| (world->mouse_cursor_item.id == selected && world->mouse_cursor_item.amount + 1 <= item_data.stack_size)) {
+						|| (world->mouse_cursor_item.id == selected && world->mouse_cursor_item.amount + 1 <= item_data->stack_size)) {
 							world->mouse_cursor_item.id = selected;
 							world->mouse_cursor_item.amount += 1;
-							consume_recipe(item_data.ingredients, item_data.ingredients_count);
+							consume_recipe(item_data->ingredients, item_data->ingredients_count);
 							play_sound("event:/craft");
 						} else {
 							play_sound("event:/error");
@@ -3974,7 +5185,7 @@ void do_ui_stuff() {
 
 					// title
 					{
-						string txt = item_data.pretty_name;
+						string txt = item_data->pretty_name;
 						Gfx_Text_Metrics met = draw_text_with_pivot(font, txt, font_height, v2(x0, y0), text_scale, COLOR_WHITE, PIVOT_top_center);
 						y0 -= met.visual_size.y + padding;
 					}
@@ -3992,9 +5203,9 @@ void do_ui_stuff() {
 
 					// ingredient list
 					// #duplicate
-					for (int i = 0; i < item_data.ingredients_count; i++) {
-						ItemInstanceData ing = item_data.ingredients[i];
-						Entity ing_data = get_item_data(ing.id);
+					for (int i = 0; i < item_data->ingredients_count; i++) {
+						ItemInstanceData ing = item_data->ingredients[i];
+						Entity* ing_data = get_item_data(ing.id);
 
 						float height = font_height_body * text_scale.x;
 
@@ -4007,11 +5218,11 @@ void do_ui_stuff() {
 
 						{
 							Range2f rect = range2f_make_top_left(v2(x0, y0), v2(height, height));
-							draw_sprite_in_rect(ing_data.icon, rect, COLOR_WHITE, 0);
+							draw_sprite_in_rect(ing_data->icon, rect, COLOR_WHITE, 0);
 							x0 += height + 1.f;
 						}
 
-						string txt = tprint("%ix %s", ing.amount, ing_data.pretty_name);
+						string txt = tprint("%ix %s", ing.amount, ing_data->pretty_name);
 						Gfx_Text_Metrics met = draw_text_with_pivot(font, txt, font_height_body, v2(x0, y0), text_scale, col, PIVOT_top_left);
 						y0 -= met.visual_size.y + padding;
 					}
@@ -4023,7 +5234,7 @@ void do_ui_stuff() {
 						x0 = x_middle;
 
 						float wrap_width = width;
-						string text = item_data.description;
+						string text = item_data->description;
 
 						string* lines = split_text_to_lines_with_wrapping(text, wrap_width, font, font_height_body, text_scale, true);
 						for (int i = 0; i < growing_array_get_valid_count(lines); i++) {
@@ -4065,7 +5276,7 @@ void do_ui_stuff() {
 		{
 			y0 -= 2.f;
 			x0 = x_middle;
-			string txt = get_archetype_data(entity->arch).pretty_name;
+			string txt = get_archetype_data(entity->arch)->pretty_name;
 			Gfx_Text_Metrics met = draw_text_with_pivot(font, txt, font_height, v2(x0, y0), text_scale, COLOR_WHITE, PIVOT_top_center);
 			y0 -= met.visual_size.y + 2.f;
 			x0 = x_left;
@@ -4077,8 +5288,8 @@ void do_ui_stuff() {
 		int count = 0;
 		for (int i = 1; i < ARCH_MAX; i++) {
 			UnlockState unlock_state = world->item_unlocks[i];
-			Entity item_data = get_item_data(i);
-			if (item_data.ingredients_count == 0 || item_data.disabled || is_fully_unlocked(unlock_state)) {
+			Entity* item_data = get_item_data(i);
+			if (item_data->ingredients_count == 0 || item_data->disabled || is_fully_unlocked(unlock_state)) {
 				continue;
 			}
 
@@ -4114,15 +5325,15 @@ void do_ui_stuff() {
 
 		if (selected) {
 			UnlockState* unlock_state = &world->item_unlocks[selected];
-			Entity item_data = get_item_data(selected);
+			Entity* item_data = get_item_data(selected);
 
 			if (is_key_just_pressed(MOUSE_BUTTON_LEFT)) {
 				consume_key_just_pressed(MOUSE_BUTTON_LEFT);
 
-				bool has_ingredients = has_enough_for_recipe(item_data.research_ingredients, item_data.research_ingredients_count);
+				bool has_ingredients = has_enough_for_recipe(item_data->research_ingredients, item_data->research_ingredients_count);
 
 				if (has_ingredients) {
-					consume_recipe(item_data.research_ingredients, item_data.research_ingredients_count);
+					consume_recipe(item_data->research_ingredients, item_data->research_ingredients_count);
 					unlock_state->research_progress = 100;
 					play_sound("event:/research");
 				} else {
@@ -4150,7 +5361,7 @@ void do_ui_stuff() {
 
 			// title
 			{
-				string txt = item_data.pretty_name;
+				string txt = item_data->pretty_name;
 				Gfx_Text_Metrics met = draw_text_with_pivot(font, txt, font_height, v2(x0, y0), text_scale, COLOR_WHITE, PIVOT_top_center);
 				y0 -= met.visual_size.y + 2.f;
 			}
@@ -4160,7 +5371,7 @@ void do_ui_stuff() {
 				x0 = x_middle;
 
 				float wrap_width = size.x;
-				string text = item_data.description;
+				string text = item_data->description;
 
 				string* lines = split_text_to_lines_with_wrapping(text, wrap_width, font, font_height_body, text_scale, true);
 				for (int i = 0; i < growing_array_get_valid_count(lines); i++) {
@@ -4176,9 +5387,9 @@ void do_ui_stuff() {
 			// ingredient list
 			// #duplicate
 			float x_left_ingredient_list = x_left;
-			for (int i = 0; i < item_data.research_ingredients_count; i++) {
-				ItemInstanceData ing = item_data.research_ingredients[i];
-				Entity ing_data = get_item_data(ing.id);
+			for (int i = 0; i < item_data->research_ingredients_count; i++) {
+				ItemInstanceData ing = item_data->research_ingredients[i];
+				Entity* ing_data = get_item_data(ing.id);
 
 				float height = font_height_body * text_scale.x;
 
@@ -4191,11 +5402,11 @@ void do_ui_stuff() {
 
 				{
 					Range2f rect = range2f_make_top_left(v2(x0, y0), v2(height, height));
-					draw_sprite_in_rect(ing_data.icon, rect, COLOR_WHITE, 0);
+					draw_sprite_in_rect(ing_data->icon, rect, COLOR_WHITE, 0);
 					x0 += height + 1.f;
 				}
 
-				string txt = tprint("%ix %s", ing.amount, ing_data.pretty_name);
+				string txt = tprint("%ix %s", ing.amount, ing_data->pretty_name);
 				Gfx_Text_Metrics met = draw_text_with_pivot(font, txt, font_height_body, v2(x0, y0), text_scale, col, PIVOT_top_left);
 				y0 -= met.visual_size.y + 2.f;
 			}
@@ -4228,8 +5439,8 @@ void do_cursor_drawing_and_logic() {
 	defer_scope(push_z_layer_in_frame(layer_cursor_item, current_draw_frame), pop_z_layer_in_frame(current_draw_frame))
 	{
 		ArchetypeID item_id = world->mouse_cursor_item.id;
-		Entity item_data = get_item_data(world->mouse_cursor_item.id);
-		if (!item_data.can_be_placed || world_frame.hover_consumed) {
+		Entity* item_data = get_item_data(world->mouse_cursor_item.id);
+		if (!item_data->can_be_placed || world_frame.hover_consumed) {
 			// it's just an item
 			Sprite* sprite = get_sprite(get_sprite_id_from_item_instance(world->mouse_cursor_item));
 			Range2f rect = range2f_make_center_center(get_mouse_pos_in_current_space(), v2(10, 10));
@@ -4252,9 +5463,9 @@ void do_cursor_drawing_and_logic() {
 			// :place building
 			world_frame.hover_consumed = true;
 
-			SpriteID sprite_id = item_data.sprite_id;
-			ArchetypeID arch_id = item_data.arch;
-			Entity arch_data = get_archetype_data(arch_id);
+			SpriteID sprite_id = item_data->sprite_id;
+			ArchetypeID arch_id = item_data->arch;
+			Entity* arch_data = get_archetype_data(arch_id);
 
 			if (is_key_just_pressed('R')) {
 				consume_key_just_pressed('R');
@@ -4310,9 +5521,9 @@ void do_cursor_drawing_and_logic() {
 			}
 
 			// range preview
-			if (arch_data.radius)
+			if (arch_data->radius)
 			{
-				float radius = arch_data.radius;
+				float radius = arch_data->radius;
 				// #polish - make this an outline?
 				draw_circle_in_frame(v2_sub(pos, v2(radius, radius)), v2(radius*2, radius*2), v4(1, 1, 1, 0.05), current_draw_frame);
 			}
@@ -4336,13 +5547,13 @@ void do_cursor_drawing_and_logic() {
 			}
 
 			// :tether connection preview
-			if (arch_data.is_oxygen_tether)
+			if (arch_data->is_oxygen_tether)
 			{
-				for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-					Entity* tether = &world->entities[i];
-					if (tether->is_valid && tether->is_oxygen_tether && tether->last_frame.is_powered) {
+				for_each_entity_with(i, ENTITY_HOT_is_oxygen_tether) {
+					Entity* tether = entity_at(i);
+					if (tether->is_valid && tether->is_oxygen_tether && is_powered(tether)) {
 						if (v2_dist(tether->pos, pos) < tether_connection_radius) {
-							draw_line(v2_add(tether->pos, tether->tether_connection_offset), v2_add(pos, arch_data.tether_connection_offset), 1.0f, col_tether);
+							draw_line(v2_add(tether->pos, tether->tether_connection_offset), v2_add(pos, arch_data->tether_connection_offset), 1.0f, col_tether);
 							break;
 						}
 					}
@@ -4366,6 +5577,8 @@ void do_cursor_drawing_and_logic() {
 					en->pos = pos;
 					en->right_click_remove = true;
 					en->dir = world->cursor_rotate_dir;
+					// the power graph rebuilds later this frame, it needs to see this tile taken
+					add_new_entity_to_tile_cache(en, en->dim);
 
 					world->mouse_cursor_item.amount -= 1;
 					if (world->mouse_cursor_item.amount <= 0) {
@@ -4530,8 +5743,8 @@ void update_thumper(Entity* en) {
 
 			// get all entities in radius
 			bool did_hit_something = false;
-			for (int j = 0; j < MAX_ENTITY_COUNT; j++) {
-				Entity* against = &world->entities[j];
+			for_each_entity(j) {
+				Entity* against = entity_at(j);
 				if (against->destroyable_world_item && v2_dist(en->pos, against->pos) < en->radius) {
 					did_hit_something = true;
 
@@ -4560,8 +5773,8 @@ void update_thumper(Entity* en) {
 
 // :portal
 void do_portal_teleport_thing (Entity* player) {
-	for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-		Entity* portal = &world->entities[i];
+	for_each_entity(i) {
+		Entity* portal = entity_at(i);
 		if (!(portal->is_valid && portal->arch == ARCH_portal && portal->dim == get_player_dim())) continue;
 
 		float portal_width = tile_width * 7;
@@ -4580,6 +5793,7 @@ void do_portal_teleport_thing (Entity* player) {
 			Vector2 relative_to_portal = v2_sub(player->pos, portal->pos);
 			player->pos = v2_add(portal->portal_view_pos, relative_to_portal);
 			player->dim = portal->dimension_target;
+			entity_hot_sync(player);
 
 			Vector2 relative_cam_pos = v2_sub(camera_pos, old_player_pos);
 			camera_pos = v2_add(player->pos, relative_cam_pos);
@@ -4818,7 +6032,7 @@ void render_conveyor(Entity* en) {
 	draw_base_sprite(en);
 
 	if (en->input0.id) {
-		draw_sprite(get_item_data(en->input0.id).icon, en->pos);
+		draw_sprite(get_item_data(en->input0.id)->icon, en->pos);
 	}
 }
 
@@ -4826,8 +6040,8 @@ void render_conveyor(Entity* en) {
 void update_enemy_nest(Entity* en) {
 
 	int enemy_count = 0;
-	for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-		Entity* against = &world->entities[i];
+	for_each_entity(i) {
+		Entity* against = entity_at(i);
 		if (is_valid(against) && against->arch == ARCH_enemy1 && against->spawned_from.id == en->id) {
 			enemy_count += 1;
 		}
@@ -4887,8 +6101,8 @@ void update_meteor(Entity* en) {
 		}
 
 		// damage entities in a radius
-		for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-			Entity* against = &world->entities[i];
+		for_each_entity_with(i, ENTITY_HOT_destroyable_by_explosion) {
+			Entity* against = entity_at(i);
 			if (is_valid(against) && against->destroyable_by_explosion) {
 				float dist = v2_dist(against->pos, en->pos);
 				if (dist < en->radius) {
@@ -4985,8 +6199,8 @@ void update_turret(Entity* en) {
 	// find closest
 	Entity* closest_enemy = 0;
 	float closest_enemy_dist = 0;
-	for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-		Entity* against = &world->entities[i];
+	for_each_entity_with(i, ENTITY_HOT_is_enemy) {
+		Entity* against = entity_at(i);
 		if (against->is_valid && against != en && against->is_enemy) {
 
 			float dist = v2_dist(against->pos, en->pos);
@@ -5114,8 +6328,8 @@ void update_enemy(Entity* en) {
 	// find nearest natural target
 	Entity* nearest_target = 0;
 	float nearest_target_distance = 0;
-	for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-		Entity* against = &world->entities[i];
+	for_each_entity_with(i, ENTITY_HOT_enemy_target) {
+		Entity* against = entity_at(i);
 		if (is_valid(against) && against->enemy_target) {
 
 			if (against->arch == ARCH_player && !is_player_alive()) {
@@ -5225,9 +6439,9 @@ void draw_world_in_frame(Dimension dim) {
 
 	// grab entities and sort by Y pos
 	Entity** entities_to_render;
-	growing_array_init_reserve((void**)&entities_to_render, sizeof(Entity*), MAX_ENTITY_COUNT, get_temporary_allocator());
-	for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-		Entity* en = &world->entities[i];
+	growing_array_init_reserve((void**)&entities_to_render, sizeof(Entity*), entity_pool.capacity, get_temporary_allocator());
+	for_each_entity(i) {
+		Entity* en = entity_at(i);
 		if (!(en->is_valid && en->dim == dim)) {
 			continue;
 		}
@@ -5421,6 +6635,214 @@ void draw_world_in_frame(Dimension dim) {
 	}
 }
 
+// :physics
+
+#include "physics.c"
+
+// run with -bench_entities
+// the filter part of the per-frame entity loops, scanning the megastruct vs the hot store
+u64 entity_iteration_pass_megastruct() {
+	// the first page is laid out just like the old fixed World.entities array
+	Entity* entities = entity_pool.pages[0];
+	u64 checksum = 0;
+	for (int i = 0; i < ENTITY_PAGE_FIRST_SIZE; i++) {
+		Entity* en = &entities[i];
+		if (en->is_valid && en->has_physics) checksum += i;
+	}
+	for (int i = 0; i < ENTITY_PAGE_FIRST_SIZE; i++) {
+		Entity* en = &entities[i];
+		if (en->is_valid && en->has_collision) checksum += i;
+	}
+	for (int i = 0; i < ENTITY_PAGE_FIRST_SIZE; i++) {
+		Entity* en = &entities[i];
+		if (en->is_valid && en->is_oxygen_tether) checksum += i;
+	}
+	for (int i = 0; i < ENTITY_PAGE_FIRST_SIZE; i++) {
+		Entity* en = &entities[i];
+		if (en->is_valid && en->is_enemy) checksum += i;
+	}
+	for (int i = 0; i < ENTITY_PAGE_FIRST_SIZE; i++) {
+		Entity* en = &entities[i];
+		if (en->is_valid && en->dim == DIM_first) checksum += i;
+	}
+	return checksum;
+}
+
+u64 entity_iteration_pass_hot() {
+	u64 checksum = 0;
+	for_each_entity_with(i, ENTITY_HOT_has_physics) {
+		checksum += i;
+	}
+	for_each_entity_with(i, ENTITY_HOT_has_collision) {
+		checksum += i;
+	}
+	for_each_entity_with(i, ENTITY_HOT_is_oxygen_tether) {
+		checksum += i;
+	}
+	for_each_entity_with(i, ENTITY_HOT_is_enemy) {
+		checksum += i;
+	}
+	for_each_entity(i) {
+		if (entity_hot.dim[i] == DIM_first) checksum += i;
+	}
+	return checksum;
+}
+
+void entity_iteration_benchmark() {
+
+	seed_for_random = 69;
+	memset(world, 0, sizeof(World));
+	entity_pool_clear();
+
+	// roughly what a built up base looks like, a bit under half full with holes everywhere
+	for (int i = 1; i < ENTITY_PAGE_FIRST_SIZE; i++) {
+		if (get_random_int_in_range(0, 9) >= 4) continue;
+		Entity* en = entity_at(i);
+		entity_apply_defaults(en);
+		en->is_valid = true;
+		en->id = i;
+		en->arch = get_random_int_in_range(1, ARCH_MAX - 1);
+		en->dim = get_random_int_in_range(0, 5) == 0 ? DIM_second : DIM_first;
+		en->has_collision = get_random_int_in_range(0, 1);
+		en->has_physics = get_random_int_in_range(0, 9) == 0;
+		en->is_oxygen_tether = get_random_int_in_range(0, 9) == 0;
+		en->is_enemy = get_random_int_in_range(0, 19) == 0;
+	}
+	entity_pool_rebuild();
+
+	// In a real frame rendering & everything else pushes the world out of cache between our loops,
+	// so we time both a warm loop and one where we trash the cache before each pass.
+	u64 trash_size = 32 * 1024 * 1024;
+	u8* trash = alloc(get_heap_allocator(), trash_size);
+
+	for (int cold = 0; cold <= 1; cold++) {
+		int pass_count = cold ? 200 : 2000;
+		u64 old_checksum = 0;
+		u64 hot_checksum = 0;
+		float64 old_seconds = 0;
+		float64 hot_seconds = 0;
+		for (int pass = 0; pass < pass_count; pass++) {
+			if (cold) memset(trash, pass, trash_size);
+			float64 start = os_get_elapsed_seconds();
+			old_checksum += entity_iteration_pass_megastruct();
+			old_seconds += os_get_elapsed_seconds() - start;
+
+			if (cold) memset(trash, pass, trash_size);
+			start = os_get_elapsed_seconds();
+			hot_checksum += entity_iteration_pass_hot();
+			hot_seconds += os_get_elapsed_seconds() - start;
+		}
+		assert(old_checksum == hot_checksum, "Hot store iteration gave different results");
+
+		log("entity iteration benchmark (%s cache), %d byte Entity, 5 filter loops per pass", cold ? "cold" : "warm", (int)sizeof(Entity));
+		log("  megastruct: %.2f us/pass", old_seconds * 1000000.0 / pass_count);
+		log("  hot store:  %.2f us/pass", hot_seconds * 1000000.0 / pass_count);
+	}
+
+	dealloc(get_heap_allocator(), trash);
+	memset(world, 0, sizeof(World));
+	entity_pool_clear();
+}
+
+// run with -bench_save
+// full worlds of different sizes through every step of a save & load
+void world_save_benchmark() {
+	ArchetypeID arches[] = { ARCH_tree, ARCH_rock, ARCH_grass, ARCH_tether, ARCH_wall, ARCH_furnace, ARCH_wood_crate, ARCH_conveyor, ARCH_enemy1, ARCH_exp_vein, ARCH_burner_drill };
+	int entity_counts[] = { 1000, 10000, 50000 };
+
+	for (int c = 0; c < ARRAY_COUNT(entity_counts); c++) {
+		int entity_count = entity_counts[c];
+		seed_for_random = 69;
+		memset(world, 0, sizeof(World));
+		entity_pool_clear();
+
+		float spread = 200 * tile_width;
+		for (int i = 0; i < entity_count; i++) {
+			Entity* en = entity_create(get_random_int_in_range(0, 5) == 0 ? DIM_second : DIM_first);
+			entity_setup(en, arches[get_random_int_in_range(0, ARRAY_COUNT(arches) - 1)]);
+			en->pos = v2(get_random_float32_in_range(-spread, spread), get_random_float32_in_range(-spread, spread));
+			en->health = get_random_int_in_range(1, max(en->max_health, 1));
+			if (en->has_input_storage) {
+				en->storage_slots[0].item = (ItemInstanceData){ .id=ARCH_rock, .amount=get_random_int_in_range(1, 64) };
+			}
+		}
+		// some holes, like a world that's been played for a while
+		for_each_entity(i) {
+			if (get_random_int_in_range(0, 9) == 0) {
+				entity_zero_immediately(entity_at(i));
+			}
+		}
+		entity_pool_flush();
+
+		u64 checksum_before = 0;
+		for_each_entity(i) {
+			checksum_before += (u64)i * entity_at(i)->id + (u64)entity_at(i)->health;
+		}
+		int live_before = entity_live_count();
+
+		// once untimed so both encodes get warmed up memory
+		WorldSnapshot snapshot;
+		world_snapshot_take(&snapshot);
+		dealloc_string(get_heap_allocator(), world_snapshot_encode(&snapshot, true));
+		world_snapshot_destroy(&snapshot);
+
+		float64 start = os_get_elapsed_seconds();
+		world_snapshot_take(&snapshot);
+		float64 snapshot_seconds = os_get_elapsed_seconds() - start;
+
+		start = os_get_elapsed_seconds();
+		string raw = world_snapshot_encode(&snapshot, false);
+		float64 encode_raw_seconds = os_get_elapsed_seconds() - start;
+
+		start = os_get_elapsed_seconds();
+		string compressed = world_snapshot_encode(&snapshot, true);
+		float64 encode_lz_seconds = os_get_elapsed_seconds() - start;
+		world_snapshot_destroy(&snapshot);
+
+		start = os_get_elapsed_seconds();
+		bool written = os_write_entire_file_s(STR("world_bench"), compressed);
+		float64 write_seconds = os_get_elapsed_seconds() - start;
+		assert(written, "Failed writing the benchmark world");
+
+		start = os_get_elapsed_seconds();
+		string file = {0};
+		bool read = os_read_entire_file_s(STR("world_bench"), &file, get_heap_allocator());
+		float64 read_seconds = os_get_elapsed_seconds() - start;
+		assert(read, "Failed reading the benchmark world");
+
+		start = os_get_elapsed_seconds();
+		WorldSnapshot loaded;
+		bool decoded = world_snapshot_decode(file, &loaded);
+		float64 decode_seconds = os_get_elapsed_seconds() - start;
+		assert(decoded, "Failed decoding the benchmark world");
+
+		start = os_get_elapsed_seconds();
+		world_snapshot_apply(&loaded);
+		float64 apply_seconds = os_get_elapsed_seconds() - start;
+		world_snapshot_destroy(&loaded);
+
+		u64 checksum_after = 0;
+		for_each_entity(i) {
+			checksum_after += (u64)i * entity_at(i)->id + (u64)entity_at(i)->health;
+		}
+		assert(checksum_before == checksum_after && live_before == entity_live_count(), "World didn't survive the round trip");
+
+		log("save benchmark, %d entities, raw World dump would be %.1f mb", live_before, (float64)(sizeof(World) + (u64)entity_pool.capacity * sizeof(Entity)) / (1024.0 * 1024.0));
+		log("  size:     raw %.2f mb, lz %.2f mb", (float64)raw.count / (1024.0 * 1024.0), (float64)compressed.count / (1024.0 * 1024.0));
+		log("  save:     snapshot %.2f ms (main thread), pack %.2f ms, pack+lz %.2f ms, write %.2f ms",
+			snapshot_seconds * 1000.0, encode_raw_seconds * 1000.0, encode_lz_seconds * 1000.0, write_seconds * 1000.0);
+		log("  load:     read %.2f ms, unpack %.2f ms, apply %.2f ms", read_seconds * 1000.0, decode_seconds * 1000.0, apply_seconds * 1000.0);
+
+		dealloc_string(get_heap_allocator(), raw);
+		dealloc_string(get_heap_allocator(), compressed);
+		dealloc_string(get_heap_allocator(), file);
+	}
+
+	os_file_delete_s(STR("world_bench"));
+	memset(world, 0, sizeof(World));
+	entity_pool_clear();
+}
+
 // :entry
 int entry(int argc, char **argv) {
 	window.title = STR("Randy's Game");
@@ -5431,6 +6853,16 @@ int entry(int argc, char **argv) {
 
 	world = alloc(get_heap_allocator(), sizeof(World));
 	memset(world, 0, sizeof(World));
+	entity_pool_init();
+
+	if (argc > 1 && strcmp(argv[1], "-bench_entities") == 0) {
+		entity_iteration_benchmark();
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "-bench_save") == 0) {
+		world_save_benchmark();
+		return 0;
+	}
 
 	// :init
 
@@ -5453,7 +6885,7 @@ int entry(int argc, char **argv) {
 	col_tether.a = 0.5;
 
 	// sprite setup
-	{
+	memory_tag_scope(MEMORY_TAG_RENDERER) {
 		sprites[0] = (Sprite){ .image=load_image_from_disk(STR("res/sprites/missing_tex.png"), get_heap_allocator()) };
 		// sprites[SPRITE_player] = (Sprite){ .image=load_image_from_disk(STR("res/sprites/player.png"), get_heap_allocator()) };
 		sprites[SPRITE_tree0] = (Sprite){ .image=load_image_from_disk(STR("res/sprites/tree0.png"), get_heap_allocator()) };
@@ -5535,7 +6967,7 @@ int entry(int argc, char **argv) {
 		#endif
 	}
 
-	font = load_font_from_disk(STR("C:/windows/fonts/arial.ttf"), get_heap_allocator());
+	font = load_font_from_disk(STR("C:/windows/fonts/arial.ttf"), get_tagged_heap_allocator(MEMORY_TAG_FONTS));
 	assert(font, "Failed loading arial.ttf, %d", GetLastError());
 
 	setup_entity_archetype_data_cache();
@@ -5557,7 +6989,7 @@ int entry(int argc, char **argv) {
 	} else {
 		world_setup();
 	}
-	world_save_to_disk();
+	world_save_to_disk_async();
 
 	Draw_Frame offscreen_draw_frame;
 	draw_frame_init(&offscreen_draw_frame);
@@ -5579,6 +7011,7 @@ int entry(int argc, char **argv) {
 		delta_t = current_time - last_time;
 		last_time = current_time;
 		os_update();
+		memory_tracking_update();
 		current_draw_frame = 0;
 
 		local_persist Gfx_Image *game_image = 0;
@@ -5593,14 +7026,18 @@ int entry(int argc, char **argv) {
 		}
 		last_window = window;
 
+		world_io_update();
+		entity_pool_flush();
+		#if CONFIGURATION == DEBUG
+		entity_hot_validate();
+		#endif
+
 		// zero entity frame state
-		for (int i = 0; i < MAX_ENTITY_COUNT; i++)
+		for_each_entity(i)
 		{
-			Entity* en = &world->entities[i];
-			if (en->is_valid) {
-				en->last_frame = en->frame;
-				en->frame = (EntityFrame){0};
-			}
+			Entity* en = entity_at(i);
+			en->last_frame = en->frame;
+			en->frame = (EntityFrame){0};
 		}
 
 		// reset appframe
@@ -5617,10 +7054,9 @@ int entry(int argc, char **argv) {
 			create_tile_entity_pair_cache();
 
 			// find player lol
-			for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-				Entity* en = &world->entities[i];
-				if (en->is_valid && en->arch == ARCH_player) {
-					world_frame.player = en;
+			for_each_entity(i) {
+				if (entity_hot.arch[i] == ARCH_player) {
+					world_frame.player = entity_at(i);
 				}
 			}
 
@@ -5647,6 +7083,12 @@ int entry(int argc, char **argv) {
 			consume_key_just_pressed(KEY_F11);
 			window.fullscreen = !window.fullscreen;
 		}
+		#if ENABLE_PROFILING
+		if (is_key_just_pressed(KEY_F3)) {
+			consume_key_just_pressed(KEY_F3);
+			show_profiler_overlay = !show_profiler_overlay;
+		}
+		#endif
 
 		// :player input axis
 		if (is_player_alive()) {
@@ -5723,93 +7165,9 @@ int entry(int argc, char **argv) {
 		}
 
 		// :tether stuff
-		{
-			// for each tether, find all nearby tethers
-			for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-				Entity* self_tether = &world->entities[i];
-				if (self_tether->is_valid && self_tether->is_oxygen_tether) {
-
-					Entity** nearby_tethers;
-					growing_array_init_reserve((void**)&nearby_tethers, sizeof(Entity*), 1, get_temporary_allocator());
-					for (int j = 0; j < MAX_ENTITY_COUNT; j++) {
-						Entity* nearby_tether = &world->entities[j];
-						if (!(nearby_tether->is_valid && nearby_tether->dim == self_tether->dim)) {
-							continue;
-						}
-						if (nearby_tether != self_tether && nearby_tether->is_valid && nearby_tether->is_oxygen_tether) {
-							if (v2_dist(nearby_tether->pos, self_tether->pos) < tether_connection_radius) {
-								growing_array_add((void**)&nearby_tethers, &nearby_tether);
-							}
-						}
-					}
-
-					self_tether->frame.connected_to_tethers = nearby_tethers;
-				}
-			}
-
-			// run through connections recursively, starting at the core tether
-			Entity* oxygenerator = entity_from_handle(world->oxygenerator);
-			if (oxygenerator->oxygen > 0)
-			{
-				Entity** connection_stack;
-				growing_array_init_reserve((void**)&connection_stack, sizeof(Entity*), 1, get_temporary_allocator());
-				growing_array_add((void**)&connection_stack, &oxygenerator);
-
-				while (growing_array_get_valid_count(connection_stack)) {
-					Entity* current = connection_stack[growing_array_get_valid_count(connection_stack)-1];
-					growing_array_pop((void**)&connection_stack);
-
-					for (int i = 0; i < growing_array_get_valid_count(current->frame.connected_to_tethers); i ++) {
-						Entity* connected_tether = current->frame.connected_to_tethers[i];
-						if (!connected_tether->frame.is_powered) {
-							growing_array_add((void**)&connection_stack, &connected_tether);
-							connected_tether->frame.is_powered = true;
-							draw_line(v2_add(connected_tether->pos, connected_tether->tether_connection_offset), v2_add(current->pos, current->tether_connection_offset), 1.0f, col_tether);
-						}
-					}
-				}
-			}
-		}
-
-		// for each o2 emitter, run through neighboring wall seals, making them powered
+		// powers tethers connected to the oxygenerator, and wall seals around powered o2 emitters
 		tm_scope("power algo")
-		for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-			Entity* en = &world->entities[i];
-			if (en->is_valid && en->arch == ARCH_o2_emitter && en->frame.is_powered) {
-
-				Entity** stack;
-				growing_array_init_reserve((void**)&stack, sizeof(Entity*), 1, get_temporary_allocator());
-				growing_array_add((void**)&stack, &en);
-
-				while (growing_array_get_valid_count(stack)) {
-					Entity* current = stack[growing_array_get_valid_count(stack)-1];
-					growing_array_pop((void**)&stack);
-
-					current->frame.is_powered = true;
-					Tile current_tile = v2_world_pos_to_tile_pos(current->pos);
-
-					Entity* left = entity_at_tile(v2i_add(v2i(-1, 0), current_tile), DIM_first);
-					if (left && left->wall_seal && !left->frame.is_powered) {
-						growing_array_add((void**)&stack, &left);
-					}
-
-					Entity* right = entity_at_tile(v2i_add(v2i(1, 0), current_tile), DIM_first);
-					if (right && right->wall_seal && !right->frame.is_powered) {
-						growing_array_add((void**)&stack, &right);
-					}
-
-					Entity* top = entity_at_tile(v2i_add(v2i(0, 1), current_tile), DIM_first);
-					if (top && top->wall_seal && !top->frame.is_powered) {
-						growing_array_add((void**)&stack, &top);
-					}
-
-					Entity* bottom = entity_at_tile(v2i_add(v2i(0, -1), current_tile), DIM_first);
-					if (bottom && bottom->wall_seal && !bottom->frame.is_powered) {
-						growing_array_add((void**)&stack, &bottom);
-					}
-				}
-			}
-		}
+		power_graph_update();
 
 		// figure out if the player is inside
 		bool is_inside = true;
@@ -5863,8 +7221,8 @@ int entry(int argc, char **argv) {
 		if (!world_frame.hover_consumed)
 		{
 			float smallest_dist = 99999;
-			for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-				Entity* en = &world->entities[i];
+			for_each_entity(i) {
+				Entity* en = entity_at(i);
 				if (!(en->is_valid && en->dim == get_player_dim())) {
 					continue;
 				}
@@ -5945,8 +7303,8 @@ int entry(int argc, char **argv) {
 		{
 			Entity** anti_meteor_entities;
 			growing_array_init_reserve((void**)&anti_meteor_entities, sizeof(Entity*), 1, get_temporary_allocator());
-			for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-				Entity* en = &world->entities[i];
+			for_each_entity_with(i, ENTITY_HOT_has_anti_meteor_radius) {
+				Entity* en = entity_at(i);
 				if (en->is_valid && en->has_anti_meteor_radius && en->radius != 0 && en->last_frame.is_powered) {
 					growing_array_add((void**)&anti_meteor_entities, &en);
 				}
@@ -5963,7 +7321,7 @@ int entry(int argc, char **argv) {
 				if (has_reached_end_time(world->next_close_meteor_spawn_end_time)) {
 					world->next_close_meteor_spawn_end_time = 0;
 
-					float meteor_radius = get_archetype_data(ARCH_meteor).radius;
+					float meteor_radius = get_archetype_data(ARCH_meteor)->radius;
 
 					Vector2 spawn_pos;
 					bool found_pos = false;
@@ -6018,7 +7376,7 @@ int entry(int argc, char **argv) {
 				if (has_reached_end_time(world->next_far_meteor_spawn_end_time)) {
 					world->next_far_meteor_spawn_end_time = 0;
 
-					float meteor_radius = get_archetype_data(ARCH_meteor).radius;
+					float meteor_radius = get_archetype_data(ARCH_meteor)->radius;
 
 					Vector2 spawn_pos;
 					bool found_pos = false;
@@ -6068,8 +7426,8 @@ int entry(int argc, char **argv) {
 		// nests need to be updated prior, beacuse they spawn the enemies
 		// enemies need to be updated later to ensure there's at least a nil target, otherwise we crash
 		tm_scope("enemy update")
-		for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-			Entity* en = &world->entities[i];
+		for_each_entity(i) {
+			Entity* en = entity_at(i);
 			if (en->is_valid) {
 				if (en->arch == ARCH_enemy_nest) {
 					update_enemy_nest(en);
@@ -6079,8 +7437,8 @@ int entry(int argc, char **argv) {
 
 		// update portal controllers before the portals.
 		// They stuff their items into the surrounding portals.
-		for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-			Entity* en = &world->entities[i];
+		for_each_entity(i) {
+			Entity* en = entity_at(i);
 			if (!(en->is_valid && en->arch == ARCH_portal_controller)) continue;
 			update_portal_controller(en);
 		}
@@ -6088,8 +7446,8 @@ int entry(int argc, char **argv) {
 		// update entities
 		Entity* player = get_player();
 		tm_scope("entity update")
-		for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-			Entity* en = &world->entities[i];
+		for_each_entity(i) {
+			Entity* en = entity_at(i);
 			if (en->is_valid) {
 
 				switch (en->arch) {
@@ -6146,11 +7504,11 @@ int entry(int argc, char **argv) {
 						en->next_crafting_progress_tick_end_time = now() + 0.1;
 						if (en->progress_on_crafting >= 100) {
 
-							Entity item_data = get_item_data(en->current_crafting_item);
+							Entity* item_data = get_item_data(en->current_crafting_item);
 
 							// :CRAFT!
 							Entity* drop = entity_create(en->dim);
-							setup_item(drop, item_data.furnace_transform_into);
+							setup_item(drop, item_data->furnace_transform_into);
 							drop->pos = en->pos;
 							drop->pos = v2_add(drop->pos, v2(get_random_float32_in_range(-2, 2), get_random_float32_in_range(-2, 2)));
 							drop->pick_up_cooldown_end_time = now() + get_random_float32_in_range(0.1, 0.3);
@@ -6278,6 +7636,7 @@ int entry(int argc, char **argv) {
 
 					if (en->frame.is_being_picked_up) {
 						en->has_physics = true;
+						entity_hot_sync(en);
 						en->disable_friction = true;
 						Vector2 pick_up_target_pos = player->pos;
 						Vector2 target_normal = v2_normalize(v2_sub(pick_up_target_pos, en->pos));
@@ -6314,97 +7673,9 @@ int entry(int argc, char **argv) {
 			}
 		}
 
-		// cache all entities that're collidable
-		Entity** collision_entities;
-		growing_array_init_reserve((void**)&collision_entities, sizeof(Entity*), 1, get_temporary_allocator());
-		for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-			Entity* en = &world->entities[i];
-			if (en->is_valid && en->has_collision) {
-				growing_array_add((void**)&collision_entities, &en);
-			}
-		}
-
 		// :physics update
 		tm_scope("physics")
-		for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-			Entity* en = &world->entities[i];
-			if (!en->is_valid || !en->has_physics) {
-				continue;
-			}
-
-			Vector2 next_pos = {0};
-			if (en->move_based_on_input_axis) {
-				next_pos = v2_add(en->pos, v2_mulf(en->frame.input_axis, en->move_speed * delta_t));
-			} else {
-				// https://guide.handmadehero.org/code/day043
-				
-				// "friction"
-				if (!en->disable_friction) {
-					en->acceleration = v2_sub(en->acceleration, v2_mulf(en->velocity, en->friction));
-				}
-				// integrate
-				en->velocity = v2_add(en->velocity, v2_mulf(en->acceleration, delta_t));
-				next_pos = v2_add(en->pos, v2_mulf(en->velocity, delta_t));
-				en->acceleration = (Vector2){0};
-			}
-
-			if (!en->ignore_collision) {
-				Range2f our_bounds = get_entity_collision_bounds(en);
-				our_bounds = range2f_shift(our_bounds, en->pos);
-
-				// resolve collisions
-				// courtesy of chatgpt
-				for (int j = 0; j < growing_array_get_valid_count(collision_entities); j++) {
-					Entity* against = collision_entities[j];
-					if (against->dim != en->dim) {
-						continue;
-					}
-
-					// Skip self
-					if (against == en) {
-						continue;
-					}
-
-					// Get the collision bounds of the other entity
-					Range2f bounds = range2f_shift(get_entity_collision_bounds(against), against->pos);
-
-					// Get our predicted bounds at next position
-					Range2f next_bounds = range2f_shift(get_entity_collision_bounds(en), next_pos);
-
-					// Check for collision between next_bounds and bounds
-					bool overlap_x = next_bounds.min.x < bounds.max.x && next_bounds.max.x > bounds.min.x;
-					bool overlap_y = next_bounds.min.y < bounds.max.y && next_bounds.max.y > bounds.min.y;
-
-					if (overlap_x && overlap_y) {
-						// Collision detected, resolve it
-
-						// Calculate the penetration distances on both axes
-						float penetration_x1 = bounds.max.x - next_bounds.min.x; // Positive if overlapping from the left
-						float penetration_x2 = next_bounds.max.x - bounds.min.x; // Positive if overlapping from the right
-						float penetration_x = (penetration_x1 < penetration_x2) ? penetration_x1 : -penetration_x2;
-
-						float penetration_y1 = bounds.max.y - next_bounds.min.y; // Positive if overlapping from the bottom
-						float penetration_y2 = next_bounds.max.y - bounds.min.y; // Positive if overlapping from the top
-						float penetration_y = (penetration_y1 < penetration_y2) ? penetration_y1 : -penetration_y2;
-
-						// Resolve collision by moving next_pos out of collision along the axis of least penetration
-						if (fabsf(penetration_x) < fabsf(penetration_y)) {
-							// Resolve along X axis
-							next_pos.x += penetration_x;
-							en->velocity.x = 0;
-						} else {
-							// Resolve along Y axis
-							next_pos.y += penetration_y;
-							en->velocity.y = 0;
-						}
-					}
-				}
-			}
-
-			en->frame.last_pos = en->pos;
-
-			en->pos = next_pos;
-		}
+		physics_update(gather_collision_entities());
 
 		do_portal_teleport_thing(get_player());
 
@@ -6413,8 +7684,8 @@ int entry(int argc, char **argv) {
 		/*
 		#if defined(DRAW_BOUNDS)
 		{
-			for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-				Entity* en = &world->entities[i];
+			for_each_entity(i) {
+				Entity* en = entity_at(i);
 				if (en->is_valid && en->has_collision || en->arch == ARCH_player) {
 					Range2f rect = range2f_shift(get_entity_collision_bounds(en), en->pos);
 					Draw_Quad* quad = draw_rect_in_frame(rect.min, range2f_size(rect), v4(1, 0, 0, 0.3), current_draw_frame);
@@ -6448,8 +7719,8 @@ int entry(int argc, char **argv) {
 
 			Entity* closest_tether = 0;
 			float closest_dist = 99999;
-			for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-				Entity* tether = &world->entities[i];
+			for_each_entity_with(i, ENTITY_HOT_is_oxygen_tether) {
+				Entity* tether = entity_at(i);
 				if (tether->is_valid && tether->is_oxygen_tether && tether->frame.is_powered && tether->arch != ARCH_o2_emitter && tether->dim == get_player_dim()) {
 					float dist = v2_dist(tether->pos, player->pos);
 					if (dist < tether_connection_radius) {
@@ -6568,8 +7839,8 @@ int entry(int argc, char **argv) {
 		{
 			Entity* o2_genny = entity_from_handle(world->oxygenerator);
 
-			for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-				Entity* en = &world->entities[i];
+			for_each_entity_with(i, ENTITY_HOT_o2_consume) {
+				Entity* en = entity_at(i);
 				if (en->is_valid && en->o2_consume && en->frame.is_powered) {
 					if (en->next_consume_end_time == 0) {
 						en->next_consume_end_time = now() + en->o2_consume_rate;
@@ -6607,19 +7878,19 @@ int entry(int argc, char **argv) {
 							if (selected_en->dmg_type == DMG_axe) {
 								for (int i = 0; i < ARCH_MAX; i++) {
 									if (world->inventory_items[i].amount) {
-										damage_amount += get_item_data(i).extra_axe_dmg;
+										damage_amount += get_item_data(i)->extra_axe_dmg;
 									}
 								}
 							} else if (selected_en->dmg_type == DMG_pickaxe) {
 								for (int i = 0; i < ARCH_MAX; i++) {
 									if (world->inventory_items[i].amount) {
-										damage_amount += get_item_data(i).extra_pickaxe_dmg;
+										damage_amount += get_item_data(i)->extra_pickaxe_dmg;
 									}
 								}
 							} else if (selected_en->dmg_type == DMG_sickle) {
 								for (int i = 0; i < ARCH_MAX; i++) {
 									if (world->inventory_items[i].amount) {
-										damage_amount += get_item_data(i).extra_sickle_dmg;
+										damage_amount += get_item_data(i)->extra_sickle_dmg;
 									}
 								}
 							} // #extend_dmg_type_here
@@ -6824,16 +8095,16 @@ int entry(int argc, char **argv) {
 
 		// :rendering pipeline
 		{
-			assert(growing_array_get_valid_count(draw_frame.quad_buffer) == 0, "submitting quads prior to the rendering pass is a no go");
+			assert(draw_frame.quad_buffer.count == 0, "submitting quads prior to the rendering pass is a no go");
 
 			// :portal rendering
 			Gfx_Image** target_portals;
 			growing_array_init_reserve((void**)&target_portals, sizeof(Gfx_Image*), 1, get_temporary_allocator());
 
-			for (int i = 0; i < MAX_ENTITY_COUNT; i++)
+			for_each_entity(i)
 			tm_scope("portal render")
 			{
-				Entity* portal = &world->entities[i];
+				Entity* portal = entity_at(i);
 				if (!(is_valid(portal) && portal->arch == ARCH_portal && portal->render_target_image)) continue;
 
 				// TODO use frame's item to turn portal on / off
@@ -6933,6 +8204,12 @@ int entry(int argc, char **argv) {
 			swap(q->uv.y, q->uv.w, float); // swap y so it's upwards
 		}
 
+		#if ENABLE_PROFILING
+		if (show_profiler_overlay) {
+			draw_profiler_overlay(font, 18, v2(-window.width/2 + 10, window.height/2 - 10), 12);
+		}
+		#endif
+
 
 		tm_scope("gfx_update") {
 			gfx_update();
@@ -6945,6 +8222,14 @@ int entry(int argc, char **argv) {
 		if (seconds_counter > 1.0) {
 			#if ENABLE_PROFILING
 			log("fps: %i", frame_count);
+			Temporary_Storage_Stats temp_stats = get_temporary_storage_stats();
+			log("temp storage: %llukb last frame, %llukb peak, %llukb capacity", temp_stats.last_frame_peak/1024, temp_stats.peak/1024, temp_stats.capacity/1024);
+			#endif
+			#if ENABLE_MEMORY_TRACKING
+			for (u64 tag = MEMORY_TAG_UNTAGGED; tag < MEMORY_TAG_COUNT; tag += 1) {
+				Memory_Tag_Stats mem = get_memory_tag_stats(tag);
+				log("memory %cs: %llukb live, %llukb peak, %.0f allocs/s, %.0f frees/s", memory_tag_names[tag], mem.live_bytes/1024, mem.peak_bytes/1024, mem.allocs_per_second, mem.frees_per_second);
+			}
 			#endif
 			seconds_counter = 0.0;
 			frame_count = 0;
@@ -6968,16 +8253,17 @@ int entry(int argc, char **argv) {
 				world->cycle_end_time = now();
 			}
 			if (is_key_just_pressed('F')) {
-				world_save_to_disk();
-				log("saved");
+				world_save_to_disk_async();
+				log("saving");
 			}
 			if (is_key_just_pressed('R')) {
-				world_attempt_load_from_disk();
-				log("loaded ");
+				world_load_from_disk_async();
 			}
 		}
 		if (is_key_just_pressed('K') && is_key_down(KEY_SHIFT)) {
+			world_io_wait();
 			memset(world, 0, sizeof(World));
+			entity_pool_clear();
 			memset(&world_frame, 0, sizeof(WorldFrame));
 			world_setup();
 			log("reset");
@@ -0,0 +1,324 @@
+// Movement & collision resolution for everything with has_physics.
+// Kept out of entry_randygame.c so physics_benchmark.c can build it headless without the rest of the game.
+// Whoever includes this provides:
+//     Entity, with the fields used below, Dimension & DIM_MAX
+//     entity_at(), entity_index(), entity_pool.capacity
+//     for_each_entity_with() with ENTITY_HOT_has_physics & ENTITY_HOT_has_collision
+//     get_entity_collision_bounds(), tile_width, delta_t
+
+Entity** gather_collision_entities() {
+	Entity** collision_entities;
+	growing_array_init_reserve((void**)&collision_entities, sizeof(Entity*), 1, get_temporary_allocator());
+	for_each_entity_with(i, ENTITY_HOT_has_collision) {
+		Entity* en = entity_at(i);
+		growing_array_add((void**)&collision_entities, &en);
+	}
+	return collision_entities;
+}
+
+Vector2 physics_integrate(Entity* en) {
+	Vector2 next_pos = {0};
+	if (en->move_based_on_input_axis) {
+		next_pos = v2_add(en->pos, v2_mulf(en->frame.input_axis, en->move_speed * delta_t));
+	} else {
+		// https://guide.handmadehero.org/code/day043
+		
+		// "friction"
+		if (!en->disable_friction) {
+			en->acceleration = v2_sub(en->acceleration, v2_mulf(en->velocity, en->friction));
+		}
+		// integrate
+		en->velocity = v2_add(en->velocity, v2_mulf(en->acceleration, delta_t));
+		next_pos = v2_add(en->pos, v2_mulf(en->velocity, delta_t));
+		en->acceleration = (Vector2){0};
+	}
+	return next_pos;
+}
+
+// resolve collisions
+// courtesy of chatgpt
+// returns true if next_pos got pushed
+bool physics_resolve_against(Entity* en, Vector2* next_pos, Range2f our_local_bounds, Range2f bounds) {
+	// Get our predicted bounds at next position
+	Range2f next_bounds = range2f_shift(our_local_bounds, *next_pos);
+
+	// Check for collision between next_bounds and bounds
+	bool overlap_x = next_bounds.min.x < bounds.max.x && next_bounds.max.x > bounds.min.x;
+	bool overlap_y = next_bounds.min.y < bounds.max.y && next_bounds.max.y > bounds.min.y;
+
+	if (!overlap_x || !overlap_y) {
+		return false;
+	}
+
+	// Collision detected, resolve it
+
+	// Calculate the penetration distances on both axes
+	float penetration_x1 = bounds.max.x - next_bounds.min.x; // Positive if overlapping from the left
+	float penetration_x2 = next_bounds.max.x - bounds.min.x; // Positive if overlapping from the right
+	float penetration_x = (penetration_x1 < penetration_x2) ? penetration_x1 : -penetration_x2;
+
+	float penetration_y1 = bounds.max.y - next_bounds.min.y; // Positive if overlapping from the bottom
+	float penetration_y2 = next_bounds.max.y - bounds.min.y; // Positive if overlapping from the top
+	float penetration_y = (penetration_y1 < penetration_y2) ? penetration_y1 : -penetration_y2;
+
+	// Resolve collision by moving next_pos out of collision along the axis of least penetration
+	if (fabsf(penetration_x) < fabsf(penetration_y)) {
+		// Resolve along X axis
+		next_pos->x += penetration_x;
+		en->velocity.x = 0;
+	} else {
+		// Resolve along Y axis
+		next_pos->y += penetration_y;
+		en->velocity.y = 0;
+	}
+	return true;
+}
+
+// the old O(N^2) version, only kept around so the benchmark can check the grid gives the same results
+void physics_update_brute_force(Entity** collision_entities) {
+	for (int i = 0; i < entity_pool.capacity; i++) {
+		Entity* en = entity_at(i);
+		if (!en->is_valid || !en->has_physics) {
+			continue;
+		}
+
+		Vector2 next_pos = physics_integrate(en);
+
+		if (!en->ignore_collision) {
+			for (int j = 0; j < growing_array_get_valid_count(collision_entities); j++) {
+				Entity* against = collision_entities[j];
+				if (against->dim != en->dim || against == en) {
+					continue;
+				}
+				Range2f bounds = range2f_shift(get_entity_collision_bounds(against), against->pos);
+				physics_resolve_against(en, &next_pos, get_entity_collision_bounds(en), bounds);
+			}
+		}
+
+		en->frame.last_pos = en->pos;
+		en->pos = next_pos;
+	}
+}
+
+// :physics grid
+// Uniform grid per Dimension, cells hashed into a fixed number of buckets.
+// Colliders go in every cell their bounds touch, so anything overlapping a mover shares a cell with it.
+// Candidates are tested in collision_entities order, same as the brute force loop, and we re-query
+// after every push since the mover might now touch colliders it didn't before. So results are identical.
+#define PHYSICS_CELL_SIZE (tile_width * 4)
+#define PHYSICS_BUCKET_COUNT 1024 // power of 2
+#define PHYSICS_MAX_CELLS_PER_RANGE 64 // anything bigger goes in the "large" list and gets tested against everything
+
+typedef struct PhysicsCellRange {
+	int min_x, min_y, max_x, max_y;
+} PhysicsCellRange;
+
+typedef struct PhysicsGridNode {
+	int collider;
+	int next;
+} PhysicsGridNode;
+
+typedef struct PhysicsGrid {
+	int buckets[DIM_MAX][PHYSICS_BUCKET_COUNT]; // first node, -1 if empty
+	int* large[DIM_MAX]; // collider indices
+	PhysicsGridNode* nodes;
+	int free_node;
+
+	Entity** colliders;
+	Range2f* bounds; // world space collider bounds
+	int* collider_of_entity; // by entity index, -1 if not a collider
+
+	u32* query_mark;
+	u32 query_stamp;
+	int* candidates;
+} PhysicsGrid;
+
+PhysicsCellRange physics_cell_range(Range2f bounds) {
+	PhysicsCellRange r;
+	r.min_x = (int)floorf(bounds.min.x / (float)PHYSICS_CELL_SIZE);
+	r.min_y = (int)floorf(bounds.min.y / (float)PHYSICS_CELL_SIZE);
+	r.max_x = (int)floorf(bounds.max.x / (float)PHYSICS_CELL_SIZE);
+	r.max_y = (int)floorf(bounds.max.y / (float)PHYSICS_CELL_SIZE);
+	return r;
+}
+
+bool physics_cell_range_is_large(PhysicsCellRange r) {
+	s64 w = (s64)r.max_x - r.min_x + 1;
+	s64 h = (s64)r.max_y - r.min_y + 1;
+	return w * h > PHYSICS_MAX_CELLS_PER_RANGE;
+}
+
+inline int physics_cell_bucket(int x, int y) {
+	u32 h = ((u32)x * 73856093u) ^ ((u32)y * 19349663u);
+	return h & (PHYSICS_BUCKET_COUNT - 1);
+}
+
+void physics_grid_insert(PhysicsGrid* grid, int collider) {
+	Dimension dim = grid->colliders[collider]->dim;
+	PhysicsCellRange r = physics_cell_range(grid->bounds[collider]);
+	if (physics_cell_range_is_large(r)) {
+		growing_array_add((void**)&grid->large[dim], &collider);
+		return;
+	}
+
+	for (int y = r.min_y; y <= r.max_y; y++)
+	for (int x = r.min_x; x <= r.max_x; x++) {
+		int bucket = physics_cell_bucket(x, y);
+		int node_index;
+		if (grid->free_node != -1) {
+			node_index = grid->free_node;
+			grid->free_node = grid->nodes[node_index].next;
+		} else {
+			node_index = growing_array_get_valid_count(grid->nodes);
+			growing_array_add_empty((void**)&grid->nodes);
+		}
+		grid->nodes[node_index].collider = collider;
+		grid->nodes[node_index].next = grid->buckets[dim][bucket];
+		grid->buckets[dim][bucket] = node_index;
+	}
+}
+
+void physics_grid_remove(PhysicsGrid* grid, int collider) {
+	Dimension dim = grid->colliders[collider]->dim;
+	PhysicsCellRange r = physics_cell_range(grid->bounds[collider]);
+	if (physics_cell_range_is_large(r)) {
+		int* large = grid->large[dim];
+		int count = growing_array_get_valid_count(large);
+		for (int i = 0; i < count; i++) {
+			if (large[i] == collider) {
+				growing_array_ordered_remove_by_index((void**)&grid->large[dim], i);
+				break;
+			}
+		}
+		return;
+	}
+
+	for (int y = r.min_y; y <= r.max_y; y++)
+	for (int x = r.min_x; x <= r.max_x; x++) {
+		int* link = &grid->buckets[dim][physics_cell_bucket(x, y)];
+		while (*link != -1) {
+			int node_index = *link;
+			if (grid->nodes[node_index].collider == collider) {
+				*link = grid->nodes[node_index].next;
+				grid->nodes[node_index].next = grid->free_node;
+				grid->free_node = node_index;
+			} else {
+				link = &grid->nodes[node_index].next;
+			}
+		}
+	}
+}
+
+void physics_grid_build(PhysicsGrid* grid, Entity** collision_entities) {
+	int collider_count = growing_array_get_valid_count(collision_entities);
+
+	memset(grid->buckets, 0xff, sizeof(grid->buckets));
+	grid->collider_of_entity = alloc(get_temporary_allocator(), sizeof(int) * entity_pool.capacity);
+	memset(grid->collider_of_entity, 0xff, sizeof(int) * entity_pool.capacity);
+	for (Dimension dim = 0; dim < DIM_MAX; dim++) {
+		growing_array_init_reserve((void**)&grid->large[dim], sizeof(int), 4, get_temporary_allocator());
+	}
+	growing_array_init_reserve((void**)&grid->nodes, sizeof(PhysicsGridNode), collider_count * 4, get_temporary_allocator());
+	growing_array_init_reserve((void**)&grid->candidates, sizeof(int), 64, get_temporary_allocator());
+	grid->free_node = -1;
+
+	grid->colliders = collision_entities;
+	grid->bounds = alloc(get_temporary_allocator(), sizeof(Range2f) * max(collider_count, 1));
+	grid->query_mark = alloc(get_temporary_allocator(), sizeof(u32) * max(collider_count, 1));
+	memset(grid->query_mark, 0, sizeof(u32) * max(collider_count, 1));
+	grid->query_stamp = 0;
+
+	for (int j = 0; j < collider_count; j++) {
+		Entity* en = collision_entities[j];
+		grid->collider_of_entity[entity_index(en)] = j;
+		grid->bounds[j] = range2f_shift(get_entity_collision_bounds(en), en->pos);
+		physics_grid_insert(grid, j);
+	}
+}
+
+void physics_grid_add_candidate(PhysicsGrid* grid, int collider, int after_collider) {
+	if (collider <= after_collider || grid->query_mark[collider] == grid->query_stamp) {
+		return;
+	}
+	grid->query_mark[collider] = grid->query_stamp;
+	growing_array_add((void**)&grid->candidates, &collider);
+}
+
+// fills grid->candidates with colliders that might overlap bounds, only ones after after_collider, in order
+void physics_grid_query(PhysicsGrid* grid, Dimension dim, Range2f bounds, int after_collider) {
+	growing_array_clear((void**)&grid->candidates);
+	grid->query_stamp += 1;
+
+	PhysicsCellRange r = physics_cell_range(bounds);
+	if (physics_cell_range_is_large(r)) {
+		// big mover, cheaper to just take everything in the dimension
+		for (int j = after_collider + 1; j < growing_array_get_valid_count(grid->colliders); j++) {
+			if (grid->colliders[j]->dim == dim) {
+				physics_grid_add_candidate(grid, j, after_collider);
+			}
+		}
+		return;
+	}
+
+	for (int y = r.min_y; y <= r.max_y; y++)
+	for (int x = r.min_x; x <= r.max_x; x++) {
+		for (int n = grid->buckets[dim][physics_cell_bucket(x, y)]; n != -1; n = grid->nodes[n].next) {
+			physics_grid_add_candidate(grid, grid->nodes[n].collider, after_collider);
+		}
+	}
+	int* large = grid->large[dim];
+	for (int i = 0; i < growing_array_get_valid_count(large); i++) {
+		physics_grid_add_candidate(grid, large[i], after_collider);
+	}
+
+	// insertion sort, there's only a handful
+	int* c = grid->candidates;
+	int count = growing_array_get_valid_count(c);
+	for (int i = 1; i < count; i++) {
+		int v = c[i];
+		int k = i - 1;
+		while (k >= 0 && c[k] > v) {
+			c[k + 1] = c[k];
+			k--;
+		}
+		c[k + 1] = v;
+	}
+}
+
+void physics_update(Entity** collision_entities) {
+	PhysicsGrid* grid = alloc(get_temporary_allocator(), sizeof(PhysicsGrid));
+	physics_grid_build(grid, collision_entities);
+
+	for_each_entity_with(i, ENTITY_HOT_has_physics) {
+		Entity* en = entity_at(i);
+
+		Vector2 next_pos = physics_integrate(en);
+		int our_collider = grid->collider_of_entity[i];
+
+		if (!en->ignore_collision) {
+			Range2f our_local_bounds = get_entity_collision_bounds(en);
+
+			physics_grid_query(grid, en->dim, range2f_shift(our_local_bounds, next_pos), -1);
+			for (int c = 0; c < growing_array_get_valid_count(grid->candidates); c++) {
+				int j = grid->candidates[c];
+				if (j == our_collider) {
+					continue;
+				}
+				if (physics_resolve_against(en, &next_pos, our_local_bounds, grid->bounds[j])) {
+					// we moved, so look again from here
+					physics_grid_query(grid, en->dim, range2f_shift(our_local_bounds, next_pos), j);
+					c = -1;
+				}
+			}
+		}
+
+		en->frame.last_pos = en->pos;
+		en->pos = next_pos;
+
+		if (our_collider != -1) {
+			physics_grid_remove(grid, our_collider);
+			grid->bounds[our_collider] = range2f_shift(get_entity_collision_bounds(en), en->pos);
+			physics_grid_insert(grid, our_collider);
+		}
+	}
+}
@@ -0,0 +1,144 @@
+
+///
+// Headless physics benchmark, build it with ./build_linux.sh -DPHYSICS_BENCHMARK=1
+// Fills a world with PHYSICS_BENCH_COLLIDER_COUNT colliders, a quarter of them moving, runs the
+// broadphase in physics.c and the old brute force version from the same start, and checks they agree.
+//
+// physics.c only needs a handful of things from the game, so this has a stripped down Entity and
+// a flat array instead of the entity pool. Keep the fields in sync with the ones physics.c uses.
+
+#include "range.c"
+
+#define PHYSICS_BENCH_COLLIDER_COUNT 1024
+#define PHYSICS_BENCH_TICK_COUNT 120
+
+const int tile_width = 8; // same as the game
+float64 delta_t;
+
+typedef enum Dimension {
+	DIM_first,
+	DIM_second,
+	DIM_MAX,
+} Dimension;
+
+typedef struct EntityFrame {
+	Vector2 input_axis;
+	Vector2 last_pos;
+} EntityFrame;
+
+typedef struct Entity {
+	bool is_valid;
+	bool has_physics;
+	bool has_collision;
+	bool ignore_collision;
+	Dimension dim;
+	Vector2 pos;
+	Vector2 velocity;
+	Vector2 acceleration;
+	float friction;
+	bool disable_friction;
+	bool move_based_on_input_axis;
+	float move_speed;
+	Vector2i tile_size;
+	Range2f collision_bounds;
+	EntityFrame frame;
+} Entity;
+
+// slot 0 is the nil entity, like in the game
+typedef struct EntityPool {
+	Entity entities[PHYSICS_BENCH_COLLIDER_COUNT + 1];
+	int capacity;
+} EntityPool;
+EntityPool entity_pool;
+
+typedef enum EntityHotFlag {
+	ENTITY_HOT_has_physics,
+	ENTITY_HOT_has_collision,
+} EntityHotFlag;
+
+inline Entity* entity_at(int index) {
+	return &entity_pool.entities[index];
+}
+int entity_index(Entity* en) {
+	return (int)(en - entity_pool.entities);
+}
+bool entity_has_hot_flag(Entity* en, EntityHotFlag flag) {
+	if (!en->is_valid) return false;
+	return flag == ENTITY_HOT_has_physics ? en->has_physics : en->has_collision;
+}
+#define for_each_entity_with(i, flag) for (int i = 1; i < entity_pool.capacity; i++) if (entity_has_hot_flag(entity_at(i), flag))
+
+// same as the game
+Range2f get_entity_collision_bounds(Entity* en) {
+	Range2f bounds = en->collision_bounds;
+	Vector2 size = range2f_size(bounds);
+	if (fabsf(size.x) <= 0.1 || fabsf(size.y) <= 0.1) {
+		bounds = range2f_make_center_center(v2(0,0), v2(en->tile_size.x * tile_width, en->tile_size.y * tile_width));
+	}
+	return bounds;
+}
+
+#include "physics.c"
+
+void physics_benchmark_fill() {
+	seed_for_random = 69;
+	memset(&entity_pool, 0, sizeof(entity_pool));
+	entity_pool.capacity = PHYSICS_BENCH_COLLIDER_COUNT + 1;
+
+	float spread = 32 * tile_width * 3;
+	for (int i = 1; i <= PHYSICS_BENCH_COLLIDER_COUNT; i++) {
+		Entity* en = entity_at(i);
+		en->is_valid = true;
+		en->has_collision = true;
+		en->friction = 2;
+		en->dim = (i % 8 == 0) ? DIM_second : DIM_first;
+		en->tile_size = v2i(get_random_int_in_range(1, 2), get_random_int_in_range(1, 2));
+		en->pos = v2(get_random_float32_in_range(-spread, spread), get_random_float32_in_range(-spread, spread));
+		if (i % 4 == 0) {
+			en->has_physics = true;
+			Vector2 dir = v2_normalize(v2(get_random_float32_in_range(-1, 1), get_random_float32_in_range(-1, 1)));
+			en->velocity = v2_mulf(dir, 100);
+		}
+	}
+}
+
+int entry(int argc, char **argv) {
+	delta_t = 1.0 / 60.0;
+
+	physics_benchmark_fill();
+	float64 start = os_get_elapsed_seconds();
+	for (int t = 0; t < PHYSICS_BENCH_TICK_COUNT; t++) {
+		reset_temporary_storage();
+		physics_update_brute_force(gather_collision_entities());
+	}
+	float64 brute_seconds = os_get_elapsed_seconds() - start;
+
+	Entity* brute_result = alloc(get_heap_allocator(), sizeof(entity_pool.entities));
+	memcpy(brute_result, entity_pool.entities, sizeof(entity_pool.entities));
+
+	physics_benchmark_fill();
+	start = os_get_elapsed_seconds();
+	for (int t = 0; t < PHYSICS_BENCH_TICK_COUNT; t++) {
+		reset_temporary_storage();
+		physics_update(gather_collision_entities());
+	}
+	float64 grid_seconds = os_get_elapsed_seconds() - start;
+
+	int mismatches = 0;
+	for (int i = 1; i <= PHYSICS_BENCH_COLLIDER_COUNT; i++) {
+		Entity* a = &brute_result[i];
+		Entity* b = entity_at(i);
+		if (memcmp(&a->pos, &b->pos, sizeof(Vector2)) != 0 || memcmp(&a->velocity, &b->velocity, sizeof(Vector2)) != 0) {
+			mismatches++;
+		}
+	}
+
+	log("physics benchmark, %d colliders, %d ticks", PHYSICS_BENCH_COLLIDER_COUNT, PHYSICS_BENCH_TICK_COUNT);
+	log("  brute force: %.3f ms/tick", brute_seconds * 1000.0 / PHYSICS_BENCH_TICK_COUNT);
+	log("  grid:        %.3f ms/tick", grid_seconds * 1000.0 / PHYSICS_BENCH_TICK_COUNT);
+	log("  mismatching entities: %d", mismatches);
+	assert(mismatches == 0, "Physics grid gave different results than brute force");
+
+	dealloc(get_heap_allocator(), brute_result);
+	return 0;
+}